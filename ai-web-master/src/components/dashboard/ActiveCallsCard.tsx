@@ -2,7 +2,7 @@ import { FadeIn } from "@/components/animations/FadeIn";
 import { Badge } from "@/components/ui/badge";
 import { Button } from "@/components/ui/button";
 import { Headphones, Timer, User, Server } from "lucide-react";
-import { useState, useEffect } from "react";
+import { useState, useEffect, useRef } from "react";
 import { useWebSocket, sharedWebSocket } from "@/hooks/useWebSocket";
 
 type ActiveCall = {
@@ -27,25 +27,65 @@ type ActiveCall = {
   duration: string;
   bridgeid: string;
   audioSocketPort: string | null;
+  startedAt: number;
+};
+
+type ChannelsDiff = {
+  version: number;
+  added: ActiveCall[];
+  updated: ActiveCall[];
+  removed: string[];
+};
+
+const formatElapsed = (startedAt: number, now: number) => {
+  const seconds = Math.max(0, Math.floor((now - startedAt) / 1000));
+  const pad = (n: number) => n.toString().padStart(2, '0');
+  return `${pad(Math.floor(seconds / 3600))}:${pad(Math.floor(seconds / 60) % 60)}:${pad(seconds % 60)}`;
 };
 
 export function ActiveCallsCard() {
-  const { data: activeCalls, isLoading, error } = useWebSocket<ActiveCall[]>("showChannels", "message");
+  const { data: snapshot, response, isLoading, error } = useWebSocket<ActiveCall[]>("showChannels", "channels");
+  const [activeCalls, setActiveCalls] = useState<ActiveCall[]>([]);
+  const [now, setNow] = useState(Date.now());
   const [viewAll, setViewAll] = useState(false);
+  const version = useRef(0);
   const displayedCalls = viewAll ? activeCalls : activeCalls.slice(0, 2);
-  
-  // Periodische Aktualisierung alle 5 Sekunden
+
+  // Der Server schickt den Stand einmal und danach nur noch Änderungen
+  useEffect(() => {
+    setActiveCalls(snapshot || []);
+    version.current = (response?.version as number | undefined) ?? 0;
+  }, [snapshot, response]);
+
   useEffect(() => {
-    // Initiale Abfrage wird durch useWebSocket bereits durchgeführt
-    
-    // Intervall für regelmäßige Aktualisierungen einrichten
-    const intervalId = setInterval(() => {
-      if (sharedWebSocket && sharedWebSocket.readyState === WebSocket.OPEN) {
-        sharedWebSocket.send(JSON.stringify({ action: "showChannels" }));
+    const handleMessage = (event: MessageEvent) => {
+      try {
+        const receivedData = JSON.parse(event.data);
+        if (receivedData.status !== "channelsDiff") return;
+        const diff: ChannelsDiff = receivedData.message;
+        if (diff.version <= version.current) return;
+        if (diff.version !== version.current + 1) {
+          // Änderung verpasst: kompletten Stand neu anfordern
+          sharedWebSocket?.send(JSON.stringify({ action: "showChannels" }));
+          return;
+        }
+        version.current = diff.version;
+        setActiveCalls(calls => {
+          const changed = new Map([...diff.added, ...diff.updated].map(call => [call.uniqueid, call]));
+          const removed = new Set([...diff.removed, ...changed.keys()]);
+          return [...calls.filter(call => !removed.has(call.uniqueid)), ...changed.values()];
+        });
+      } catch (parseError) {
+        console.error("Error parsing channelsDiff:", parseError);
       }
-    }, 5000); // Alle 5 Sekunden
-    
-    // Aufräumen beim Unmount der Komponente
+    };
+    sharedWebSocket?.addEventListener('message', handleMessage);
+    return () => sharedWebSocket?.removeEventListener('message', handleMessage);
+  }, [snapshot]);
+
+  // Gesprächsdauer lokal hochzählen
+  useEffect(() => {
+    const intervalId = setInterval(() => setNow(Date.now()), 1000);
     return () => clearInterval(intervalId);
   }, []);
   
@@ -107,7 +147,7 @@ export function ActiveCallsCard() {
                     
                     <div className="flex items-center gap-1 text-muted-foreground">
                       <Timer className="h-3 w-3" />
-                      <span>{call.duration}</span>
+                      <span>{call.startedAt ? formatElapsed(call.startedAt, now) : call.duration}</span>
                     </div>
                     
                     <div className="flex items-center gap-1 text-muted-foreground">
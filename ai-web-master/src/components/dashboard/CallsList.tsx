@@ -17,8 +17,8 @@ import {
   User,
   Check
 } from "lucide-react";
-import { useEffect, useState } from "react";
-import { useWebSocket } from "@/hooks/useWebSocket";
+import { useEffect, useRef, useState } from "react";
+import { sharedWebSocket, useWebSocket } from "@/hooks/useWebSocket";
 import { CallDetailsModal } from "./CallDetailsModal";
 
 interface Conversation {
@@ -33,7 +33,56 @@ interface Conversation {
 }
 
 export function CallsList() {
-  const { data: conversations, isLoading: loading, error } = useWebSocket<Conversation[]>("listConversations", "conversations");
+  const { data: page, response, isLoading: loading, error } = useWebSocket<Conversation[]>("listConversations", "conversations");
+  const [conversations, setConversations] = useState<Conversation[]>([]);
+  const [loadingMore, setLoadingMore] = useState(false);
+  const appendNextPage = useRef(false);
+  const nextCursor = (response?.next_cursor as string | null | undefined) ?? null;
+
+  // The server sends one page per request; older pages are appended
+  useEffect(() => {
+    const rows = page || [];
+    setConversations(prev => appendNextPage.current ? [...prev, ...rows] : rows);
+    appendNextPage.current = false;
+    setLoadingMore(false);
+  }, [page]);
+
+  const loadMore = () => {
+    if (!nextCursor || !sharedWebSocket || sharedWebSocket.readyState !== WebSocket.OPEN) return;
+    const ws = sharedWebSocket;
+    const requestId = `listConversations-${Date.now()}`;
+
+    // The server answers a failed page with an "error" status carrying our
+    // requestId, which useWebSocket does not pass on
+    const stopLoading = () => {
+      ws.removeEventListener('message', handleReply);
+      ws.removeEventListener('close', stopLoading);
+      appendNextPage.current = false;
+      setLoadingMore(false);
+    };
+    const handleReply = (event: MessageEvent) => {
+      let reply;
+      try {
+        reply = JSON.parse(event.data);
+      } catch (parseError) {
+        return;
+      }
+      if (reply.requestId !== requestId) return;
+      if (reply.status === "error") {
+        console.error("Error loading more conversations:", reply.message);
+        stopLoading();
+      } else {
+        ws.removeEventListener('message', handleReply);
+        ws.removeEventListener('close', stopLoading);
+      }
+    };
+    ws.addEventListener('message', handleReply);
+    ws.addEventListener('close', stopLoading);
+
+    appendNextPage.current = true;
+    setLoadingMore(true);
+    ws.send(JSON.stringify({ action: "listConversations", cursor: nextCursor, requestId }));
+  };
   
   const [selectedConversation, setSelectedConversation] = useState<Conversation | null>(null);
   const [showDetailsModal, setShowDetailsModal] = useState(false);
@@ -204,7 +253,15 @@ export function CallsList() {
         </div>
         
         <div className="px-3 md:px-5 py-2 md:py-3 border-t">
-          <Button variant="outline" className="w-full" size="sm">Alle Konversationen anzeigen</Button>
+          <Button
+            variant="outline"
+            className="w-full"
+            size="sm"
+            onClick={loadMore}
+            disabled={!nextCursor || loadingMore}
+          >
+            {loadingMore ? "Lade..." : nextCursor ? "Weitere Konversationen laden" : "Alle Konversationen geladen"}
+          </Button>
         </div>
       </div>
       
@@ -8,6 +8,8 @@ export function useWebSocket<T>(action: string, dataKey: string) {
   const [data, setData] = useState<T>([] as unknown as T);
   const [isLoading, setIsLoading] = useState(true);
   const [error, setError] = useState<string | null>(null);
+  // The whole response, for fields next to dataKey such as a page cursor
+  const [response, setResponse] = useState<Record<string, unknown> | null>(null);
 
   const memoizedAction = useMemo(() => action, [action]);
   const memoizedDataKey = useMemo(() => dataKey, [dataKey]);
@@ -43,17 +45,11 @@ export function useWebSocket<T>(action: string, dataKey: string) {
         if (receivedData.status === action) {
           console.log(`Received data for action: ${action}`);
           
-          // Für showChannels-Aktion: Direkt das message-Array verwenden
-          if (action === "showChannels" && Array.isArray(receivedData.message)) {
-            console.log("Setting showChannels data:", receivedData.message);
-            setData(receivedData.message);
-            setError(null);
-          } 
-          // Für andere Aktionen: Versuchen, auf das angegebene Feld zuzugreifen
-          else if (receivedData.message) {
+          if (receivedData.message) {
             const response: T = receivedData.message;
             console.log(`Accessing data via key '${String(dataKey)}':`, response[dataKey]);
             setData(response[dataKey]);
+            setResponse(receivedData.message);
             setError(null);
           }
         }
@@ -107,5 +103,5 @@ export function useWebSocket<T>(action: string, dataKey: string) {
     };
   }, [memoizedAction, memoizedDataKey]);
 
-  return { data, isLoading, error };
+  return { data, response, isLoading, error };
 }
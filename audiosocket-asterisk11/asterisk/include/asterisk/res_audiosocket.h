@@ -39,7 +39,8 @@ extern "C" {
 /*!
  * \brief Send the initial message to an AudioSocket server
  *
- * \param server The server address, including port.
+ * \param server The server address, including port, or unix:<path> for a
+ * service listening on a Unix socket.
  * \param server An optional channel which will be put into autoservice during
  * the connection period.  If there is no channel to be autoserviced, pass NULL
  * instead.
@@ -63,6 +64,9 @@ const int ast_audiosocket_init(const int svc, const char *id);
 /*!
  * \brief Send an Asterisk audio frame to an AudioSocket server
  *
+ * When timestamps are enabled in audiosocket.conf, the frame is preceded by
+ * a timestamp message holding the time it was sent.
+ *
  * \param svc The file descriptor of the network socket to the AudioSocket server.
  * \param f The Asterisk audio frame to send.
  *
@@ -77,6 +81,9 @@ const int ast_audiosocket_send_frame(const int svc, const struct ast_frame *f);
  * This returned object is a pointer to an Asterisk frame which must be
  * manually freed by the caller.
  *
+ * Timestamp messages from the server produce the null frame; requests among
+ * them are answered when timestamps are enabled in audiosocket.conf.
+ *
  * \param svc The file descriptor of the network socket to the AudioSocket server.
  *
  * \retval A \ref ast_frame on success
@@ -58,7 +58,7 @@
                                 <para>ID is the universally-unique identifier of the call for the audio socket service.  This ID must conform to the string form of a standard UUID.</para>
                         </parameter>
                         <parameter name="service" required="true">
-                                <para>Service is the name or IP address and port number of the audio socket service to which this call should be connected.  This should be in the form host:port, such as myserver:9019 </para>
+                                <para>Service is the name or IP address and port number of the audio socket service to which this call should be connected.  This should be in the form host:port, such as myserver:9019, or unix:path for a service listening on a Unix socket, such as unix:/var/run/audiosocket.sock </para>
                         </parameter>
                 </syntax>
                 <description>
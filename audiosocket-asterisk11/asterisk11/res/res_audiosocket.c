@@ -32,6 +32,8 @@
 #include "errno.h"
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <sys/un.h>
+#include <netinet/tcp.h>
 
 #include "asterisk/file.h"
 #include "asterisk/res_audiosocket.h"
@@ -40,11 +42,41 @@
 #include "asterisk/acl.h"      /* For ast_sockaddr functions */
 #include "asterisk/netsock2.h" /* For socket functions */
 #include "asterisk/utils.h"
+#include "asterisk/cli.h"
+#include "asterisk/config.h"
+#include "asterisk/lock.h"
 
 #define MODULE_DESCRIPTION      "AudioSocket support functions for Asterisk"
 
 #define MAX_CONNECT_TIMEOUT_MSEC 2000
 
+#define AUDIOSOCKET_CONFIG "audiosocket.conf"
+
+/*! \brief Server prefix selecting a Unix socket rather than a TCP address */
+#define AUDIOSOCKET_UNIX_PREFIX "unix:"
+
+#define ECHO_DEFAULT_BINDADDR "127.0.0.1:9093"
+#define ECHO_MAX_DELAY_MSEC 5000
+#define ECHO_POLL_MSEC 500
+#define ECHO_STOP_WAIT_MSEC 3000
+#define ECHO_FRAME_USEC 20000
+#define ECHO_BACKLOG 16
+
+/*! \brief Optional message kind carrying a timestamp; see the README */
+#define AUDIOSOCKET_KIND_TIMESTAMP 0x20
+
+/*! \brief Timestamp events, the first byte of a timestamp payload */
+#define AUDIOSOCKET_TS_SENT 0x01     /*!< Asterisk sent the audio message that follows */
+#define AUDIOSOCKET_TS_REQUEST 0x02  /*!< The server asks for the audio message that follows to be stamped */
+#define AUDIOSOCKET_TS_RECEIVED 0x03 /*!< Asterisk read the requested message; the request time follows */
+
+/*! \brief Length of a timestamp message: header, event and one or two times */
+#define AUDIOSOCKET_TS_LEN (3 + 1 + 8)
+#define AUDIOSOCKET_TS_RECEIVED_LEN (AUDIOSOCKET_TS_LEN + 8)
+
+/*! \brief Set from the timestamps option of audiosocket.conf */
+static int timestamps_enabled;
+
 /*!
  * \internal
  * \brief Attempt to complete the audiosocket connection.
@@ -98,6 +130,49 @@ static int handle_audiosocket_connection(const char *server,
         return 0;
 }
 
+/*!
+ * \internal
+ * \brief Connect to an AudioSocket service listening on a Unix socket.
+ *
+ * \param path Filesystem path of the socket.
+ *
+ * \return non-blocking socket file descriptor on success, -1 on error.
+ */
+static int audiosocket_connect_unix(const char *path)
+{
+        struct sockaddr_un sun = { .sun_family = AF_UNIX, };
+        int s;
+
+        if (ast_strlen_zero(path) || strlen(path) >= sizeof(sun.sun_path)) {
+                ast_log(LOG_ERROR, "Invalid AudioSocket Unix socket path '%s'\n", path);
+                return -1;
+        }
+        ast_copy_string(sun.sun_path, path, sizeof(sun.sun_path));
+
+        if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+                ast_log(LOG_WARNING, "Unable to create socket: %s\n", strerror(errno));
+                return -1;
+        }
+
+        /* A local connect completes immediately, so it is made before the
+         * socket is switched to non-blocking mode like the TCP ones.
+         */
+        if (connect(s, (struct sockaddr *) &sun, sizeof(sun))) {
+                ast_log(LOG_WARNING, "Connect to AudioSocket at '%s' failed: %s\n", path,
+                        strerror(errno));
+                close(s);
+                return -1;
+        }
+
+        if (fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) < 0) {
+                ast_log(LOG_WARNING, "Failed to set socket to non-blocking: %s\n", strerror(errno));
+                close(s);
+                return -1;
+        }
+
+        return s;
+}
+
 const int ast_audiosocket_connect(const char *server, struct ast_channel *chan)
 {
         int s = -1;
@@ -115,6 +190,19 @@ const int ast_audiosocket_connect(const char *server, struct ast_channel *chan)
                 goto end;
         }
 
+        if (!strncasecmp(server, AUDIOSOCKET_UNIX_PREFIX, strlen(AUDIOSOCKET_UNIX_PREFIX))) {
+                s = audiosocket_connect_unix(server + strlen(AUDIOSOCKET_UNIX_PREFIX));
+                if (chan && ast_autoservice_stop(chan) < 0) {
+                        ast_log(LOG_WARNING, "Failed to stop autoservice for channel %s\n",
+                        ast_channel_name(chan));
+                        if (s >= 0) {
+                                close(s);
+                        }
+                        return -1;
+                }
+                return s;
+        }
+
         if (!(num_addrs = ast_sockaddr_resolve(&addrs, server, PARSE_PORT_REQUIRE,
                 AF_UNSPEC))) {
                 ast_log(LOG_ERROR, "Failed to resolve AudioSocket service using %s - "
@@ -202,21 +290,89 @@ const int ast_audiosocket_init(const int svc, const char *id)
     return 0;
 }
 
+/*!
+ * \internal
+ * \brief Store a time as big-endian microseconds since the epoch.
+ */
+static void timestamp_put(uint8_t *p, struct timeval tv)
+{
+        uint64_t us = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+        int i;
+
+        for (i = 7; i >= 0; i--) {
+                p[i] = us & 0xff;
+                us >>= 8;
+        }
+}
+
+/*!
+ * \internal
+ * \brief Write a timestamp message header and event into p.
+ *
+ * \return the position after the event, where the times go.
+ */
+static uint8_t *timestamp_header(uint8_t *p, uint8_t event, uint16_t len)
+{
+        *(p++) = AUDIOSOCKET_KIND_TIMESTAMP;
+        *(p++) = len >> 8;
+        *(p++) = len & 0xff;
+        *(p++) = event;
+        return p;
+}
+
+/*!
+ * \internal
+ * \brief Answer a timestamp request read from the server.
+ *
+ * \param svc The file descriptor of the network socket to the AudioSocket server.
+ * \param received When the request was read.
+ * \param data The payload of the timestamp message.
+ * \param len The length of the payload.
+ */
+static void timestamp_answer(const int svc, struct timeval received, const uint8_t *data, uint16_t len)
+{
+        uint8_t buf[AUDIOSOCKET_TS_RECEIVED_LEN];
+        uint8_t *p;
+
+        if (!timestamps_enabled || len < 9 || data[0] != AUDIOSOCKET_TS_REQUEST) {
+                return;
+        }
+
+        p = timestamp_header(buf, AUDIOSOCKET_TS_RECEIVED, AUDIOSOCKET_TS_RECEIVED_LEN - 3);
+        timestamp_put(p, received);
+        memcpy(p + 8, data + 1, 8);
+
+        if (write(svc, buf, sizeof(buf)) != sizeof(buf)) {
+                ast_log(LOG_WARNING, "Failed to write timestamp to AudioSocket\n");
+        }
+}
+
 const int ast_audiosocket_send_frame(const int svc, const struct ast_frame *f)
 {
         int ret = 0;
         uint8_t kind = 0x10;    /* always 16-bit, 8kHz signed linear mono, for now */
         uint8_t *p;
-        uint8_t buf[3 + f->datalen];
+        uint8_t buf[AUDIOSOCKET_TS_LEN + 3 + f->datalen];
+        int total;
 
         p = buf;
 
+        /* With timestamps enabled, each audio message is preceded by the time
+         * it was sent, in the same write.
+         */
+        if (timestamps_enabled) {
+                p = timestamp_header(p, AUDIOSOCKET_TS_SENT, AUDIOSOCKET_TS_LEN - 3);
+                timestamp_put(p, ast_tvnow());
+                p += 8;
+        }
+
         *(p++) = kind;
         *(p++) = f->datalen >> 8;
         *(p++) = f->datalen & 0xff;
         memcpy(p, f->data.ptr, f->datalen);
+        total = p + f->datalen - buf;
 
-        if (write(svc, buf, 3 + f->datalen) != 3 + f->datalen) {
+        if (write(svc, buf, total) != total) {
                 ast_log(LOG_WARNING, "Failed to write data to AudioSocket\n");
                 ret = -1;
         }
@@ -241,6 +397,7 @@ struct ast_frame *ast_audiosocket_receive_frame(const int svc)
         uint16_t len = 0;
         uint8_t *data;
         uint8_t retry = 3;
+        struct timeval received;
 
         n = read(svc, &kind, 1);
         if (n < 0 && errno == EAGAIN) {
@@ -257,7 +414,11 @@ struct ast_frame *ast_audiosocket_receive_frame(const int svc)
                 /* AudioSocket ended by remote */
                 return NULL;
         }
-        if (kind != 0x10) {
+        received = ast_tvnow();
+        if (kind == AUDIOSOCKET_KIND_TIMESTAMP) {
+                /* read and answer, if requested, but produce no frame */
+                not_audio = 1;
+        } else if (kind != 0x10) {
                 /* read but ignore non-audio message */
                 ast_log(LOG_WARNING, "Received non-audio AudioSocket message\n");
                 not_audio = 1;
@@ -319,6 +480,9 @@ struct ast_frame *ast_audiosocket_receive_frame(const int svc)
         }
 
         if (not_audio) {
+                if (kind == AUDIOSOCKET_KIND_TIMESTAMP) {
+                        timestamp_answer(svc, received, data, len);
+                }
                 ast_free(data);
                 return &ast_null_frame;
         }
@@ -331,15 +495,577 @@ struct ast_frame *ast_audiosocket_receive_frame(const int svc)
         return ast_frisolate(&f);
 }
 
+/*
+ * Built-in loopback echo server.
+ *
+ * Each session reads the ID message and then returns every audio message it
+ * receives, after an optional fixed delay, until either side hangs up.  This
+ * gives a reference endpoint for measuring the latency contributed by
+ * Asterisk itself, independently of any real AudioSocket server.
+ */
+
+/*! \brief A message held by an echo session until its delay has elapsed */
+struct echo_frame {
+        struct timeval received;
+        struct echo_frame *next;
+        size_t len;
+        uint8_t msg[0];
+};
+
+/*! \brief Serialises starting and stopping the echo server and guards its statistics */
+AST_MUTEX_DEFINE_STATIC(echo_lock);
+
+static pthread_t echo_thread = AST_PTHREADT_NULL;
+static int echo_fd = -1;
+static volatile int echo_running;
+/*! \brief Set while echo_stop waits for the listener without holding echo_lock */
+static int echo_stopping;
+static char echo_bindaddr[PATH_MAX];
+static unsigned int echo_delay_ms;
+
+static struct {
+        unsigned int active;
+        unsigned long sessions;
+        unsigned long frames;
+        uint64_t hold_us_total;
+        uint64_t hold_us_max;
+        uint64_t jitter_us_max;
+} echo_stats;
+
+static int64_t echo_tvdiff_us(struct timeval end, struct timeval start)
+{
+        return (int64_t) (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+}
+
+static int echo_read_full(int fd, uint8_t *buf, size_t len)
+{
+        size_t got = 0;
+        ssize_t n;
+
+        while (got < len) {
+                n = read(fd, buf + got, len - got);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        return -1;
+                }
+                got += n;
+        }
+
+        return 0;
+}
+
+static int echo_write_full(int fd, const uint8_t *buf, size_t len)
+{
+        size_t done = 0;
+        ssize_t n;
+
+        while (done < len) {
+                n = write(fd, buf + done, len - done);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        return -1;
+                }
+                done += n;
+        }
+
+        return 0;
+}
+
+/*!
+ * \internal
+ * \brief Echo audio back on a single accepted connection.
+ *
+ * Frames in and out are timestamped; each is logged at debug level 3, and a
+ * summary of the hold time (in to out) and of the inbound inter-arrival
+ * jitter is logged when the session ends.
+ */
+static void *echo_session(void *data)
+{
+        int fd = (int) (intptr_t) data;
+        struct pollfd pfd = { .fd = fd, .events = POLLIN, };
+        struct echo_frame *head = NULL, *tail = NULL, *ef;
+        struct timeval now, last_in = { 0, }, delay;
+        uint64_t hold, jitter, hold_total = 0, hold_max = 0, jitter_max = 0;
+        unsigned long frames = 0;
+        int timeout, hangup = 0;
+        uint8_t hdr[3];
+        uint16_t len;
+
+        delay = ast_samp2tv(echo_delay_ms, 1000);
+
+        while (echo_running) {
+                timeout = ECHO_POLL_MSEC;
+                if (head) {
+                        timeout = MAX(0, ast_tvdiff_ms(ast_tvadd(head->received, delay), ast_tvnow()));
+                }
+
+                if (ast_poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+                        break;
+                }
+
+                if (pfd.revents) {
+                        if (echo_read_full(fd, hdr, 3)) {
+                                hangup = 1;
+                                break;
+                        }
+                        len = (hdr[1] << 8) | hdr[2];
+
+                        if (!(ef = ast_malloc(sizeof(*ef) + 3 + len))) {
+                                break;
+                        }
+                        memcpy(ef->msg, hdr, 3);
+                        if (len && echo_read_full(fd, ef->msg + 3, len)) {
+                                ast_free(ef);
+                                hangup = 1;
+                                break;
+                        }
+                        ef->received = ast_tvnow();
+                        ef->len = 3 + len;
+                        ef->next = NULL;
+
+                        if (hdr[0] == 0x00) {
+                                /* Hangup from Asterisk */
+                                ast_free(ef);
+                                hangup = 1;
+                                break;
+                        }
+                        if (hdr[0] != 0x10) {
+                                /* Only audio is echoed */
+                                ast_free(ef);
+                                continue;
+                        }
+
+                        if (!ast_tvzero(last_in)) {
+                                jitter = llabs(echo_tvdiff_us(ef->received, last_in) - ECHO_FRAME_USEC);
+                                jitter_max = MAX(jitter_max, jitter);
+                        }
+                        last_in = ef->received;
+
+                        if (tail) {
+                                tail->next = ef;
+                        } else {
+                                head = ef;
+                        }
+                        tail = ef;
+                }
+
+                now = ast_tvnow();
+                while (head && ast_tvcmp(ast_tvadd(head->received, delay), now) <= 0) {
+                        ef = head;
+                        if (!(head = ef->next)) {
+                                tail = NULL;
+                        }
+
+                        if (echo_write_full(fd, ef->msg, ef->len)) {
+                                ast_free(ef);
+                                hangup = 1;
+                                goto done;
+                        }
+                        now = ast_tvnow();
+
+                        hold = echo_tvdiff_us(now, ef->received);
+                        hold_total += hold;
+                        hold_max = MAX(hold_max, hold);
+                        frames++;
+
+                        ast_debug(3, "AudioSocket echo frame %lu (%zu bytes) in %ld.%06ld out %ld.%06ld\n",
+                                frames, ef->len - 3, (long) ef->received.tv_sec, (long) ef->received.tv_usec,
+                                (long) now.tv_sec, (long) now.tv_usec);
+
+                        ast_free(ef);
+                }
+        }
+
+done:
+        if (!hangup) {
+                /* The echo server is stopping; tell Asterisk to hang up */
+                echo_write_full(fd, (const uint8_t *) "\x00\x00\x00", 3);
+        }
+
+        while ((ef = head)) {
+                head = ef->next;
+                ast_free(ef);
+        }
+        close(fd);
+
+        ast_verb(3, "AudioSocket echo session ended after %lu frames: hold avg %" PRIu64
+                " us max %" PRIu64 " us, inbound jitter max %" PRIu64 " us\n",
+                frames, frames ? hold_total / frames : 0, hold_max, jitter_max);
+
+        ast_mutex_lock(&echo_lock);
+        echo_stats.active--;
+        echo_stats.frames += frames;
+        echo_stats.hold_us_total += hold_total;
+        echo_stats.hold_us_max = MAX(echo_stats.hold_us_max, hold_max);
+        echo_stats.jitter_us_max = MAX(echo_stats.jitter_us_max, jitter_max);
+        ast_mutex_unlock(&echo_lock);
+
+        return NULL;
+}
+
+static void *echo_listener(void *unused)
+{
+        struct pollfd pfd = { .fd = echo_fd, .events = POLLIN, };
+        struct timeval io_timeout = { .tv_sec = 1, };
+        pthread_t session;
+        int fd, nodelay = 1;
+
+        while (echo_running) {
+                if (ast_poll(&pfd, 1, ECHO_POLL_MSEC) <= 0) {
+                        continue;
+                }
+
+                if ((fd = accept(echo_fd, NULL, NULL)) < 0) {
+                        if (errno != EINTR && errno != EAGAIN) {
+                                ast_log(LOG_WARNING, "AudioSocket echo server failed to accept: %s\n",
+                                        strerror(errno));
+                        }
+                        continue;
+                }
+
+                /* Bound blocking reads and writes so that a stalled peer cannot
+                 * hold a session past the shutdown of the server.
+                 */
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &io_timeout, sizeof(io_timeout));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &io_timeout, sizeof(io_timeout));
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+                ast_mutex_lock(&echo_lock);
+                echo_stats.active++;
+                echo_stats.sessions++;
+                ast_mutex_unlock(&echo_lock);
+
+                if (ast_pthread_create_detached_background(&session, NULL, echo_session,
+                        (void *) (intptr_t) fd)) {
+                        ast_log(LOG_ERROR, "Failed to start AudioSocket echo session\n");
+                        close(fd);
+                        ast_mutex_lock(&echo_lock);
+                        echo_stats.active--;
+                        ast_mutex_unlock(&echo_lock);
+                }
+        }
+
+        return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Start the echo server.
+ *
+ * \param bindaddr TCP address and port, or unix:<path> for a Unix socket.
+ * \param delay_ms Fixed delay applied to each echoed frame.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ */
+static int echo_start(const char *bindaddr, unsigned int delay_ms)
+{
+        struct ast_sockaddr addr;
+        struct sockaddr_un sun = { .sun_family = AF_UNIX, };
+        const char *path;
+        int fd = -1, reuse = 1;
+
+        ast_mutex_lock(&echo_lock);
+
+        if (echo_running) {
+                ast_log(LOG_WARNING, "AudioSocket echo server is already running on %s\n",
+                        echo_bindaddr);
+                goto error;
+        }
+        if (echo_stopping) {
+                ast_log(LOG_WARNING, "AudioSocket echo server on %s is still stopping\n",
+                        echo_bindaddr);
+                goto error;
+        }
+
+        if (!strncasecmp(bindaddr, AUDIOSOCKET_UNIX_PREFIX, strlen(AUDIOSOCKET_UNIX_PREFIX))) {
+                path = bindaddr + strlen(AUDIOSOCKET_UNIX_PREFIX);
+                if (ast_strlen_zero(path) || strlen(path) >= sizeof(sun.sun_path)) {
+                        ast_log(LOG_ERROR, "Invalid AudioSocket echo socket path '%s'\n", path);
+                        goto error;
+                }
+                ast_copy_string(sun.sun_path, path, sizeof(sun.sun_path));
+
+                if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+                        ast_log(LOG_ERROR, "Unable to create socket: %s\n", strerror(errno));
+                        goto error;
+                }
+                unlink(path);
+                if (bind(fd, (struct sockaddr *) &sun, sizeof(sun))) {
+                        ast_log(LOG_ERROR, "Unable to bind AudioSocket echo server to %s: %s\n",
+                                path, strerror(errno));
+                        goto error;
+                }
+        } else {
+                if (!ast_sockaddr_parse(&addr, bindaddr, PARSE_PORT_REQUIRE)) {
+                        ast_log(LOG_ERROR, "Invalid AudioSocket echo address '%s' - "
+                                "requires an address and port\n", bindaddr);
+                        goto error;
+                }
+
+                if ((fd = socket(ast_sockaddr_is_ipv6(&addr) ? AF_INET6 : AF_INET,
+                        SOCK_STREAM, IPPROTO_TCP)) < 0) {
+                        ast_log(LOG_ERROR, "Unable to create socket: %s\n", strerror(errno));
+                        goto error;
+                }
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+                if (ast_bind(fd, &addr)) {
+                        ast_log(LOG_ERROR, "Unable to bind AudioSocket echo server to %s: %s\n",
+                                bindaddr, strerror(errno));
+                        goto error;
+                }
+        }
+
+        if (listen(fd, ECHO_BACKLOG)) {
+                ast_log(LOG_ERROR, "Unable to listen on %s: %s\n", bindaddr, strerror(errno));
+                goto error;
+        }
+
+        echo_fd = fd;
+        echo_delay_ms = delay_ms;
+        ast_copy_string(echo_bindaddr, bindaddr, sizeof(echo_bindaddr));
+        echo_running = 1;
+
+        if (ast_pthread_create_background(&echo_thread, NULL, echo_listener, NULL)) {
+                ast_log(LOG_ERROR, "Failed to start AudioSocket echo server thread\n");
+                echo_running = 0;
+                echo_fd = -1;
+                goto error;
+        }
+
+        ast_mutex_unlock(&echo_lock);
+
+        ast_verb(2, "AudioSocket echo server listening on %s with %u ms delay\n",
+                bindaddr, delay_ms);
+        return 0;
+
+error:
+        if (fd >= 0) {
+                close(fd);
+        }
+        ast_mutex_unlock(&echo_lock);
+        return -1;
+}
+
+/*!
+ * \internal
+ * \brief Stop the echo server and wait for its sessions to end.
+ *
+ * \retval 0 on success.
+ * \retval -1 if sessions are still running.
+ */
+static int echo_stop(void)
+{
+        unsigned int active;
+        int i;
+
+        ast_mutex_lock(&echo_lock);
+        if (echo_running) {
+                echo_running = 0;
+                echo_stopping = 1;
+                /* The listener takes echo_lock to count a session it has just
+                 * accepted, so it must not be held while joining it.
+                 */
+                ast_mutex_unlock(&echo_lock);
+                pthread_join(echo_thread, NULL);
+                ast_mutex_lock(&echo_lock);
+                echo_stopping = 0;
+                echo_thread = AST_PTHREADT_NULL;
+
+                close(echo_fd);
+                echo_fd = -1;
+                if (!strncasecmp(echo_bindaddr, AUDIOSOCKET_UNIX_PREFIX,
+                        strlen(AUDIOSOCKET_UNIX_PREFIX))) {
+                        unlink(echo_bindaddr + strlen(AUDIOSOCKET_UNIX_PREFIX));
+                }
+                ast_verb(2, "AudioSocket echo server on %s stopped\n", echo_bindaddr);
+        }
+        ast_mutex_unlock(&echo_lock);
+
+        /* Sessions notice the shutdown within one poll interval, or within the
+         * socket timeout if blocked on a stalled peer.
+         */
+        for (i = 0; i < ECHO_STOP_WAIT_MSEC / 10; i++) {
+                ast_mutex_lock(&echo_lock);
+                active = echo_stats.active;
+                ast_mutex_unlock(&echo_lock);
+
+                if (!active) {
+                        return 0;
+                }
+                usleep(10000);
+        }
+
+        ast_log(LOG_WARNING, "%u AudioSocket echo sessions did not end\n", active);
+        return -1;
+}
+
+static char *handle_cli_echo_start(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+        const char *bindaddr = ECHO_DEFAULT_BINDADDR;
+        unsigned int delay_ms = 0;
+
+        switch (cmd) {
+        case CLI_INIT:
+                e->command = "audiosocket echo start";
+                e->usage =
+                        "Usage: audiosocket echo start [<address:port>|unix:<path>] [<delay>]\n"
+                        "       Start the built-in AudioSocket loopback echo server, which\n"
+                        "       returns all audio it receives after an optional delay in\n"
+                        "       milliseconds.  Listens on " ECHO_DEFAULT_BINDADDR " by default.\n"
+                        "       Dial it with AudioSocket(<uuid>,<address:port>) or\n"
+                        "       AudioSocket(<uuid>,unix:<path>).\n";
+                return NULL;
+        case CLI_GENERATE:
+                return NULL;
+        }
+
+        if (a->argc > 5) {
+                return CLI_SHOWUSAGE;
+        }
+        if (a->argc > 3) {
+                bindaddr = a->argv[3];
+        }
+        if (a->argc > 4 && (sscanf(a->argv[4], "%30u", &delay_ms) != 1
+                || delay_ms > ECHO_MAX_DELAY_MSEC)) {
+                ast_cli(a->fd, "Delay must be between 0 and %d milliseconds\n", ECHO_MAX_DELAY_MSEC);
+                return CLI_FAILURE;
+        }
+
+        if (echo_start(bindaddr, delay_ms)) {
+                ast_cli(a->fd, "Failed to start the AudioSocket echo server; see the log for details\n");
+                return CLI_FAILURE;
+        }
+
+        ast_cli(a->fd, "AudioSocket echo server listening on %s with %u ms delay\n",
+                bindaddr, delay_ms);
+        return CLI_SUCCESS;
+}
+
+static char *handle_cli_echo_stop(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+        switch (cmd) {
+        case CLI_INIT:
+                e->command = "audiosocket echo stop";
+                e->usage =
+                        "Usage: audiosocket echo stop\n"
+                        "       Stop the built-in AudioSocket loopback echo server and\n"
+                        "       hang up its sessions.\n";
+                return NULL;
+        case CLI_GENERATE:
+                return NULL;
+        }
+
+        if (a->argc != 3) {
+                return CLI_SHOWUSAGE;
+        }
+
+        if (echo_stop()) {
+                return CLI_FAILURE;
+        }
+        return CLI_SUCCESS;
+}
+
+static char *handle_cli_echo_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+        switch (cmd) {
+        case CLI_INIT:
+                e->command = "audiosocket show echo";
+                e->usage =
+                        "Usage: audiosocket show echo\n"
+                        "       Show the state and timing statistics of the built-in\n"
+                        "       AudioSocket loopback echo server.\n";
+                return NULL;
+        case CLI_GENERATE:
+                return NULL;
+        }
+
+        if (a->argc != 3) {
+                return CLI_SHOWUSAGE;
+        }
+
+        ast_mutex_lock(&echo_lock);
+        if (echo_running) {
+                ast_cli(a->fd, "Listening on:        %s\n", echo_bindaddr);
+                ast_cli(a->fd, "Delay:               %u ms\n", echo_delay_ms);
+        } else {
+                ast_cli(a->fd, "Listening on:        (stopped)\n");
+        }
+        ast_cli(a->fd, "Active sessions:     %u\n", echo_stats.active);
+        ast_cli(a->fd, "Completed sessions:  %lu\n", echo_stats.sessions - echo_stats.active);
+        ast_cli(a->fd, "Frames echoed:       %lu\n", echo_stats.frames);
+        ast_cli(a->fd, "Hold time avg/max:   %" PRIu64 " / %" PRIu64 " us\n",
+                echo_stats.frames ? echo_stats.hold_us_total / echo_stats.frames : 0,
+                echo_stats.hold_us_max);
+        ast_cli(a->fd, "Inbound jitter max:  %" PRIu64 " us\n", echo_stats.jitter_us_max);
+        ast_mutex_unlock(&echo_lock);
+
+        return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry audiosocket_cli[] = {
+        AST_CLI_DEFINE(handle_cli_echo_start, "Start the AudioSocket loopback echo server"),
+        AST_CLI_DEFINE(handle_cli_echo_stop, "Stop the AudioSocket loopback echo server"),
+        AST_CLI_DEFINE(handle_cli_echo_show, "Show AudioSocket loopback echo server statistics"),
+};
+
+/*!
+ * \internal
+ * \brief Apply the general options of audiosocket.conf and start the echo
+ * server if it is enabled.
+ */
+static void load_config(void)
+{
+        struct ast_flags config_flags = { 0 };
+        struct ast_config *cfg;
+        const char *bindaddr = ECHO_DEFAULT_BINDADDR, *val;
+        unsigned int delay_ms = 0;
+
+        cfg = ast_config_load(AUDIOSOCKET_CONFIG, config_flags);
+        if (!cfg || cfg == CONFIG_STATUS_FILEINVALID) {
+                /* The configuration file is optional */
+                return;
+        }
+
+        timestamps_enabled = ast_true(ast_variable_retrieve(cfg, "general", "timestamps"));
+        if (timestamps_enabled) {
+                ast_verb(2, "AudioSocket timestamps enabled\n");
+        }
+
+        if (ast_true(ast_variable_retrieve(cfg, "echo", "enabled"))) {
+                if ((val = ast_variable_retrieve(cfg, "echo", "bindaddr")) && !ast_strlen_zero(val)) {
+                        bindaddr = val;
+                }
+                if ((val = ast_variable_retrieve(cfg, "echo", "delay"))
+                        && (sscanf(val, "%30u", &delay_ms) != 1 || delay_ms > ECHO_MAX_DELAY_MSEC)) {
+                        ast_log(LOG_WARNING, "Invalid AudioSocket echo delay '%s'; using 0\n", val);
+                        delay_ms = 0;
+                }
+                echo_start(bindaddr, delay_ms);
+        }
+
+        ast_config_destroy(cfg);
+}
+
 static int load_module(void)
 {
         ast_verb(1, "Loading AudioSocket Support module\n");
+        ast_cli_register_multiple(audiosocket_cli, ARRAY_LEN(audiosocket_cli));
+        load_config();
         return AST_MODULE_LOAD_SUCCESS;
 }
 
 static int unload_module(void)
 {
         ast_verb(1, "Unloading AudioSocket Support module\n");
+        if (echo_stop()) {
+                return -1;
+        }
+        ast_cli_unregister_multiple(audiosocket_cli, ARRAY_LEN(audiosocket_cli));
         return AST_MODULE_LOAD_SUCCESS;
 }
 
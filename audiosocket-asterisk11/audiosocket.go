@@ -3,6 +3,7 @@ package audiosocket
 import (
 	"encoding/binary"
 	"io"
+	"time"
 
 	"github.com/gofrs/uuid"
 	"github.com/pkg/errors"
@@ -27,10 +28,28 @@ const (
 	// KindSlin indicates the message contains signed-linear audio data
 	KindSlin = 0x10
 
+	// KindTimestamp indicates the message contains a timestamp event; see TimestampEvent
+	KindTimestamp = 0x20
+
 	// KindError indicates the message contains an error code
 	KindError = 0xff
 )
 
+// TimestampEvent identifies the event of a timestamp message
+type TimestampEvent byte
+
+const (
+	// TimestampSent is the time Asterisk sent the audio message that follows
+	TimestampSent = 0x01
+
+	// TimestampRequest asks Asterisk to stamp the audio message that follows
+	TimestampRequest = 0x02
+
+	// TimestampReceived is the time Asterisk read a request, followed by the
+	// time carried by that request
+	TimestampReceived = 0x03
+)
+
 // ErrorCode indicates an error, if present
 type ErrorCode byte
 
@@ -91,6 +110,37 @@ func (m Message) Payload() []byte {
 	return m[3:]
 }
 
+// Timestamp returns the event and times of a timestamp message.  The times
+// are those of the payload: one for TimestampSent and TimestampRequest, and
+// the receive and request times for TimestampReceived.
+func (m Message) Timestamp() (TimestampEvent, []time.Time, error) {
+	if m.Kind() != KindTimestamp {
+		return 0, nil, errors.Errorf("wrong message type %d", m.Kind())
+	}
+	payload := m.Payload()
+	if len(payload) < 9 || (len(payload)-1)%8 != 0 {
+		return 0, nil, errors.Errorf("invalid timestamp payload length %d", len(payload))
+	}
+
+	var times []time.Time
+	for i := 1; i < len(payload); i += 8 {
+		us := int64(binary.BigEndian.Uint64(payload[i : i+8]))
+		times = append(times, time.Unix(0, us*int64(time.Microsecond)))
+	}
+	return TimestampEvent(payload[0]), times, nil
+}
+
+// TimestampRequestMessage creates a new Message asking Asterisk to stamp the
+// audio message sent after it
+func TimestampRequestMessage(t time.Time) Message {
+	out := make([]byte, 3+9)
+	out[0] = KindTimestamp
+	binary.BigEndian.PutUint16(out[1:], 9)
+	out[3] = TimestampRequest
+	binary.BigEndian.PutUint64(out[4:], uint64(t.UnixNano()/int64(time.Microsecond)))
+	return out
+}
+
 // ID returns the session's unique ID if and only if the Message is the initial
 // ID message.  Normally, you would call GetID on the socket instead of
 // manually running this function.
@@ -0,0 +1,235 @@
+// Package codec provides the per-sample conversion kernels an AudioSocket
+// server typically needs between the 8kHz signed linear audio Asterisk sends
+// (KindSlin) and the formats used by speech engines: G.711 μ-law and A-law,
+// and sample rate conversion between 8, 16 and 24kHz.
+//
+// All bulk functions operate on whole frames at once and reuse the
+// destination slice when it has sufficient capacity, so a caller which keeps
+// its buffers between frames performs no allocations.
+package codec
+
+import "encoding/binary"
+
+const (
+	ulawBias = 0x84
+	ulawClip = 8159
+
+	signBit   = 0x80
+	quantMask = 0x0f
+	segShift  = 4
+	segMask   = 0x70
+)
+
+var ulawSegEnd = [8]int{0x3f, 0x7f, 0xff, 0x1ff, 0x3ff, 0x7ff, 0xfff, 0x1fff}
+var alawSegEnd = [8]int{0x1f, 0x3f, 0x7f, 0xff, 0x1ff, 0x3ff, 0x7ff, 0xfff}
+
+var (
+	// ulawDecodeTable and alawDecodeTable hold the little-endian slin
+	// representation of each G.711 code word.
+	ulawDecodeTable [256]uint16
+	alawDecodeTable [256]uint16
+
+	// ulawEncodeTable is indexed by the top 14 bits of a sample and
+	// alawEncodeTable by the top 13 bits, which is the full precision
+	// each law operates on.
+	ulawEncodeTable [1 << 14]byte
+	alawEncodeTable [1 << 13]byte
+)
+
+func init() {
+	for i := 0; i < 256; i++ {
+		ulawDecodeTable[i] = uint16(ulawToLinear(byte(i)))
+		alawDecodeTable[i] = uint16(alawToLinear(byte(i)))
+	}
+	for i := range ulawEncodeTable {
+		ulawEncodeTable[i] = linearToUlaw(int16(uint16(i) << 2))
+	}
+	for i := range alawEncodeTable {
+		alawEncodeTable[i] = linearToAlaw(int16(uint16(i) << 3))
+	}
+}
+
+func segment(val int, table *[8]int) int {
+	for i, end := range table {
+		if val <= end {
+			return i
+		}
+	}
+	return len(table)
+}
+
+// linearToUlaw is the reference G.711 μ-law encoder used to build the tables
+func linearToUlaw(sample int16) byte {
+	var mask byte = 0xff
+
+	pcm := int(sample) >> 2
+	if pcm < 0 {
+		pcm = -pcm
+		mask = 0x7f
+	}
+	if pcm > ulawClip {
+		pcm = ulawClip
+	}
+	pcm += ulawBias >> 2
+
+	seg := segment(pcm, &ulawSegEnd)
+	if seg >= 8 {
+		return 0x7f ^ mask
+	}
+	return byte(seg<<segShift|(pcm>>uint(seg+1))&quantMask) ^ mask
+}
+
+// ulawToLinear is the reference G.711 μ-law decoder used to build the tables
+func ulawToLinear(u byte) int16 {
+	u = ^u
+	t := (int(u&quantMask) << 3) + ulawBias
+	t <<= uint(u&segMask) >> segShift
+	if u&signBit != 0 {
+		return int16(ulawBias - t)
+	}
+	return int16(t - ulawBias)
+}
+
+// linearToAlaw is the reference G.711 A-law encoder used to build the tables
+func linearToAlaw(sample int16) byte {
+	var mask byte = 0xd5
+
+	pcm := int(sample) >> 3
+	if pcm < 0 {
+		mask = 0x55
+		pcm = -pcm - 1
+	}
+
+	seg := segment(pcm, &alawSegEnd)
+	if seg >= 8 {
+		return 0x7f ^ mask
+	}
+
+	aval := seg << segShift
+	if seg < 2 {
+		aval |= (pcm >> 1) & quantMask
+	} else {
+		aval |= (pcm >> uint(seg)) & quantMask
+	}
+	return byte(aval) ^ mask
+}
+
+// alawToLinear is the reference G.711 A-law decoder used to build the tables
+func alawToLinear(a byte) int16 {
+	a ^= 0x55
+	t := int(a&quantMask) << 4
+	switch seg := uint(a&segMask) >> segShift; seg {
+	case 0:
+		t += 8
+	case 1:
+		t += 0x108
+	default:
+		t += 0x108
+		t <<= seg - 1
+	}
+	if a&signBit != 0 {
+		return int16(t)
+	}
+	return int16(-t)
+}
+
+// UlawDecode returns the signed linear value of a single μ-law code word
+func UlawDecode(u byte) int16 {
+	return int16(ulawDecodeTable[u])
+}
+
+// UlawEncode returns the μ-law code word for a single signed linear sample
+func UlawEncode(sample int16) byte {
+	return ulawEncodeTable[uint16(sample)>>2]
+}
+
+// AlawDecode returns the signed linear value of a single A-law code word
+func AlawDecode(a byte) int16 {
+	return int16(alawDecodeTable[a])
+}
+
+// AlawEncode returns the A-law code word for a single signed linear sample
+func AlawEncode(sample int16) byte {
+	return alawEncodeTable[uint16(sample)>>3]
+}
+
+// UlawToSlin decodes the μ-law frame src into little-endian signed linear
+// audio, as carried by KindSlin messages.  The result is written to dst if it
+// has sufficient capacity (2*len(src)); otherwise a new slice is allocated.
+//
+// dst and src may be the same slice, in which case the frame is expanded in
+// place.
+func UlawToSlin(dst, src []byte) []byte {
+	return expand(dst, src, &ulawDecodeTable)
+}
+
+// AlawToSlin decodes the A-law frame src into little-endian signed linear
+// audio.  It follows the same buffer rules as UlawToSlin.
+func AlawToSlin(dst, src []byte) []byte {
+	return expand(dst, src, &alawDecodeTable)
+}
+
+// SlinToUlaw encodes the little-endian signed linear frame src as μ-law.  The
+// result is written to dst if it has sufficient capacity (len(src)/2);
+// otherwise a new slice is allocated.  A trailing odd byte in src is ignored.
+//
+// dst and src may be the same slice, in which case the frame is compressed in
+// place.
+func SlinToUlaw(dst, src []byte) []byte {
+	return compress(dst, src, ulawEncodeTable[:], 2)
+}
+
+// SlinToAlaw encodes the little-endian signed linear frame src as A-law.  It
+// follows the same buffer rules as SlinToUlaw.
+func SlinToAlaw(dst, src []byte) []byte {
+	return compress(dst, src, alawEncodeTable[:], 3)
+}
+
+// expand runs backwards over src so that writing two bytes per code word
+// never overwrites input which has not yet been read when dst aliases src.
+func expand(dst, src []byte, table *[256]uint16) []byte {
+	n := len(src)
+	dst = growBytes(dst, 2*n)
+
+	i := n
+	for ; i >= 4; i -= 4 {
+		s := src[i-4 : i : i]
+		v := uint64(table[s[0]]) |
+			uint64(table[s[1]])<<16 |
+			uint64(table[s[2]])<<32 |
+			uint64(table[s[3]])<<48
+		binary.LittleEndian.PutUint64(dst[2*i-8:2*i], v)
+	}
+	for ; i > 0; i-- {
+		binary.LittleEndian.PutUint16(dst[2*i-2:], table[src[i-1]])
+	}
+	return dst
+}
+
+// compress runs forwards over src; each group of four samples is loaded
+// before its output is stored, so in-place use is safe.
+func compress(dst, src []byte, table []byte, shift uint) []byte {
+	n := len(src) / 2
+	dst = growBytes(dst, n)
+
+	i := 0
+	for ; i+4 <= n; i += 4 {
+		v := binary.LittleEndian.Uint64(src[2*i : 2*i+8])
+		d := dst[i : i+4 : i+4]
+		d[0] = table[uint16(v)>>shift]
+		d[1] = table[uint16(v>>16)>>shift]
+		d[2] = table[uint16(v>>32)>>shift]
+		d[3] = table[uint16(v>>48)>>shift]
+	}
+	for ; i < n; i++ {
+		dst[i] = table[binary.LittleEndian.Uint16(src[2*i:])>>shift]
+	}
+	return dst
+}
+
+func growBytes(b []byte, n int) []byte {
+	if cap(b) < n {
+		return make([]byte, n)
+	}
+	return b[:n]
+}
@@ -0,0 +1,262 @@
+package codec_test
+
+import (
+	"encoding/binary"
+	"math"
+	"math/rand"
+	"testing"
+
+	"github.com/CyCoreSystems/audiosocket/codec"
+)
+
+// allSamples returns every 16-bit sample value as a little-endian slin frame
+func allSamples() []byte {
+	all := make([]byte, 2*65536)
+	for i := 0; i < 65536; i++ {
+		binary.LittleEndian.PutUint16(all[2*i:], uint16(i))
+	}
+	return all
+}
+
+// allCodes returns every G.711 code word
+func allCodes() []byte {
+	codes := make([]byte, 256)
+	for i := range codes {
+		codes[i] = byte(i)
+	}
+	return codes
+}
+
+// testFrame returns 20ms of an 8kHz tone with some noise, as slin
+func testFrame() []byte {
+	const samples = 160
+	slin := make([]byte, 2*samples)
+	for i := 0; i < samples; i++ {
+		s := int16(8000*math.Sin(float64(i)*2*math.Pi*440/8000)) + int16(rand.Intn(200)-100)
+		binary.LittleEndian.PutUint16(slin[2*i:], uint16(s))
+	}
+	return slin
+}
+
+type g711 struct {
+	name        string
+	encode      func(dst, src []byte) []byte
+	decode      func(dst, src []byte) []byte
+	encodeOne   func(int16) byte
+	decodeOne   func(byte) int16
+	naiveEncode func([]byte) []byte
+	naiveDecode func([]byte) []byte
+}
+
+var laws = []g711{
+	{"ulaw", codec.SlinToUlaw, codec.UlawToSlin, codec.UlawEncode, codec.UlawDecode, naiveSlinToUlaw, naiveUlawToSlin},
+	{"alaw", codec.SlinToAlaw, codec.AlawToSlin, codec.AlawEncode, codec.AlawDecode, naiveSlinToAlaw, naiveAlawToSlin},
+}
+
+// TestEncode checks the table encoders against the per-sample reference for
+// every possible sample
+func TestEncode(t *testing.T) {
+	all := allSamples()
+	for _, law := range laws {
+		got := law.encode(nil, all)
+		want := law.naiveEncode(all)
+		for i := range want {
+			if got[i] != want[i] {
+				t.Fatalf("%s encode of %d: got %#x, want %#x", law.name, int16(i), got[i], want[i])
+			}
+			if one := law.encodeOne(int16(i)); one != want[i] {
+				t.Fatalf("%s single encode of %d: got %#x, want %#x", law.name, int16(i), one, want[i])
+			}
+		}
+	}
+}
+
+// TestDecode checks the table decoders against the per-sample reference for
+// every code word
+func TestDecode(t *testing.T) {
+	codes := allCodes()
+	for _, law := range laws {
+		got := law.decode(nil, codes)
+		want := law.naiveDecode(codes)
+		for i := range codes {
+			g := int16(binary.LittleEndian.Uint16(got[2*i:]))
+			w := int16(binary.LittleEndian.Uint16(want[2*i:]))
+			if g != w {
+				t.Fatalf("%s decode of %#x: got %d, want %d", law.name, codes[i], g, w)
+			}
+			if one := law.decodeOne(codes[i]); one != w {
+				t.Fatalf("%s single decode of %#x: got %d, want %d", law.name, codes[i], one, w)
+			}
+		}
+	}
+}
+
+// TestInPlace checks decoding and re-encoding a frame in the same buffer
+func TestInPlace(t *testing.T) {
+	codes := allCodes()
+	for _, law := range laws {
+		want := law.naiveDecode(codes)
+
+		buf := make([]byte, len(codes), 2*len(codes))
+		copy(buf, codes)
+		buf = law.decode(buf, buf)
+		for i := range want {
+			if buf[i] != want[i] {
+				t.Fatalf("in-place %s decode of %#x differs", law.name, codes[i/2])
+			}
+		}
+
+		buf = law.encode(buf, buf)
+		for i := range codes {
+			// Code words which decode to the same value, such as μ-law's
+			// two zeroes, need not survive the round trip
+			if buf[i] != codes[i] && law.decodeOne(buf[i]) != law.decodeOne(codes[i]) {
+				t.Fatalf("in-place %s round trip of %#x gave %#x", law.name, codes[i], buf[i])
+			}
+		}
+	}
+}
+
+func BenchmarkSlinToUlaw(b *testing.B) {
+	benchmarkEncode(b, laws[0])
+}
+
+func BenchmarkSlinToAlaw(b *testing.B) {
+	benchmarkEncode(b, laws[1])
+}
+
+func BenchmarkUlawToSlin(b *testing.B) {
+	benchmarkDecode(b, laws[0])
+}
+
+func BenchmarkAlawToSlin(b *testing.B) {
+	benchmarkDecode(b, laws[1])
+}
+
+func benchmarkEncode(b *testing.B, law g711) {
+	slin := testFrame()
+	b.Run("naive", func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(int64(len(slin)))
+		for i := 0; i < b.N; i++ {
+			law.naiveEncode(slin)
+		}
+	})
+	b.Run("codec", func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(int64(len(slin)))
+		dst := make([]byte, len(slin)/2)
+		for i := 0; i < b.N; i++ {
+			dst = law.encode(dst, slin)
+		}
+	})
+}
+
+func benchmarkDecode(b *testing.B, law g711) {
+	coded := law.encode(nil, testFrame())
+	b.Run("naive", func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(int64(len(coded)))
+		for i := 0; i < b.N; i++ {
+			law.naiveDecode(coded)
+		}
+	})
+	b.Run("codec", func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(int64(len(coded)))
+		dst := make([]byte, 2*len(coded))
+		for i := 0; i < b.N; i++ {
+			dst = law.decode(dst, coded)
+		}
+	})
+}
+
+// naiveSlinToUlaw is the straightforward per-sample μ-law encoder
+func naiveSlinToUlaw(in []byte) []byte {
+	var out []byte
+	for i := 0; i+1 < len(in); i += 2 {
+		pcm := int(int16(binary.LittleEndian.Uint16(in[i:]))) >> 2
+		mask := 0xff
+		if pcm < 0 {
+			pcm = -pcm
+			mask = 0x7f
+		}
+		if pcm > 8159 {
+			pcm = 8159
+		}
+		pcm += 0x84 >> 2
+
+		seg := 0
+		for end := 0x3f; seg < 8 && pcm > end; end = end<<1 | 1 {
+			seg++
+		}
+		if seg >= 8 {
+			out = append(out, byte(0x7f^mask))
+			continue
+		}
+		out = append(out, byte((seg<<4|(pcm>>uint(seg+1))&0xf)^mask))
+	}
+	return out
+}
+
+// naiveUlawToSlin is the straightforward per-sample μ-law decoder
+func naiveUlawToSlin(in []byte) []byte {
+	var out []byte
+	for _, u := range in {
+		u = ^u
+		t := (int(u&0xf) << 3) + 0x84
+		t <<= uint(u&0x70) >> 4
+		s := t - 0x84
+		if u&0x80 != 0 {
+			s = 0x84 - t
+		}
+		out = append(out, byte(s), byte(s>>8))
+	}
+	return out
+}
+
+// naiveSlinToAlaw is the straightforward per-sample A-law encoder
+func naiveSlinToAlaw(in []byte) []byte {
+	var out []byte
+	for i := 0; i+1 < len(in); i += 2 {
+		pcm := int(int16(binary.LittleEndian.Uint16(in[i:]))) >> 3
+		mask := 0xd5
+		if pcm < 0 {
+			pcm = -pcm - 1
+			mask = 0x55
+		}
+
+		seg := 0
+		for end := 0x1f; seg < 8 && pcm > end; end = end<<1 | 1 {
+			seg++
+		}
+		if seg >= 8 {
+			out = append(out, byte(0x7f^mask))
+			continue
+		}
+		shift := uint(seg)
+		if seg < 2 {
+			shift = 1
+		}
+		out = append(out, byte((seg<<4|(pcm>>shift)&0xf)^mask))
+	}
+	return out
+}
+
+// naiveAlawToSlin is the straightforward per-sample A-law decoder
+func naiveAlawToSlin(in []byte) []byte {
+	var out []byte
+	for _, a := range in {
+		a ^= 0x55
+		t := int(a&0xf)<<4 + 8
+		if seg := uint(a&0x70) >> 4; seg > 0 {
+			t = (t + 0x100) << (seg - 1)
+		}
+		s := -t
+		if a&0x80 != 0 {
+			s = t
+		}
+		out = append(out, byte(s), byte(s>>8))
+	}
+	return out
+}
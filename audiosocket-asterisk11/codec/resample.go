@@ -0,0 +1,262 @@
+package codec
+
+import (
+	"encoding/binary"
+	"math"
+
+	"github.com/pkg/errors"
+)
+
+// TapsPerPhase is the number of filter taps evaluated for each output sample
+const TapsPerPhase = 16
+
+// coefShift is the fixed-point precision of the filter coefficients (Q15)
+const coefShift = 15
+
+// Resampler converts a stream of signed linear audio between 8, 16 and 24kHz
+// using a polyphase windowed-sinc filter.  The filter history and phase are
+// kept between calls, so a stream may be fed one frame at a time without
+// discontinuities at frame boundaries.
+//
+// A Resampler is not safe for concurrent use; use one per stream and
+// direction.
+type Resampler struct {
+	inRate  int
+	outRate int
+
+	up   int // interpolation factor
+	down int // decimation factor
+	taps int
+
+	// coef holds one row per phase, stored in reverse tap order so that
+	// each output sample is a dot product over contiguous input.
+	coef [][]int32
+
+	// pos is the position of the next output sample on the upsampled time
+	// base, relative to the first sample of the next input frame.
+	pos int
+
+	// ext holds taps-1 samples of history followed by the current input
+	ext []int16
+
+	scratch []int16
+}
+
+// NewResampler returns a Resampler converting from inRate to outRate.  Both
+// rates must be one of 8000, 16000 or 24000.  When the rates are equal, the
+// Resampler copies its input unchanged.
+func NewResampler(inRate, outRate int) (*Resampler, error) {
+	if !supportedRate(inRate) {
+		return nil, errors.Errorf("unsupported input rate %d", inRate)
+	}
+	if !supportedRate(outRate) {
+		return nil, errors.Errorf("unsupported output rate %d", outRate)
+	}
+
+	g := gcd(inRate, outRate)
+	r := &Resampler{
+		inRate:  inRate,
+		outRate: outRate,
+		up:      outRate / g,
+		down:    inRate / g,
+		taps:    TapsPerPhase,
+	}
+	if r.up == r.down {
+		r.taps = 1
+	}
+	r.coef = designFilter(r.up, r.down, r.taps)
+	r.ext = make([]int16, r.taps-1, r.taps-1+inRate/50)
+
+	return r, nil
+}
+
+func supportedRate(rate int) bool {
+	return rate == 8000 || rate == 16000 || rate == 24000
+}
+
+func gcd(a, b int) int {
+	for b != 0 {
+		a, b = b, a%b
+	}
+	return a
+}
+
+// designFilter builds the polyphase decomposition of a Blackman-windowed sinc
+// low-pass filter with its cutoff just below the lower of the two Nyquist
+// frequencies.
+func designFilter(up, down, taps int) [][]int32 {
+	coef := make([][]int32, up)
+	if taps == 1 {
+		coef[0] = []int32{1 << coefShift}
+		return coef
+	}
+
+	n := up * taps
+	ratio := up
+	if down > up {
+		ratio = down
+	}
+	fc := 0.92 * 0.5 / float64(ratio) // cycles per upsampled sample
+	mid := float64(n-1) / 2
+
+	proto := make([]float64, n)
+	for i := range proto {
+		x := float64(i) - mid
+		sinc := 2 * fc
+		if x != 0 {
+			sinc = math.Sin(2*math.Pi*fc*x) / (math.Pi * x)
+		}
+		w := 0.42 - 0.5*math.Cos(2*math.Pi*float64(i)/float64(n-1)) +
+			0.08*math.Cos(4*math.Pi*float64(i)/float64(n-1))
+		proto[i] = float64(up) * sinc * w
+	}
+
+	for p := 0; p < up; p++ {
+		// Normalise each phase to unity DC gain so that a constant input
+		// produces a constant output regardless of phase.
+		var sum float64
+		for j := 0; j < taps; j++ {
+			sum += proto[p+j*up]
+		}
+
+		row := make([]int32, taps)
+		for j := 0; j < taps; j++ {
+			row[taps-1-j] = int32(math.Round(proto[p+j*up] / sum * (1 << coefShift)))
+		}
+		coef[p] = row
+	}
+	return coef
+}
+
+// InRate returns the sample rate expected on input
+func (r *Resampler) InRate() int {
+	return r.inRate
+}
+
+// OutRate returns the sample rate produced on output
+func (r *Resampler) OutRate() int {
+	return r.outRate
+}
+
+// Reset clears the filter history, as at the start of a new stream
+func (r *Resampler) Reset() {
+	r.pos = 0
+	r.ext = r.ext[:r.taps-1]
+	for i := range r.ext {
+		r.ext[i] = 0
+	}
+}
+
+// Resample converts the samples in src and returns the output samples.  The
+// result is written to dst if it has sufficient capacity; otherwise a new
+// slice is allocated.  dst may alias src.
+//
+// The number of output samples for a given frame varies by at most one from
+// len(src)*OutRate/InRate, depending upon the phase carried over from the
+// previous frame.
+func (r *Resampler) Resample(dst, src []int16) []int16 {
+	r.ext = append(r.ext[:r.taps-1], src...)
+	dst = growInt16(dst, r.outputLen(len(src)))
+	return r.filter(dst, len(src))
+}
+
+// ResampleSlin converts the little-endian signed linear frame src, as carried
+// by KindSlin messages, and returns the converted frame in the same format.
+// The result is written to dst if it has sufficient capacity; otherwise a new
+// slice is allocated.  dst may alias src.
+func (r *Resampler) ResampleSlin(dst, src []byte) []byte {
+	n := len(src) / 2
+	h := r.taps - 1
+
+	if cap(r.ext) < h+n {
+		ext := make([]int16, h+n)
+		copy(ext, r.ext[:h])
+		r.ext = ext
+	}
+	r.ext = r.ext[:h+n]
+	in := r.ext[h:]
+	for i := range in {
+		in[i] = int16(binary.LittleEndian.Uint16(src[2*i:]))
+	}
+
+	r.scratch = growInt16(r.scratch, r.outputLen(n))
+	out := r.filter(r.scratch, n)
+
+	dst = growBytes(dst, 2*len(out))
+	for i, s := range out {
+		binary.LittleEndian.PutUint16(dst[2*i:], uint16(s))
+	}
+	return dst
+}
+
+// outputLen returns the number of samples the next n input samples produce
+func (r *Resampler) outputLen(n int) int {
+	limit := n * r.up
+	if r.pos >= limit {
+		return 0
+	}
+	return (limit - r.pos + r.down - 1) / r.down
+}
+
+// filter produces output from the n input samples loaded after the history
+// in r.ext, then retains the tail of the input as history for the next call.
+func (r *Resampler) filter(dst []int16, n int) []int16 {
+	limit := n * r.up
+	taps := r.taps
+	ext := r.ext
+
+	// Track the input index and phase incrementally rather than dividing
+	// for every output sample.
+	i := 0
+	k := r.pos / r.up
+	p := r.pos - k*r.up
+	for k < n {
+		dst[i] = dot(r.coef[p], ext[k:k+taps])
+		i++
+		p += r.down
+		for p >= r.up {
+			p -= r.up
+			k++
+		}
+	}
+	r.pos = k*r.up + p - limit
+
+	copy(ext, ext[n:n+taps-1])
+	r.ext = ext[:taps-1]
+
+	return dst[:i]
+}
+
+// dot computes a Q15 dot product with four independent accumulators, which
+// lets the compiler eliminate bounds checks and overlap the multiplies.
+func dot(c []int32, x []int16) int16 {
+	x = x[:len(c)]
+
+	var a0, a1, a2, a3 int64
+	i := 0
+	for ; i+4 <= len(c); i += 4 {
+		a0 += int64(c[i]) * int64(x[i])
+		a1 += int64(c[i+1]) * int64(x[i+1])
+		a2 += int64(c[i+2]) * int64(x[i+2])
+		a3 += int64(c[i+3]) * int64(x[i+3])
+	}
+	for ; i < len(c); i++ {
+		a0 += int64(c[i]) * int64(x[i])
+	}
+
+	acc := (a0 + a1 + a2 + a3 + 1<<(coefShift-1)) >> coefShift
+	if acc > math.MaxInt16 {
+		return math.MaxInt16
+	}
+	if acc < math.MinInt16 {
+		return math.MinInt16
+	}
+	return int16(acc)
+}
+
+func growInt16(b []int16, n int) []int16 {
+	if cap(b) < n {
+		return make([]int16, n)
+	}
+	return b[:n]
+}
@@ -0,0 +1,190 @@
+package codec_test
+
+import (
+	"encoding/binary"
+	"fmt"
+	"math"
+	"math/rand"
+	"testing"
+
+	"github.com/CyCoreSystems/audiosocket/codec"
+)
+
+var ratePairs = [][2]int{
+	{8000, 16000}, {16000, 8000}, {8000, 24000}, {24000, 8000}, {16000, 24000}, {24000, 16000}, {8000, 8000},
+}
+
+// maxResampleError is the largest difference allowed between the Resampler
+// and the floating point reference, in sample values.  It allows for the Q15
+// coefficients and the normalisation of each phase to unity DC gain.
+const maxResampleError = 64
+
+// toneFrames returns count 20ms slin frames at rate of a 440Hz tone with
+// some noise, continuous across frames
+func toneFrames(rate, count int) [][]byte {
+	samples := rate / 50
+	frames := make([][]byte, count)
+	for f := range frames {
+		frame := make([]byte, 2*samples)
+		for i := 0; i < samples; i++ {
+			n := f*samples + i
+			s := int16(8000*math.Sin(float64(n)*2*math.Pi*440/float64(rate))) + int16(rand.Intn(200)-100)
+			binary.LittleEndian.PutUint16(frame[2*i:], uint16(s))
+		}
+		frames[f] = frame
+	}
+	return frames
+}
+
+// TestResampler checks a stream converted frame by frame against the
+// floating point reference
+func TestResampler(t *testing.T) {
+	for _, rates := range ratePairs {
+		in, out := rates[0], rates[1]
+		t.Run(fmt.Sprintf("%dto%d", in/1000, out/1000), func(t *testing.T) {
+			r, err := codec.NewResampler(in, out)
+			if err != nil {
+				t.Fatal(err)
+			}
+			nr := newNaiveResampler(in, out)
+
+			var got, want []byte
+			for _, frame := range toneFrames(in, 25) {
+				got = append(got, r.ResampleSlin(nil, frame)...)
+				want = append(want, nr.resample(frame)...)
+			}
+			if len(got) != len(want) {
+				t.Fatalf("got %d samples, want %d", len(got)/2, len(want)/2)
+			}
+			for i := 0; i < len(want); i += 2 {
+				g := int(int16(binary.LittleEndian.Uint16(got[i:])))
+				w := int(int16(binary.LittleEndian.Uint16(want[i:])))
+				if d := g - w; d > maxResampleError || d < -maxResampleError {
+					t.Fatalf("sample %d: got %d, want %d", i/2, g, w)
+				}
+			}
+		})
+	}
+}
+
+// TestResamplerFrames checks that Resample and ResampleSlin agree and that
+// the frame boundaries do not change the output
+func TestResamplerFrames(t *testing.T) {
+	for _, rates := range ratePairs {
+		in, out := rates[0], rates[1]
+		frames := toneFrames(in, 10)
+
+		var whole []byte
+		for _, frame := range frames {
+			whole = append(whole, frame...)
+		}
+		r, err := codec.NewResampler(in, out)
+		if err != nil {
+			t.Fatal(err)
+		}
+		want := r.ResampleSlin(nil, whole)
+
+		r.Reset()
+		var got []int16
+		for _, frame := range frames {
+			samples := make([]int16, len(frame)/2)
+			for i := range samples {
+				samples[i] = int16(binary.LittleEndian.Uint16(frame[2*i:]))
+			}
+			got = append(got, r.Resample(nil, samples)...)
+		}
+
+		if 2*len(got) != len(want) {
+			t.Fatalf("%d to %d: got %d samples by frame, want %d", in, out, len(got), len(want)/2)
+		}
+		for i, s := range got {
+			if w := int16(binary.LittleEndian.Uint16(want[2*i:])); s != w {
+				t.Fatalf("%d to %d: sample %d is %d by frame, %d at once", in, out, i, s, w)
+			}
+		}
+	}
+}
+
+func BenchmarkResample(b *testing.B) {
+	for _, rates := range [][2]int{{8000, 16000}, {16000, 8000}, {8000, 24000}, {24000, 16000}} {
+		in, out := rates[0], rates[1]
+		frame := toneFrames(in, 1)[0]
+		b.Run(fmt.Sprintf("%dto%d/naive", in/1000, out/1000), func(b *testing.B) {
+			b.ReportAllocs()
+			b.SetBytes(int64(len(frame)))
+			nr := newNaiveResampler(in, out)
+			for i := 0; i < b.N; i++ {
+				nr.resample(frame)
+			}
+		})
+		b.Run(fmt.Sprintf("%dto%d/codec", in/1000, out/1000), func(b *testing.B) {
+			b.ReportAllocs()
+			b.SetBytes(int64(len(frame)))
+			r, err := codec.NewResampler(in, out)
+			if err != nil {
+				b.Fatal(err)
+			}
+			var dst []byte
+			for i := 0; i < b.N; i++ {
+				dst = r.ResampleSlin(dst, frame)
+			}
+		})
+	}
+}
+
+// naiveResampler zero-stuffs the input to the common multiple rate, applies
+// the full low-pass filter in floating point and then decimates.
+type naiveResampler struct {
+	up, down int
+	h        []float64
+	hist     []float64
+}
+
+func newNaiveResampler(in, out int) *naiveResampler {
+	g := in
+	for b := out; b != 0; {
+		g, b = b, g%b
+	}
+	up, down := out/g, in/g
+	if up == down {
+		return &naiveResampler{up: 1, down: 1, h: []float64{1}}
+	}
+
+	n := up * codec.TapsPerPhase
+	ratio := math.Max(float64(up), float64(down))
+	fc := 0.92 * 0.5 / ratio
+	h := make([]float64, n)
+	for i := range h {
+		x := float64(i) - float64(n-1)/2
+		sinc := 2 * fc
+		if x != 0 {
+			sinc = math.Sin(2*math.Pi*fc*x) / (math.Pi * x)
+		}
+		w := 0.42 - 0.5*math.Cos(2*math.Pi*float64(i)/float64(n-1)) + 0.08*math.Cos(4*math.Pi*float64(i)/float64(n-1))
+		h[i] = float64(up) * sinc * w
+	}
+	return &naiveResampler{up: up, down: down, h: h, hist: make([]float64, n-1)}
+}
+
+func (r *naiveResampler) resample(in []byte) []byte {
+	stuffed := append([]float64(nil), r.hist...)
+	for i := 0; i+1 < len(in); i += 2 {
+		stuffed = append(stuffed, float64(int16(binary.LittleEndian.Uint16(in[i:]))))
+		for j := 1; j < r.up; j++ {
+			stuffed = append(stuffed, 0)
+		}
+	}
+
+	var out []byte
+	n := len(r.h)
+	for k := n - 1; k < len(stuffed); k += r.down {
+		var acc float64
+		for j := 0; j < n; j++ {
+			acc += r.h[j] * stuffed[k-j]
+		}
+		s := int16(math.Max(math.MinInt16, math.Min(math.MaxInt16, math.Round(acc))))
+		out = append(out, byte(s), byte(s>>8))
+	}
+	r.hist = append(r.hist[:0], stuffed[len(stuffed)-(n-1):]...)
+	return out
+}
@@ -0,0 +1,389 @@
+// Command loadgen is a synthetic Asterisk for load testing AudioSocket
+// servers.  Each simulated call behaves like app_audiosocket: it connects,
+// sends the ID message, streams signed linear audio from a file at real 20ms
+// cadence, reads back whatever audio the server sends and optionally finishes
+// with a hangup message.
+//
+// Three modes are available:
+//
+//	fixed  start -calls calls (spread across -ramp) and report once they finish
+//	ramp   add -step concurrent calls every -step-interval, reporting each
+//	       step, until -calls is reached or inbound loss exceeds -max-loss
+//	soak   hold -calls concurrent calls for -soak, reporting every -report
+package main
+
+import (
+	"bufio"
+	"context"
+	"flag"
+	"io"
+	"io/ioutil"
+	"log"
+	"net"
+	"os"
+	"os/signal"
+	"strconv"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/CyCoreSystems/audiosocket"
+	"github.com/gofrs/uuid"
+	"github.com/pkg/errors"
+)
+
+// frameInterval is the cadence at which Asterisk sends slin frames
+const frameInterval = 20 * time.Millisecond
+
+var (
+	addr         = flag.String("addr", "localhost:8080", "AudioSocket server address")
+	mode         = flag.String("mode", "fixed", "load mode: fixed, ramp or soak")
+	calls        = flag.Int("calls", 10, "number of concurrent calls (maximum in ramp mode)")
+	fileName     = flag.String("file", "test.slin", "8kHz signed linear audio to stream on each call")
+	callDuration = flag.Duration("call-duration", 0, "length of each call; the file is looped to fill it (0 plays the file once)")
+	hangup       = flag.Bool("hangup", true, "send a hangup message at the end of each call")
+	linger       = flag.Duration("linger", 2*time.Second, "time to keep reading server audio after the last frame is sent")
+	rampUp       = flag.Duration("ramp", 0, "period over which each batch of calls is started")
+	step         = flag.Int("step", 10, "calls added per step in ramp mode")
+	stepInterval = flag.Duration("step-interval", 30*time.Second, "duration of each step in ramp mode")
+	maxLoss      = flag.Float64("max-loss", 0.01, "fraction of late or dropped inbound frames which ends ramp mode")
+	soak         = flag.Duration("soak", 10*time.Minute, "total duration of soak mode")
+	reportEvery  = flag.Duration("report", 30*time.Second, "reporting interval in soak mode")
+	lateAfter    = flag.Duration("late", 10*time.Millisecond, "inbound frames arriving this much beyond the frame interval are counted as late")
+	silenceGap   = flag.Duration("silence-gap", time.Second, "inbound gaps longer than this are treated as the server not speaking rather than as loss")
+	dialTimeout  = flag.Duration("dial-timeout", 5*time.Second, "timeout for connecting to the server")
+)
+
+var audioData []byte
+
+var stats = new(Stats)
+
+// active is the number of calls currently connected
+var active int64
+
+func main() {
+	var err error
+
+	flag.Parse()
+
+	audioData, err = ioutil.ReadFile(*fileName)
+	if err != nil {
+		log.Fatalln("failed to read audio file:", err)
+	}
+	if len(audioData) < audiosocket.DefaultSlinChunkSize {
+		log.Fatalln("audio file is shorter than one frame")
+	}
+
+	ctx, cancel := context.WithCancel(context.Background())
+	defer cancel()
+
+	sig := make(chan os.Signal, 1)
+	signal.Notify(sig, os.Interrupt)
+	go func() {
+		<-sig
+		log.Println("interrupted; stopping calls")
+		cancel()
+	}()
+
+	switch *mode {
+	case "fixed":
+		runFixed(ctx)
+	case "ramp":
+		runRamp(ctx)
+	case "soak":
+		runSoak(ctx)
+	default:
+		log.Fatalf("unknown mode %q", *mode)
+	}
+}
+
+// runFixed starts a single batch of calls and reports once all have ended
+func runFixed(ctx context.Context) {
+	var wg sync.WaitGroup
+	startSlots(ctx, &wg, *calls, false)
+	wg.Wait()
+
+	stats.Snapshot().Print(os.Stdout, "total", atomic.LoadInt64(&active))
+}
+
+// runRamp raises the concurrency step by step until the configured maximum
+// is reached or the server starts losing frames
+func runRamp(ctx context.Context) {
+	ctx, cancel := context.WithCancel(ctx)
+	defer cancel()
+
+	var wg sync.WaitGroup
+	total := new(Stats)
+
+	level := 0
+	for level < *calls && ctx.Err() == nil {
+		n := *step
+		if level+n > *calls {
+			n = *calls - level
+		}
+		startSlots(ctx, &wg, n, true)
+		level += n
+
+		select {
+		case <-ctx.Done():
+		case <-time.After(*stepInterval):
+		}
+
+		s := stats.Snapshot()
+		s.Print(os.Stdout, "step "+strconv.Itoa(level)+" calls", atomic.LoadInt64(&active))
+		total.merge(s)
+
+		if s.failed > 0 || s.LossRatio() > *maxLoss {
+			log.Printf("limit reached at %d concurrent calls", level)
+			break
+		}
+	}
+
+	cancel()
+	wg.Wait()
+
+	total.merge(stats.Snapshot())
+	total.Print(os.Stdout, "total", 0)
+}
+
+// runSoak holds a constant number of calls for the soak duration, replacing
+// each call as it ends
+func runSoak(ctx context.Context) {
+	ctx, cancel := context.WithTimeout(ctx, *soak)
+	defer cancel()
+
+	var wg sync.WaitGroup
+	total := new(Stats)
+
+	startSlots(ctx, &wg, *calls, true)
+
+	t := time.NewTicker(*reportEvery)
+	defer t.Stop()
+
+	for ctx.Err() == nil {
+		select {
+		case <-ctx.Done():
+		case <-t.C:
+			s := stats.Snapshot()
+			s.Print(os.Stdout, "interval", atomic.LoadInt64(&active))
+			total.merge(s)
+		}
+	}
+
+	wg.Wait()
+
+	total.merge(stats.Snapshot())
+	total.Print(os.Stdout, "total", 0)
+}
+
+// startSlots starts n call slots, spreading their first calls evenly across
+// the ramp period.  A repeating slot places a new call as soon as its
+// previous one ends, until the context is cancelled.
+func startSlots(ctx context.Context, wg *sync.WaitGroup, n int, repeat bool) {
+	for i := 0; i < n; i++ {
+		var delay time.Duration
+		if n > 1 {
+			delay = *rampUp * time.Duration(i) / time.Duration(n)
+		}
+
+		wg.Add(1)
+		go func(delay time.Duration) {
+			defer wg.Done()
+
+			select {
+			case <-ctx.Done():
+				return
+			case <-time.After(delay):
+			}
+
+			for {
+				if err := runCall(ctx); err != nil {
+					log.Println("call failed:", err)
+				}
+				if !repeat || ctx.Err() != nil {
+					return
+				}
+			}
+		}(delay)
+	}
+}
+
+// runCall places a single call against the server
+func runCall(ctx context.Context) (err error) {
+	stats.mu.Lock()
+	stats.started++
+	stats.mu.Unlock()
+
+	defer func() {
+		stats.mu.Lock()
+		if err != nil {
+			stats.failed++
+		} else {
+			stats.completed++
+		}
+		stats.mu.Unlock()
+	}()
+
+	id, err := uuid.NewV4()
+	if err != nil {
+		return errors.Wrap(err, "failed to generate call ID")
+	}
+
+	dialStart := time.Now()
+	c, err := net.DialTimeout("tcp", *addr, *dialTimeout)
+	if err != nil {
+		return errors.Wrapf(err, "failed to connect to %s", *addr)
+	}
+	defer c.Close()
+
+	if _, err = c.Write(audiosocket.IDMessage(id)); err != nil {
+		return errors.Wrap(err, "failed to send ID message")
+	}
+	idSent := time.Now()
+
+	atomic.AddInt64(&active, 1)
+	defer atomic.AddInt64(&active, -1)
+
+	stats.mu.Lock()
+	stats.connect.Record(idSent.Sub(dialStart))
+	stats.mu.Unlock()
+
+	callCtx, cancel := context.WithCancel(ctx)
+	defer cancel()
+
+	recvDone := make(chan struct{})
+	go func() {
+		defer close(recvDone)
+		receiveAudio(c, idSent, cancel)
+	}()
+
+	if err = sendAudio(callCtx, c, idSent); err != nil {
+		return err
+	}
+
+	// The server has hung up or closed the connection
+	if callCtx.Err() != nil {
+		return nil
+	}
+
+	if *hangup {
+		if _, err = c.Write(audiosocket.HangupMessage()); err != nil {
+			return errors.Wrap(err, "failed to send hangup message")
+		}
+	}
+
+	// Let the server finish sending before tearing down the connection
+	select {
+	case <-recvDone:
+	case <-ctx.Done():
+	case <-time.After(*linger):
+	}
+	return nil
+}
+
+// sendAudio streams the audio file as slin frames on an absolute 20ms
+// schedule starting at start, so that a late wakeup does not push back every
+// subsequent frame.
+func sendAudio(ctx context.Context, w io.Writer, start time.Time) error {
+	var sent uint64
+	defer func() {
+		stats.mu.Lock()
+		stats.framesSent += sent
+		stats.mu.Unlock()
+	}()
+
+	var end time.Time
+	if *callDuration > 0 {
+		end = start.Add(*callDuration)
+	}
+
+	var i int
+	next := start
+	for ctx.Err() == nil {
+		if end.IsZero() {
+			if i >= len(audioData) {
+				return nil
+			}
+		} else if !next.Before(end) {
+			return nil
+		}
+		if i >= len(audioData) {
+			i = 0
+		}
+
+		if d := time.Until(next); d > 0 {
+			time.Sleep(d)
+		}
+		slip := time.Since(next)
+
+		chunkLen := audiosocket.DefaultSlinChunkSize
+		if i+chunkLen > len(audioData) {
+			chunkLen = len(audioData) - i
+		}
+		if _, err := w.Write(audiosocket.SlinMessage(audioData[i : i+chunkLen])); err != nil {
+			return errors.Wrap(err, "failed to write chunk to audiosocket")
+		}
+		i += chunkLen
+		sent++
+
+		stats.mu.Lock()
+		stats.sendSlip.Record(slip)
+		stats.mu.Unlock()
+
+		next = next.Add(frameInterval)
+	}
+	return nil
+}
+
+// receiveAudio reads messages from the server until it hangs up or the
+// connection is closed, recording the timing of each inbound slin frame.
+//
+// An inter-arrival gap of roughly n frame intervals counts as n-1 dropped
+// frames; a gap short of that but more than the late threshold beyond the
+// frame interval counts as one late frame.  Gaps longer than the silence gap
+// start a new talk spurt and are not counted at all.
+func receiveAudio(r io.Reader, start time.Time, cancel context.CancelFunc) {
+	defer cancel()
+
+	br := bufio.NewReader(r)
+
+	var last time.Time
+	for {
+		m, err := audiosocket.NextMessage(br)
+		if err != nil {
+			return
+		}
+		now := time.Now()
+
+		switch m.Kind() {
+		case audiosocket.KindHangup:
+			return
+		case audiosocket.KindSlin:
+		default:
+			continue
+		}
+
+		stats.mu.Lock()
+		stats.framesRecv++
+		switch gap := now.Sub(last); {
+		case last.IsZero():
+			stats.firstAudio.Record(now.Sub(start))
+		case gap > *silenceGap:
+		default:
+			dev := gap - frameInterval
+			if dev < 0 {
+				dev = -dev
+			}
+			stats.jitter.Record(dev)
+
+			if missing := int((gap+frameInterval/2)/frameInterval) - 1; missing > 0 {
+				stats.dropped += uint64(missing)
+			} else if gap > frameInterval+*lateAfter {
+				stats.late++
+			}
+		}
+		stats.mu.Unlock()
+
+		last = now
+	}
+}
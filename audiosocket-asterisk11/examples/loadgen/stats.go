@@ -0,0 +1,197 @@
+package main
+
+import (
+	"fmt"
+	"io"
+	"math/bits"
+	"sync"
+	"time"
+)
+
+// histSubBits sets the number of linear sub-buckets per power of two; 32
+// sub-buckets gives roughly 3% relative precision across the whole range.
+const histSubBits = 5
+const histSub = 1 << histSubBits
+const histBuckets = 64 * histSub
+
+// histogram is a fixed-size log-linear histogram of durations at microsecond
+// resolution.  Its memory use is constant regardless of the number of samples,
+// so it is safe to feed every frame of a long soak test into one.
+type histogram struct {
+	counts [histBuckets]uint64
+	n      uint64
+	max    time.Duration
+}
+
+func histIndex(us uint64) int {
+	if us < histSub {
+		return int(us)
+	}
+	shift := uint(bits.Len64(us) - 1 - histSubBits)
+	return int(shift)*histSub + int(us>>shift)
+}
+
+// histValue returns the midpoint of the given bucket
+func histValue(idx int) time.Duration {
+	if idx < 2*histSub {
+		return time.Duration(idx) * time.Microsecond
+	}
+	shift := uint(idx/histSub - 1)
+	lo := uint64(idx-int(shift)*histSub) << shift
+	return time.Duration(lo+(uint64(1)<<shift)/2) * time.Microsecond
+}
+
+// Record adds a sample to the histogram
+func (h *histogram) Record(d time.Duration) {
+	if d < 0 {
+		d = 0
+	}
+	h.counts[histIndex(uint64(d/time.Microsecond))]++
+	h.n++
+	if d > h.max {
+		h.max = d
+	}
+}
+
+// Merge adds the samples of o to the histogram
+func (h *histogram) Merge(o *histogram) {
+	for i, c := range o.counts {
+		h.counts[i] += c
+	}
+	h.n += o.n
+	if o.max > h.max {
+		h.max = o.max
+	}
+}
+
+// Quantile returns the approximate value below which the fraction q of
+// samples fall
+func (h *histogram) Quantile(q float64) time.Duration {
+	if h.n == 0 {
+		return 0
+	}
+	rank := uint64(q*float64(h.n) + 0.5)
+	if rank < 1 {
+		rank = 1
+	}
+	var seen uint64
+	for i, c := range h.counts {
+		seen += c
+		if seen >= rank {
+			if v := histValue(i); v < h.max {
+				return v
+			}
+			return h.max
+		}
+	}
+	return h.max
+}
+
+// Stats collects the measurements of all calls over a reporting interval
+type Stats struct {
+	mu sync.Mutex
+
+	started   int
+	completed int
+	failed    int
+
+	framesSent uint64
+	framesRecv uint64
+	late       uint64
+	dropped    uint64
+
+	// connect is the time from dialing to the ID message being written
+	connect histogram
+
+	// firstAudio is the time from the ID message to the first slin frame
+	// received from the server
+	firstAudio histogram
+
+	// jitter is the deviation of each inbound inter-arrival gap from the
+	// frame interval
+	jitter histogram
+
+	// sendSlip is how late the generator itself sent each frame; if this
+	// grows, the generator rather than the server is saturated
+	sendSlip histogram
+}
+
+// Snapshot returns a copy of the collected statistics and resets them
+func (s *Stats) Snapshot() *Stats {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	out := new(Stats)
+	out.merge(s)
+
+	s.started, s.completed, s.failed = 0, 0, 0
+	s.framesSent, s.framesRecv, s.late, s.dropped = 0, 0, 0, 0
+	s.connect = histogram{}
+	s.firstAudio = histogram{}
+	s.jitter = histogram{}
+	s.sendSlip = histogram{}
+
+	return out
+}
+
+// merge adds the values of o to s.  The caller must hold any locks required.
+func (s *Stats) merge(o *Stats) {
+	s.started += o.started
+	s.completed += o.completed
+	s.failed += o.failed
+	s.framesSent += o.framesSent
+	s.framesRecv += o.framesRecv
+	s.late += o.late
+	s.dropped += o.dropped
+	s.connect.Merge(&o.connect)
+	s.firstAudio.Merge(&o.firstAudio)
+	s.jitter.Merge(&o.jitter)
+	s.sendSlip.Merge(&o.sendSlip)
+}
+
+// LossRatio returns the fraction of expected inbound frames which were
+// either late or missing
+func (s *Stats) LossRatio() float64 {
+	expected := s.framesRecv + s.dropped
+	if expected == 0 {
+		return 0
+	}
+	return float64(s.late+s.dropped) / float64(expected)
+}
+
+// Print writes a human-readable report of the statistics
+func (s *Stats) Print(w io.Writer, title string, active int64) {
+	fmt.Fprintf(w, "--- %s: active=%d started=%d completed=%d failed=%d\n",
+		title, active, s.started, s.completed, s.failed)
+	fmt.Fprintf(w, "    frames sent=%d received=%d late=%d dropped=%d (%.2f%%)\n",
+		s.framesSent, s.framesRecv, s.late, s.dropped, 100*s.LossRatio())
+
+	fmt.Fprintf(w, "    %-12s %10s %10s %10s %10s %10s %10s\n", "", "count", "p50", "p90", "p99", "p99.9", "max")
+	for _, row := range []struct {
+		name string
+		h    *histogram
+	}{
+		{"connect", &s.connect},
+		{"first-audio", &s.firstAudio},
+		{"jitter", &s.jitter},
+		{"send-slip", &s.sendSlip},
+	} {
+		fmt.Fprintf(w, "    %-12s %10d %10s %10s %10s %10s %10s\n", row.name, row.h.n,
+			fmtDuration(row.h.Quantile(0.5)),
+			fmtDuration(row.h.Quantile(0.9)),
+			fmtDuration(row.h.Quantile(0.99)),
+			fmtDuration(row.h.Quantile(0.999)),
+			fmtDuration(row.h.max))
+	}
+}
+
+func fmtDuration(d time.Duration) string {
+	switch {
+	case d >= time.Second:
+		return fmt.Sprintf("%.2fs", d.Seconds())
+	case d >= time.Millisecond:
+		return fmt.Sprintf("%.2fms", float64(d)/float64(time.Millisecond))
+	default:
+		return fmt.Sprintf("%dµs", d/time.Microsecond)
+	}
+}
@@ -0,0 +1,312 @@
+// Command replay re-drives a recorded AudioSocket trace against a server,
+// playing the part of Asterisk: the messages Asterisk originally sent are
+// written with their recorded timing, scaled by -speed, and the server's
+// responses are read back and timed.
+//
+// A speed of 1 replays in real time, N replays N times faster and 0 replays
+// as fast as possible.  -max-gap compresses long pauses in the original
+// traffic without changing the timing of the frames around them.  With
+// -record, the replayed session is itself written as a trace, so that runs
+// against different builds can be compared with -compare:
+//
+//	replay -addr localhost:8080 -record new.astrace call.astrace
+//	replay -compare call.astrace new.astrace
+package main
+
+import (
+	"bufio"
+	"flag"
+	"fmt"
+	"io"
+	"log"
+	"net"
+	"os"
+	"sort"
+	"sync"
+	"time"
+
+	"github.com/CyCoreSystems/audiosocket"
+	"github.com/gofrs/uuid"
+	"github.com/pkg/errors"
+)
+
+var (
+	addr    = flag.String("addr", "localhost:8080", "AudioSocket server address")
+	speed   = flag.Float64("speed", 1, "replay speed multiplier; 0 replays as fast as possible")
+	maxGap  = flag.Duration("max-gap", 0, "compress pauses between sent messages to at most this long (0 keeps them)")
+	calls   = flag.Int("calls", 1, "number of concurrent replays of each trace")
+	newID   = flag.Bool("new-id", true, "replace the recorded call ID with a fresh one for each replay")
+	linger  = flag.Duration("linger", 2*time.Second, "time to keep reading responses after the last message is sent")
+	record  = flag.String("record", "", "write the replayed session to this trace file (suffixed with the replay number when -calls > 1)")
+	compare = flag.Bool("compare", false, "print the timing summary of each trace argument instead of replaying")
+)
+
+func main() {
+	flag.Parse()
+
+	if flag.NArg() < 1 {
+		log.Fatalln("usage: replay [flags] trace...")
+	}
+
+	if *compare {
+		for _, name := range flag.Args() {
+			s, err := summarizeFile(name)
+			if err != nil {
+				log.Fatalln("failed to read trace:", err)
+			}
+			s.Print(os.Stdout, name)
+		}
+		return
+	}
+
+	for _, name := range flag.Args() {
+		records, err := loadTrace(name)
+		if err != nil {
+			log.Fatalln("failed to read trace:", err)
+		}
+		summarize(records).Print(os.Stdout, name+" (original)")
+
+		var wg sync.WaitGroup
+		results := make([][]*audiosocket.TraceRecord, *calls)
+		for i := 0; i < *calls; i++ {
+			wg.Add(1)
+			go func(i int) {
+				defer wg.Done()
+
+				var err error
+				results[i], err = replay(records, recordName(i))
+				if err != nil {
+					log.Printf("replay %d of %s failed: %v", i, name, err)
+				}
+			}(i)
+		}
+		wg.Wait()
+
+		var all []*audiosocket.TraceRecord
+		for _, r := range results {
+			all = append(all, r...)
+		}
+		s := summarize(all)
+		s.calls = *calls
+		s.Print(os.Stdout, name+" (replay)")
+	}
+}
+
+func recordName(i int) string {
+	if *record == "" || *calls == 1 {
+		return *record
+	}
+	return fmt.Sprintf("%s.%d", *record, i)
+}
+
+func loadTrace(name string) ([]*audiosocket.TraceRecord, error) {
+	f, err := os.Open(name)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+
+	tr, err := audiosocket.NewTraceReader(f)
+	if err != nil {
+		return nil, err
+	}
+
+	var out []*audiosocket.TraceRecord
+	for {
+		rec, err := tr.Next()
+		if err == io.EOF {
+			return out, nil
+		}
+		if err != nil {
+			return out, err
+		}
+		out = append(out, rec)
+	}
+}
+
+// replay sends the messages Asterisk sent in the trace, and returns the
+// session as observed by the replay, with offsets relative to its start
+func replay(records []*audiosocket.TraceRecord, recordTo string) ([]*audiosocket.TraceRecord, error) {
+	c, err := net.Dial("tcp", *addr)
+	if err != nil {
+		return nil, errors.Wrapf(err, "failed to connect to %s", *addr)
+	}
+	defer c.Close()
+
+	var tw *audiosocket.TraceWriter
+	if recordTo != "" {
+		if tw, err = audiosocket.CreateTrace(recordTo); err != nil {
+			return nil, err
+		}
+		defer tw.Close()
+	}
+
+	var mu sync.Mutex
+	var observed []*audiosocket.TraceRecord
+	start := time.Now()
+	observe := func(dir audiosocket.TraceDirection, m audiosocket.Message) {
+		now := time.Since(start)
+		if tw != nil {
+			tw.WriteMessage(dir, m)
+		}
+		mu.Lock()
+		observed = append(observed, &audiosocket.TraceRecord{Direction: dir, Offset: now, Message: m})
+		mu.Unlock()
+	}
+
+	done := make(chan struct{})
+	go func() {
+		defer close(done)
+		r := bufio.NewReader(c)
+		for {
+			m, err := audiosocket.NextMessage(r)
+			if err != nil {
+				return
+			}
+			observe(audiosocket.TraceToAsterisk, m)
+			if m.Kind() == audiosocket.KindHangup {
+				return
+			}
+		}
+	}()
+
+	// finish stops the reader by closing the connection, so that neither
+	// observed nor the trace writer is used once replay has returned
+	finish := func() []*audiosocket.TraceRecord {
+		c.Close()
+		<-done
+		return observed
+	}
+
+	// Schedule each message relative to the previous one so that -max-gap
+	// only removes the excess of a long pause
+	var due, prev time.Duration
+	for _, rec := range records {
+		if rec.Direction != audiosocket.TraceFromAsterisk {
+			continue
+		}
+
+		gap := rec.Offset - prev
+		prev = rec.Offset
+		if *maxGap > 0 && gap > *maxGap {
+			gap = *maxGap
+		}
+		if *speed > 0 {
+			due += time.Duration(float64(gap) / *speed)
+			if d := time.Until(start.Add(due)); d > 0 {
+				time.Sleep(d)
+			}
+		}
+
+		m := rec.Message
+		if *newID && m.Kind() == audiosocket.KindID {
+			id, err := uuid.NewV4()
+			if err != nil {
+				finish()
+				return nil, errors.Wrap(err, "failed to generate call ID")
+			}
+			m = audiosocket.IDMessage(id)
+		}
+
+		select {
+		case <-done:
+			// The server has hung up
+			return finish(), nil
+		default:
+		}
+		if _, err := c.Write(m); err != nil {
+			return finish(), errors.Wrap(err, "failed to write message")
+		}
+		observe(audiosocket.TraceFromAsterisk, m)
+	}
+
+	select {
+	case <-done:
+	case <-time.After(*linger):
+	}
+
+	return finish(), nil
+}
+
+// summary describes the timing of the server's side of one or more sessions
+type summary struct {
+	calls int
+
+	sent     int
+	received int
+
+	// firstAudio holds, per session, the time from the ID message to the
+	// first audio sent by the server
+	firstAudio []time.Duration
+
+	// gaps holds the inter-arrival times of consecutive audio frames sent
+	// by the server, excluding pauses of a second or more
+	gaps []time.Duration
+}
+
+func summarizeFile(name string) (*summary, error) {
+	records, err := loadTrace(name)
+	if err != nil {
+		return nil, err
+	}
+	return summarize(records), nil
+}
+
+// summarize computes the summary of a list of records, which may contain
+// several sessions; each ID message starts a new one
+func summarize(records []*audiosocket.TraceRecord) *summary {
+	s := &summary{calls: 1}
+
+	var idAt, last time.Duration
+	var haveID, haveAudio bool
+	for _, rec := range records {
+		if rec.Direction == audiosocket.TraceFromAsterisk {
+			s.sent++
+			if rec.Message.Kind() == audiosocket.KindID {
+				idAt, haveID, haveAudio = rec.Offset, true, false
+			}
+			continue
+		}
+
+		s.received++
+		if rec.Message.Kind() != audiosocket.KindSlin {
+			continue
+		}
+		if !haveAudio {
+			if haveID {
+				s.firstAudio = append(s.firstAudio, rec.Offset-idAt)
+			}
+			haveAudio = true
+		} else if gap := rec.Offset - last; gap < time.Second {
+			s.gaps = append(s.gaps, gap)
+		}
+		last = rec.Offset
+	}
+	return s
+}
+
+func (s *summary) Print(w io.Writer, title string) {
+	fmt.Fprintf(w, "--- %s: sessions=%d sent=%d received=%d\n", title, s.calls, s.sent, s.received)
+	fmt.Fprintf(w, "    %-12s %8s %10s %10s %10s %10s\n", "", "count", "p50", "p90", "p99", "max")
+	printDist(w, "first-audio", s.firstAudio)
+	printDist(w, "audio-gap", s.gaps)
+}
+
+func printDist(w io.Writer, name string, d []time.Duration) {
+	sort.Slice(d, func(i, j int) bool { return d[i] < d[j] })
+
+	q := func(p float64) string {
+		if len(d) == 0 {
+			return "-"
+		}
+		return fmtDuration(d[int(p*float64(len(d)-1)+0.5)])
+	}
+	fmt.Fprintf(w, "    %-12s %8d %10s %10s %10s %10s\n", name, len(d), q(0.5), q(0.9), q(0.99), q(1))
+}
+
+func fmtDuration(d time.Duration) string {
+	if d >= time.Second {
+		return fmt.Sprintf("%.2fs", d.Seconds())
+	}
+	return fmt.Sprintf("%.2fms", float64(d)/float64(time.Millisecond))
+}
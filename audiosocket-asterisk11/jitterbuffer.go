@@ -0,0 +1,457 @@
+package audiosocket
+
+import (
+	"context"
+	"encoding/binary"
+	"io"
+	"math"
+	"sync"
+	"time"
+
+	"github.com/pkg/errors"
+)
+
+// DefaultFrameDuration is the duration of audio carried by each slin message
+// sent by Asterisk
+const DefaultFrameDuration = 20 * time.Millisecond
+
+// jitterPeakDecay is the per-frame decay of the peak inter-arrival deviation
+// used to size the buffer; it halves roughly every seven seconds at 20ms
+// frames, so the buffer shrinks slowly once the network calms down.
+const jitterPeakDecay = 0.998
+
+// jitterGrowTicks is the number of consecutive ticks the buffer must hold
+// less than its target depth before a frame is inserted to grow it
+const jitterGrowTicks = 5
+
+// jitterShrinkTicks is the number of consecutive ticks the buffer must hold
+// more than one frame above its target depth before a frame is discarded to
+// reduce latency
+const jitterShrinkTicks = 50
+
+// JitterBufferOptions configures a JitterBuffer.  Zero values select the
+// defaults.
+type JitterBufferOptions struct {
+	// FrameDuration is the cadence at which frames are emitted.  Defaults to
+	// DefaultFrameDuration.
+	FrameDuration time.Duration
+
+	// FrameSize is the size in bytes of a silence frame when no audio has
+	// yet been received.  Defaults to DefaultSlinChunkSize.
+	FrameSize int
+
+	// MinDepth and MaxDepth bound the adaptive depth of the buffer, in
+	// frames.  They default to 1 and 10.
+	MinDepth int
+	MaxDepth int
+
+	// ConcealFrames is the number of consecutive missing frames which are
+	// concealed by repeating the last frame at decreasing volume before
+	// silence is substituted.  Defaults to 3; a negative value always uses
+	// silence.
+	ConcealFrames int
+}
+
+// JitterStats describes the state of a JitterBuffer
+type JitterStats struct {
+	// Depth is the number of frames currently buffered
+	Depth int
+
+	// Target is the depth the buffer is currently adapting towards
+	Target int
+
+	// Jitter is the smoothed inter-arrival jitter, as defined by RFC 3550
+	Jitter time.Duration
+
+	// Received is the number of frames pushed into the buffer
+	Received uint64
+
+	// Played is the number of received frames emitted
+	Played uint64
+
+	// Concealed is the number of concealment or silence frames emitted in
+	// place of missing audio
+	Concealed uint64
+
+	// Inserted is the number of concealment frames emitted to grow the
+	// buffer towards its target depth
+	Inserted uint64
+
+	// Late is the number of frames which arrived after their slot had
+	// already been concealed
+	Late uint64
+
+	// Discarded is the number of frames dropped, either because they were
+	// late and the buffer was already at its target depth or to reduce the
+	// depth of the buffer
+	Discarded uint64
+}
+
+// Lost returns the number of concealed frames whose audio never arrived
+func (s JitterStats) Lost() uint64 {
+	if s.Late > s.Concealed {
+		return 0
+	}
+	return s.Concealed - s.Late
+}
+
+// JitterBuffer smooths the bursty arrival of audio from an AudioSocket
+// connection into a steady cadence of frames.  Its depth adapts to the
+// measured inter-arrival variance, and gaps in the audio are filled with
+// concealment or silence frames so that the consumer always receives one
+// frame per interval.
+//
+// Frames may be fed manually with Push and Pop, or Start may be used to read
+// an AudioSocket connection and emit frames on a channel.
+type JitterBuffer struct {
+	opts JitterBufferOptions
+
+	mu sync.Mutex
+
+	queue [][]byte
+	head  int
+	n     int
+
+	target  int
+	playing bool
+	closed  bool
+	deficit int
+	excess  int
+
+	// owed is the number of slots concealed whose frames may yet arrive
+	owed int
+
+	last    []byte
+	lossRun int
+
+	lastArrival time.Time
+	jitter      float64
+	peak        float64
+
+	stats JitterStats
+
+	err error
+}
+
+// NewJitterBuffer returns a new JitterBuffer.  opts may be nil.
+func NewJitterBuffer(opts *JitterBufferOptions) *JitterBuffer {
+	var o JitterBufferOptions
+	if opts != nil {
+		o = *opts
+	}
+	if o.FrameDuration <= 0 {
+		o.FrameDuration = DefaultFrameDuration
+	}
+	if o.FrameSize < 1 {
+		o.FrameSize = DefaultSlinChunkSize
+	}
+	if o.MinDepth < 1 {
+		o.MinDepth = 1
+	}
+	if o.MaxDepth < 1 {
+		o.MaxDepth = 10
+	}
+	if o.MaxDepth < o.MinDepth {
+		o.MaxDepth = o.MinDepth
+	}
+	if o.ConcealFrames == 0 {
+		o.ConcealFrames = 3
+	}
+
+	return &JitterBuffer{
+		opts:   o,
+		queue:  make([][]byte, o.MaxDepth),
+		target: o.MinDepth,
+	}
+}
+
+// Push adds a frame of slin audio to the buffer.  The buffer takes ownership
+// of the frame, which must not be modified afterwards.
+func (jb *JitterBuffer) Push(frame []byte) {
+	jb.push(frame, time.Now())
+}
+
+func (jb *JitterBuffer) push(frame []byte, now time.Time) {
+	jb.mu.Lock()
+	defer jb.mu.Unlock()
+
+	jb.stats.Received++
+	jb.measure(now)
+
+	if jb.owed > 0 {
+		jb.owed--
+		jb.stats.Late++
+
+		// The slot has already been concealed; keeping the frame grows the
+		// buffer, which is only wanted if it is below its target depth.
+		if jb.n >= jb.target {
+			jb.stats.Discarded++
+			return
+		}
+	}
+
+	if jb.n == len(jb.queue) {
+		jb.dequeue()
+		jb.stats.Discarded++
+	}
+	jb.queue[(jb.head+jb.n)%len(jb.queue)] = frame
+	jb.n++
+}
+
+// measure updates the jitter estimates from the arrival time of a frame and
+// recomputes the target depth
+func (jb *JitterBuffer) measure(now time.Time) {
+	if !jb.lastArrival.IsZero() {
+		d := math.Abs(float64(now.Sub(jb.lastArrival) - jb.opts.FrameDuration))
+		jb.jitter += (d - jb.jitter) / 16
+
+		jb.peak *= jitterPeakDecay
+		if d > jb.peak {
+			jb.peak = d
+		}
+	}
+	jb.lastArrival = now
+
+	target := 1 + int(math.Ceil(jb.peak/float64(jb.opts.FrameDuration)))
+	if target < jb.opts.MinDepth {
+		target = jb.opts.MinDepth
+	}
+	if target > jb.opts.MaxDepth {
+		target = jb.opts.MaxDepth
+	}
+	jb.target = target
+}
+
+func (jb *JitterBuffer) dequeue() []byte {
+	f := jb.queue[jb.head]
+	jb.queue[jb.head] = nil
+	jb.head = (jb.head + 1) % len(jb.queue)
+	jb.n--
+	return f
+}
+
+// Pop returns the frame for the current interval and should be called once
+// per FrameDuration.  It returns nil while the buffer is initially filling to
+// its target depth; after that, it always returns a frame, substituting
+// concealment or silence if no audio is available.
+func (jb *JitterBuffer) Pop() []byte {
+	f, _ := jb.pop()
+	return f
+}
+
+// pop additionally reports whether any more frames will be produced
+func (jb *JitterBuffer) pop() ([]byte, bool) {
+	jb.mu.Lock()
+	defer jb.mu.Unlock()
+
+	if jb.closed && jb.n == 0 {
+		return nil, false
+	}
+
+	if !jb.playing {
+		if jb.n < jb.target && !jb.closed {
+			return nil, true
+		}
+		jb.playing = true
+	}
+
+	if jb.n == 0 {
+		// After a long gap the missing audio is not worth waiting for, so
+		// at most a buffer's worth of slots is remembered as owed.
+		if jb.owed < jb.opts.MaxDepth {
+			jb.owed++
+		}
+		jb.stats.Concealed++
+		return jb.conceal(), true
+	}
+
+	// Adapt the depth one frame at a time: grow quickly by inserting a
+	// concealment frame, and shrink slowly by discarding one, with a frame
+	// of hysteresis so that ordinary jitter does not trigger either.
+	switch {
+	case jb.n < jb.target && !jb.closed:
+		jb.excess = 0
+		jb.deficit++
+		if jb.deficit >= jitterGrowTicks {
+			jb.deficit = 0
+			jb.stats.Inserted++
+			return jb.conceal(), true
+		}
+	case jb.n > jb.target+1:
+		jb.deficit = 0
+		jb.excess++
+		if jb.excess >= jitterShrinkTicks {
+			jb.excess = 0
+			jb.dequeue()
+			jb.stats.Discarded++
+		}
+	default:
+		jb.deficit = 0
+		jb.excess = 0
+	}
+
+	f := jb.dequeue()
+	jb.last = f
+	jb.lossRun = 0
+	jb.stats.Played++
+	return f, true
+}
+
+// conceal returns a frame to stand in for missing audio: the last frame
+// received, attenuated further for each consecutive missing frame, and then
+// silence
+func (jb *JitterBuffer) conceal() []byte {
+	jb.lossRun++
+
+	size := jb.opts.FrameSize
+	if jb.last != nil {
+		size = len(jb.last)
+	}
+	out := make([]byte, size)
+
+	if jb.last == nil || jb.lossRun > jb.opts.ConcealFrames {
+		return out
+	}
+
+	gain := int32(jb.opts.ConcealFrames+1-jb.lossRun) * 256 / int32(jb.opts.ConcealFrames+1)
+	for i := 0; i+1 < len(jb.last); i += 2 {
+		s := int32(int16(binary.LittleEndian.Uint16(jb.last[i:])))
+		binary.LittleEndian.PutUint16(out[i:], uint16(int16(s*gain>>8)))
+	}
+	return out
+}
+
+// Close indicates that no more frames will be pushed.  The frames remaining
+// in the buffer are still returned by Pop.
+func (jb *JitterBuffer) Close() {
+	jb.mu.Lock()
+	jb.closed = true
+	jb.mu.Unlock()
+}
+
+// Stats returns the current statistics of the buffer
+func (jb *JitterBuffer) Stats() JitterStats {
+	jb.mu.Lock()
+	defer jb.mu.Unlock()
+
+	s := jb.stats
+	s.Depth = jb.n
+	s.Target = jb.target
+	s.Jitter = time.Duration(jb.jitter)
+	return s
+}
+
+// Err returns the error which ended the stream read by Start, if any.  A
+// hangup message is not considered an error.
+func (jb *JitterBuffer) Err() error {
+	jb.mu.Lock()
+	defer jb.mu.Unlock()
+	return jb.err
+}
+
+// Start reads messages from r, buffering any slin audio, and returns a
+// channel on which one frame is delivered every FrameDuration.  Messages
+// other than slin audio and hangup are ignored.
+//
+// The channel is closed once r returns an error or a hangup message and the
+// buffer has drained, or when ctx is cancelled.  Err then reports why the
+// stream ended.  The consumer must keep up with the cadence of the channel.
+//
+// When ctx is cancelled and r has a SetReadDeadline method, as a net.Conn
+// does, its read deadline is set to the past to stop the pending read, which
+// leaves r unusable for further reads.  Any other r must be closed by the
+// caller to stop the reading goroutine.
+func (jb *JitterBuffer) Start(ctx context.Context, r io.Reader) <-chan []byte {
+	out := make(chan []byte, 1)
+
+	go jb.read(ctx, r)
+	go jb.play(ctx, out)
+
+	return out
+}
+
+func (jb *JitterBuffer) read(ctx context.Context, r io.Reader) {
+	defer jb.Close()
+
+	if d, ok := r.(readDeadliner); ok {
+		stop := make(chan struct{})
+		defer close(stop)
+		go func() {
+			select {
+			case <-ctx.Done():
+				d.SetReadDeadline(time.Now())
+			case <-stop:
+			}
+		}()
+	}
+
+	for ctx.Err() == nil {
+		m, err := NextMessage(r)
+		if err != nil {
+			if ctx.Err() != nil {
+				jb.setErr(ctx.Err())
+			} else if errors.Cause(err) != io.EOF {
+				jb.setErr(err)
+			}
+			return
+		}
+
+		switch m.Kind() {
+		case KindHangup:
+			return
+		case KindSlin:
+			if m.ContentLength() > 0 {
+				jb.Push(m.Payload())
+			}
+		}
+	}
+}
+
+// readDeadliner is implemented by readers whose pending reads can be
+// interrupted, such as net.Conn
+type readDeadliner interface {
+	SetReadDeadline(t time.Time) error
+}
+
+// play emits frames on an absolute schedule, so that a late wakeup does not
+// delay every subsequent frame
+func (jb *JitterBuffer) play(ctx context.Context, out chan<- []byte) {
+	defer close(out)
+
+	t := time.NewTimer(time.Hour)
+	t.Stop()
+	defer t.Stop()
+
+	next := time.Now()
+	for {
+		f, more := jb.pop()
+		if !more {
+			return
+		}
+		if f != nil {
+			select {
+			case out <- f:
+			case <-ctx.Done():
+				jb.setErr(ctx.Err())
+				return
+			}
+		}
+
+		next = next.Add(jb.opts.FrameDuration)
+		t.Reset(time.Until(next))
+		select {
+		case <-t.C:
+		case <-ctx.Done():
+			jb.setErr(ctx.Err())
+			return
+		}
+	}
+}
+
+func (jb *JitterBuffer) setErr(err error) {
+	jb.mu.Lock()
+	if jb.err == nil {
+		jb.err = errors.Wrap(err, "jitter buffer stopped")
+	}
+	jb.mu.Unlock()
+}
@@ -0,0 +1,286 @@
+package audiosocket
+
+import (
+	"bufio"
+	"encoding/binary"
+	"io"
+	"net"
+	"os"
+	"sync"
+	"time"
+
+	"github.com/pkg/errors"
+)
+
+// A trace records the raw AudioSocket messages of a connection in both
+// directions, so that a session can be inspected or replayed later.  The
+// format is:
+//
+//	header:  "ASTRACE" 0x01, then the start time as big-endian int64 Unix nanoseconds
+//	record:  direction byte, uvarint microseconds since the previous record,
+//	         then the complete AudioSocket message (header and payload)
+//
+// At one 20ms slin frame per direction, each record adds two or three bytes
+// to the message itself.
+
+// traceMagic identifies a trace file and its version
+var traceMagic = [8]byte{'A', 'S', 'T', 'R', 'A', 'C', 'E', 1}
+
+// TraceDirection indicates which side of the connection sent a traced message
+type TraceDirection byte
+
+const (
+	// TraceFromAsterisk marks a message sent by Asterisk to the server
+	TraceFromAsterisk TraceDirection = 0x00
+
+	// TraceToAsterisk marks a message sent by the server to Asterisk
+	TraceToAsterisk TraceDirection = 0x01
+)
+
+// TraceRecord is a single message read from a trace
+type TraceRecord struct {
+	// Direction indicates which side sent the message
+	Direction TraceDirection
+
+	// Offset is the time at which the message was recorded, relative to the
+	// start of the trace
+	Offset time.Duration
+
+	// Message is the complete AudioSocket message
+	Message Message
+}
+
+// TraceWriter records AudioSocket messages to a trace.  It is safe for
+// concurrent use, so both directions of a connection may share one writer.
+type TraceWriter struct {
+	mu sync.Mutex
+
+	w *bufio.Writer
+	c io.Closer
+
+	start time.Time
+	last  time.Time
+
+	hdr [1 + binary.MaxVarintLen64]byte
+
+	err error
+}
+
+// NewTraceWriter starts a new trace on w.  If w is also an io.Closer, it is
+// closed by Close.
+func NewTraceWriter(w io.Writer) (*TraceWriter, error) {
+	tw := &TraceWriter{
+		w:     bufio.NewWriter(w),
+		start: time.Now(),
+	}
+	tw.last = tw.start
+	if c, ok := w.(io.Closer); ok {
+		tw.c = c
+	}
+
+	var hdr [16]byte
+	copy(hdr[:], traceMagic[:])
+	binary.BigEndian.PutUint64(hdr[8:], uint64(tw.start.UnixNano()))
+	if _, err := tw.w.Write(hdr[:]); err != nil {
+		return nil, errors.Wrap(err, "failed to write trace header")
+	}
+	return tw, nil
+}
+
+// CreateTrace creates the named file and starts a new trace in it
+func CreateTrace(name string) (*TraceWriter, error) {
+	f, err := os.Create(name)
+	if err != nil {
+		return nil, errors.Wrap(err, "failed to create trace file")
+	}
+	tw, err := NewTraceWriter(f)
+	if err != nil {
+		f.Close()
+		return nil, err
+	}
+	return tw, nil
+}
+
+// WriteMessage records a message sent in the given direction, timestamped
+// with the current time.  Once a write has failed, all subsequent writes
+// return the same error.
+func (tw *TraceWriter) WriteMessage(dir TraceDirection, m Message) error {
+	now := time.Now()
+
+	tw.mu.Lock()
+	defer tw.mu.Unlock()
+
+	if tw.err != nil {
+		return tw.err
+	}
+
+	delta := now.Sub(tw.last)
+	if delta < 0 {
+		delta = 0
+	}
+	// Advance by whole microseconds only, so that rounding errors do not
+	// accumulate over a long trace
+	delta -= delta % time.Microsecond
+	tw.last = tw.last.Add(delta)
+
+	tw.hdr[0] = byte(dir)
+	n := 1 + binary.PutUvarint(tw.hdr[1:], uint64(delta/time.Microsecond))
+	if _, err := tw.w.Write(tw.hdr[:n]); err != nil {
+		tw.err = errors.Wrap(err, "failed to write trace record")
+		return tw.err
+	}
+	if _, err := tw.w.Write(m); err != nil {
+		tw.err = errors.Wrap(err, "failed to write trace record")
+		return tw.err
+	}
+	return nil
+}
+
+// Flush writes any buffered records to the underlying writer
+func (tw *TraceWriter) Flush() error {
+	tw.mu.Lock()
+	defer tw.mu.Unlock()
+
+	if tw.err != nil {
+		return tw.err
+	}
+	if err := tw.w.Flush(); err != nil {
+		tw.err = errors.Wrap(err, "failed to flush trace")
+	}
+	return tw.err
+}
+
+// Close flushes the trace and closes the underlying writer, if it is closable
+func (tw *TraceWriter) Close() error {
+	err := tw.Flush()
+	if tw.c != nil {
+		if cerr := tw.c.Close(); err == nil && cerr != nil {
+			err = errors.Wrap(cerr, "failed to close trace")
+		}
+	}
+	return err
+}
+
+// TraceReader reads the records of a trace
+type TraceReader struct {
+	r      *bufio.Reader
+	start  time.Time
+	offset time.Duration
+}
+
+// NewTraceReader reads the trace header from r and returns a reader for its
+// records
+func NewTraceReader(r io.Reader) (*TraceReader, error) {
+	br := bufio.NewReader(r)
+
+	var hdr [16]byte
+	if _, err := io.ReadFull(br, hdr[:]); err != nil {
+		return nil, errors.Wrap(err, "failed to read trace header")
+	}
+	for i := range traceMagic {
+		if hdr[i] != traceMagic[i] {
+			return nil, errors.New("not an AudioSocket trace")
+		}
+	}
+
+	return &TraceReader{
+		r:     br,
+		start: time.Unix(0, int64(binary.BigEndian.Uint64(hdr[8:]))),
+	}, nil
+}
+
+// Start returns the wall clock time at which the trace was started
+func (tr *TraceReader) Start() time.Time {
+	return tr.start
+}
+
+// Next returns the next record of the trace, or io.EOF at its end
+func (tr *TraceReader) Next() (*TraceRecord, error) {
+	dir, err := tr.r.ReadByte()
+	if err != nil {
+		return nil, err
+	}
+
+	delta, err := binary.ReadUvarint(tr.r)
+	if err != nil {
+		return nil, errors.Wrap(err, "failed to read trace record timestamp")
+	}
+	tr.offset += time.Duration(delta) * time.Microsecond
+
+	m, err := NextMessage(tr.r)
+	if err != nil {
+		return nil, errors.Wrap(err, "failed to read trace record message")
+	}
+
+	return &TraceRecord{
+		Direction: TraceDirection(dir),
+		Offset:    tr.offset,
+		Message:   m,
+	}, nil
+}
+
+// TapConn wraps the server side of an AudioSocket connection, recording each
+// complete message read from it as TraceFromAsterisk and each message written
+// to it as TraceToAsterisk.  Errors writing the trace never affect the
+// connection itself.
+type TapConn struct {
+	net.Conn
+
+	tw *TraceWriter
+
+	in  traceFramer
+	out traceFramer
+}
+
+// NewTapConn returns a connection which records the traffic of c to tw
+func NewTapConn(c net.Conn, tw *TraceWriter) *TapConn {
+	return &TapConn{
+		Conn: c,
+		tw:   tw,
+		in:   traceFramer{dir: TraceFromAsterisk},
+		out:  traceFramer{dir: TraceToAsterisk},
+	}
+}
+
+// Read implements io.Reader
+func (t *TapConn) Read(p []byte) (int, error) {
+	n, err := t.Conn.Read(p)
+	if n > 0 {
+		t.in.feed(t.tw, p[:n])
+	}
+	return n, err
+}
+
+// Write implements io.Writer
+func (t *TapConn) Write(p []byte) (int, error) {
+	n, err := t.Conn.Write(p)
+	if n > 0 {
+		t.out.feed(t.tw, p[:n])
+	}
+	return n, err
+}
+
+// traceFramer reassembles messages from the arbitrary chunks in which a
+// stream is read or written, so that each is recorded whole when its last
+// byte passes.
+type traceFramer struct {
+	dir TraceDirection
+	buf []byte
+}
+
+func (f *traceFramer) feed(tw *TraceWriter, p []byte) {
+	f.buf = append(f.buf, p...)
+
+	off := 0
+	for len(f.buf)-off >= 3 {
+		size := 3 + int(binary.BigEndian.Uint16(f.buf[off+1:off+3]))
+		if len(f.buf)-off < size {
+			break
+		}
+		tw.WriteMessage(f.dir, f.buf[off:off+size])
+		off += size
+	}
+
+	// Keep only the incomplete tail, reusing the buffer
+	f.buf = f.buf[:copy(f.buf, f.buf[off:])]
+}
@@ -1,5 +1,32 @@
 require('dotenv').config();
 const AsteriskManager = require('asterisk-manager');
+const ChannelCache = require('./ChannelCache.cjs');
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
+
+// How long an originated channel rings before it counts as not answered
+const ORIGINATE_RING_TIMEOUT = 30 * 1000;
+
+// Extra time for the OriginateResponse after the ring timeout
+const ORIGINATE_RESPONSE_GRACE = 10 * 1000;
+
+// Reason codes of a failed OriginateResponse
+const ORIGINATE_REASONS = {
+  0: 'no such channel or extension',
+  1: 'hung up',
+  3: 'no answer',
+  5: 'busy',
+  8: 'congestion',
+};
+
+// Failures of the network or the trunk rather than of the callee
+const RETRYABLE_REASONS = new Set([0, 8]);
+
+function originateError(message, reason, retryable) {
+  const error = new Error(message);
+  error.reason = reason;
+  error.retryable = retryable;
+  return error;
+}
 
 class AsteriskService {
   destructor() {
@@ -22,6 +49,19 @@ class AsteriskService {
 
     this.ami.keepConnected();
 
+    // Live channel table, kept from AMI events instead of dumped per request
+    this.channels = new ChannelCache(this.ami);
+
+    // Originates waiting for their OriginateResponse, by ActionID
+    this.pendingOriginates = new Map();
+    this.originateSequence = 0;
+    // asterisk-manager hands a message with both Response and ActionID, as
+    // OriginateResponse has, to the emitter named after its ActionID rather
+    // than to managerevent; originateCall listens there, these cover the
+    // library versions that emit it as an event
+    this.ami.on('managerevent', (evt) => this.handleOriginateResponse(evt));
+    this.ami.on('originateresponse', (evt) => this.handleOriginateResponse(evt));
+
     this.ami.on('connect', () => {
       console.log('[Asterisk AMI] Connected');
     });
@@ -35,35 +75,111 @@ class AsteriskService {
     });
   }
 
+  /**
+   * Dials a channel and connects it to the bridge once answered
+   * The Originate is sent async and matched to its OriginateResponse by
+   * ActionID, so the AMI connection is not blocked while the channel rings.
+   * Without an OriginateResponse the call may still have been answered, so
+   * that failure is never retryable.
+   * @param {string} channel The channel to dial, e.g. SIP/4930123@trunk
+   * @param {string} connectionId Passed to AudioSocket as the call ID
+   * @param {number} port The AudioSocket port of the call
+   * @returns {Promise<Object>} Resolves once the channel answered with
+   *   response, message, actionid, uniqueid and channel; rejects with an
+   *   error carrying the Asterisk reason code and whether a retry may succeed
+   */
   async originateCall(channel, connectionId, port = 5051) {
     return new Promise((resolve, reject) => {
       const host = process.env.AUDIOSOCKET_HOST || 'dev.dial24.net';
-      
-      this.ami.action({
+      let actionId = `originate-${process.pid}-${++this.originateSequence}`;
+
+      // Receives the messages the library routes by ActionID after the
+      // action callback has had the "successfully queued" reply
+      const onActionMessage = (err, res) => this.handleOriginateResponse(res || err || {});
+
+      // The error callback and the response or timeout may both report the
+      // same originate; only the first counts
+      let settled = false;
+      const finish = (error, evt) => {
+        if (settled) return;
+        settled = true;
+        this.pendingOriginates.delete(actionId);
+        this.ami.removeListener(actionId, onActionMessage);
+        timeout.cancel();
+        if (error) {
+          console.error(`Originate failed for connection ${connectionId}: ${error.message}`);
+          reject(error);
+        } else {
+          console.log(`Originate answered for connection ${connectionId} using port ${port}: ${evt.channel || channel}`);
+          resolve({
+            response: 'Success',
+            message: 'Originate successfully queued',
+            actionid: actionId,
+            uniqueid: evt.uniqueid,
+            channel: evt.channel || channel,
+          });
+        }
+      };
+      const timeout = sharedTimerWheel.schedule(ORIGINATE_RING_TIMEOUT + ORIGINATE_RESPONSE_GRACE, () => {
+        finish(originateError('No OriginateResponse received', null, false));
+      });
+
+      const requestedId = actionId;
+      this.pendingOriginates.set(actionId, finish);
+      actionId = this.ami.action({
         action: 'Originate',
+        actionid: actionId,
         channel: channel,
         callerid: '4921612963110 <4921612963110>',
         application: 'AudioSocket',
         data: `${connectionId},${host}:${port}`, // Now use dynamic port
+        variable: `AUDIOSOCKET_ID=${connectionId}`, // Marks the channel for the channel cache
+        timeout: ORIGINATE_RING_TIMEOUT,
+        async: 'true',
       }, (err, res) => {
-        if (err) {
-          console.error('Originate error:', err);
-          reject(err);
-        } else {
-          console.log(`Originate response for connection ${connectionId} using port ${port}:`, res);
-          resolve(res);
+        const message = res || err || {};
+        if (String(message.event).toLowerCase() === 'originateresponse') {
+          this.handleOriginateResponse(message);
+        } else if (err) {
+          finish(originateError(err.message || 'Originate rejected', null, true));
+        } else if (res && res.response === 'Error') {
+          finish(originateError(res.message || 'Originate rejected', null, true));
         }
-      });
+      }) || actionId;
+      if (actionId !== requestedId && this.pendingOriginates.delete(requestedId)) {
+        this.pendingOriginates.set(actionId, finish);
+      }
+      if (this.pendingOriginates.has(actionId)) this.ami.on(actionId, onActionMessage);
     });
   }
 
+  /**
+   * Settles the pending originate an OriginateResponse belongs to; later
+   * copies of the same response find nothing pending
+   */
+  handleOriginateResponse(evt) {
+    if (String(evt.event).toLowerCase() !== 'originateresponse') return;
+    const finish = this.pendingOriginates.get(evt.actionid);
+    if (!finish) return;
+    if (evt.response === 'Success') {
+      finish(null, evt);
+    } else {
+      const reason = parseInt(evt.reason, 10);
+      const description = ORIGINATE_REASONS[reason] || `reason ${evt.reason}`;
+      finish(originateError(`Call not answered: ${description}`, reason, RETRYABLE_REASONS.has(reason)));
+    }
+  }
+
   async hangupCall(channel) {
     return new Promise((resolve, reject) => {
       this.ami.action({
         action: 'Hangup',
         channel: channel
       }, (err, res) => {
-        if (err) {
+        const message = res || err || {};
+        if (String(message.event).toLowerCase() === 'originateresponse') {
+          this.handleOriginateResponse(message);
+        } else if (err) {
           console.error('Hangup error:', err);
           reject(err);
         } else {
@@ -74,46 +190,13 @@ class AsteriskService {
     });
   }
 
-  async getChannels() {
-    return new Promise((resolve, reject) => {
-        const channelList = [];
-        
-        // Create a named handler function that we can remove later
-        const eventHandler = (evt) => {
-            if (evt.event === 'CoreShowChannel') {
-                if (evt.channel.match(/^AudioSocket/) || evt.application.match(/^AudioSocket/)  || evt.applicationdata.match(/^AudioSocket/)) {
-                    let audioSocketPort = null;
-                    const match = evt.channel.match(/:(\d+)-/);
-                    if (match) {
-                        audioSocketPort = parseInt(match[1], 10);
-                    }
-                    channelList.push({ ...evt, audioSocketPort });
-                }
-            } else if (evt.event === 'CoreShowChannelsComplete') {
-                // Remove the listener before resolving
-                this.ami.removeListener('managerevent', eventHandler);
-                resolve(channelList || null);
-            }
-        };
-
-        // Add the listener
-        this.ami.on('managerevent', eventHandler);
-        
-        this.ami.action({ action: 'CoreShowChannels' }, (err) => {
-            if (err) {
-              console.error('CoreShowChannels error:', err);
-              // Remove listener on error too to prevent leak
-              this.ami.removeListener('managerevent', eventHandler);
-              reject(err);
-            }
-        });
-        
-        // Optional: Add a timeout to prevent hanging promises
-        setTimeout(() => {
-            this.ami.removeListener('managerevent', eventHandler);
-            reject(new Error('CoreShowChannels timed out'));
-        }, 10000); // 10 second timeout
-    });
+  /**
+   * The active AudioSocket channels from the channel cache
+   * @returns {Object} { version, channels }; later 'diff' events of
+   *   this.channels apply on top of it
+   */
+  getChannels() {
+    return this.channels.snapshot();
   }
 
   async transferCall(extension) {
@@ -170,6 +253,7 @@ class AsteriskService {
   }
 
   disconnect() {
+    this.channels.close();
     this.ami.disconnect();
   }
 }
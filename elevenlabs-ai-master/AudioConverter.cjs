@@ -0,0 +1,218 @@
+const NativeAudio = require('./NativeAudio.cjs');
+
+// AudioSocket always carries 8kHz 16-bit signed linear audio
+const ASTERISK_FORMAT = 'pcm_8000';
+
+// Format ElevenLabs uses when an agent's config does not name one
+const ELEVENLABS_DEFAULT_FORMAT = 'pcm_16000';
+
+// Same filter design as native/resampler.cc
+const BASE_TAPS = 16;
+const KAISER_BETA = 7;
+const ROLLOFF = 0.9;
+
+function besselI0(x) {
+  let sum = 1;
+  let term = 1;
+  for (let k = 1; k < 50; k++) {
+    term *= (x / (2 * k)) ** 2;
+    sum += term;
+    if (term < 1e-12 * sum) break;
+  }
+  return sum;
+}
+
+function gcd(a, b) {
+  while (b) [a, b] = [b, a % b];
+  return a;
+}
+
+/**
+ * JsResampler - JavaScript version of the native polyphase resampler
+ * Used when the addon is not built; converts 16-bit signed linear audio
+ * between two rates, keeping its filter history between calls
+ */
+class JsResampler {
+  constructor(inRate, outRate) {
+    this.inRate = inRate;
+    this.outRate = outRate;
+    const g = gcd(inRate, outRate);
+    this.up = outRate / g;
+    this.down = inRate / g;
+    this.taps = BASE_TAPS * Math.ceil(this.down / this.up);
+
+    const length = this.up * this.taps;
+    const cutoff = ROLLOFF * 0.5 / Math.max(this.up, this.down);
+    const center = (length - 1) / 2;
+    const norm = besselI0(KAISER_BETA);
+    const prototype = new Float64Array(length);
+    for (let n = 0; n < length; n++) {
+      const t = n - center;
+      const sinc = t === 0 ? 2 * cutoff : Math.sin(2 * Math.PI * cutoff * t) / (Math.PI * t);
+      const r = 2 * n / (length - 1) - 1;
+      const window = besselI0(KAISER_BETA * Math.sqrt(Math.max(0, 1 - r * r))) / norm;
+      prototype[n] = sinc * window * this.up;
+    }
+
+    // Phase p holds prototype[p + k * L] for k = taps - 1 down to 0
+    this.bank = new Float32Array(this.up * this.taps);
+    for (let p = 0; p < this.up; p++) {
+      for (let j = 0; j < this.taps; j++) {
+        this.bank[p * this.taps + j] = prototype[p + (this.taps - 1 - j) * this.up];
+      }
+    }
+    this.reset();
+  }
+
+  reset() {
+    this.history = new Float32Array(this.taps - 1);
+    this.pos = this.taps - 1;
+    this.phase = 0;
+  }
+
+  process(buffer) {
+    const samples = buffer.length >> 1;
+    const x = new Float32Array(this.history.length + samples);
+    x.set(this.history);
+    for (let i = 0; i < samples; i++) {
+      x[this.history.length + i] = buffer.readInt16LE(i * 2);
+    }
+
+    const out = Buffer.allocUnsafe((Math.floor(samples * this.up / this.down) + 2) * 2);
+    let count = 0;
+    const { taps, up, down, bank } = this;
+    while (this.pos < x.length) {
+      const start = this.pos + 1 - taps;
+      const h = this.phase * taps;
+      let y = 0;
+      for (let j = 0; j < taps; j++) y += bank[h + j] * x[start + j];
+      out.writeInt16LE(Math.max(-32768, Math.min(32767, Math.round(y))), count * 2);
+      count++;
+
+      this.phase += down;
+      this.pos += Math.floor(this.phase / up);
+      this.phase %= up;
+    }
+
+    const keepFrom = this.pos + 1 - taps;
+    this.history = x.slice(keepFrom);
+    this.pos -= keepFrom;
+    return out.subarray(0, count * 2);
+  }
+}
+
+/**
+ * Creates a stateful resampler, native when the addon is built
+ * @param {number} inRate Input sample rate
+ * @param {number} outRate Output sample rate
+ * @returns {Object} process(buffer) and reset()
+ */
+function createResampler(inRate, outRate) {
+  if (NativeAudio.addon?.Resampler) return new NativeAudio.addon.Resampler(inRate, outRate);
+  return new JsResampler(inRate, outRate);
+}
+
+/**
+ * Parses an ElevenLabs audio format name such as pcm_16000 or ulaw_8000
+ * @param {string} format The format name
+ * @returns {Object|null} encoding ('pcm' or 'ulaw') and sampleRate, or null
+ *   if the format is not supported
+ */
+function parseFormat(format) {
+  const match = /^(pcm|ulaw)_(\d+)$/.exec(format || '');
+  if (!match) return null;
+  return { encoding: match[1], sampleRate: parseInt(match[2], 10) };
+}
+
+/**
+ * AudioConverter - Converts one direction of a call's audio between formats
+ * Decodes mu-law input, resamples with continuity across chunks and encodes
+ * mu-law output as needed; audio already in the target format is passed
+ * through untouched.
+ */
+class AudioConverter {
+  /**
+   * @param {string} from Format of the input, e.g. pcm_8000
+   * @param {string} to Format of the output
+   */
+  constructor(from, to) {
+    this.from = parseFormat(from);
+    this.to = parseFormat(to);
+    if (!this.from || !this.to) {
+      throw new Error(`Unsupported audio conversion from ${from} to ${to}`);
+    }
+    this.format = `${from}>${to}`;
+    this.resampler = this.from.sampleRate === this.to.sampleRate
+      ? null
+      : createResampler(this.from.sampleRate, this.to.sampleRate);
+    this.passthrough = !this.resampler && this.from.encoding === this.to.encoding;
+    this.mulaw = this.from.encoding === 'ulaw' || this.to.encoding === 'ulaw' ? require('alawmulaw').mulaw : null;
+    this.oddByte = null; // Trailing byte of a pcm chunk split mid-sample
+  }
+
+  /**
+   * @param {Buffer} audio Audio in the input format
+   * @returns {Buffer} Audio in the output format; may be empty while the
+   *   resampler fills its history
+   */
+  convert(audio) {
+    if (this.passthrough) return audio;
+
+    let pcm = audio;
+    if (this.from.encoding === 'pcm') {
+      // Streamed chunks may split a sample; keep its first byte for the next chunk
+      if (this.oddByte) {
+        pcm = Buffer.concat([this.oddByte, pcm]);
+        this.oddByte = null;
+      }
+      if (pcm.length % 2 !== 0) {
+        this.oddByte = Buffer.from(pcm.subarray(pcm.length - 1));
+        pcm = pcm.subarray(0, pcm.length - 1);
+      }
+    } else {
+      const samples = this.mulaw.decode(audio);
+      pcm = Buffer.from(samples.buffer, samples.byteOffset, samples.byteLength);
+    }
+    if (this.resampler) {
+      pcm = this.resampler.process(pcm);
+    }
+    if (this.to.encoding === 'ulaw') {
+      const samples = new Int16Array(pcm.buffer.slice(pcm.byteOffset, pcm.byteOffset + pcm.length));
+      return Buffer.from(this.mulaw.encode(samples));
+    }
+    return pcm;
+  }
+
+  /**
+   * Drops the resampler history, e.g. when playout is interrupted
+   */
+  reset() {
+    if (this.resampler) this.resampler.reset();
+    this.oddByte = null;
+  }
+}
+
+/**
+ * Picks the formats of a call's ElevenLabs audio from the agent's stored
+ * ASR and TTS config
+ * @param {Object} asrConfig The agent's asr config
+ * @param {Object} ttsConfig The agent's tts config
+ * @returns {Object} inputFormat (caller audio sent) and outputFormat (agent
+ *   audio received)
+ */
+function formatsFromAgentConfig(asrConfig, ttsConfig) {
+  return {
+    inputFormat: asrConfig?.user_input_audio_format || ELEVENLABS_DEFAULT_FORMAT,
+    outputFormat: ttsConfig?.agent_output_audio_format || ELEVENLABS_DEFAULT_FORMAT,
+  };
+}
+
+module.exports = {
+  AudioConverter,
+  JsResampler,
+  createResampler,
+  parseFormat,
+  formatsFromAgentConfig,
+  ASTERISK_FORMAT,
+  ELEVENLABS_DEFAULT_FORMAT,
+};
@@ -0,0 +1,130 @@
+const EventEmitter = require('events');
+const { createLogger } = require('./Logger.cjs');
+
+const log = createLogger('AudioPacer');
+
+// Asterisk expects one 20ms slin frame per packet
+const FRAME_MS = 20;
+
+// If the event loop stalls for longer than this many frames, the pacer skips
+// the missed ticks instead of bursting them all out at once
+const MAX_CATCH_UP_FRAMES = 3;
+
+/**
+ * AudioPacer - A single process-wide playout clock for all calls
+ * Ticks on drift-corrected frame boundaries derived from a fixed epoch, and on
+ * every tick writes the next frame of each active stream. One timer serves any
+ * number of calls, so timer churn stays constant as calls are added.
+ *
+ * Streams registered with the pacer must implement writeNextFrame(), which
+ * writes at most one frame and returns false once the stream has nothing left
+ * to play; the stream is then unregistered until it is added again.
+ */
+class AudioPacer extends EventEmitter {
+  constructor(frameMs = FRAME_MS, maxCatchUpFrames = MAX_CATCH_UP_FRAMES) {
+    super();
+    this.frameNs = BigInt(Math.round(frameMs * 1e6));
+    this.maxCatchUpNs = this.frameNs * BigInt(maxCatchUpFrames);
+    this.streams = new Set();
+    this.timer = null;
+    this.epoch = 0n;
+    this.tickCount = 0n;
+    this.stats = {
+      ticks: 0,
+      framesWritten: 0,
+      lateTicks: 0,
+      maxLateMs: 0,
+      resyncs: 0,
+    };
+    this.tick = this.tick.bind(this);
+  }
+
+  /**
+   * Register a stream to receive a frame on every tick
+   * @param {Object} stream An object implementing writeNextFrame()
+   */
+  add(stream) {
+    this.streams.add(stream);
+    if (!this.timer) {
+      this.epoch = process.hrtime.bigint();
+      this.tickCount = 0n;
+      this.schedule();
+    }
+  }
+
+  /**
+   * Unregister a stream; the clock stops when no streams remain
+   * @param {Object} stream A previously added stream
+   */
+  remove(stream) {
+    this.streams.delete(stream);
+    if (this.streams.size === 0 && this.timer) {
+      clearTimeout(this.timer);
+      this.timer = null;
+    }
+  }
+
+  /**
+   * Schedule the next tick against the epoch rather than the previous tick,
+   * so timer lateness does not accumulate into drift
+   */
+  schedule() {
+    const due = this.epoch + (this.tickCount + 1n) * this.frameNs;
+    const delayMs = Number(due - process.hrtime.bigint()) / 1e6;
+    this.timer = setTimeout(this.tick, Math.max(0, delayMs));
+  }
+
+  tick() {
+    this.timer = null;
+    this.tickCount++;
+
+    const now = process.hrtime.bigint();
+    const lateNs = now - (this.epoch + this.tickCount * this.frameNs);
+    const lateMs = Number(lateNs) / 1e6;
+    if (lateMs >= 1) {
+      this.stats.lateTicks++;
+      if (lateMs > this.stats.maxLateMs) this.stats.maxLateMs = lateMs;
+    }
+    if (lateNs > this.maxCatchUpNs) {
+      log.warn('Event loop stalled for %sms, resynchronising clock', lateMs.toFixed(1));
+      this.stats.resyncs++;
+      this.epoch = now;
+      this.tickCount = 0n;
+    }
+
+    this.stats.ticks++;
+    for (const stream of this.streams) {
+      try {
+        if (stream.writeNextFrame()) {
+          this.stats.framesWritten++;
+        } else {
+          this.streams.delete(stream);
+        }
+      } catch (error) {
+        log.error('Error writing frame:', error);
+        this.streams.delete(stream);
+      }
+    }
+
+    if (this.streams.size > 0) {
+      this.schedule();
+    }
+  }
+
+  /**
+   * Get the pacer statistics
+   * @returns {Object} Tick counts, lateness and number of active streams
+   */
+  getStats() {
+    return { ...this.stats, activeStreams: this.streams.size };
+  }
+}
+
+// The shared pacer used by every StreamService in the process
+const sharedPacer = new AudioPacer();
+
+module.exports = {
+  AudioPacer,
+  sharedPacer,
+  FRAME_MS
+};
@@ -0,0 +1,75 @@
+const { Buffer } = require('buffer');
+const { Transform } = require('stream');
+const { createLogger } = require('./Logger.cjs');
+
+const log = createLogger('Audiosocket');
+
+// Every AudioSocket packet starts with a type byte and a big-endian length
+const HEADER_SIZE = 3;
+
+// Largest payload accepted by default; 20ms of 48kHz slin is 1920 bytes, so
+// anything much larger means the stream is corrupt or not AudioSocket at all
+const DEFAULT_MAX_PAYLOAD = 4096;
+
+/**
+ * AudioSocketDecoder - Streaming decoder for the AudioSocket protocol
+ * Accepts the raw byte stream from Asterisk in arbitrarily split chunks and
+ * emits each complete packet (header and payload) as a separate Buffer.
+ * Packets contained in a single chunk are emitted as subarray views of it
+ * without copying; only a packet split across chunks is reassembled.
+ */
+class AudioSocketDecoder extends Transform {
+  /**
+   * @param {Object} options
+   * @param {number} options.maxPayload Largest payload length accepted
+   */
+  constructor({ maxPayload = DEFAULT_MAX_PAYLOAD } = {}) {
+    super({ readableObjectMode: true });
+    this.maxPayload = maxPayload;
+    this.remainder = null; // Incomplete packet carried over to the next chunk
+    this.packets = 0;
+  }
+
+  _transform(chunk, encoding, callback) {
+    let buffer = chunk;
+    if (this.remainder) {
+      buffer = Buffer.concat([this.remainder, chunk]);
+      this.remainder = null;
+    }
+
+    let offset = 0;
+    while (buffer.length - offset >= HEADER_SIZE) {
+      const length = buffer.readUInt16BE(offset + 1);
+      if (length > this.maxPayload) {
+        callback(new Error(`AudioSocket packet of type 0x${buffer[offset].toString(16)} has oversized payload of ${length} bytes`));
+        return;
+      }
+
+      const end = offset + HEADER_SIZE + length;
+      if (end > buffer.length) break;
+
+      this.push(buffer.subarray(offset, end));
+      this.packets++;
+      offset = end;
+    }
+
+    if (offset < buffer.length) {
+      // Copy the tail so a large chunk is not kept alive by a few bytes
+      this.remainder = Buffer.from(buffer.subarray(offset));
+    }
+    callback();
+  }
+
+  _flush(callback) {
+    if (this.remainder) {
+      log.warn('Stream ended inside a packet, discarding %s bytes', this.remainder.length);
+      this.remainder = null;
+    }
+    callback();
+  }
+}
+
+module.exports = {
+  AudioSocketDecoder,
+  DEFAULT_MAX_PAYLOAD
+};
@@ -0,0 +1,163 @@
+const { normalizeChunkMs } = require('./UpstreamAggregator.cjs');
+const { formatsFromAgentConfig } = require('./AudioConverter.cjs');
+
+// How long per-agent rows are reused between calls
+const AGENT_TTL = 30000;
+
+/**
+ * TtlCache - Caches the promises of async lookups for a fixed time
+ * Concurrent lookups of the same key share one query. Failed lookups and
+ * null results are not kept.
+ */
+class TtlCache {
+  constructor(ttl) {
+    this.ttl = ttl;
+    this.entries = new Map();
+  }
+
+  get(key, load) {
+    const now = Date.now();
+    const entry = this.entries.get(key);
+    if (entry && entry.expires > now) return entry.value;
+
+    const value = load().then(
+      (result) => {
+        if (result == null) this.evict(key, value);
+        return result;
+      },
+      (error) => {
+        this.evict(key, value);
+        throw error;
+      }
+    );
+    this.entries.set(key, { value, expires: now + this.ttl });
+    return value;
+  }
+
+  evict(key, value) {
+    if (this.entries.get(key)?.value === value) this.entries.delete(key);
+  }
+
+  clear() {
+    this.entries.clear();
+  }
+}
+
+function parseJson(text) {
+  try {
+    return JSON.parse(text || '{}');
+  } catch (error) {
+    return {};
+  }
+}
+
+/**
+ * CallContextLoader - Loads the dialer context of an incoming call
+ * Remote agent rows change rarely and are cached per agent; the live agent
+ * and lead change with every call and are always queried. The lead data,
+ * custom fields and auto call are fetched concurrently, with the lead row
+ * taken from the custom fields query, which already joins it.
+ */
+class CallContextLoader {
+  constructor(dbManager, { agentTtl = AGENT_TTL } = {}) {
+    this.dbManager = dbManager;
+    this.remoteAgentsByPort = new TtlCache(agentTtl);
+    this.remoteAgentsByConference = new TtlCache(agentTtl);
+    this.agentSettings = new TtlCache(agentTtl);
+  }
+
+  getRemoteAgentByPort(port) {
+    return this.remoteAgentsByPort.get(port, async () => {
+      const [remoteAgent] = await this.dbManager.getActiveRemoteAgents(port);
+      return remoteAgent || null;
+    });
+  }
+
+  getRemoteAgentByConference(confExten, serverIp) {
+    return this.remoteAgentsByConference.get(`${confExten}@${serverIp}`,
+      () => this.dbManager.getRemoteAgentByConference(confExten, serverIp));
+  }
+
+  /**
+   * Gets the bridge settings of an ElevenLabs agent
+   * Agents without their own settings, or whose settings cannot be read, get
+   * the defaults from the environment. The audio formats come from the ASR
+   * and TTS config stored by saveAgentDb and are left out for unknown agents.
+   * @param {string} agentId The ElevenLabs agent ID
+   * @returns {Promise<Object>} upstreamChunkMs, inputFormat and outputFormat
+   */
+  getAgentSettings(agentId) {
+    const defaultChunkMs = normalizeChunkMs(process.env.ELEVENLABS_UPSTREAM_CHUNK_MS);
+    if (!agentId) return Promise.resolve({ upstreamChunkMs: defaultChunkMs });
+
+    return this.agentSettings.get(agentId, async () => {
+      const row = await this.dbManager.getAgentStreamSettings(agentId);
+      if (!row) return { upstreamChunkMs: defaultChunkMs };
+      return {
+        upstreamChunkMs: normalizeChunkMs(row.upstream_chunk_ms, defaultChunkMs),
+        ...formatsFromAgentConfig(parseJson(row.asr_config), parseJson(row.tts_config)),
+      };
+    }).catch((error) => {
+      console.error(`[CallContextLoader] Error getting settings of agent ${agentId}:`, error.message);
+      return { upstreamChunkMs: defaultChunkMs };
+    });
+  }
+
+  /**
+   * Loads the auto call and lead data of a lead concurrently
+   * @param {number} leadId The lead ID
+   * @param {PhaseTimer} timer Receives the 'lead' mark
+   * @param {string|number} tag Log tag of the connection
+   * @returns {Promise<Object>} autoCalls and leadData
+   */
+  async loadLead(leadId, timer, tag) {
+    const [autoCalls, leadData] = await Promise.all([
+      this.dbManager.getAutoCalls(leadId),
+      this.dbManager.getLeadDataCustomFields(leadId),
+    ]);
+    if (timer) timer.mark('lead');
+    if (autoCalls) {
+      console.log(`[Audiosocket:${tag}] Stream for Auto Calls - Phone No: ${autoCalls.phone_code}${autoCalls.phone_number} - Status: ${autoCalls.status} - CallTime: ${autoCalls.call_time} - CallType: ${autoCalls.call_type}`);
+    }
+    console.log(`[Audiosocket:${tag}] Lead Informations loaded`);
+    return { autoCalls, leadData: leadData || {} };
+  }
+
+  /**
+   * Loads the full context of a call on a remote agent's dedicated port
+   * Errors are logged and the context loaded so far is returned, so the call
+   * still proceeds
+   * @param {number} port The AudioSocket port of the remote agent
+   * @param {PhaseTimer} timer Receives the 'remote_agent', 'live_agent' and 'lead' marks
+   * @returns {Promise<Object>} remoteAgent, liveAgent, autoCalls and leadData
+   */
+  async loadByPort(port, timer) {
+    const context = {};
+    try {
+      context.remoteAgent = await this.getRemoteAgentByPort(port);
+      if (timer) timer.mark('remote_agent');
+      const { user_start, conf_exten, server_ip } = context.remoteAgent;
+      console.log(`[Audiosocket:${port}] Stream for Remote Agent - User: ${user_start} - Exten: ${conf_exten} - IP: ${server_ip}`);
+
+      context.liveAgent = await this.dbManager.getLiveAgents(user_start, conf_exten, server_ip);
+      if (timer) timer.mark('live_agent');
+      console.log(`[Audiosocket:${port}] Stream for Live Agent - User: ${context.liveAgent.lead_id} - Campaign: ${context.liveAgent.campaign_id} - Channel: ${context.liveAgent.channel} - Callserver: ${context.liveAgent.call_server_ip}`);
+
+      Object.assign(context, await this.loadLead(context.liveAgent.lead_id, timer, port));
+    } catch (error) {
+      console.error(`[Audiosocket-${port}] Error getting agent data:`, error);
+    }
+    return context;
+  }
+
+  /**
+   * Drops all cached agent rows and settings, e.g. after agents were reconfigured
+   */
+  invalidate() {
+    this.remoteAgentsByPort.clear();
+    this.remoteAgentsByConference.clear();
+    this.agentSettings.clear();
+  }
+}
+
+module.exports = CallContextLoader;
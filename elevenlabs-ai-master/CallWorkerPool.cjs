@@ -0,0 +1,223 @@
+const path = require('path');
+const { fork } = require('child_process');
+const EventEmitter = require('events');
+
+// How often workers report their load
+const REPORT_INTERVAL = 1000;
+
+// Delay before a crashed worker is replaced
+const RESPAWN_DELAY = 1000;
+
+/**
+ * CallWorkerPool - Runs call media in a pool of worker processes
+ * The main process keeps the control plane (dashboard API, database, AMI and
+ * call routing) and hands each accepted AudioSocket connection, before any of
+ * it is read, to the least-loaded worker. Workers run the decoder, pacer and
+ * ElevenLabs session of their calls on their own event loops, resolve call
+ * IDs through the main process and report their load periodically.
+ *
+ * Processes are used rather than worker_threads because only processes can
+ * receive socket handles.
+ */
+class CallWorkerPool extends EventEmitter {
+  /**
+   * @param {number} size Number of worker processes
+   * @param {PortManager} portManager Resolves call IDs and re-emits call events
+   */
+  constructor(size, portManager) {
+    super();
+    this.size = size;
+    this.portManager = portManager;
+    this.script = path.join(__dirname, 'callWorker.cjs');
+    this.workers = [];
+    this.stopping = false;
+  }
+
+  /**
+   * Starts all worker processes
+   */
+  start() {
+    for (let i = 0; i < this.size; i++) {
+      this.workers.push(this.spawn(i));
+    }
+    console.log(`[CallWorkerPool] Started ${this.size} call workers`);
+    return this;
+  }
+
+  spawn(index) {
+    const child = fork(this.script, [], {
+      serialization: 'advanced',
+      env: { ...process.env, CALL_WORKER_INDEX: String(index), CALL_WORKER_REPORT_INTERVAL: String(REPORT_INTERVAL) },
+    });
+    const worker = {
+      index,
+      child,
+      calls: 0, // Calls reported by the worker
+      pending: 0, // Connections dispatched since its last report
+      lagMs: 0,
+      lagMaxMs: 0,
+      rssBytes: 0,
+      queuedBytes: 0, // Agent audio queued for playout
+      shedCalls: 0, // Calls refused for lack of memory
+      reportedAt: 0,
+    };
+
+    child.on('message', (message) => this.handleMessage(worker, message));
+    child.on('error', (error) => {
+      console.error(`[CallWorkerPool] Worker ${index} error:`, error.message);
+    });
+    child.on('exit', (code, signal) => {
+      if (this.stopping) return;
+      console.error(`[CallWorkerPool] Worker ${index} exited (${signal || code}), restarting; its calls are lost`);
+      setTimeout(() => {
+        if (!this.stopping) this.workers[index] = this.spawn(index);
+      }, RESPAWN_DELAY);
+    });
+    return worker;
+  }
+
+  handleMessage(worker, message) {
+    switch (message.type) {
+      case 'load':
+        worker.calls = message.calls;
+        worker.pending = 0;
+        worker.lagMs = message.lagMs;
+        worker.lagMaxMs = message.lagMaxMs;
+        worker.rssBytes = message.rssBytes;
+        worker.queuedBytes = message.queuedBytes;
+        worker.shedCalls = message.shedCalls;
+        worker.reportedAt = Date.now();
+        this.emit('load', worker.index, message);
+        break;
+
+      case 'resolveCall':
+        // The context promise cannot cross processes, so the worker gets the
+        // call once its lead data has loaded, along with the agent settings
+        // it has no database to look up
+        this.portManager.resolveCall(message.callId)
+          .then(async (call) => {
+            if (call) {
+              const { context, ...rest } = call;
+              const [loaded, agentSettings] = await Promise.all([
+                context || {},
+                this.portManager.loadAgentSettings(rest.customParameters),
+              ]);
+              call = { ...rest, customParameters: { ...rest.customParameters, ...loaded, agentSettings } };
+            }
+            worker.child.send({ type: 'resolvedCall', requestId: message.requestId, call });
+          })
+          .catch((error) => {
+            console.error(`[CallWorkerPool] Error resolving call ${message.callId}:`, error);
+            worker.child.send({ type: 'resolvedCall', requestId: message.requestId, call: null });
+          });
+        break;
+
+      case 'event':
+        // Call events (transcripts, responses) are handled on the main thread
+        this.portManager.emit(message.name, message.payload);
+        break;
+
+      default:
+        console.warn(`[CallWorkerPool] Unknown message from worker ${worker.index}: ${message.type}`);
+    }
+  }
+
+  /**
+   * Picks the worker for a new call: fewest calls including those dispatched
+   * since its last report, then lowest event loop lag
+   */
+  leastLoaded() {
+    let best = null;
+    for (const worker of this.workers) {
+      if (!worker.child.connected) continue;
+      if (!best) {
+        best = worker;
+        continue;
+      }
+      const load = worker.calls + worker.pending;
+      const bestLoad = best.calls + best.pending;
+      if (load < bestLoad || (load === bestLoad && worker.lagMs < best.lagMs)) {
+        best = worker;
+      }
+    }
+    return best;
+  }
+
+  /**
+   * Hands an accepted, unread connection to the least-loaded worker
+   * @param {net.Socket} socket A socket accepted with pauseOnConnect
+   */
+  dispatch(socket) {
+    const worker = this.leastLoaded();
+    if (!worker) {
+      console.error('[CallWorkerPool] No call worker available, rejecting connection');
+      socket.destroy();
+      return;
+    }
+    worker.pending++;
+    worker.child.send({ type: 'call' }, socket, (error) => {
+      if (error) {
+        console.error(`[CallWorkerPool] Failed to hand connection to worker ${worker.index}:`, error.message);
+        socket.destroy();
+      }
+    });
+  }
+
+  /**
+   * Counts the calls the workers can still take
+   * @param {number} maxCalls Calls per worker
+   * @param {number} maxLagMs Event loop lag above which a worker takes no more calls
+   * @returns {number} Free call slots over all connected workers
+   */
+  freeSlots(maxCalls, maxLagMs = Infinity) {
+    let free = 0;
+    for (const worker of this.workers) {
+      if (!worker.child.connected || worker.lagMs > maxLagMs) continue;
+      free += Math.max(0, maxCalls - worker.calls - worker.pending);
+    }
+    return free;
+  }
+
+  /**
+   * Counts the calls running on or handed to the workers
+   */
+  countCalls() {
+    let calls = 0;
+    for (const worker of this.workers) calls += worker.calls + worker.pending;
+    return calls;
+  }
+
+  /**
+   * Get the load of every worker
+   * @returns {Array<Object>} Calls, lag, memory, queued playout and shed
+   *   calls per worker
+   */
+  getStats() {
+    return this.workers.map(({ index, child, calls, pending, lagMs, lagMaxMs, rssBytes, queuedBytes, shedCalls, reportedAt }) => ({
+      index,
+      pid: child.pid,
+      connected: child.connected,
+      calls,
+      pending,
+      lagMs,
+      lagMaxMs,
+      rssBytes,
+      queuedBytes,
+      shedCalls,
+      reportedAt,
+    }));
+  }
+
+  /**
+   * Stops all workers, ending their calls
+   */
+  stop() {
+    this.stopping = true;
+    for (const { child } of this.workers) {
+      child.kill();
+    }
+    this.workers = [];
+  }
+}
+
+module.exports = CallWorkerPool;
@@ -0,0 +1,344 @@
+const EventEmitter = require('events');
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
+
+// Changes within this window go out as one diff
+const DIFF_BATCH_DELAY = 250;
+
+// How often the table is compared with a CoreShowChannels dump
+const DEFAULT_RECONCILE_INTERVAL = 30 * 1000;
+
+// A CoreShowChannels dump that takes longer is abandoned
+const DUMP_TIMEOUT = 10 * 1000;
+
+// Event fields copied onto the channel entry, by event
+const EVENT_FIELDS = {
+  newchannel: ['channel', 'channelstate', 'channelstatedesc', 'calleridnum', 'calleridname', 'accountcode', 'context', 'exten', 'linkedid'],
+  newstate: ['channel', 'channelstate', 'channelstatedesc', 'calleridnum', 'calleridname', 'connectedlinenum', 'connectedlinename'],
+  newexten: ['context', 'extension', 'priority', 'application', 'appdata'],
+  newcallerid: ['calleridnum', 'calleridname'],
+  newconnectedline: ['connectedlinenum', 'connectedlinename'],
+};
+
+// Fields of a CoreShowChannel event kept in the table
+const DUMP_FIELDS = [
+  'channel', 'channelstate', 'channelstatedesc', 'calleridnum', 'calleridname',
+  'connectedlinenum', 'connectedlinename', 'accountcode', 'context', 'exten', 'extension',
+  'priority', 'application', 'applicationdata', 'linkedid', 'bridgeid', 'bridgeduniqueid',
+];
+
+/**
+ * Formats seconds the way CoreShowChannel reports a duration
+ * @returns {string} HH:MM:SS
+ */
+function formatDuration(seconds) {
+  const pad = (n) => String(n).padStart(2, '0');
+  return `${pad(Math.floor(seconds / 3600))}:${pad(Math.floor(seconds / 60) % 60)}:${pad(seconds % 60)}`;
+}
+
+function parseDuration(duration) {
+  if (!duration) return 0;
+  return String(duration).split(':').reduce((total, part) => total * 60 + (parseInt(part, 10) || 0), 0);
+}
+
+/**
+ * ChannelCache - Live table of the Asterisk channels, kept from AMI events
+ * Newchannel, Newstate, Newexten, NewCallerid, NewConnectedLine, VarSet,
+ * Rename, bridge and Hangup events update the table as they arrive, so
+ * reading the channels costs no AMI round trip. Changes to the AudioSocket
+ * channels are batched and emitted as 'diff' events for the dashboards. A
+ * periodic CoreShowChannels dump, and one after every AMI (re)connect,
+ * heals anything the events missed.
+ */
+class ChannelCache extends EventEmitter {
+  /**
+   * @param {Object} ami Connected asterisk-manager instance
+   * @param {Object} options
+   * @param {number} options.reconcileInterval Milliseconds between full dumps
+   * @param {TimerWheel} options.wheel Wheel for the diff batching and dump timers
+   */
+  constructor(ami, {
+    reconcileInterval = parseInt(process.env.CHANNEL_RECONCILE_INTERVAL || DEFAULT_RECONCILE_INTERVAL, 10),
+    wheel = sharedTimerWheel,
+  } = {}) {
+    super();
+    this.ami = ami;
+    this.wheel = wheel;
+    this.channels = new Map(); // Uniqueid -> channel entry
+    this.published = new Set(); // Uniqueids of the channels the dashboards know
+    this.dirty = new Set(); // Uniqueids changed since the last diff
+    this.diffTimer = null;
+    this.version = 0; // Incremented with every diff
+    this.reconciling = null; // { startedAt, hungUp } while a dump runs
+    this.dumpSequence = 0;
+    this.stats = { events: 0, diffs: 0, reconciles: 0, drift: 0 };
+
+    this.onEvent = this.onEvent.bind(this);
+    this.ami.on('managerevent', this.onEvent);
+    this.ami.on('connect', () => this.reconcile());
+    this.reconcileTimer = wheel.every(reconcileInterval, () => this.reconcile());
+  }
+
+  onEvent(evt) {
+    const name = (evt.event || '').toLowerCase();
+    const uniqueid = evt.uniqueid;
+    switch (name) {
+      case 'newchannel':
+        this.update(uniqueid, evt, EVENT_FIELDS.newchannel, true);
+        break;
+      case 'newstate':
+      case 'newexten':
+      case 'newcallerid':
+      case 'newconnectedline':
+        this.update(uniqueid, evt, EVENT_FIELDS[name], name === 'newstate');
+        break;
+      case 'varset':
+        // chan_audiosocket and originateCall tag their channels with AUDIOSOCKET_* variables
+        if (/^AUDIOSOCKET_/.test(evt.variable || '')) {
+          const entry = this.update(uniqueid, evt, [], false);
+          if (entry) {
+            entry.audiosocket = true;
+            const port = evt.variable === 'AUDIOSOCKET_SERVICE' && (evt.value || '').match(/:(\d+)$/);
+            if (port) entry.audioSocketPort = parseInt(port[1], 10);
+          }
+        }
+        break;
+      case 'rename':
+        this.update(uniqueid, { channel: evt.newname || evt.channel }, ['channel'], false);
+        break;
+      case 'bridge': // Asterisk 11
+        this.update(evt.uniqueid1, { bridgeid: evt.bridgestate === 'Link' ? evt.uniqueid2 : '' }, ['bridgeid'], false);
+        this.update(evt.uniqueid2, { bridgeid: evt.bridgestate === 'Link' ? evt.uniqueid1 : '' }, ['bridgeid'], false);
+        break;
+      case 'bridgeenter':
+        this.update(uniqueid, { bridgeid: evt.bridgeuniqueid }, ['bridgeid'], false);
+        break;
+      case 'bridgeleave':
+        this.update(uniqueid, { bridgeid: '' }, ['bridgeid'], false);
+        break;
+      case 'hangup':
+        if (!uniqueid) return;
+        this.stats.events++;
+        this.channels.delete(uniqueid);
+        if (this.reconciling) this.reconciling.hungUp.add(uniqueid);
+        this.markDirty(uniqueid);
+        break;
+      default:
+        return;
+    }
+  }
+
+  /**
+   * Copies event fields onto a channel entry
+   * @param {string} uniqueid Channel the event is for
+   * @param {Object} source Event or values to copy
+   * @param {Array} fields Fields of source to copy
+   * @param {boolean} create Whether an unknown channel gets a new entry
+   * @returns {Object|null} The entry, or null for an unknown channel
+   */
+  update(uniqueid, source, fields, create) {
+    if (!uniqueid) return null;
+    let entry = this.channels.get(uniqueid);
+    if (!entry) {
+      if (!create) return null;
+      entry = { uniqueid, audioSocketPort: null, audiosocket: false, startedAt: Date.now(), seenAt: Date.now() };
+      this.channels.set(uniqueid, entry);
+    }
+    this.stats.events++;
+    for (const field of fields) {
+      if (source[field] !== undefined) entry[field] = source[field];
+    }
+    this.normalize(entry);
+    this.markDirty(uniqueid);
+    return entry;
+  }
+
+  /**
+   * Maps the field names of the different events onto the CoreShowChannel ones
+   */
+  normalize(entry) {
+    if (entry.extension !== undefined) {
+      entry.exten = entry.extension;
+      delete entry.extension;
+    }
+    if (entry.appdata !== undefined) {
+      entry.applicationdata = entry.appdata;
+      delete entry.appdata;
+    }
+    if (entry.bridgeduniqueid !== undefined) {
+      entry.bridgeid = entry.bridgeduniqueid;
+      delete entry.bridgeduniqueid;
+    }
+    if (entry.audioSocketPort === null && entry.channel) {
+      const match = entry.channel.match(/:(\d+)-/);
+      if (match) entry.audioSocketPort = parseInt(match[1], 10);
+    }
+  }
+
+  /**
+   * Whether a channel is shown on the dashboards
+   */
+  isAudioSocket(entry) {
+    return entry.audiosocket
+      || /^AudioSocket/.test(entry.channel || '')
+      || /^AudioSocket/.test(entry.application || '')
+      || /^AudioSocket/.test(entry.applicationdata || '');
+  }
+
+  markDirty(uniqueid) {
+    this.dirty.add(uniqueid);
+    if (!this.diffTimer) {
+      this.diffTimer = this.wheel.schedule(DIFF_BATCH_DELAY, () => this.flushDiff());
+    }
+  }
+
+  /**
+   * Emits the changes to the AudioSocket channels since the last diff
+   */
+  flushDiff() {
+    this.diffTimer = null;
+    const added = [];
+    const updated = [];
+    const removed = [];
+    for (const uniqueid of this.dirty) {
+      const entry = this.channels.get(uniqueid);
+      const visible = entry && this.isAudioSocket(entry);
+      if (visible) {
+        (this.published.has(uniqueid) ? updated : added).push(this.toChannel(entry));
+        this.published.add(uniqueid);
+      } else if (this.published.has(uniqueid)) {
+        removed.push(uniqueid);
+        this.published.delete(uniqueid);
+      }
+    }
+    this.dirty.clear();
+    if (added.length === 0 && updated.length === 0 && removed.length === 0) return;
+    this.version++;
+    this.stats.diffs++;
+    this.emit('diff', { version: this.version, added, updated, removed });
+  }
+
+  /**
+   * Dashboard view of a channel entry
+   */
+  toChannel(entry) {
+    const { seenAt, audiosocket, ...channel } = entry;
+    channel.duration = formatDuration(Math.max(0, Math.floor((Date.now() - entry.startedAt) / 1000)));
+    return channel;
+  }
+
+  /**
+   * The AudioSocket channels as of the last diff
+   * @returns {Object} { version, channels }; diffs with a higher version apply on top
+   */
+  snapshot() {
+    const channels = [];
+    for (const uniqueid of this.published) {
+      const entry = this.channels.get(uniqueid);
+      if (entry) channels.push(this.toChannel(entry));
+    }
+    return { version: this.version, channels };
+  }
+
+  /**
+   * Replaces the table with a CoreShowChannels dump, keeping the channels
+   * created and dropping the ones hung up while the dump ran
+   */
+  async reconcile() {
+    if (this.reconciling) return;
+    const startedAt = Date.now();
+    this.reconciling = { startedAt, hungUp: new Set() };
+    try {
+      const dumped = await this.dumpChannels();
+      let drift = 0;
+      const seen = new Set();
+      for (const evt of dumped) {
+        const uniqueid = evt.uniqueid;
+        if (!uniqueid || this.reconciling.hungUp.has(uniqueid)) continue;
+        seen.add(uniqueid);
+        let entry = this.channels.get(uniqueid);
+        let changed = false;
+        if (!entry) {
+          entry = {
+            uniqueid,
+            audioSocketPort: null,
+            audiosocket: false,
+            startedAt: startedAt - parseDuration(evt.duration) * 1000,
+            seenAt: startedAt,
+          };
+          this.channels.set(uniqueid, entry);
+          changed = true;
+        }
+        for (const field of DUMP_FIELDS) {
+          if (evt[field] === undefined) continue;
+          const key = field === 'extension' ? 'exten' : field === 'bridgeduniqueid' ? 'bridgeid' : field;
+          if (entry[key] !== evt[field]) changed = true;
+          entry[field] = evt[field];
+        }
+        if (changed) drift++;
+        this.normalize(entry);
+        if (changed) this.markDirty(uniqueid);
+      }
+      for (const [uniqueid, entry] of this.channels) {
+        if (!seen.has(uniqueid) && entry.seenAt < startedAt) {
+          this.channels.delete(uniqueid);
+          this.markDirty(uniqueid);
+          drift++;
+        }
+      }
+      this.stats.reconciles++;
+      this.stats.drift += drift;
+      if (drift > 0) {
+        console.log(`[ChannelCache] Reconciled ${drift} channels that differed from Asterisk`);
+      }
+    } catch (error) {
+      console.error(`[ChannelCache] Reconcile failed: ${error.message}`);
+    } finally {
+      this.reconciling = null;
+    }
+  }
+
+  /**
+   * Lists every channel with CoreShowChannels
+   * @returns {Promise<Array>} The CoreShowChannel events
+   */
+  dumpChannels() {
+    return new Promise((resolve, reject) => {
+      const channels = [];
+      let actionId = `channels-${process.pid}-${++this.dumpSequence}`;
+      const finish = (error) => {
+        this.ami.removeListener('managerevent', handler);
+        timeout.cancel();
+        if (error) {
+          reject(error);
+        } else {
+          resolve(channels);
+        }
+      };
+      const handler = (evt) => {
+        if (evt.actionid !== actionId) return;
+        if (evt.event === 'CoreShowChannel') {
+          channels.push(evt);
+        } else if (evt.event === 'CoreShowChannelsComplete') {
+          finish();
+        }
+      };
+      const timeout = this.wheel.schedule(DUMP_TIMEOUT, () => finish(new Error('CoreShowChannels timed out')));
+      this.ami.on('managerevent', handler);
+      actionId = this.ami.action({ action: 'CoreShowChannels', actionid: actionId }, (err) => {
+        if (err) finish(err);
+      }) || actionId;
+    });
+  }
+
+  getStats() {
+    return { ...this.stats, channels: this.channels.size, published: this.published.size, version: this.version };
+  }
+
+  close() {
+    this.reconcileTimer.cancel();
+    if (this.diffTimer) this.diffTimer.cancel();
+    this.ami.removeListener('managerevent', this.onEvent);
+  }
+}
+
+module.exports = ChannelCache;
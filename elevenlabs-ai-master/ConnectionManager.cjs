@@ -1,5 +1,13 @@
 const EventEmitter = require('events');
 const { v4: uuidv4 } = require('uuid');
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
+
+// How often idle connections are looked for; a connection is closed at most
+// this long after its inactivity timeout
+const SWEEP_INTERVAL = 10 * 1000;
+
+// Most recent log entries kept per connection
+const LOG_RETENTION = parseInt(process.env.LOG_RETENTION || 200, 10);
 
 /**
  * ConnectionManager - Manages WebSocket connections and related resources
@@ -7,7 +15,7 @@ const { v4: uuidv4 } = require('uuid');
  * Improved with better connection lifecycle management and resource cleanup
  */
 class ConnectionManager extends EventEmitter {
-  constructor(inactivityTimeout = 5 * 60 * 1000, staleThreshold = 10 * 60 * 1000) {
+  constructor(inactivityTimeout = 5 * 60 * 1000, staleThreshold = 10 * 60 * 1000, wheel = sharedTimerWheel) {
     super();
     this.connections = new Map(); // Map of connection ID to connection info
     this.inactivityTimeout = inactivityTimeout;
@@ -15,7 +23,10 @@ class ConnectionManager extends EventEmitter {
     this.pendingClosures = new Set(); // Track connection IDs in process of closing
     this.pendingClosures = new Set(); // Track connection IDs in process of closing
     this.connectionTimestamps = new Map(); // Track when connections were created
-    this.connectionTimeouts = new Map(); // Track connection timeouts
+    this.subscriptions = new Map(); // Topic -> Set of connection IDs
+
+    // Activity only records a timestamp; one sweep closes idle connections
+    this.sweepTimer = wheel.every(SWEEP_INTERVAL, () => this.expireIdleConnections());
   }
 
   /**
@@ -44,7 +55,7 @@ class ConnectionManager extends EventEmitter {
     // Create connection object with more structured state tracking
     this.connections.set(connectionId, {
       ws,
-      logs: [],
+      logs: [], // Last LOG_RETENTION entries sent to the client
       elevenLabsWs: null,
       customParameters: {},
       state: {
@@ -56,14 +67,6 @@ class ConnectionManager extends EventEmitter {
       agents: {}
     });
     
-    // Set up an inactivity timeout
-    const connectionTimeout = setTimeout(() => {
-      console.warn(`[ConnectionManager] Connection ${connectionId} inactive for 5 minutes, closing`);
-      this.closeConnection(connectionId);
-    }, this.inactivityTimeout);
-    
-    this.connectionTimeouts.set(connectionId, connectionTimeout);
-    
     return connectionId;
   }
   /**
@@ -137,22 +140,27 @@ class ConnectionManager extends EventEmitter {
   }
   /**
    * Update the activity timestamp for a connection
+   * Called on every message, so it only records the time; expireIdleConnections
+   * closes the connections that stay idle
    * @param {string} connectionId The connection ID
    */
   updateActivity(connectionId) {  
     const connection = this.connections.get(connectionId);
     connection.state.lastActivity = Date.now();
-    
-    // Reset the inactivity timeout if the connection is not closing
-    if (!connection.state.isClosing && this.connectionTimeouts.has(connectionId)) {
-      clearTimeout(this.connectionTimeouts.get(connectionId));
-      
-      const connectionTimeout = setTimeout(() => {
-        console.warn(`[ConnectionManager] Connection ${connectionId} inactive for 5 minutes, closing`);
+  }
+
+  /**
+   * Close the connections inactive for longer than the inactivity timeout
+   * Runs every SWEEP_INTERVAL on the timer wheel
+   */
+  expireIdleConnections() {
+    const now = Date.now();
+    for (const [connectionId, connection] of this.connections) {
+      if (connection.state.isClosing) continue;
+      if (now - connection.state.lastActivity >= this.inactivityTimeout) {
+        console.warn(`[ConnectionManager] Connection ${connectionId} inactive for ${Math.round(this.inactivityTimeout / 1000 / 60)} minutes, closing`);
         this.closeConnection(connectionId);
-      }, 5 * 60 * 1000); // 5 minutes
-      
-      this.connectionTimeouts.set(connectionId, connectionTimeout);
+      }
     }
   }
 
@@ -276,14 +284,20 @@ class ConnectionManager extends EventEmitter {
       fullMessage += ' ' + formattedArgs.join(' ');
     }
 
+    const entry = {
+      type: 'log',
+      logType: type,
+      message: fullMessage,
+      timestamp: new Date().toISOString()
+    };
+    connection.logs.push(entry);
+    if (connection.logs.length > LOG_RETENTION) {
+      connection.logs.shift();
+    }
+
     // Send log to WebSocket client with error handling
     try {
-      const payload = JSON.stringify({
-        type: 'log',
-        logType: type,
-        message: fullMessage,
-        timestamp: new Date().toISOString()
-      });
+      const payload = JSON.stringify(entry);
       
       //console.log(`[ConnectionManager] Sending log to ${connectionId}: ${type} - ${fullMessage.substring(0, 50)}${fullMessage.length > 50 ? '...' : ''}`);
       connection.ws.send(payload);
@@ -355,6 +369,34 @@ class ConnectionManager extends EventEmitter {
     }
   }
 
+  /**
+   * Subscribe a connection to the messages published on a topic
+   * @param {string} connectionId The connection ID
+   * @param {string} topic Topic name, e.g. 'channels'
+   */
+  subscribe(connectionId, topic) {
+    if (!this.connections.has(connectionId)) return;
+    if (!this.subscriptions.has(topic)) {
+      this.subscriptions.set(topic, new Set());
+    }
+    this.subscriptions.get(topic).add(connectionId);
+  }
+
+  /**
+   * Send a status message to every connection subscribed to a topic
+   * @param {string} topic Topic name
+   * @param {string} status Status type
+   * @param {*} message Status message
+   */
+  publish(topic, status, message) {
+    const subscribers = this.subscriptions.get(topic);
+    if (!subscribers) return;
+    for (const connectionId of subscribers) {
+      if (this.pendingClosures.has(connectionId)) continue;
+      this.sendStatus(connectionId, status, message);
+    }
+  }
+
   /**
    * Close and remove a connection
    * @param {string} connectionId The connection ID
@@ -378,12 +420,6 @@ class ConnectionManager extends EventEmitter {
     this.pendingClosures.add(connectionId);
     connection.state.isClosing = true;
     
-    // Clear any timeout for this connection
-    if (this.connectionTimeouts.has(connectionId)) {
-      clearTimeout(this.connectionTimeouts.get(connectionId));
-      this.connectionTimeouts.delete(connectionId);
-    }
-    
     // Close ElevenLabs WebSocket if it exists
     if (connection.elevenLabsWs) {
       try {
@@ -437,6 +473,9 @@ class ConnectionManager extends EventEmitter {
       // Remove connection from all tracking maps and sets
       this.connections.delete(connectionId);
       this.connectionTimestamps.delete(connectionId);
+      for (const subscribers of this.subscriptions.values()) {
+        subscribers.delete(connectionId);
+      }
       this.pendingClosures.delete(connectionId);
       console.log(`[ConnectionManager] Connection fully removed: ${connectionId}`);
       this.emit('connectionClosed', connectionId);
@@ -487,6 +526,13 @@ class ConnectionManager extends EventEmitter {
       }
     }
   }
+
+  /**
+   * Stop the idle sweep
+   */
+  close() {
+    this.sweepTimer.cancel();
+  }
 }
 
 module.exports = ConnectionManager;
@@ -1,10 +1,21 @@
+const { sharedLogWriter, LEVELS } = require('./Logger.cjs');
+
 /**
  * ConsoleLogger - Custom console logger that intercepts and redirects console output
  * to both the standard console and specific WebSocket connections
+ * Console calls are queued on the shared log ring like Logger lines, so
+ * neither their formatting nor the stdout write and the forwarding to the
+ * connection happen inside the calling code.
  */
 class ConsoleLogger {
-  constructor(connectionManager) {
+  /**
+   * @param {ConnectionManager|null} connectionManager Receives the lines logged
+   *   while a connection is active; none in call workers
+   * @param {LogWriter} writer Ring the lines go to
+   */
+  constructor(connectionManager = null, writer = sharedLogWriter) {
     this.connectionManager = connectionManager;
+    this.writer = writer;
     this.originalConsole = {
       log: console.log,
       error: console.error,
@@ -13,6 +24,10 @@ class ConsoleLogger {
     };
     
     this.activeConnectionId = null;
+
+    if (connectionManager) {
+      writer.connectionSink = (connectionId, type, message) => connectionManager.addLog(connectionId, type, message);
+    }
     
     // Replace console methods with custom versions
     this.overrideConsoleMethods();
@@ -22,49 +37,13 @@ class ConsoleLogger {
    * Override standard console methods to intercept logs
    */
   overrideConsoleMethods() {
-    // Override console.log
-    console.log = (...args) => {
-      // Call original console.log
-      this.originalConsole.log(...args);
-      
-      // If there's an active connection, send to that connection
-      if (this.activeConnectionId) {
-        this.connectionManager.addLog(this.activeConnectionId, 'log', ...args);
-      }
-    };
-
-    // Override console.error
-    console.error = (...args) => {
-      // Call original console.error
-      this.originalConsole.error(...args);
-      
-      // If there's an active connection, send to that connection
-      if (this.activeConnectionId) {
-        this.connectionManager.addLog(this.activeConnectionId, 'error', ...args);
-      }
-    };
-
-    // Override console.warn
-    console.warn = (...args) => {
-      // Call original console.warn
-      this.originalConsole.warn(...args);
-      
-      // If there's an active connection, send to that connection
-      if (this.activeConnectionId) {
-        this.connectionManager.addLog(this.activeConnectionId, 'warn', ...args);
-      }
-    };
-
-    // Override console.info
-    console.info = (...args) => {
-      // Call original console.info
-      this.originalConsole.info(...args);
-      
-      // If there's an active connection, send to that connection
-      if (this.activeConnectionId) {
-        this.connectionManager.addLog(this.activeConnectionId, 'info', ...args);
-      }
+    const queue = (level, type = null) => (...args) => {
+      this.writer.write(level, null, this.activeConnectionId, args.length > 0 ? args[0] : '', args.slice(1), type);
     };
+    console.log = queue(LEVELS.info);
+    console.info = queue(LEVELS.info, 'info');
+    console.warn = queue(LEVELS.warn);
+    console.error = queue(LEVELS.error);
   }
 
   /**
@@ -102,6 +81,8 @@ class ConsoleLogger {
    * Restore original console methods
    */
   restore() {
+    this.writer.flush();
+    this.writer.connectionSink = null;
     console.log = this.originalConsole.log;
     console.error = this.originalConsole.error;
     console.warn = this.originalConsole.warn;
@@ -1,5 +1,35 @@
 const { pool } = require('./MySQL.cjs');
 
+// Conversations per listConversations page
+const DEFAULT_PAGE_SIZE = 100;
+const MAX_PAGE_SIZE = 500;
+
+/**
+ * Encode the position after a conversation as an opaque page cursor
+ * @param {Object} conv Row with start_time_unix_secs and conversation_id
+ * @returns {string} The cursor
+ */
+function encodeConversationCursor(conv) {
+    return Buffer.from(`${conv.start_time_unix_secs}:${conv.conversation_id}`).toString('base64url');
+}
+
+/**
+ * Decode a page cursor
+ * @param {string} cursor Cursor from encodeConversationCursor
+ * @returns {Object} { start, conversationId }
+ * @throws {Error} If the cursor is malformed
+ */
+function decodeConversationCursor(cursor) {
+    const value = Buffer.from(String(cursor), 'base64url').toString();
+    const separator = value.indexOf(':');
+    const start = parseInt(value.slice(0, separator), 10);
+    const conversationId = value.slice(separator + 1);
+    if (separator < 1 || !Number.isFinite(start) || !conversationId) {
+        throw new Error('Invalid conversation cursor');
+    }
+    return { start, conversationId };
+}
+
 /**
  * Database manager class for handling all database operations in the ElevenAPI system.
  * Provides methods for querying and managing agents, conversations, evaluations, and remote agent management.
@@ -36,6 +66,30 @@ class DatabaseManager {
         }
     }
 
+    /**
+     * Run queries in one transaction on a dedicated connection
+     * Commits when fn resolves and rolls back when it throws
+     * @param {Function} fn Called with the connection; its queries must go
+     *   through connection.query to be part of the transaction
+     * @returns {Promise<*>} What fn resolves to
+     */
+    async transaction(fn) {
+        const connection = await pool.getConnection();
+        try {
+            await connection.beginTransaction();
+            const result = await fn(connection);
+            await connection.commit();
+            return result;
+        } catch (error) {
+            await connection.rollback().catch((rollbackError) => {
+                console.error('[DatabaseManager] Rollback error:', rollbackError);
+            });
+            throw error;
+        } finally {
+            connection.release();
+        }
+    }
+
     // Agent Management Methods
 
     /**
@@ -110,6 +164,32 @@ class DatabaseManager {
         return agent ? this.convertToApiFormat(agent) : null;
     }
 
+    /**
+     * Get the bridge settings of an agent
+     * @param {string} agentId The ElevenLabs agent ID
+     * @returns {Promise<Object|null>} upstream_chunk_ms, asr_config and tts_config,
+     *   or null if the agent is unknown
+     */
+    async getAgentStreamSettings(agentId) {
+        const results = await this.executeQuery(
+            'SELECT upstream_chunk_ms, asr_config, tts_config FROM elevenlabs_agents WHERE agent_id = ?',
+            [agentId]
+        );
+        return results[0] || null;
+    }
+
+    /**
+     * Set the bridge settings of an agent
+     * @param {string} agentId The ElevenLabs agent ID
+     * @param {number|null} upstreamChunkMs Caller audio per message in ms, or null for the default
+     */
+    async updateAgentStreamSettings(agentId, upstreamChunkMs) {
+        await this.executeQuery(
+            'UPDATE elevenlabs_agents SET upstream_chunk_ms = ? WHERE agent_id = ?',
+            [upstreamChunkMs, agentId]
+        );
+    }
+
     /**
      * Get agent by userId
      * @param {string} userId 
@@ -364,52 +444,114 @@ class DatabaseManager {
     }
 
     /**
-     * List conversations for an agent
+     * List conversations for an agent, newest first
      * @param {string} agentId 
      * @param {Object} options Filtering options
-     * @returns {Promise<Array>} Array of conversations
+     * @param {string} options.compId List the conversations of every agent of the company instead
+     * @param {number} options.limit Page size (at most MAX_PAGE_SIZE)
+     * @param {string} options.cursor next_cursor of the previous page
+     * @returns {Promise<Object>} The page of conversations and the cursor of the next page
      */
     async listConversations(agentId, options = {}) {
         if (options.compId) {
-            return this.listConversationsByCompanyId(options.compId, options.limit);
-        } else {
-            const query = `
-                SELECT c.*, a.name as agent_name,
-                       (SELECT COUNT(*) FROM elevenlabs_conversation_turns t 
-                        WHERE t.conversation_id = c.conversation_id) as turns_count
-                FROM elevenlabs_conversations c
-                JOIN elevenlabs_agents a ON c.agent_id = a.agent_id
-                WHERE c.agent_id = ?
-                ORDER BY c.created_at DESC
-                LIMIT ?`;
-            const conversations = await this.executeQuery(query, [agentId, options.limit || 100]);
-            return {
-                conversations: conversations.map(conv => this.formatConversation(conv))
-            };
+            return this.listConversationsByCompanyId(options.compId, options);
         }
+        const agents = await this.executeQuery(
+            'SELECT agent_id, name FROM elevenlabs_agents WHERE agent_id = ?',
+            [agentId]
+        );
+        return this.listConversationPage(agents, options);
     }
 
     /**
-     * List all conversations for a company
+     * List all conversations for a company, newest first
      * @param {string} compId Company ID to filter conversations
-     * @param {number} limit Maximum number of conversations to return
-     * @returns {Promise<Object>} Object containing array of formatted conversations
+     * @param {Object} options Page options
+     * @param {number} options.limit Page size (at most MAX_PAGE_SIZE)
+     * @param {string} options.cursor next_cursor of the previous page
+     * @returns {Promise<Object>} The page of conversations and the cursor of the next page
      */
-    async listConversationsByCompanyId(compId, limit = 100) {
-        const query = `
-            SELECT c.*, a.name as agent_name, ad.comp_id,
-                   (SELECT COUNT(*) FROM elevenlabs_conversation_turns t 
-                    WHERE t.conversation_id = c.conversation_id) as turns_count
-            FROM elevenlabs_conversations c
-            JOIN elevenlabs_agents a ON c.agent_id = a.agent_id
-            JOIN elevenlabs_agents_dialer ad ON a.agent_id = ad.agent_id
-            WHERE ad.comp_id = ?
-            ORDER BY c.created_at DESC
-            LIMIT ?`;
+    async listConversationsByCompanyId(compId, options = {}) {
+        const agents = await this.executeQuery(`
+            SELECT a.agent_id, a.name
+            FROM elevenlabs_agents_dialer ad
+            JOIN elevenlabs_agents a ON a.agent_id = ad.agent_id
+            WHERE ad.comp_id = ?`, [compId]);
+        return this.listConversationPage(agents, options);
+    }
+
+    /**
+     * Read one page of conversations of the given agents
+     * Pages are keyed on (start_time_unix_secs, conversation_id) instead of an
+     * offset. Each agent's newest conversations before the cursor are read
+     * from the agent_start_idx index, which also holds every listed column,
+     * and the per-agent pages are merged; so a page costs the same no matter
+     * how far back it is or how large the table gets. Conversations without a
+     * start time are not listed. Full details come from getConversation.
+     * @param {Array} agents Rows with agent_id and name
+     * @param {Object} options Page options (limit, cursor)
+     * @returns {Promise<Object>} { conversations, next_cursor }, next_cursor is
+     *   null on the last page
+     * @private
+     */
+    async listConversationPage(agents, { limit, cursor } = {}) {
+        const pageSize = Math.min(MAX_PAGE_SIZE, Math.max(1, parseInt(limit, 10) || DEFAULT_PAGE_SIZE));
+        if (agents.length === 0) {
+            return { conversations: [], next_cursor: null };
+        }
+
+        const after = cursor ? decodeConversationCursor(cursor) : null;
+        const keyset = after
+            ? 'AND (c.start_time_unix_secs < ? OR (c.start_time_unix_secs = ? AND c.conversation_id < ?))'
+            : 'AND c.start_time_unix_secs IS NOT NULL';
+        const branches = [];
+        const params = [];
+        for (const agent of agents) {
+            // One more row than the page tells whether there is a next page
+            branches.push(`
+                SELECT c.conversation_id, c.agent_id, c.start_time_unix_secs,
+                       c.call_duration_secs, c.status, c.call_successful
+                FROM elevenlabs_conversations c
+                WHERE c.agent_id = ? ${keyset}
+                ORDER BY c.start_time_unix_secs DESC, c.conversation_id DESC
+                LIMIT ?`);
+            params.push(agent.agent_id);
+            if (after) params.push(after.start, after.start, after.conversationId);
+            params.push(pageSize + 1);
+        }
+        const query = agents.length === 1
+            ? branches[0]
+            : `(${branches.join(') UNION ALL (')})
+               ORDER BY start_time_unix_secs DESC, conversation_id DESC
+               LIMIT ?`;
+        if (agents.length > 1) params.push(pageSize + 1);
+
+        const rows = await this.executeQuery(query, params);
+        const hasMore = rows.length > pageSize;
+        const page = hasMore ? rows.slice(0, pageSize) : rows;
+
+        // Turn counts of the page only, from the conversation_id index
+        const turnCounts = new Map();
+        if (page.length > 0) {
+            const counts = await this.executeQuery(`
+                SELECT conversation_id, COUNT(*) AS turns_count
+                FROM elevenlabs_conversation_turns
+                WHERE conversation_id IN (?)
+                GROUP BY conversation_id`, [page.map(conv => conv.conversation_id)]);
+            for (const row of counts) {
+                turnCounts.set(row.conversation_id, row.turns_count);
+            }
+        }
 
-        const conversations = await this.executeQuery(query, [compId, limit]);
+        const agentNames = new Map(agents.map(agent => [agent.agent_id, agent.name]));
+        const last = page[page.length - 1];
         return {
-            conversations: conversations.map(conv => this.formatConversation(conv))
+            conversations: page.map(conv => this.formatConversation({
+                ...conv,
+                agent_name: agentNames.get(conv.agent_id),
+                turns_count: turnCounts.get(conv.conversation_id)
+            })),
+            next_cursor: hasMore ? encodeConversationCursor(last) : null
         };
     }
 
@@ -751,6 +893,25 @@ class DatabaseManager {
         return true;
     }
 
+    /**
+     * Store the bridge latency of an agent turn until its turn row exists
+     * The turn rows are written by the post-call webhook, after the call
+     * @param {string} conversationId
+     * @param {number} agentTurn Index of the turn among the agent's turns
+     * @param {Object} metrics Elapsed time in seconds by metric name
+     */
+    async saveTurnLatency(conversationId, agentTurn, metrics) {
+        const rows = Object.entries(metrics)
+            .filter(([name, elapsed_time]) => typeof elapsed_time === 'number')
+            .map(([name, elapsed_time]) => [conversationId, agentTurn, name, elapsed_time]);
+        if (rows.length === 0) return;
+
+        await this.executeQuery(
+            'REPLACE INTO elevenlabs_turn_latency (conversation_id, agent_turn, metric_name, elapsed_time) VALUES ?',
+            [rows]
+        );
+    }
+
     // Evaluation Methods
 
     /**
@@ -836,6 +997,20 @@ class DatabaseManager {
         );
     }
 
+    /**
+     * Get the active remote agent attached to an agent conference
+     * @param {string} confExten The conference extension of the live agent
+     * @param {string} serverIp The server IP of the live agent
+     * @returns {Promise<Object|null>} Remote agent or null if not found
+     */
+    async getRemoteAgentByConference(confExten, serverIp) {
+        const results = await this.executeQuery(
+            'SELECT * FROM osdial_remote_agents WHERE conf_exten = ? AND server_ip = ? AND status = "ACTIVE"',
+            [confExten, serverIp]
+        );
+        return results[0] || null;
+    }
+
     /**
      * Get active remote agents count for agent_id
      * @returns {Promise<Array>} Array of active remote agents
@@ -934,6 +1109,28 @@ class DatabaseManager {
     }
 
 
+    /**
+     * Get the remote agents for RemoteAgentReconciler
+     * @param {number|null} since Unix seconds; only rows modified at or after
+     *   it are returned. Null returns every remote agent.
+     * @param {boolean} withModified Whether to select modified_at as
+     *   modified_unix; false for databases without the column
+     * @returns {Promise<Array>} remote_agent_id, agent_id, audio_port, status
+     *   and modified_unix of the rows
+     */
+    async getRemoteAgentChanges(since = null, withModified = true) {
+        let query = `
+            SELECT remote_agent_id, agent_id, audio_port, status
+                   ${withModified ? ', UNIX_TIMESTAMP(modified_at) AS modified_unix' : ''}
+            FROM osdial_remote_agents`;
+        const params = [];
+        if (since !== null) {
+            query += ' WHERE modified_at >= FROM_UNIXTIME(?)';
+            params.push(since);
+        }
+        return this.executeQuery(query, params);
+    }
+
     /**
      * Get active remote agents with audio port
      * @returns {Promise<Array>} Array of active remote agents
@@ -1086,6 +1283,19 @@ class DatabaseManager {
         const results = await this.executeQuery(query, params);
         return results[0] || null;
     }
+
+    /**
+     * Get the live agent currently handling a lead
+     * @param {number} leadId The lead ID to lookup
+     * @returns {Promise<Object|null>} Agent information or null if not found
+     */
+    async getLiveAgentByLeadId(leadId) {
+        const results = await this.executeQuery(
+            'SELECT * FROM osdial_live_agents WHERE lead_id = ?',
+            [leadId]
+        );
+        return results[0] || null;
+    }
 }
 
 module.exports = DatabaseManager;
\ No newline at end of file
@@ -0,0 +1,230 @@
+const fetch = require('node-fetch');
+const { WebSocket } = require('ws');
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
+
+const { ELEVENLABS_AGENT_ID, ELEVENLABS_API_KEY } = process.env;
+
+// Base URL of the ElevenLabs API; pointed at mockElevenLabs.cjs for tests
+const ELEVENLABS_API_URL = process.env.ELEVENLABS_API_URL || 'https://api.elevenlabs.io';
+
+// Time allowed for the WebSocket handshake
+const CONNECT_TIMEOUT = 15000;
+
+// Helper function to get signed URL for ElevenLabs
+async function getSignedUrl(agentId = null) {
+  try {
+    // Use provided agent_id or fall back to environment variable
+    const agent_id = agentId || ELEVENLABS_AGENT_ID;
+    
+    if (!ELEVENLABS_API_KEY) {
+      throw new Error("Missing ELEVENLABS_API_KEY in environment variables");
+    };
+    if (!agent_id) {
+      throw new Error("Missing ELEVENLABS_AGENT_ID in environment variables or custom parameters");
+    };
+    console.log(`[ElevenLabs] Getting signed URL for agent_id: ${agent_id}`);
+    // Add timeout to prevent hanging requests
+    const controller = new AbortController();
+    const timeoutId = sharedTimerWheel.schedule(10000, () => controller.abort()); // 10 second timeout
+    try {
+      const response = await fetch(
+        `${ELEVENLABS_API_URL}/v1/convai/conversation/get_signed_url?agent_id=${agent_id}`,
+        {
+          method: "GET",
+          headers: {
+            "xi-api-key": ELEVENLABS_API_KEY,
+          },
+          signal: controller.signal
+        }
+      );
+      timeoutId.cancel();
+      if (!response.ok) {
+        throw new Error(`Failed to get signed URL: ${response.statusText}`);
+      }
+      const data = await response.json();
+      //console.log(`[ElevenLabs] Successfully obtained signed URL`);
+      return data.signed_url;
+    } catch (fetchError) {
+      timeoutId.cancel();
+      if (fetchError.name === 'AbortError') {
+        throw new Error('Timeout while getting signed URL from ElevenLabs API');
+      }
+      throw fetchError;
+    }
+  } catch (error) {
+    console.error("[ElevenLabs] Error getting signed URL:", error);
+    throw error;
+  }
+}
+
+/**
+ * Opens a conversation WebSocket on a signed URL
+ * @param {string} signedUrl The signed URL
+ * @param {string|null} connectionId Connection ID for logging
+ * @returns {Promise<WebSocket>} Resolves once the WebSocket is open
+ */
+function connectWebSocket(signedUrl, connectionId = null) {
+  return new Promise((resolve, reject) => {
+    const wsConnection = new WebSocket(signedUrl);
+
+    // Set a 15-second timeout for connection
+    const connectionTimeout = sharedTimerWheel.schedule(CONNECT_TIMEOUT, () => {
+      console.error(`[ElevenLabs:${connectionId}] Connection timeout`);
+      try {
+        wsConnection.close();
+      } catch (e) {}
+      reject(new Error('Connection timeout: Cannot connect to service within 15 seconds'));
+    });
+
+    const onClose = (code, reason) => {
+      connectionTimeout.cancel();
+      reject(new Error(`WebSocket closed before open: ${code} - ${reason}`));
+    };
+    wsConnection.once("close", onClose);
+
+    wsConnection.on("open", () => {
+      connectionTimeout.cancel();
+      wsConnection.removeListener("close", onClose);
+      resolve(wsConnection);
+    });
+
+    // Handle connection errors
+    wsConnection.on("error", (wsError) => {
+      connectionTimeout.cancel();
+      console.error(`[ElevenLabs:${connectionId}] WebSocket error during setup:`, wsError);
+      reject(wsError);
+    });
+  });
+}
+
+/**
+ * Builds the conversation_initiation_client_data message of a call
+ * @param {string} connectionId Connection ID for logging
+ * @param {Object} customParameters The call parameters
+ * @returns {Object} The message
+ */
+function buildInitialConfig(connectionId, customParameters) {
+  // Send initial configuration with prompt and first message
+  const initialConfig = {
+    type: "conversation_initiation_client_data",
+    conversation_config_override: {
+      agent: {},
+    },
+    dynamic_variables: {
+      agent_id: customParameters?.agent_id,
+      called_number: customParameters.autoCalls?.phone_code + customParameters.autoCalls?.phone_number,
+      lead_id: customParameters.autoCalls?.lead_id,
+      campaign_id: customParameters.liveAgent?.campaign_id,
+      uniqueid: customParameters.liveAgent?.uniqueid,
+      first_name: customParameters.leadData?.first_name,
+      last_name: customParameters.leadData?.last_name,
+      title: customParameters.leadData?.title,
+      address1: customParameters.leadData?.address1,
+      address2: customParameters.leadData?.address2,
+      city: customParameters.leadData?.city,
+      postal_code: customParameters.leadData?.postal_code,
+      custom1: customParameters.leadData?.custom1,
+      custom2: customParameters.leadData?.custom2,
+      email: customParameters.leadData?.email,
+      phone_number: customParameters.leadData?.phone_number,
+      comments: customParameters.leadData?.comments,
+      called_count: customParameters.leadData?.called_count,
+    },
+  };
+
+  // Apply custom parameters if available
+  if (customParameters?.params?.prompt) {
+    initialConfig.conversation_config_override.agent.prompt = { "prompt": customParameters?.params.prompt};
+    console.log(`[ElevenLabs:${connectionId}] Using prompt: ${customParameters?.params.prompt}`);
+  }
+  if (customParameters?.params?.first_message) {
+    initialConfig.conversation_config_override.agent.first_message = customParameters?.params.first_message;
+    console.log(`[ElevenLabs:${connectionId}] Using first message: ${customParameters?.params.first_message}`);
+  }
+  if (customParameters?.params?.language) {
+    initialConfig.conversation_config_override.agent.language = customParameters?.params.language;
+    console.log(`[ElevenLabs:${connectionId}] Using language: ${customParameters?.params.language}`);
+  }
+  return initialConfig;
+}
+
+/**
+ * Creates the function that connects a call to ElevenLabs Conversational AI
+ * The returned function accepts, besides the call parameters, a context
+ * promise resolving to further parameters (the lead data) which is awaited
+ * only after the WebSocket has opened, so that the database lookups overlap
+ * the signed URL request and handshake, and an optional PhaseTimer. A
+ * settings promise (the agent's bridge settings) is awaited at the same
+ * point, so it has resolved before the initial config is sent and any reply
+ * can arrive.
+ * @param {ConnectionManager|null} connectionManager Receives the WebSocket of
+ *   API-started calls; null in call workers, which have no API connections
+ * @param {ElevenLabsSessionPool|null} sessionPool Supplies pre-fetched signed
+ *   URLs or pre-opened sessions, skipping those round trips
+ * @returns {Function} async (connectionId, customParameters, { context, settings, timer }) => WebSocket
+ */
+function createElevenLabsSetup(connectionManager = null, sessionPool = null) {
+  return async (connectionId = null, customParameters = null, { context = null, settings = null, timer = null } = {}) => {
+    // Better logging for debugging
+    console.log(`[ElevenLabs] Setting up connection for ${connectionId} with parameters: `,
+      customParameters ? JSON.stringify(customParameters).substring(0, 100) + "..." : "none");
+
+    const agentId = customParameters?.agent_id || ELEVENLABS_AGENT_ID;
+    const claimed = sessionPool ? sessionPool.claim(agentId) : null;
+
+    let wsConnection;
+    if (claimed?.ws) {
+      console.log(`[ElevenLabs:${connectionId}] Using pre-opened session`);
+      wsConnection = claimed.ws;
+      if (timer) timer.mark('signed_url');
+    } else {
+      let signedUrl = claimed?.url;
+      if (!signedUrl) {
+        try {
+          signedUrl = await getSignedUrl(agentId);
+        } catch (urlError) {
+          console.error(`[ElevenLabs:${connectionId}] Failed to get signed URL:`, urlError.message);
+          if (connectionId && connectionManager) {
+            connectionManager.sendStatus(connectionId, 'error', `Failed to get signed URL: ${urlError.message}`, null);
+          }
+          throw urlError;
+        }
+      }
+      if (timer) timer.mark('signed_url');
+      wsConnection = await connectWebSocket(signedUrl, connectionId);
+    }
+    if (timer) timer.mark('ws_open');
+    console.log(`[ElevenLabs:${connectionId}] Connected successfully to Conversational AI`);
+
+    // The session is open from here on; close it if the call cannot start
+    try {
+      // Wait for the lead and agent lookups, which ran in parallel with the handshake
+      const [loaded] = await Promise.all([context, settings]);
+      if (loaded) Object.assign(customParameters, loaded);
+      if (timer) timer.mark('session_ready');
+
+      console.log(`[ElevenLabs:${connectionId}] Sending initial config`);
+      wsConnection.send(JSON.stringify(buildInitialConfig(connectionId, customParameters)));
+    } catch (setupError) {
+      console.error(`[ElevenLabs:${connectionId}] Error starting the session:`, setupError);
+      wsConnection.close();
+      throw setupError;
+    }
+
+    // Register the WebSocket with the connection manager
+    if (connectionId && connectionManager) {
+      connectionManager.setElevenLabsWs(connectionId, wsConnection);
+    }
+
+    // Pre-opened sessions are paused in the pool; the caller attaches its
+    // message handlers before any further messages are read
+    if (wsConnection.isPaused) wsConnection.resume();
+    return wsConnection;
+  };
+}
+
+module.exports = {
+  getSignedUrl,
+  connectWebSocket,
+  createElevenLabsSetup
+};
@@ -0,0 +1,208 @@
+const { getSignedUrl, connectWebSocket } = require('./ElevenLabsSession.cjs');
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
+
+// Signed URLs are valid for 15 minutes; pooled ones are used well within that
+const URL_TTL = 10 * 60 * 1000;
+
+// Pre-opened sessions are replaced after this long, before the server
+// gives up on a conversation that never started
+const SESSION_TTL = 60 * 1000;
+
+// The pool keeps as many warm sessions per agent as calls arrived in this window
+const RATE_WINDOW = 10 * 1000;
+
+// Agents without calls for this long are no longer kept warm
+const IDLE_TIMEOUT = 10 * 60 * 1000;
+
+// Delay before retrying after a failed refill
+const RETRY_DELAY = 5000;
+
+const MAINTAIN_INTERVAL = 5000;
+
+/**
+ * ElevenLabsSessionPool - Keeps conversation sessions ready per agent
+ * Holds signed URLs fetched ahead of time and, with openSessions, WebSockets
+ * already opened on them, so a call skips the signed URL request and the
+ * handshake. Each agent is kept at as many warm sessions as calls arrived for
+ * it in the last RATE_WINDOW, at least one while it has taken calls recently,
+ * and at most max.
+ */
+class ElevenLabsSessionPool {
+  /**
+   * @param {Object} options
+   * @param {number} options.max Most warm sessions kept per agent
+   * @param {boolean} options.openSessions Also open the WebSockets ahead of time
+   */
+  constructor({ max = 4, openSessions = false } = {}) {
+    this.max = max;
+    this.openSessions = openSessions;
+    this.agents = new Map();
+    this.stats = { hits: 0, urlHits: 0, misses: 0, refills: 0, refillErrors: 0, expired: 0 };
+
+    this.timer = sharedTimerWheel.every(MAINTAIN_INTERVAL, () => this.maintain());
+  }
+
+  agent(agentId) {
+    let agent = this.agents.get(agentId);
+    if (!agent) {
+      agent = { agentId, urls: [], sessions: [], inflight: 0, arrivals: [], lastArrival: 0, retryAt: 0 };
+      this.agents.set(agentId, agent);
+    }
+    return agent;
+  }
+
+  /**
+   * Starts keeping one session ready for an agent that is expected to take calls
+   * @param {string} agentId The ElevenLabs agent ID
+   */
+  warm(agentId) {
+    const agent = this.agent(agentId);
+    agent.lastArrival = Math.max(agent.lastArrival, Date.now());
+    this.refill(agent);
+  }
+
+  /**
+   * Takes a ready session for a new call
+   * @param {string} agentId The ElevenLabs agent ID
+   * @returns {Object|null} { ws } with an open, paused WebSocket, { url } with
+   *   a signed URL, or null if none is ready
+   */
+  claim(agentId) {
+    const now = Date.now();
+    const agent = this.agent(agentId);
+    agent.arrivals.push(now);
+    agent.lastArrival = now;
+    this.prune(agent, now);
+
+    let claimed = null;
+    const session = agent.sessions.pop();
+    if (session) {
+      this.stats.hits++;
+      claimed = { ws: session.ws };
+    } else {
+      const url = agent.urls.pop();
+      if (url) {
+        this.stats.urlHits++;
+        claimed = { url: url.url };
+      } else {
+        this.stats.misses++;
+      }
+    }
+
+    this.refill(agent);
+    return claimed;
+  }
+
+  /**
+   * Number of sessions to keep ready for an agent
+   */
+  target(agent, now) {
+    while (agent.arrivals.length > 0 && agent.arrivals[0] < now - RATE_WINDOW) {
+      agent.arrivals.shift();
+    }
+    const recent = now - agent.lastArrival < IDLE_TIMEOUT ? 1 : 0;
+    return Math.min(this.max, Math.max(agent.arrivals.length, recent));
+  }
+
+  /**
+   * Drops expired URLs and sessions, and sessions the server has closed
+   */
+  prune(agent, now) {
+    const urls = agent.urls.filter((url) => now - url.fetchedAt < URL_TTL);
+    const sessions = agent.sessions.filter((session) => {
+      if (session.ws.readyState === 1 && now - session.openedAt < SESSION_TTL) return true;
+      session.ws.close();
+      return false;
+    });
+    this.stats.expired += agent.urls.length - urls.length + agent.sessions.length - sessions.length;
+    agent.urls = urls;
+    agent.sessions = sessions;
+  }
+
+  /**
+   * Starts fetching sessions until the agent reaches its target
+   */
+  refill(agent) {
+    const now = Date.now();
+    if (now < agent.retryAt) return;
+
+    const missing = this.target(agent, now) - agent.urls.length - agent.sessions.length - agent.inflight;
+    for (let i = 0; i < missing; i++) {
+      agent.inflight++;
+      this.stats.refills++;
+      this.fetchSession(agent.agentId)
+        .then((session) => {
+          if (session.ws) {
+            agent.sessions.push(session);
+            // Drop it from the pool if the server closes it while idle
+            session.ws.once('close', () => {
+              agent.sessions = agent.sessions.filter((s) => s !== session);
+            });
+          } else {
+            agent.urls.push(session);
+          }
+        })
+        .catch((error) => {
+          console.error(`[ElevenLabsSessionPool] Failed to prepare session for ${agent.agentId}:`, error.message);
+          this.stats.refillErrors++;
+          agent.retryAt = Date.now() + RETRY_DELAY;
+        })
+        .finally(() => {
+          agent.inflight--;
+        });
+    }
+  }
+
+  async fetchSession(agentId) {
+    const url = await getSignedUrl(agentId);
+    const fetchedAt = Date.now();
+    if (!this.openSessions) return { url, fetchedAt };
+
+    const ws = await connectWebSocket(url);
+    // Hold incoming messages until a call claims the session
+    ws.pause();
+    ws.on('error', () => {});
+    return { ws, openedAt: Date.now() };
+  }
+
+  /**
+   * Expires old sessions, tops agents up and forgets idle agents
+   */
+  maintain() {
+    const now = Date.now();
+    for (const [agentId, agent] of this.agents) {
+      this.prune(agent, now);
+      if (now - agent.lastArrival >= IDLE_TIMEOUT && agent.inflight === 0) {
+        agent.sessions.forEach((session) => session.ws.close());
+        this.agents.delete(agentId);
+        continue;
+      }
+      this.refill(agent);
+    }
+  }
+
+  /**
+   * Get the pool statistics
+   * @returns {Object} Claim outcomes and the ready sessions per agent
+   */
+  getStats() {
+    const agents = {};
+    for (const [agentId, agent] of this.agents) {
+      agents[agentId] = { urls: agent.urls.length, sessions: agent.sessions.length, inflight: agent.inflight };
+    }
+    return { ...this.stats, agents };
+  }
+
+  /**
+   * Closes all pooled sessions and stops maintenance
+   */
+  close() {
+    this.timer.cancel();
+    for (const agent of this.agents.values()) {
+      agent.sessions.forEach((session) => session.ws.close());
+    }
+    this.agents.clear();
+  }
+}
+
+module.exports = ElevenLabsSessionPool;
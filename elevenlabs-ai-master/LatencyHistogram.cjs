@@ -0,0 +1,123 @@
+// Largest value tracked, in microseconds (one minute); larger ones are clamped
+const DEFAULT_HIGHEST_US = 60000000;
+
+// Decimal digits of precision kept at every magnitude
+const DEFAULT_SIGNIFICANT_DIGITS = 2;
+
+/**
+ * LatencyHistogram - HDR histogram of latencies
+ * Values are counted in microseconds in buckets whose width doubles with the
+ * magnitude, each split into enough sub-buckets to keep the configured
+ * number of significant digits. Recording is a few integer operations and
+ * the memory is fixed (about 2,500 counters for the defaults), so every turn
+ * of every call can be recorded and percentiles read at any time.
+ */
+class LatencyHistogram {
+  /**
+   * @param {Object} options
+   * @param {number} options.highestUs Largest value tracked, in microseconds
+   * @param {number} options.significantDigits Precision of the counted values
+   */
+  constructor({ highestUs = DEFAULT_HIGHEST_US, significantDigits = DEFAULT_SIGNIFICANT_DIGITS } = {}) {
+    const subBucketCountMagnitude = Math.ceil(Math.log2(2 * 10 ** significantDigits));
+    this.subBucketHalfCountMagnitude = subBucketCountMagnitude - 1;
+    this.subBucketHalfCount = 1 << this.subBucketHalfCountMagnitude;
+    this.subBucketMask = (1 << subBucketCountMagnitude) - 1;
+    this.highestUs = Math.min(highestUs, 0x7fffffff);
+
+    const bucketCount = this.bucketIndex(this.highestUs) + 1;
+    this.counts = new Uint32Array((bucketCount + 1) * this.subBucketHalfCount);
+    this.reset();
+  }
+
+  bucketIndex(us) {
+    return 31 - Math.clz32(us | this.subBucketMask) - this.subBucketHalfCountMagnitude;
+  }
+
+  countsIndex(us) {
+    const bucket = this.bucketIndex(us);
+    const subBucket = us >>> bucket;
+    return ((bucket + 1) << this.subBucketHalfCountMagnitude) + subBucket - this.subBucketHalfCount;
+  }
+
+  /**
+   * Largest value counted at an index, in microseconds
+   */
+  valueAtIndex(index) {
+    let bucket = (index >> this.subBucketHalfCountMagnitude) - 1;
+    let subBucket = (index & (this.subBucketHalfCount - 1)) + this.subBucketHalfCount;
+    if (bucket < 0) {
+      subBucket -= this.subBucketHalfCount;
+      bucket = 0;
+    }
+    return ((subBucket + 1) << bucket) - 1;
+  }
+
+  /**
+   * Counts a latency
+   * @param {number} ms The latency in milliseconds; negative values count as 0
+   */
+  record(ms) {
+    const us = Math.min(this.highestUs, Math.max(0, Math.round(ms * 1000)));
+    this.counts[this.countsIndex(us)]++;
+    this.count++;
+    this.sumUs += us;
+    if (us < this.minUs) this.minUs = us;
+    if (us > this.maxUs) this.maxUs = us;
+  }
+
+  /**
+   * Value below which the given percentage of the latencies fall
+   * @param {number} percentile From 0 to 100
+   * @returns {number} The latency in milliseconds, or 0 if none was recorded
+   */
+  percentile(percentile) {
+    if (this.count === 0) return 0;
+    const target = Math.max(1, Math.ceil(percentile / 100 * this.count));
+    let seen = 0;
+    for (let i = 0; i < this.counts.length; i++) {
+      seen += this.counts[i];
+      if (seen >= target) return Math.min(this.valueAtIndex(i), this.maxUs) / 1000;
+    }
+    return this.maxUs / 1000;
+  }
+
+  /**
+   * Adds the counts of another histogram of the same layout
+   */
+  merge(other) {
+    for (let i = 0; i < this.counts.length; i++) this.counts[i] += other.counts[i];
+    this.count += other.count;
+    this.sumUs += other.sumUs;
+    this.minUs = Math.min(this.minUs, other.minUs);
+    this.maxUs = Math.max(this.maxUs, other.maxUs);
+  }
+
+  reset() {
+    this.counts.fill(0);
+    this.count = 0;
+    this.sumUs = 0;
+    this.minUs = Infinity;
+    this.maxUs = 0;
+  }
+
+  /**
+   * Get a summary of the latencies
+   * @returns {Object} count, and mean, min, max, p50, p90, p99 and p999 in ms
+   */
+  getStats() {
+    const round = (ms) => Math.round(ms * 10) / 10;
+    return {
+      count: this.count,
+      mean: this.count > 0 ? round(this.sumUs / this.count / 1000) : 0,
+      min: this.count > 0 ? round(this.minUs / 1000) : 0,
+      max: round(this.maxUs / 1000),
+      p50: round(this.percentile(50)),
+      p90: round(this.percentile(90)),
+      p99: round(this.percentile(99)),
+      p999: round(this.percentile(99.9)),
+    };
+  }
+}
+
+module.exports = LatencyHistogram;
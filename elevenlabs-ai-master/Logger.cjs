@@ -0,0 +1,234 @@
+const util = require('util');
+
+// Levels in order of severity; a logger passes its own level and those above
+const LEVELS = { error: 0, warn: 1, info: 2, debug: 3 };
+const LEVEL_NAMES = Object.keys(LEVELS);
+
+// Log lines held between flushes; lines beyond it are dropped and counted
+const DEFAULT_BUFFER_LINES = 8192;
+
+/**
+ * Parses "Module=value,Module=value" settings such as LOG_MODULES
+ * @returns {Map} Value by module name
+ */
+function parseModuleSettings(spec = '') {
+  const settings = new Map();
+  for (const part of spec.split(',')) {
+    const [name, value] = part.split('=').map((s) => s.trim());
+    if (name && value) settings.set(name, value);
+  }
+  return settings;
+}
+
+function parseLevel(name, fallback) {
+  return name && name in LEVELS ? LEVELS[name] : fallback;
+}
+
+/**
+ * LogWriter - Process-wide ring of pending log lines and their flusher
+ * Loggers only store the level, time, format and arguments of a line in
+ * preallocated slots. The ring is drained once per event loop turn (on
+ * setImmediate), where the lines are formatted and written to stdout and
+ * stderr in one write each, and the ones logged for a dashboard connection
+ * are handed to the connection sink. When the ring is full new lines are
+ * dropped; the count is logged with the next flush.
+ */
+class LogWriter {
+  /**
+   * @param {Object} options
+   * @param {number} options.bufferLines Capacity of the ring
+   * @param {string} options.format 'text' for "[Module] message" lines, 'json'
+   *   for one JSON object per line
+   */
+  constructor({
+    bufferLines = parseInt(process.env.LOG_BUFFER_LINES || DEFAULT_BUFFER_LINES, 10),
+    format = process.env.LOG_FORMAT || 'text',
+  } = {}) {
+    this.capacity = bufferLines;
+    this.json = format === 'json';
+    this.times = new Float64Array(bufferLines);
+    this.levels = new Uint8Array(bufferLines);
+    this.names = new Array(bufferLines).fill(null);
+    this.connectionIds = new Array(bufferLines).fill(null);
+    this.formats = new Array(bufferLines).fill(null);
+    this.args = new Array(bufferLines).fill(null);
+    this.types = new Array(bufferLines).fill(null);
+    this.head = 0; // Next slot to write
+    this.size = 0;
+    this.dropped = 0;
+    this.scheduled = false;
+    this.connectionSink = null; // (connectionId, level, message) for ConsoleLogger
+    this.stats = { lines: 0, dropped: 0, flushes: 0 };
+    this.flush = this.flush.bind(this);
+  }
+
+  /**
+   * Stores a line for the next flush
+   * @param {number} level One of LEVELS
+   * @param {string|null} name Module prefix, or null for lines that carry their own
+   * @param {string|null} connectionId Dashboard connection the line is for
+   * @param {*} format Message, with util.format placeholders for args
+   * @param {Array} args Values for the placeholders
+   * @param {string|null} type Log type given to the connection sink, by
+   *   default 'log' for info lines and the level name otherwise
+   */
+  write(level, name, connectionId, format, args, type = null) {
+    if (this.size === this.capacity) {
+      this.dropped++;
+      this.stats.dropped++;
+      return;
+    }
+    const slot = this.head;
+    this.times[slot] = Date.now();
+    this.levels[slot] = level;
+    this.names[slot] = name;
+    this.connectionIds[slot] = connectionId;
+    this.formats[slot] = format;
+    this.args[slot] = args;
+    this.types[slot] = type;
+    this.head = (slot + 1) % this.capacity;
+    this.size++;
+    this.stats.lines++;
+    if (!this.scheduled) {
+      this.scheduled = true;
+      setImmediate(this.flush);
+    }
+  }
+
+  /**
+   * Formats and writes the lines pending when the flush starts
+   * Lines written while it runs, e.g. by the connection sink, are left for
+   * the next flush.
+   */
+  flush() {
+    this.scheduled = false;
+    if (this.size === 0 && this.dropped === 0) return;
+    this.stats.flushes++;
+    let out = '';
+    let err = '';
+    const count = this.size;
+    let slot = (this.head - count + this.capacity) % this.capacity;
+    for (let n = count; n > 0; n--) {
+      const level = this.levels[slot];
+      const message = util.format(this.formats[slot], ...this.args[slot]);
+      const line = this.formatLine(this.times[slot], level, this.names[slot], message);
+      if (level <= LEVELS.warn) {
+        err += line;
+      } else {
+        out += line;
+      }
+      const connectionId = this.connectionIds[slot];
+      if (connectionId && this.connectionSink) {
+        const type = this.types[slot] || (level === LEVELS.info ? 'log' : LEVEL_NAMES[level]);
+        this.connectionSink(connectionId, type, message);
+      }
+      this.names[slot] = this.connectionIds[slot] = this.formats[slot] = this.args[slot] = this.types[slot] = null;
+      slot = (slot + 1) % this.capacity;
+    }
+    this.size -= count;
+    if (this.dropped > 0) {
+      err += this.formatLine(Date.now(), LEVELS.warn, 'Logger', `Log buffer full, dropped ${this.dropped} lines`);
+      this.dropped = 0;
+    }
+    if (out) process.stdout.write(out);
+    if (err) process.stderr.write(err);
+    if (this.size > 0 && !this.scheduled) {
+      this.scheduled = true;
+      setImmediate(this.flush);
+    }
+  }
+
+  formatLine(time, level, name, message) {
+    if (this.json) {
+      return `${JSON.stringify({ time: new Date(time).toISOString(), level: LEVEL_NAMES[level], module: name || undefined, msg: message })}\n`;
+    }
+    return name ? `[${name}] ${message}\n` : `${message}\n`;
+  }
+
+  getStats() {
+    return { ...this.stats, pending: this.size };
+  }
+}
+
+// The writer shared by every logger of the process; flushed at exit so the
+// last lines before a crash or process.exit are not lost
+const sharedLogWriter = new LogWriter();
+process.on('exit', () => sharedLogWriter.flush());
+
+// LOG_LEVEL sets the default level, LOG_MODULES overrides it per module
+// ("ElevenLabs=debug,Audiosocket=warn") and LOG_SAMPLE keeps a fraction of a
+// module's info and debug lines ("Audiosocket=0.1"); errors and warnings are
+// never sampled
+const defaultLevel = parseLevel(process.env.LOG_LEVEL, LEVELS.info);
+const moduleLevels = parseModuleSettings(process.env.LOG_MODULES);
+const moduleSampling = parseModuleSettings(process.env.LOG_SAMPLE);
+
+/**
+ * Logger - Levelled logger of one module
+ * Calls take a util.format string and its arguments rather than a built
+ * string, so a line below the module's level costs a comparison and the
+ * formatting of the rest happens when the ring is flushed.
+ */
+class Logger {
+  /**
+   * @param {string} module Module name, used as the line prefix and to look
+   *   up the module's level and sampling
+   * @param {LogWriter} writer Ring the lines go to
+   */
+  constructor(module, writer = sharedLogWriter) {
+    this.module = module;
+    this.name = module;
+    this.writer = writer;
+    this.level = parseLevel(moduleLevels.get(module), defaultLevel);
+    this.sample = Math.min(1, parseFloat(moduleSampling.get(module) || 1));
+  }
+
+  /**
+   * Logger for one call or connection of the module, prefixed "[Module:tag]"
+   */
+  child(tag) {
+    const child = Object.create(this);
+    child.name = `${this.module}:${tag}`;
+    return child;
+  }
+
+  enabled(level) {
+    return LEVELS[level] <= this.level;
+  }
+
+  error(format, ...args) {
+    this.writer.write(LEVELS.error, this.name, null, format, args);
+  }
+
+  warn(format, ...args) {
+    if (this.level < LEVELS.warn) return;
+    this.writer.write(LEVELS.warn, this.name, null, format, args);
+  }
+
+  info(format, ...args) {
+    if (this.level < LEVELS.info || (this.sample < 1 && Math.random() >= this.sample)) return;
+    this.writer.write(LEVELS.info, this.name, null, format, args);
+  }
+
+  debug(format, ...args) {
+    if (this.level < LEVELS.debug || (this.sample < 1 && Math.random() >= this.sample)) return;
+    this.writer.write(LEVELS.debug, this.name, null, format, args);
+  }
+}
+
+/**
+ * Creates the logger of a module
+ * @param {string} module Module name, e.g. 'Audiosocket'
+ * @returns {Logger} The logger
+ */
+function createLogger(module) {
+  return new Logger(module);
+}
+
+module.exports = {
+  createLogger,
+  Logger,
+  LogWriter,
+  sharedLogWriter,
+  LEVELS
+};
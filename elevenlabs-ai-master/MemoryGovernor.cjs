@@ -0,0 +1,87 @@
+const v8 = require('v8');
+
+// New calls are refused once the V8 heap is this full...
+const DEFAULT_HEAP_PERCENT = 85;
+
+// ...or once this much agent audio is queued for playout across all calls
+const DEFAULT_MAX_QUEUED_MB = 256;
+
+/**
+ * MemoryGovernor - Process-wide accounting of buffered call audio
+ * StreamServices reserve the bytes they queue for playout and release them
+ * once written or dropped, so the total is known without walking the calls.
+ * New calls are shed while the total or the heap is over its limit; calls
+ * in progress are bounded by their own playout budget instead.
+ */
+class MemoryGovernor {
+  /**
+   * @param {Object} options
+   * @param {number} options.heapPercent Heap usage, as a percentage of the
+   *   V8 heap limit, above which new calls are refused
+   * @param {number} options.maxQueuedBytes Total queued playout above which
+   *   new calls are refused
+   */
+  constructor({
+    heapPercent = parseFloat(process.env.MEMORY_SHED_HEAP_PERCENT || DEFAULT_HEAP_PERCENT),
+    maxQueuedBytes = parseFloat(process.env.MEMORY_SHED_QUEUED_MB || DEFAULT_MAX_QUEUED_MB) * 1024 * 1024,
+  } = {}) {
+    this.heapLimit = v8.getHeapStatistics().heap_size_limit * heapPercent / 100;
+    this.maxQueuedBytes = maxQueuedBytes;
+    this.queuedBytes = 0;
+    this.stats = { admittedCalls: 0, shedCalls: 0, peakQueuedBytes: 0 };
+  }
+
+  reserve(bytes) {
+    this.queuedBytes += bytes;
+    if (this.queuedBytes > this.stats.peakQueuedBytes) this.stats.peakQueuedBytes = this.queuedBytes;
+  }
+
+  release(bytes) {
+    this.queuedBytes -= bytes;
+  }
+
+  /**
+   * Checks the limits without counting a call, e.g. before dialing out
+   * @returns {string|null} Why new calls would be shed, or null if none would be
+   */
+  overloadReason() {
+    if (this.queuedBytes > this.maxQueuedBytes) {
+      return `${Math.round(this.queuedBytes / 1048576)}MB of playout queued`;
+    }
+    const { heapUsed } = process.memoryUsage();
+    if (heapUsed > this.heapLimit) {
+      return `heap at ${Math.round(heapUsed / 1048576)}MB of ${Math.round(this.heapLimit / 1048576)}MB allowed`;
+    }
+    return null;
+  }
+
+  /**
+   * Decides whether a new call can be taken
+   * @returns {string|null} Why the call must be shed, or null to accept it
+   */
+  admitCall() {
+    const reason = this.overloadReason();
+    if (reason) {
+      this.stats.shedCalls++;
+    } else {
+      this.stats.admittedCalls++;
+    }
+    return reason;
+  }
+
+  /**
+   * Get the memory accounting
+   * @returns {Object} Queued bytes now and at peak, and admitted and shed calls
+   */
+  getStats() {
+    return { queuedBytes: this.queuedBytes, ...this.stats };
+  }
+}
+
+// Shared by all calls of the process
+const sharedMemoryGovernor = new MemoryGovernor();
+
+module.exports = {
+  MemoryGovernor,
+  sharedMemoryGovernor
+};
@@ -0,0 +1,52 @@
+const http = require('http');
+
+/**
+ * Starts the local metrics endpoint
+ * GET /metrics returns the turn latency summaries, the session cache
+ * counters and the outbound call pacing in the Prometheus text format and GET /metrics.json the same as
+ * JSON. It binds to the loopback interface unless told otherwise, as it has
+ * no authentication.
+ * @param {Object} options
+ * @param {number} options.port The port to listen on
+ * @param {string} options.host The address to bind to
+ * @param {TurnMetrics} options.turnMetrics The histograms to serve
+ * @param {SessionCache} options.sessionCache The dashboard session cache, if any
+ * @param {OriginateScheduler} options.originateScheduler The outbound call queue, if any
+ * @returns {http.Server} The server
+ */
+function startMetricsServer({ port, host = '127.0.0.1', turnMetrics, sessionCache = null, originateScheduler = null }) {
+  const server = http.createServer((req, res) => {
+    if (req.method !== 'GET') {
+      res.writeHead(405).end();
+      return;
+    }
+    switch (req.url) {
+      case '/metrics':
+        res.writeHead(200, { 'Content-Type': 'text/plain; version=0.0.4' });
+        res.end(turnMetrics.toPrometheus()
+          + (sessionCache ? sessionCache.toPrometheus() : '')
+          + (originateScheduler ? originateScheduler.toPrometheus() : ''));
+        break;
+      case '/metrics.json':
+        res.writeHead(200, { 'Content-Type': 'application/json' });
+        res.end(JSON.stringify({
+          ...turnMetrics.getStats(),
+          sessionCache: sessionCache ? sessionCache.getStats() : undefined,
+          originate: originateScheduler ? originateScheduler.getStats() : undefined,
+        }));
+        break;
+      default:
+        res.writeHead(404).end();
+    }
+  });
+
+  server.on('error', (err) => {
+    console.error(`[Metrics] Server error on port ${port}: ${err.message}`);
+  });
+  server.listen(port, host, () => {
+    console.log(`[Metrics] Serving turn latency on http://${host}:${port}/metrics`);
+  });
+  return server;
+}
+
+module.exports = { startMetricsServer };
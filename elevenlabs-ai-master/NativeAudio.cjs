@@ -0,0 +1,170 @@
+// AudioSocket framing and base64 transcoding for the per-frame media path.
+// Uses the native addon in native/ when it has been built (npm install tries
+// npm run build:native and goes on without it if that fails), with plain
+// JavaScript implementations of the same functions otherwise. Set NATIVE_AUDIO=0 to force the JavaScript path.
+
+const AUDIO_PACKET_TYPE = 0x10;
+
+const KEY = Buffer.from('"audio_base_64"');
+const USER_AUDIO_PREFIX = Buffer.from('{"user_audio_chunk":"');
+const USER_AUDIO_SUFFIX = Buffer.from('"}');
+
+function loadAddon() {
+  if (process.env.NATIVE_AUDIO === '0') return null;
+  try {
+    return require('./native/build/Release/audiosocket_native.node');
+  } catch (error) {
+    return null;
+  }
+}
+
+const addon = loadAddon();
+
+/**
+ * JavaScript implementations, with the same contracts as the addon
+ */
+const js = {
+  base64Encode(src, dst) {
+    return dst.write(src.toString('base64'), 0, 'latin1');
+  },
+
+  base64Decode(src, dst) {
+    const text = src.toString('latin1');
+    if (text.length % 4 !== 0 || !/^[A-Za-z0-9+/]*={0,2}$/.test(text)) return -1;
+    return dst.write(text, 0, 'base64');
+  },
+
+  extractAudio(message, dst) {
+    const keyAt = message.indexOf(KEY);
+    if (keyAt === -1) return -1;
+    try {
+      const audio = JSON.parse(message).audio_event?.audio_base_64;
+      if (typeof audio !== 'string') return -2;
+      const written = dst.write(audio, 0, 'base64');
+      return written < Buffer.byteLength(audio, 'base64') ? -2 : written;
+    } catch (error) {
+      return -2;
+    }
+  },
+
+  encodeFrames(audio, dst, frameBytes = 320) {
+    let out = 0;
+    for (let i = 0; i < audio.length; i += frameBytes) {
+      const length = Math.min(frameBytes, audio.length - i);
+      dst[out] = AUDIO_PACKET_TYPE;
+      dst.writeUInt16BE(length, out + 1);
+      audio.copy(dst, out + 3, i, i + length);
+      out += 3 + length;
+    }
+    return out;
+  },
+
+  decodeFrames(buffer, out) {
+    let count = 0;
+    let offset = 0;
+    while (buffer.length - offset >= 3 && (count + 1) * 3 <= out.length) {
+      const length = buffer.readUInt16BE(offset + 1);
+      if (buffer.length - offset - 3 < length) break;
+      out[count * 3] = offset;
+      out[count * 3 + 1] = length;
+      out[count * 3 + 2] = buffer[offset];
+      count++;
+      offset += 3 + length;
+    }
+    return count;
+  },
+
+  encodeUserAudioMessage(audio, dst) {
+    let out = USER_AUDIO_PREFIX.copy(dst, 0);
+    out += dst.write(audio.toString('base64'), out, 'latin1');
+    return out + USER_AUDIO_SUFFIX.copy(dst, out);
+  },
+};
+
+const impl = addon || js;
+
+function encodedLength(bytes) {
+  return Math.ceil(bytes / 3) * 4;
+}
+
+/**
+ * Base64-encodes audio
+ * @param {Buffer} audio Raw audio
+ * @returns {Buffer} The base64 text as latin1 bytes
+ */
+function base64Encode(audio) {
+  const dst = Buffer.allocUnsafe(encodedLength(audio.length));
+  return dst.subarray(0, impl.base64Encode(audio, dst));
+}
+
+/**
+ * Decodes base64 text held in a Buffer
+ * @param {Buffer} text The base64 text
+ * @returns {Buffer|null} The decoded bytes, or null if text is not valid base64
+ */
+function base64Decode(text) {
+  // Four bytes of slack for the SIMD decoder's last store
+  const dst = Buffer.allocUnsafe(Math.floor(text.length / 4) * 3 + 4);
+  const written = impl.base64Decode(text, dst);
+  return written < 0 ? null : dst.subarray(0, written);
+}
+
+/**
+ * Decodes the agent audio of a raw ElevenLabs 'audio' message without
+ * parsing the JSON
+ * @param {Buffer} message The WebSocket message as received
+ * @returns {Buffer|null} The audio, or null if the message carries no
+ *   audio_base_64 field or needs a full parse
+ */
+function extractAudio(message) {
+  if (!Buffer.isBuffer(message)) return null;
+  const dst = Buffer.allocUnsafe(Math.floor(message.length / 4) * 3 + 4);
+  const written = impl.extractAudio(message, dst);
+  return written < 0 ? null : dst.subarray(0, written);
+}
+
+/**
+ * Splits audio into AudioSocket audio packets
+ * @param {Buffer} audio Raw audio
+ * @param {number} frameBytes Largest payload per packet
+ * @returns {Buffer} The packets, back to back
+ */
+function encodeFrames(audio, frameBytes = 320) {
+  const frames = Math.ceil(audio.length / frameBytes);
+  const dst = Buffer.allocUnsafe(audio.length + 3 * frames);
+  return dst.subarray(0, impl.encodeFrames(audio, dst, frameBytes));
+}
+
+/**
+ * Finds the complete AudioSocket packets at the start of a buffer
+ * @param {Buffer} buffer Received bytes, starting at a packet boundary
+ * @param {Int32Array} out Receives offset, payload length and type per packet
+ * @returns {number} Number of packets written to out
+ */
+function decodeFrames(buffer, out) {
+  return impl.decodeFrames(buffer, out);
+}
+
+/**
+ * Builds the user_audio_chunk message for caller audio
+ * @param {Buffer} audio Raw caller audio
+ * @returns {Buffer} The JSON text, to be sent as a text frame
+ */
+function encodeUserAudioMessage(audio) {
+  const dst = Buffer.allocUnsafe(USER_AUDIO_PREFIX.length + encodedLength(audio.length) + USER_AUDIO_SUFFIX.length);
+  return dst.subarray(0, impl.encodeUserAudioMessage(audio, dst));
+}
+
+module.exports = {
+  isNative: Boolean(addon),
+  simd: Boolean(addon && addon.simd),
+  base64Encode,
+  base64Decode,
+  extractAudio,
+  encodeFrames,
+  decodeFrames,
+  encodeUserAudioMessage,
+  // Exposed for the benchmark
+  js,
+  addon,
+};
@@ -0,0 +1,318 @@
+const EventEmitter = require('events');
+const LatencyHistogram = require('./LatencyHistogram.cjs');
+const { sharedTimerWheel, TICK_MS } = require('./TimerWheel.cjs');
+
+// Originates per second allowed per trunk and per campaign unless configured
+const DEFAULT_TRUNK_RATE = 10;
+const DEFAULT_CAMPAIGN_RATE = 5;
+
+// Attempts per call for failures worth retrying
+const DEFAULT_MAX_ATTEMPTS = 3;
+
+// Retry delays double from the first to the last, each with up to half of it
+// added at random so retries of a failed burst spread out
+const RETRY_MIN_DELAY = 2000;
+const RETRY_MAX_DELAY = 30000;
+
+// How often the queue is looked at again while it waits for capacity
+const CAPACITY_POLL_DELAY = 500;
+
+// Window of the calls per second figure
+const RATE_WINDOW = 10 * 1000;
+
+// Longest time in queue tracked (10 minutes)
+const QUEUE_HISTOGRAM_HIGHEST_US = 600000000;
+
+/**
+ * Parses "name=rate,name=rate" settings such as ORIGINATE_TRUNK_RATES
+ * @returns {Map} Rate by name
+ */
+function parseRates(spec = '') {
+  const rates = new Map();
+  for (const part of spec.split(',')) {
+    const [name, value] = part.split('=').map((s) => s.trim());
+    const rate = parseFloat(value);
+    if (name && rate > 0) rates.set(name, rate);
+  }
+  return rates;
+}
+
+/**
+ * TokenBucket - Allows rate actions per second with bursts of up to burst
+ */
+class TokenBucket {
+  constructor(rate, burst = Math.max(1, rate)) {
+    this.rate = rate;
+    this.burst = burst;
+    this.tokens = burst;
+    this.updatedAt = Date.now();
+  }
+
+  refill(now) {
+    this.tokens = Math.min(this.burst, this.tokens + (now - this.updatedAt) * this.rate / 1000);
+    this.updatedAt = now;
+  }
+
+  /**
+   * Milliseconds until a token is available, 0 if one is available now
+   */
+  waitTime(now) {
+    this.refill(now);
+    return this.tokens >= 1 ? 0 : Math.ceil((1 - this.tokens) * 1000 / this.rate);
+  }
+
+  take() {
+    this.tokens -= 1;
+  }
+}
+
+/**
+ * OriginateScheduler - Queue that paces outbound calls to what the trunk,
+ * the campaign and the bridge can take
+ * A call leaves the queue when the token buckets of its trunk and campaign
+ * both have a token and the bridge has a free call slot (port, worker,
+ * ElevenLabs session), which its prepare step then claims. Calls whose buckets are empty do not hold
+ * up calls on other trunks or campaigns. Failures that may succeed later
+ * (Asterisk unreachable, congestion, no channel) are queued again after an
+ * exponential delay with jitter; busy and unanswered calls are not.
+ */
+class OriginateScheduler extends EventEmitter {
+  /**
+   * @param {Object} options
+   * @param {Function} options.originate (request) => Promise of the
+   *   OriginateResponse; rejects with an error whose retryable flag says
+   *   whether to try again
+   * @param {Function} options.capacity () => number of calls the bridge can
+   *   take now; the slots claimed by prepare for originates in flight count
+   *   as taken
+   * @param {Map} options.trunkRates Originates per second by trunk
+   * @param {Map} options.campaignRates Originates per second by campaign
+   * @param {number} options.trunkRate Rate of trunks not in trunkRates
+   * @param {number} options.campaignRate Rate of campaigns not in campaignRates
+   * @param {number} options.maxAttempts Attempts per call
+   * @param {TimerWheel} options.wheel Wheel for the pacing timers
+   */
+  constructor({
+    originate,
+    capacity = () => Infinity,
+    trunkRates = parseRates(process.env.ORIGINATE_TRUNK_RATES),
+    campaignRates = parseRates(process.env.ORIGINATE_CAMPAIGN_RATES),
+    trunkRate = parseFloat(process.env.ORIGINATE_TRUNK_RATE || DEFAULT_TRUNK_RATE),
+    campaignRate = parseFloat(process.env.ORIGINATE_CAMPAIGN_RATE || DEFAULT_CAMPAIGN_RATE),
+    maxAttempts = parseInt(process.env.ORIGINATE_MAX_ATTEMPTS || DEFAULT_MAX_ATTEMPTS, 10),
+    wheel = sharedTimerWheel,
+  }) {
+    super();
+    this.originate = originate;
+    this.capacity = capacity;
+    this.trunkRates = trunkRates;
+    this.campaignRates = campaignRates;
+    this.trunkRate = trunkRate;
+    this.campaignRate = campaignRate;
+    this.maxAttempts = maxAttempts;
+    this.wheel = wheel;
+    this.buckets = new Map(); // "trunk:name" or "campaign:name" -> TokenBucket
+    this.queue = []; // Requests in arrival order
+    this.inflight = 0; // Originates sent and not yet answered or failed
+    this.wakeTimer = null;
+    this.wakeAt = Infinity;
+    this.dispatched = []; // Dispatch times within RATE_WINDOW
+    this.queueTime = new LatencyHistogram({ highestUs: QUEUE_HISTOGRAM_HIGHEST_US });
+    this.stats = { submitted: 0, originated: 0, answered: 0, failed: 0, retries: 0 };
+  }
+
+  /**
+   * Queues a call
+   * @param {Object} request
+   * @param {string} request.connectionId Dashboard connection of the call
+   * @param {string} request.channel Channel to dial, e.g. SIP/4930123@trunk
+   * @param {string} request.trunk Trunk the channel goes out on
+   * @param {string} request.campaign Campaign (or agent) the call belongs to
+   * @param {Function} request.prepare Called right before each attempt;
+   *   returns the AudioSocket port for the call
+   * @param {Function} request.release Called after an attempt failed, to
+   *   undo prepare
+   * @returns {Promise<Object>} The OriginateResponse once the call is answered
+   */
+  submit(request) {
+    return new Promise((resolve, reject) => {
+      this.stats.submitted++;
+      this.queue.push({
+        ...request,
+        trunk: request.trunk || 'default',
+        campaign: request.campaign || 'default',
+        queuedAt: Date.now(),
+        notBefore: 0,
+        attempts: 0,
+        resolve,
+        reject,
+      });
+      this.pump();
+    });
+  }
+
+  bucket(kind, name) {
+    const key = `${kind}:${name}`;
+    let bucket = this.buckets.get(key);
+    if (!bucket) {
+      const rate = kind === 'trunk'
+        ? this.trunkRates.get(name) || this.trunkRate
+        : this.campaignRates.get(name) || this.campaignRate;
+      bucket = new TokenBucket(rate);
+      this.buckets.set(key, bucket);
+    }
+    return bucket;
+  }
+
+  /**
+   * Sends every queued call that may go now and arms a timer for the next
+   */
+  pump() {
+    const now = Date.now();
+    let free = this.capacity();
+    let wait = Infinity;
+    for (let i = 0; i < this.queue.length && free > 0; i++) {
+      const request = this.queue[i];
+      if (request.notBefore > now) {
+        wait = Math.min(wait, request.notBefore - now);
+        continue;
+      }
+      const trunk = this.bucket('trunk', request.trunk);
+      const campaign = this.bucket('campaign', request.campaign);
+      const tokenWait = Math.max(trunk.waitTime(now), campaign.waitTime(now));
+      if (tokenWait > 0) {
+        wait = Math.min(wait, tokenWait);
+        continue;
+      }
+      trunk.take();
+      campaign.take();
+      this.queue.splice(i--, 1);
+      free--;
+      this.dispatch(request, now);
+    }
+    if (free <= 0 && this.queue.length > 0) {
+      // Capacity frees up when calls end, which the bridge does not signal
+      wait = Math.min(wait, CAPACITY_POLL_DELAY);
+    }
+    this.wake(wait);
+  }
+
+  wake(delay) {
+    if (delay === Infinity) return;
+    const at = Date.now() + Math.max(delay, TICK_MS);
+    if (this.wakeTimer && this.wakeAt <= at) return;
+    if (this.wakeTimer) this.wakeTimer.cancel();
+    this.wakeAt = at;
+    this.wakeTimer = this.wheel.schedule(at - Date.now(), () => {
+      this.wakeTimer = null;
+      this.wakeAt = Infinity;
+      this.pump();
+    });
+  }
+
+  async dispatch(request, now) {
+    if (request.attempts === 0) this.queueTime.record(now - request.queuedAt);
+    request.attempts++;
+    this.inflight++;
+    this.stats.originated++;
+    this.dispatched.push(now);
+
+    let result;
+    try {
+      const port = request.prepare ? request.prepare() : undefined;
+      result = await this.originate({ ...request, port });
+    } catch (error) {
+      this.inflight--;
+      if (request.release) request.release();
+      if (error.retryable && request.attempts < this.maxAttempts) {
+        const base = Math.min(RETRY_MAX_DELAY, RETRY_MIN_DELAY * 2 ** (request.attempts - 1));
+        const delay = Math.round(base + Math.random() * base / 2);
+        this.stats.retries++;
+        console.warn(`[Originate] ${request.channel} failed (${error.message}), retrying in ${delay}ms (attempt ${request.attempts + 1} of ${this.maxAttempts})`);
+        request.notBefore = Date.now() + delay;
+        this.queue.unshift(request);
+      } else {
+        this.stats.failed++;
+        request.reject(error);
+      }
+      this.pump();
+      return;
+    }
+
+    this.inflight--;
+    this.stats.answered++;
+    request.resolve(result);
+    this.pump();
+  }
+
+  callsPerSecond() {
+    const since = Date.now() - RATE_WINDOW;
+    while (this.dispatched.length > 0 && this.dispatched[0] < since) this.dispatched.shift();
+    return Math.round(this.dispatched.length / (RATE_WINDOW / 1000) * 10) / 10;
+  }
+
+  /**
+   * Get the scheduler statistics
+   * @returns {Object} Call counts, queue depth, originates in flight, calls
+   *   per second over the last 10 seconds and the time in queue in ms
+   */
+  getStats() {
+    return {
+      ...this.stats,
+      queued: this.queue.length,
+      inflight: this.inflight,
+      callsPerSecond: this.callsPerSecond(),
+      queueTime: this.queueTime.getStats(),
+    };
+  }
+
+  /**
+   * Formats the statistics in the Prometheus text format
+   * @returns {string} The metrics
+   */
+  toPrometheus() {
+    const name = 'elevenlabs_bridge_originate';
+    const stats = this.getStats();
+    const lines = [
+      `# HELP ${name}_calls_total Outbound calls by outcome.`,
+      `# TYPE ${name}_calls_total counter`,
+      `${name}_calls_total{outcome="submitted"} ${stats.submitted}`,
+      `${name}_calls_total{outcome="originated"} ${stats.originated}`,
+      `${name}_calls_total{outcome="answered"} ${stats.answered}`,
+      `${name}_calls_total{outcome="failed"} ${stats.failed}`,
+      `${name}_calls_total{outcome="retried"} ${stats.retries}`,
+      `# TYPE ${name}_queued gauge`,
+      `${name}_queued ${stats.queued}`,
+      `# TYPE ${name}_inflight gauge`,
+      `${name}_inflight ${stats.inflight}`,
+      `# HELP ${name}_calls_per_second Originates sent per second over the last 10 seconds.`,
+      `# TYPE ${name}_calls_per_second gauge`,
+      `${name}_calls_per_second ${stats.callsPerSecond}`,
+      `# HELP ${name}_queue_seconds Time from submit to the first originate.`,
+      `# TYPE ${name}_queue_seconds summary`,
+    ];
+    for (const quantile of [0.5, 0.9, 0.99]) {
+      lines.push(`${name}_queue_seconds{quantile="${quantile}"} ${(this.queueTime.percentile(quantile * 100) / 1000).toFixed(3)}`);
+    }
+    lines.push(`${name}_queue_seconds_sum ${(this.queueTime.sumUs / 1e6).toFixed(3)}`);
+    lines.push(`${name}_queue_seconds_count ${this.queueTime.count}`);
+    return `${lines.join('\n')}\n`;
+  }
+
+  /**
+   * Stops pacing; queued calls fail
+   */
+  close() {
+    if (this.wakeTimer) this.wakeTimer.cancel();
+    this.wakeTimer = null;
+    for (const request of this.queue.splice(0)) {
+      request.reject(new Error('Originate scheduler closed'));
+    }
+  }
+}
+
+module.exports = {
+  OriginateScheduler,
+  TokenBucket,
+  parseRates,
+};
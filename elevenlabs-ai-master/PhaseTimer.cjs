@@ -0,0 +1,36 @@
+/**
+ * PhaseTimer - Records when each phase of call setup completed
+ * Marks are milliseconds since the timer was created (the connection was
+ * accepted), so the gaps between them give the duration of each phase.
+ */
+class PhaseTimer {
+  constructor() {
+    this.start = process.hrtime.bigint();
+    this.marks = {};
+  }
+
+  /**
+   * Records the end of a phase; only the first mark of each name is kept
+   * @param {string} name The phase name
+   * @returns {number} Milliseconds since the start
+   */
+  mark(name) {
+    if (!(name in this.marks)) {
+      this.marks[name] = Number(process.hrtime.bigint() - this.start) / 1e6;
+    }
+    return this.marks[name];
+  }
+
+  /**
+   * Formats the marks in the order they were recorded
+   * @returns {string} e.g. "context=41ms signed_url=180ms"
+   */
+  toString() {
+    return Object.entries(this.marks)
+      .sort((a, b) => a[1] - b[1])
+      .map(([name, ms]) => `${name}=${ms.toFixed(0)}ms`)
+      .join(' ');
+  }
+}
+
+module.exports = PhaseTimer;
@@ -1,6 +1,66 @@
 const net = require('net');
 const EventEmitter = require('events');
-const { StreamService } = require('./StreamService.cjs');
+const { StreamService, PACKET_TYPES } = require('./StreamService.cjs');
+const { AudioSocketDecoder } = require('./AudioSocketDecoder.cjs');
+const CallContextLoader = require('./CallContextLoader.cjs');
+const PhaseTimer = require('./PhaseTimer.cjs');
+const NativeAudio = require('./NativeAudio.cjs');
+const { UpstreamAggregator, normalizeChunkMs } = require('./UpstreamAggregator.cjs');
+const { AudioConverter, ASTERISK_FORMAT } = require('./AudioConverter.cjs');
+const { sharedMemoryGovernor } = require('./MemoryGovernor.cjs');
+const { TurnLatencyTracker, now } = require('./TurnLatency.cjs');
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
+const { createLogger } = require('./Logger.cjs');
+
+const log = createLogger('PortManager');
+const audiosocketLog = createLogger('Audiosocket');
+const elevenLabsLog = createLogger('ElevenLabs');
+
+// Calls routed by lead ID use an AudioSocket ID of the form
+// 00000000-0000-0000-0000-NNNNNNNNNNNN, with the lead ID as the
+// zero-padded decimal digits of the last group
+const LEAD_ID_PREFIX = '00000000-0000-0000-0000-';
+
+// Time allowed for Asterisk to send the ID packet on a multiplexed connection
+const ID_TIMEOUT = 5000;
+
+/**
+ * Formats the 16-byte payload of an AudioSocket ID packet as a UUID string
+ * @param {Buffer} id The raw ID
+ * @returns {string} The lowercase, hyphenated UUID
+ */
+function formatCallId(id) {
+  const hex = id.toString('hex');
+  return `${hex.slice(0, 8)}-${hex.slice(8, 12)}-${hex.slice(12, 16)}-${hex.slice(16, 20)}-${hex.slice(20)}`;
+}
+
+/**
+ * Creates the converter for one direction of a call's audio
+ * Unsupported formats are logged and the audio is passed through unchanged
+ * @returns {AudioConverter|null} The converter, or null if none is needed
+ */
+function createConverter(from, to, connectionId) {
+  if (from === to) return null;
+  try {
+    const converter = new AudioConverter(from, to);
+    elevenLabsLog.child(connectionId).info('Converting audio %s to %s', from, to);
+    return converter;
+  } catch (error) {
+    elevenLabsLog.child(connectionId).error('%s, passing audio through', error.message);
+    return null;
+  }
+}
+
+/**
+ * Extracts the lead ID from a call ID of the lead routing form
+ * @param {string} callId The call ID
+ * @returns {number|null} The lead ID, or null if the call ID is not of that form
+ */
+function leadIdFromCallId(callId) {
+  if (!callId.startsWith(LEAD_ID_PREFIX)) return null;
+  const digits = callId.slice(LEAD_ID_PREFIX.length);
+  return /^\d+$/.test(digits) ? parseInt(digits, 10) : null;
+}
 
 
 class PortManager extends EventEmitter {
@@ -9,8 +69,283 @@ class PortManager extends EventEmitter {
     this.minPort = minPort;
     this.maxPort = maxPort;
     this.usedPorts = new Set();
-    this.activeServers = new Map(); // connectionId -> {server, port}
+    this.activeServers = new Map(); // connectionId -> {server, port, persistant, customParameters}
     this.dbManager = dbManager;
+    this.contextLoader = dbManager ? new CallContextLoader(dbManager) : null;
+
+    // Multiplexed mode: shared listeners routing connections by call ID
+    this.listeners = [];
+    this.routes = new Map(); // callId -> call registered by registerCall
+    this.activeCalls = new Map(); // connectionId -> socket
+    this.streams = new Map(); // connectionId -> StreamService of a running call
+    this.workerPool = null; // CallWorkerPool of the multiplexed listener, if any
+    this.memory = sharedMemoryGovernor;
+    this.setupElevenLabsCallback = null;
+    this.streamServiceFactory = null;
+
+    // Caller audio aggregation of finished calls, including those of call workers
+    this.upstreamTotals = { calls: 0, frames: 0, messages: 0, seconds: 0, addedLatencyMsSum: 0 };
+    this.on('upstreamStats', (stats) => this.addUpstreamStats(stats));
+  }
+
+  /**
+   * Starts the multiplexed AudioSocket listener
+   * Every call connects to the same port and is routed by the ID Asterisk
+   * sends first: either a call ID registered with registerCall, or a lead ID
+   * (see LEAD_ID_PREFIX) whose remote agent is looked up in the dialer.
+   * @param {number} port The port to listen on
+   * @param {Function} setupElevenLabsCallback Connects a call to ElevenLabs
+   * @param {Function} streamServiceFactory Creates the StreamService of a socket
+   * @param {Object} options host, reusePort to share the port between
+   *   processes with SO_REUSEPORT (Node.js 22.12 or later), and workerPool to
+   *   hand each connection, unread, to a CallWorkerPool instead of running
+   *   the call on this event loop
+   * @returns {Promise<void>} Resolves once listening
+   */
+  listen(port, setupElevenLabsCallback, streamServiceFactory, { host, reusePort = false, workerPool = null } = {}) {
+    this.setupElevenLabsCallback = setupElevenLabsCallback;
+    this.streamServiceFactory = streamServiceFactory;
+
+    const server = workerPool
+      ? net.createServer({ pauseOnConnect: true }, (socket) => workerPool.dispatch(socket))
+      : net.createServer((socket) => this.handleMultiplexedConnection(socket));
+    server.on('error', (err) => {
+      log.error('Listener error on port %s: %s', port, err.message);
+      this.emit('error', { port, error: err });
+    });
+    this.listeners.push(server);
+    this.workerPool = workerPool;
+
+    return new Promise((resolve) => {
+      server.listen({ port, host, reusePort }, () => {
+        audiosocketLog.child(port).info('Listening for multiplexed connections%s', reusePort ? ' (SO_REUSEPORT)' : '');
+        resolve();
+      });
+    });
+  }
+
+  /**
+   * Registers a call to be routed by its AudioSocket ID on the multiplexed listener
+   * @param {string} callId The UUID Asterisk will send, e.g. the connectionId
+   *   passed to AudioSocket by originateCall
+   * @param {string} connectionId The connection the call belongs to
+   * @param {Object} customParameters Parameters passed to ElevenLabs
+   */
+  registerCall(callId, connectionId, customParameters) {
+    this.routes.set(callId.toLowerCase(), { connectionId, customParameters });
+  }
+
+  /**
+   * Removes a registered call that has not connected
+   * @param {string} callId The call ID given to registerCall
+   */
+  unregisterCall(callId) {
+    this.routes.delete(callId.toLowerCase());
+  }
+
+  /**
+   * Finds the call a multiplexed connection belongs to
+   * The lead data of lead-routed calls is not awaited: it is returned as the
+   * context promise so it loads while ElevenLabs connects
+   * @param {string} callId The call ID sent by Asterisk
+   * @param {PhaseTimer} timer Receives the marks of the lookups
+   * @returns {Promise<Object|null>} connectionId, customParameters and
+   *   context, or null if unknown
+   */
+  async resolveCall(callId, timer = null) {
+    const call = this.routes.get(callId);
+    if (call) {
+      this.routes.delete(callId);
+      return call;
+    }
+
+    const leadId = leadIdFromCallId(callId);
+    if (leadId === null) return null;
+
+    // The lead lookups only need the lead ID, so they start right away
+    const context = this.contextLoader.loadLead(leadId, timer, callId).catch((error) => {
+      audiosocketLog.child(callId).error('Error getting lead data:', error);
+      return {};
+    });
+
+    const liveAgent = await this.dbManager.getLiveAgentByLeadId(leadId);
+    if (!liveAgent) return null;
+    const remoteAgent = await this.contextLoader.getRemoteAgentByConference(liveAgent.conf_exten, liveAgent.server_ip);
+    if (!remoteAgent) return null;
+    if (timer) timer.mark('remote_agent');
+    audiosocketLog.child(callId).info('Stream for Remote Agent - User: %s - Exten: %s - IP: %s', remoteAgent.user_start, remoteAgent.conf_exten, remoteAgent.server_ip);
+
+    const customParameters = {
+      agent_id: remoteAgent.agent_id || process.env.ELEVENLABS_AGENT_ID,
+      remoteAgent,
+      liveAgent,
+    };
+    return { connectionId: `lead_${leadId}`, customParameters, context };
+  }
+
+  /**
+   * Gets the bridge settings of the agent of a call
+   * Calls resolved by the main process for a call worker already carry them
+   * @param {Object} customParameters Parameters of the call
+   * @returns {Promise<Object>} upstreamChunkMs
+   */
+  loadAgentSettings(customParameters) {
+    if (customParameters?.agentSettings) return Promise.resolve(customParameters.agentSettings);
+    if (this.contextLoader) return this.contextLoader.getAgentSettings(customParameters?.agent_id);
+    return Promise.resolve({ upstreamChunkMs: normalizeChunkMs(process.env.ELEVENLABS_UPSTREAM_CHUNK_MS) });
+  }
+
+  addUpstreamStats({ frames, messages, seconds, addedLatencyMs }) {
+    const totals = this.upstreamTotals;
+    totals.calls++;
+    totals.frames += frames;
+    totals.messages += messages;
+    totals.seconds += seconds;
+    totals.addedLatencyMsSum += addedLatencyMs * frames;
+  }
+
+  /**
+   * Get the caller audio aggregation of all finished calls
+   * @returns {Object} Calls, messages per call second and mean added latency per frame
+   */
+  getUpstreamStats() {
+    const { calls, frames, messages, seconds, addedLatencyMsSum } = this.upstreamTotals;
+    return {
+      calls,
+      frames,
+      messages,
+      messagesPerSecond: seconds > 0 ? Math.round(messages / seconds * 10) / 10 : 0,
+      addedLatencyMs: frames > 0 ? Math.round(addedLatencyMsSum / frames * 10) / 10 : 0,
+    };
+  }
+
+  /**
+   * Get the playout state of every running call
+   * @returns {Object} StreamService stats by connectionId
+   */
+  getCallStats() {
+    const stats = {};
+    for (const [connectionId, streamService] of this.streams) {
+      stats[connectionId] = streamService.getStats();
+    }
+    return stats;
+  }
+
+  /**
+   * Counts the calls running or about to connect, on this process and its
+   * call workers: running streams, registered calls not yet connected and
+   * call servers of API calls not yet connected
+   * @returns {number} The number of calls
+   */
+  countCalls() {
+    let calls = this.streams.size + this.routes.size;
+    if (this.workerPool) calls += this.workerPool.countCalls();
+    for (const [connectionId, { persistant }] of this.activeServers) {
+      if (!persistant && !this.streams.has(connectionId)) calls++;
+    }
+    return calls;
+  }
+
+  /**
+   * Counts the calls this bridge can still take, for pacing outbound calls
+   * With a port per call it is the number of free ports; on the multiplexed
+   * listener it is maxCalls per call worker (or for this process without
+   * workers), leaving out workers lagging more than maxLagMs, less the calls
+   * registered but not yet connected. None while short of memory.
+   * @param {Object} options
+   * @param {number} options.maxCalls Calls per call worker or process
+   * @param {number} options.maxLagMs Event loop lag above which a worker takes no calls
+   * @returns {number} Free call slots
+   */
+  getCapacity({ maxCalls = Infinity, maxLagMs = Infinity } = {}) {
+    if (this.memory.overloadReason()) return 0;
+    if (this.listeners.length === 0) {
+      let free = 0;
+      for (let port = this.minPort; port <= this.maxPort; port++) {
+        if (!this.usedPorts.has(port)) free++;
+      }
+      return free;
+    }
+    if (this.workerPool) {
+      return this.workerPool.freeSlots(maxCalls, maxLagMs) - this.routes.size;
+    }
+    return maxCalls - this.streams.size - this.routes.size;
+  }
+
+  /**
+   * Refuses a new connection while the process is short of memory
+   * Asterisk sees the connection close and the dialplan carries on
+   * @returns {boolean} True if the connection was shed
+   */
+  shedIfOverloaded(socket, tag) {
+    const reason = this.memory.admitCall();
+    if (!reason) return false;
+    audiosocketLog.child(tag).warn('Shedding new call, %s', reason);
+    this.emit('callShed', { tag, reason });
+    socket.destroy();
+    return true;
+  }
+
+  /**
+   * Reads the ID packet of a multiplexed connection and starts its call
+   */
+  handleMultiplexedConnection(socket) {
+    const peer = `${socket.remoteAddress}:${socket.remotePort}`;
+    socket.on('error', (err) => {
+      audiosocketLog.child(peer).error('Socket error: %s', err.message);
+    });
+    if (this.shedIfOverloaded(socket, peer)) return;
+    socket.setNoDelay(true);
+    const decoder = this.createDecoder(socket, peer);
+    const timer = new PhaseTimer();
+
+    const idTimer = sharedTimerWheel.schedule(ID_TIMEOUT, () => {
+      audiosocketLog.child(peer).warn('No ID received within %sms, closing', ID_TIMEOUT);
+      socket.destroy();
+    });
+    socket.once('close', () => idTimer.cancel());
+
+    decoder.once('data', async (packet) => {
+      idTimer.cancel();
+      // Hold further packets until the call is set up
+      decoder.pause();
+
+      if (packet[0] !== PACKET_TYPES.UUID || packet.length < 19) {
+        audiosocketLog.child(peer).warn('First packet is not an ID, closing');
+        socket.destroy();
+        return;
+      }
+      const callId = formatCallId(packet.subarray(3, 19));
+
+      let call;
+      try {
+        call = await this.resolveCall(callId, timer);
+      } catch (error) {
+        audiosocketLog.child(callId).error('Error getting agent data:', error);
+      }
+      if (!call) {
+        audiosocketLog.child(peer).warn('No call found for ID %s, closing', callId);
+        socket.end();
+        return;
+      }
+      if (socket.destroyed) {
+        audiosocketLog.child(callId).warn('Connection closed before the call was set up');
+        return;
+      }
+
+      const { connectionId } = call;
+      audiosocketLog.child(callId).info('Stream connected for %s', connectionId);
+      this.activeCalls.set(connectionId, socket);
+      await this.runCall(socket, decoder, {
+        ...call,
+        setupElevenLabsCallback: this.setupElevenLabsCallback,
+        streamServiceFactory: this.streamServiceFactory,
+        tag: callId,
+        timer,
+        packets: [packet],
+        onClose: () => this.activeCalls.delete(connectionId),
+      });
+    });
   }
 
   allocatePort() {
@@ -25,7 +360,7 @@ class PortManager extends EventEmitter {
 
   releasePort(port) {
     this.usedPorts.delete(port);
-    console.log(`[PortManager] Released port ${port}`);
+    log.info('Released port %s', port);
   }
 
   createCallServer(connectionId, customParameters, setupElevenLabsCallback, streamServiceFactory, port = null) {
@@ -34,7 +369,7 @@ class PortManager extends EventEmitter {
       let allocatedPort;
       if (port === null) {
         allocatedPort = this.allocatePort();
-        console.log(`[PortManager] Allocated port ${allocatedPort} for connection ${connectionId}`);
+        log.info('Allocated port %s for connection %s', allocatedPort, connectionId);
       } else {
         if (this.usedPorts.has(port)) {
           return false;
@@ -42,109 +377,40 @@ class PortManager extends EventEmitter {
         persistant = true;
         allocatedPort = port;
         this.usedPorts.add(port);
-        console.log(`[PortManager] Using provided port ${port} for connection ${connectionId}`);
+        log.info('Using provided port %s for connection %s', port, connectionId);
       }
 
+      // Read per connection, so updateCallServer applies to the next call
+      const serverInfo = { server: null, port: allocatedPort, persistant, customParameters };
       const server = net.createServer(async (socket) => {
-        console.log(`[Audiosocket:${port}] Stream connected for ${connectionId}`);
-        socket.setNoDelay(true);
-        
-        // Get Dialer Remote Agent and Live Agent Parameters
-        try {
-          [customParameters.remoteAgent] = await this.dbManager.getActiveRemoteAgents(port);
-          console.log(`[Audiosocket:${port}] Stream for Remote Agent - User: ${customParameters.remoteAgent.user_start} - Exten: ${customParameters.remoteAgent.conf_exten} - IP: ${customParameters.remoteAgent.server_ip}`);
-          customParameters.liveAgent = await this.dbManager.getLiveAgents(customParameters.remoteAgent.user_start, customParameters.remoteAgent.conf_exten, customParameters.remoteAgent.server_ip);
-          console.log(`[Audiosocket:${port}] Stream for Live Agent - User: ${customParameters.liveAgent.lead_id} - Campaign: ${customParameters.liveAgent.campaign_id} - Channel: ${customParameters.liveAgent.channel} - Callserver: ${customParameters.liveAgent.call_server_ip}`);
-          customParameters.autoCalls = await this.dbManager.getAutoCalls(customParameters.liveAgent.lead_id);
-          console.log(`[Audiosocket:${port}] Stream for Auto Calls - Phone No: ${customParameters.autoCalls.phone_code}${customParameters.autoCalls.phone_number} - Status: ${customParameters.autoCalls.status} - CallTime: ${customParameters.autoCalls.call_time} - CallType: ${customParameters.autoCalls.call_type}`);
-          const leadData = await this.dbManager.getLeadData(customParameters.liveAgent.lead_id);
-          console.log(`[Audiosocket:${port}] Lead Informations loaded`);
-          const leadFields = await this.dbManager.getLeadDataCustomFields(customParameters.liveAgent.lead_id);
-          console.log(`[Audiosocket:${port}] Lead Fields loaded`);
-          customParameters.leadData = { ...leadData, ...leadFields };
-
-        }
-        catch (error) {
-          console.error(`[Audiosocket-${port}] Error getting agent data:`, error);
-        }
-
-
-        const streamService = streamServiceFactory(socket);
-
-        // UUID
-        streamService.on('uuid', async (uuid) => {
-          console.log(`[Audiosocket-${port}] Connection got UUID ${uuid}`);
-        });
-
-        // Hangup von anderer SEite
-        streamService.on('terminate', () => {         
-          this.closeCallServer(connectionId, persistant);
-          //socket.end();
-          console.log(`[Audiosocket:${port}] Stream terminated from other side for ${connectionId}`);
-        });
-        
-        // Create a transform stream for audio data
-        const { Transform } = require('stream');
-        const transformStream = new Transform({
-          transform(chunk, encoding, callback) {
-            //console.log(`[Audiosocket:${port}] Processing ${chunk.length} bytes of audio`);
-            callback(null, chunk);
-          },
+        audiosocketLog.child(port).info('Stream connected for %s', connectionId);
+        socket.on('error', (err) => {
+          audiosocketLog.child(port).error('Socket error for %s: %s', connectionId, err.message);
         });
-        
-        try {
-          // Set up ElevenLabs with the known parameters immediately
-          console.log(`[Audiosocket:${port}] Setting up ElevenLabs using known parameters`);
-          const elevenLabsWs = await setupElevenLabsCallback(connectionId, customParameters);
-          
-          if (!elevenLabsWs) {
-            console.error(`[Audiosocket:${port}] Failed to establish ElevenLabs connection`);
-            // Don't continue with socket setup if no connection
-            socket.end();
-            return;
-          }
+        if (this.shedIfOverloaded(socket, port)) return;
+        socket.setNoDelay(true);
+        const decoder = this.createDecoder(socket, port);
 
-          console.log(`[Audiosocket:${port}] ElevenLabs connection established successfully`);
-                
-          // Set up handlers for ElevenLabs messages AFTER connection is established
-          this.setupElevenLabsHandlers(elevenLabsWs, streamService, connectionId);
+        // Load the dialer context of remote agent calls while ElevenLabs
+        // connects; calls started through the API carry their own parameters
+        const timer = new PhaseTimer();
+        const context = port === null ? null : this.contextLoader.loadByPort(port, timer);
 
-          // Handle incoming data from Asterisk
-          socket.on('data', (packetData) => {
-            //console.log(`[Audiosocket:${port}] Received ${packetData.length} bytes from Asterisk`);
-            
-            // Process packets for audio data
-            try {
-              streamService.handleAndProcessPacket(packetData, transformStream);
-            } catch (error) {
-              console.error(`[Audiosocket:${port}] Error processing packet:`, error);
-            }
-          });
-            // Handle socket closure
-            socket.on('end', () => {
-              console.log(`[Audiosocket:${port}] Stream disconnected for ${connectionId}`);
-              if (elevenLabsWs && elevenLabsWs.readyState === 1) {
-                elevenLabsWs.close();
-              }
-              
-              // Close and cleanup the server
-              this.closeCallServer(connectionId, persistant);
-            });
-
-        } catch (wsError) {
-          console.error(`[Audiosocket:${port}] Error setting up ElevenLabs:`, wsError);
-          socket.end();
-          this.closeCallServer(connectionId, persistant);
-        }
-        
-        socket.on('error', (err) => {
-          console.error(`[Audiosocket:${port}] Socket error for ${connectionId}: ${err.message}`);
+        await this.runCall(socket, decoder, {
+          connectionId,
+          customParameters: { ...serverInfo.customParameters },
+          setupElevenLabsCallback,
+          streamServiceFactory,
+          context,
+          timer,
+          tag: port,
+          onClose: () => this.closeCallServer(connectionId, persistant),
         });
       });
 
 
       server.on('error', (err) => {
-        console.error(`[PortManager] Server error on port ${port}: ${err.message}`);
+        log.error('Server error on port %s: %s', port, err.message);
         this.releasePort(port);
         this.emit('error', { connectionId, port, error: err });
       });
@@ -155,17 +421,146 @@ class PortManager extends EventEmitter {
       }
 
       server.listen(allocatedPort, () => {
-        console.log(`[Audiosocket:${allocatedPort}] Server listening for connection ${connectionId}`);
+        audiosocketLog.child(allocatedPort).info('Server listening for connection %s', connectionId);
       });
       
-      this.activeServers.set(connectionId, { server, port: allocatedPort });
+      serverInfo.server = server;
+      this.activeServers.set(connectionId, serverInfo);
       return allocatedPort;
     } catch (error) {
-      console.error(`[PortManager] Failed to create call server: ${error.message}`);
+      log.error('Failed to create call server: %s', error.message);
       throw error;
     }
   }
   
+  /**
+   * Creates the packet decoder for an accepted socket and pipes the socket into it
+   * Packets are buffered in the decoder until runCall starts consuming them
+   */
+  createDecoder(socket, tag) {
+    const decoder = new AudioSocketDecoder();
+    decoder.on('error', (err) => {
+      audiosocketLog.child(tag).error('Protocol error: %s', err.message);
+      socket.destroy();
+    });
+    socket.pipe(decoder);
+    return decoder;
+  }
+
+  /**
+   * Connects an accepted AudioSocket connection to ElevenLabs and runs the call
+   * @param {net.Socket} socket The connection from Asterisk
+   * @param {AudioSocketDecoder} decoder The decoder piped from the socket
+   * @param {Object} call Call parameters; context is an optional promise of
+   *   further parameters loading in parallel, packets holds any packets already
+   *   read from the decoder, and onClose is called when the call ends
+   */
+  async runCall(socket, decoder, { connectionId, customParameters, setupElevenLabsCallback, streamServiceFactory, tag, onClose, context = null, timer = new PhaseTimer(), packets = [] }) {
+    const callLog = audiosocketLog.child(tag);
+    const streamService = streamServiceFactory(socket);
+    this.streams.set(connectionId, streamService);
+    socket.once('close', () => {
+      if (this.streams.get(connectionId) === streamService) this.streams.delete(connectionId);
+      const stats = streamService.getStats();
+      if (stats.droppedFrames > 0 || stats.writeStalls > 0) {
+        callLog.warn('Playout for %s: %s frames dropped, %s write stalls (%sms), peak queue %s bytes', connectionId, stats.droppedFrames, stats.writeStalls, stats.stallMs, stats.peakQueuedBytes);
+      }
+      this.emit('playoutStats', { connectionId, ...stats });
+    });
+
+    // UUID
+    streamService.on('uuid', async (uuid) => {
+      callLog.info('Connection got UUID %s', uuid);
+    });
+
+    // Hangup von anderer SEite
+    streamService.on('terminate', () => {
+      onClose();
+      callLog.info('Stream terminated from other side for %s', connectionId);
+    });
+
+    // Looked up while ElevenLabs connects; the setup waits for it before
+    // sending the initial config, so the handlers below get it before the
+    // first ElevenLabs message
+    const agentSettings = this.loadAgentSettings(customParameters);
+
+    // Handle socket closure; attached before the setup, as the decoder
+    // already reads the socket and the caller may hang up while ElevenLabs
+    // connects
+    let elevenLabsWs = null;
+    let upstream = null;
+    let disconnected = false;
+    const onDisconnect = () => {
+      if (disconnected) return;
+      disconnected = true;
+      callLog.info('Stream disconnected for %s', connectionId);
+      if (upstream) upstream.close();
+      if (elevenLabsWs && elevenLabsWs.readyState === 1) elevenLabsWs.close();
+
+      // Close and cleanup the server
+      onClose();
+    };
+    socket.once('end', onDisconnect);
+    socket.once('close', onDisconnect);
+
+    try {
+      // Set up ElevenLabs with the known parameters immediately
+      callLog.info('Setting up ElevenLabs using known parameters');
+      elevenLabsWs = await setupElevenLabsCallback(connectionId, customParameters, { context, settings: agentSettings, timer });
+
+      if (disconnected || socket.destroyed) {
+        callLog.warn('Caller hung up while ElevenLabs connected for %s', connectionId);
+        if (elevenLabsWs) elevenLabsWs.close();
+        onDisconnect();
+        return;
+      }
+
+      if (!elevenLabsWs) {
+        callLog.error('Failed to establish ElevenLabs connection');
+        // Don't continue with socket setup if no connection
+        socket.end();
+        onClose();
+        return;
+      }
+
+      callLog.info('ElevenLabs connection established successfully');
+
+      // Set up handlers for ElevenLabs messages AFTER connection is established
+      upstream = this.setupElevenLabsHandlers(elevenLabsWs, streamService, connectionId, timer, await agentSettings);
+
+      // Handle incoming packets from Asterisk, starting with any already read
+      const handlePacket = (packet) => {
+        try {
+          streamService.handlePacket(packet);
+        } catch (error) {
+          callLog.error('Error processing packet:', error);
+        }
+      };
+      packets.forEach(handlePacket);
+      decoder.on('data', handlePacket);
+      decoder.resume();
+
+    } catch (wsError) {
+      callLog.error('Error setting up ElevenLabs:', wsError);
+      socket.end();
+      onClose();
+    }
+  }
+
+  /**
+   * Replaces the parameters a call server gives its next calls, e.g. after
+   * the agent of a remote agent's port changed; running calls keep theirs
+   * @param {string} connectionId The connection the server was created for
+   * @param {Object} customParameters The new parameters
+   * @returns {boolean} False if there is no such server
+   */
+  updateCallServer(connectionId, customParameters) {
+    const serverInfo = this.activeServers.get(connectionId);
+    if (!serverInfo) return false;
+    serverInfo.customParameters = customParameters;
+    return true;
+  }
+
   closeCallServer(connectionId, persistant = false) {
     const serverInfo = this.activeServers.get(connectionId);
     if (!serverInfo) return;
@@ -174,76 +569,154 @@ class PortManager extends EventEmitter {
     
     if (!persistant) {
       server.close(() => {
-        console.log(`[PortManager] Server closed for connection ${connectionId} on port ${port}`);
+        log.info('Server closed for connection %s on port %s', connectionId, port);
         this.releasePort(port);
       });
       
       this.activeServers.delete(connectionId);
     } else {
-      console.log(`[PortManager] Server recycle for connection ${connectionId} on port ${port}`);
+      log.info('Server recycle for connection %s on port %s', connectionId, port);
     }
   }
   
-  setupElevenLabsHandlers(elevenLabsWs, streamService, connectionId) {
+  /**
+   * Connects a call's StreamService and ElevenLabs WebSocket in both directions
+   * @returns {UpstreamAggregator} Batches the caller audio; closed when the call ends
+   */
+  setupElevenLabsHandlers(elevenLabsWs, streamService, connectionId, timer = null, agentSettings = {}) {
+    const callLog = elevenLabsLog.child(connectionId);
+
+    // Report the setup phases once the caller hears the agent
+    const markFirstAudio = () => {
+      if (!timer || 'first_audio' in timer.marks) return;
+      timer.mark('first_audio');
+      audiosocketLog.child(connectionId).info('Call setup: %s', timer);
+      this.emit('callTimings', { connectionId, timings: { ...timer.marks } });
+    };
+
+    // Asterisk speaks 8kHz slin; the agent's formats come from its stored
+    // ASR and TTS config and are confirmed by the initiation metadata
+    const formats = {
+      input: agentSettings.inputFormat || ASTERISK_FORMAT,
+      output: agentSettings.outputFormat || ASTERISK_FORMAT,
+    };
+    let toElevenLabs = createConverter(ASTERISK_FORMAT, formats.input, connectionId);
+    let toAsterisk = createConverter(formats.output, ASTERISK_FORMAT, connectionId);
+
+    // Times each turn from the end of the caller's speech to the agent's audio
+    let conversationId = null;
+    const turns = new TurnLatencyTracker({
+      onTurn: ({ agentTurn, hops }) => {
+        const parts = Object.entries(hops)
+          .filter(([hop, ms]) => hop !== 'total' && ms !== null)
+          .map(([hop, ms]) => `${hop} ${ms}`);
+        callLog.info('Turn %s latency %sms: %s', agentTurn, hops.total, parts.join(', '));
+        this.emit('turnLatency', { connectionId, conversationId, agentTurn, hops });
+      },
+    });
+    streamService.on('playoutStarted', () => turns.playoutStarted());
+    streamService.on('asteriskReceived', (receivedAt) => turns.asteriskReceived(receivedAt));
+
+    const playAgentAudio = (audioData) => {
+      const receivedAt = now();
+      const audio = toAsterisk ? toAsterisk.convert(audioData) : audioData;
+      streamService.sendAudio(audio);
+      turns.agentAudio(receivedAt);
+      markFirstAudio();
+    };
+
+    // Caller audio goes out in chunks of the agent's upstream_chunk_ms
+    const upstream = new UpstreamAggregator({
+      chunkMs: agentSettings.upstreamChunkMs,
+      send: (audioData) => {
+        // Only send if WS connection is open
+        if (elevenLabsWs && elevenLabsWs.readyState === 1) { // WebSocket.OPEN
+          const audio = toElevenLabs ? toElevenLabs.convert(audioData) : audioData;
+          if (audio.length === 0) return;
+          // Built as bytes and sent as a text frame, without JSON.stringify
+          elevenLabsWs.send(NativeAudio.encodeUserAudioMessage(audio), { binary: false });
+          turns.callerAudioSent();
+        }
+      },
+    });
 
     streamService.on('audioReceived', (audioData) => {
-      //console.log(`[Audiosocket:${port}] Audio data received: ${audioData.length} bytes`);
-      // Process audio data here if needed
-      // Only send if WS connection is open
-      if (elevenLabsWs && elevenLabsWs.readyState === 1) { // WebSocket.OPEN
-        //console.log(`[Audiosocket:${port}] Sending audio to ElevenLabs`);
-        const audioMessage = {
-          user_audio_chunk: Buffer.from(audioData).toString('base64'),
-        };
-        elevenLabsWs.send(JSON.stringify(audioMessage));
-      } else {
-        //console.log(`[Audiosocket:${port}] WS not ready, state: ${elevenLabsWs?.readyState}`);
-      }
+      callLog.debug('Audio data received: %d bytes', audioData.length);
+      turns.callerAudio(audioData, streamService.asteriskSentAt);
+      upstream.push(audioData);
     });
 
     elevenLabsWs.on("message", data => {
       try {
+        // Audio messages make up most of the traffic; take their audio
+        // straight from the raw message and parse only everything else
+        const agentAudio = NativeAudio.extractAudio(data);
+        if (agentAudio) {
+          callLog.debug('Received audio: %d bytes', agentAudio.length);
+          playAgentAudio(agentAudio);
+          return;
+        }
+
         const message = JSON.parse(data);
-        //console.log(`[ElevenLabs:${connectionId}] Received message type: ${message.type}`);
+        callLog.debug('Received message type: %s', message.type);
         
         switch (message.type) {
           case "audio":
             // Handle audio from ElevenLabs and send to Asterisk
             if (message.audio?.chunk) {
               const audioData = Buffer.from(message.audio.chunk, 'base64');
-              //console.log(`[ElevenLabs:${connectionId}] Received audio chunk: ${audioData.length} bytes`);
-              streamService.sendAudio(audioData);
+              callLog.debug('Received audio chunk: %d bytes', audioData.length);
+              playAgentAudio(audioData);
             } else if (message.audio_event?.audio_base_64) {
               const audioData = Buffer.from(message.audio_event.audio_base_64, 'base64');
-              //console.log(`[ElevenLabs:${connectionId}] Received audio event: ${audioData.length} bytes`);
-              streamService.sendAudio(audioData);
+              callLog.debug('Received audio event: %d bytes', audioData.length);
+              playAgentAudio(audioData);
             }
             break;
+
+          case "conversation_initiation_metadata": {
+            // The formats ElevenLabs actually uses for this conversation
+            const metadata = message.conversation_initiation_metadata_event || {};
+            conversationId = metadata.conversation_id || null;
+            if (metadata.user_input_audio_format && metadata.user_input_audio_format !== formats.input) {
+              formats.input = metadata.user_input_audio_format;
+              toElevenLabs = createConverter(ASTERISK_FORMAT, formats.input, connectionId);
+            }
+            if (metadata.agent_output_audio_format && metadata.agent_output_audio_format !== formats.output) {
+              formats.output = metadata.agent_output_audio_format;
+              toAsterisk = createConverter(formats.output, ASTERISK_FORMAT, connectionId);
+            }
+            break;
+          }
             
           case "agent_response":
+            turns.agentResponse();
             this.emit('agent_response', { connectionId, agent_response: message.agent_response_event?.agent_response });
-            //console.log(`[ElevenLabs:${connectionId}] Agent response: ${message.agent_response_event?.agent_response}`);
+            callLog.debug('Agent response: %s', message.agent_response_event?.agent_response);
             break;
 
           case "agent_response_correction":
             this.emit('agent_response_correction', { connectionId, agent_response_correction: message.correction_event?.corrected_response });
-            //console.log(`[ElevenLabs:${connectionId}] Agent response: ${message.agent_response_event?.agent_response}`);
+            callLog.debug('Agent response correction: %s', message.correction_event?.corrected_response);
             break;
           case "user_transcript":
+            turns.userTranscript();
             this.emit('user_transcript', { connectionId, user_transcript: message.user_transcription_event?.user_transcript });
-            //console.log(`[ElevenLabs:${connectionId}] User transcript: ${message.user_transcription_event?.user_transcript}`);
+            callLog.debug('User transcript: %s', message.user_transcription_event?.user_transcript);
             break;
           
           case "interruption":
             //this.emit('interruption', { connectionId, interruption: message.interruption_event?.event_id });
             streamService.emit('voiceInterrupted');
-            console.log(`[ElevenLabs:${connectionId}] Interruption event`);
+            // The next agent audio starts a new utterance
+            if (toAsterisk) toAsterisk.reset();
+            callLog.info('Interruption event');
             break;
 
           case "ping":
             // Handle pings from ElevenLabs
             if (message.ping_event?.event_id) {
-              //console.log(`[ElevenLabs:${connectionId}] Sending pong`);
+              callLog.debug('Sending pong');
               elevenLabsWs.send(
                 JSON.stringify({
                   type: "pong",
@@ -254,33 +727,46 @@ class PortManager extends EventEmitter {
             break;
             
           default:
-            console.log(`[ElevenLabs:${connectionId}] Received message type: ${message.type}`);
+            callLog.info('Received message type: %s', message.type);
         }
       } catch (error) {
-        console.error(`[ElevenLabs:${connectionId}] Error processing message:`, error);
+        callLog.error('Error processing message:', error);
       }
     });
     
     elevenLabsWs.on("close", () => {
-      console.log(`[ElevenLabs:${connectionId}] WebSocket closed`);
+      callLog.info('WebSocket closed');
+      upstream.close();
+      turns.close();
+      const stats = upstream.getStats();
+      callLog.info('Upstream: %sms chunks, %s messages (%s/s), added latency %sms mean, %sms max', stats.chunkMs, stats.messages, stats.messagesPerSecond, stats.addedLatencyMs, stats.addedLatencyMaxMs);
+      this.emit('upstreamStats', { connectionId, ...stats });
     });
     
     elevenLabsWs.on("error", (error) => {
-      console.error(`[ElevenLabs:${connectionId}] WebSocket error:`, error);
+      callLog.error('WebSocket error:', error);
     });
+
+    return upstream;
   }
   
   closeAllServers() {
-    console.log(`[PortManager] Closing all active servers (${this.activeServers.size})`);
+    log.info('Closing all active servers (%s)', this.activeServers.size);
     
     for (const [connectionId, { server, port }] of this.activeServers.entries()) {
-      console.log(`[PortManager] Closing server for ${connectionId} on port ${port}`);
+      log.info('Closing server for %s on port %s', connectionId, port);
       server.close(() => {
         this.releasePort(port);
       });
     }
     
     this.activeServers.clear();
+
+    for (const server of this.listeners) {
+      server.close();
+    }
+    this.listeners = [];
+    this.routes.clear();
   }
 }
 
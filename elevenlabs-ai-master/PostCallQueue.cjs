@@ -0,0 +1,252 @@
+const fs = require('fs');
+const path = require('path');
+const EventEmitter = require('events');
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
+
+// Payloads persisted per transaction
+const DEFAULT_BATCH_SIZE = 20;
+
+// Retry delays double from the first to the last
+const RETRY_MIN_DELAY = 1000;
+const RETRY_MAX_DELAY = 60 * 1000;
+
+// Payloads the database rejects are moved aside after this many attempts
+const MAX_ATTEMPTS = 10;
+
+// Errors of the connection rather than of the payload; these are retried
+// until the database is back
+const CONNECTION_ERROR_CODES = new Set([
+  'ECONNREFUSED', 'ECONNRESET', 'ETIMEDOUT', 'EHOSTUNREACH', 'ENETUNREACH', 'ENOTFOUND', 'EAI_AGAIN', 'EPIPE',
+  'PROTOCOL_CONNECTION_LOST', 'PROTOCOL_SEQUENCE_TIMEOUT', 'ER_CON_COUNT_ERROR', 'ER_SERVER_SHUTDOWN',
+]);
+
+/**
+ * Whether a store() failure means the database could not be reached
+ * @param {Error} error The error thrown by store()
+ * @returns {boolean} True for connection errors
+ */
+function isConnectionError(error) {
+  return Boolean(error && (error.fatal || CONNECTION_ERROR_CODES.has(error.code)));
+}
+
+// How often the throughput and queue depth are logged while there is work
+const STATS_INTERVAL = 60 * 1000;
+
+/**
+ * PostCallQueue - Durable write-behind queue of post-call webhook payloads
+ * enqueue() writes a payload to its own file in the queue directory (synced
+ * and renamed into place) and resolves, so the webhook can be acknowledged
+ * without waiting for the database. The writer then hands the payloads in
+ * arrival order, up to batchSize at a time, to store(). Once it resolves, the
+ * files are deleted. A batch that fails is retried payload by payload with
+ * exponential backoff; while the database cannot be reached the retries go
+ * on every RETRY_MAX_DELAY for as long as it takes. Payloads the database
+ * still rejects after MAX_ATTEMPTS, or that cannot be read, are moved to the
+ * failed/ subdirectory. Files left by a previous
+ * run are picked up by start(), so a payload is stored at least once.
+ */
+class PostCallQueue extends EventEmitter {
+  /**
+   * @param {Object} options
+   * @param {string} options.dir Queue directory
+   * @param {Function} options.store Persists an array of payloads; throws on failure
+   * @param {number} options.batchSize Most payloads per store() call
+   */
+  constructor({
+    dir = process.env.POSTCALL_QUEUE_DIR || path.join(__dirname, 'postcall-queue'),
+    store,
+    batchSize = parseInt(process.env.POSTCALL_BATCH_SIZE || DEFAULT_BATCH_SIZE, 10),
+  }) {
+    super();
+    this.dir = dir;
+    this.failedDir = path.join(dir, 'failed');
+    this.store = store;
+    this.batchSize = batchSize;
+    this.pending = []; // File names in arrival order
+    this.attempts = new Map(); // File name -> failed attempts
+    this.sequence = 0;
+    this.draining = false;
+    this.retryTimer = null;
+    this.lastError = null; // Error of the last failed store()
+    this.stats = { enqueued: 0, stored: 0, failed: 0, retries: 0, batches: 0 };
+    this.reported = { stored: 0, at: Date.now() };
+    this.statsTimer = null;
+  }
+
+  /**
+   * Creates the queue directory and resumes the payloads left in it
+   */
+  async start() {
+    await fs.promises.mkdir(this.failedDir, { recursive: true });
+    const files = (await fs.promises.readdir(this.dir)).filter((name) => name.endsWith('.json')).sort();
+    this.pending.push(...files);
+    if (files.length > 0) {
+      console.log(`[PostCallQueue] Resuming ${files.length} queued payloads`);
+    }
+    this.statsTimer = sharedTimerWheel.every(STATS_INTERVAL, () => this.reportStats());
+    this.drain();
+  }
+
+  /**
+   * Stores a payload durably and schedules it for the database
+   * @param {Object} payload The webhook body
+   * @returns {Promise<void>} Resolves once the payload is on disk
+   */
+  async enqueue(payload) {
+    // Names sort in arrival order
+    const name = `${Date.now().toString().padStart(15, '0')}-${String(this.sequence++).padStart(6, '0')}.json`;
+    const file = path.join(this.dir, name);
+    const tmp = `${file}.tmp`;
+    const handle = await fs.promises.open(tmp, 'w');
+    try {
+      await handle.writeFile(JSON.stringify(payload));
+      await handle.sync();
+    } finally {
+      await handle.close();
+    }
+    await fs.promises.rename(tmp, file);
+
+    this.pending.push(name);
+    this.stats.enqueued++;
+    this.drain();
+  }
+
+  /**
+   * Persists the queued payloads until the queue is empty or a retry is due
+   */
+  async drain() {
+    if (this.draining || this.retryTimer) return;
+    this.draining = true;
+    try {
+      while (this.pending.length > 0) {
+        // A batch only shares a transaction with payloads that never failed,
+        // so a bad payload is retried on its own
+        const retrying = this.attempts.has(this.pending[0]);
+        const batch = retrying ? this.pending.slice(0, 1) : this.takeFreshBatch();
+        const stored = await this.storeBatch(batch);
+        if (!stored && batch.length === 1) {
+          this.scheduleRetry(batch[0]);
+          return;
+        }
+      }
+    } finally {
+      this.draining = false;
+    }
+  }
+
+  takeFreshBatch() {
+    const batch = [];
+    for (const name of this.pending) {
+      if (batch.length >= this.batchSize || this.attempts.has(name)) break;
+      batch.push(name);
+    }
+    return batch;
+  }
+
+  /**
+   * Reads and stores a batch, removing its files once committed
+   * @returns {Promise<boolean>} False if store() failed
+   */
+  async storeBatch(batch) {
+    const payloads = [];
+    const names = [];
+    for (const name of batch) {
+      try {
+        payloads.push(JSON.parse(await fs.promises.readFile(path.join(this.dir, name), 'utf8')));
+        names.push(name);
+      } catch (error) {
+        console.error(`[PostCallQueue] Unreadable payload ${name}: ${error.message}`);
+        await this.moveToFailed(name);
+      }
+    }
+    if (names.length === 0) return true;
+
+    try {
+      await this.store(payloads);
+    } catch (error) {
+      console.error(`[PostCallQueue] Storing ${names.length} payloads failed: ${error.message}`);
+      this.lastError = error;
+      // Mark them for one-by-one retries
+      for (const name of names) {
+        if (!this.attempts.has(name)) this.attempts.set(name, 0);
+      }
+      if (names.length === 1) this.attempts.set(names[0], this.attempts.get(names[0]) + 1);
+      return false;
+    }
+
+    this.stats.batches++;
+    this.stats.stored += names.length;
+    for (const name of names) {
+      this.attempts.delete(name);
+      this.remove(name);
+      await fs.promises.unlink(path.join(this.dir, name)).catch((error) => {
+        console.error(`[PostCallQueue] Could not delete ${name}: ${error.message}`);
+      });
+    }
+    this.emit('stored', names.length);
+    return true;
+  }
+
+  scheduleRetry(name) {
+    const attempts = this.attempts.get(name);
+    const unreachable = isConnectionError(this.lastError);
+    if (attempts >= MAX_ATTEMPTS && !unreachable) {
+      console.error(`[PostCallQueue] Giving up on ${name} after ${attempts} attempts`);
+      this.moveToFailed(name).then(() => this.drain());
+      return;
+    }
+    const delay = Math.min(RETRY_MAX_DELAY, RETRY_MIN_DELAY * 2 ** Math.min(attempts - 1, 16));
+    this.stats.retries++;
+    if (unreachable) {
+      console.warn(`[PostCallQueue] Database unreachable, retrying ${name} in ${delay}ms (attempt ${attempts + 1})`);
+    } else {
+      console.warn(`[PostCallQueue] Retrying ${name} in ${delay}ms (attempt ${attempts + 1} of ${MAX_ATTEMPTS})`);
+    }
+    this.retryTimer = sharedTimerWheel.schedule(delay, () => {
+      this.retryTimer = null;
+      this.drain();
+    });
+  }
+
+  async moveToFailed(name) {
+    this.remove(name);
+    this.attempts.delete(name);
+    this.stats.failed++;
+    await fs.promises.rename(path.join(this.dir, name), path.join(this.failedDir, name)).catch((error) => {
+      console.error(`[PostCallQueue] Could not move ${name} to failed: ${error.message}`);
+    });
+  }
+
+  remove(name) {
+    const index = this.pending.indexOf(name);
+    if (index !== -1) this.pending.splice(index, 1);
+  }
+
+  reportStats() {
+    const stats = this.getStats();
+    if (stats.depth === 0 && stats.storedPerSecond === 0) return;
+    console.log(`[PostCallQueue] Depth ${stats.depth}, stored ${stats.stored} (${stats.storedPerSecond}/s), retries ${stats.retries}, failed ${stats.failed}`);
+    this.reported = { stored: this.stats.stored, at: Date.now() };
+  }
+
+  /**
+   * Get the queue statistics
+   * @returns {Object} Queue depth, payload counts and the store rate since the last report
+   */
+  getStats() {
+    const seconds = (Date.now() - this.reported.at) / 1000;
+    const storedPerSecond = seconds > 0 ? Math.round((this.stats.stored - this.reported.stored) / seconds * 10) / 10 : 0;
+    return { depth: this.pending.length, ...this.stats, storedPerSecond };
+  }
+
+  /**
+   * Stops the writer; queued payloads stay on disk for the next start
+   */
+  close() {
+    if (this.statsTimer) this.statsTimer.cancel();
+    if (this.retryTimer) this.retryTimer.cancel();
+    this.retryTimer = null;
+  }
+}
+
+module.exports = PostCallQueue;
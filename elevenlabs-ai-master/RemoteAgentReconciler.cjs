@@ -0,0 +1,197 @@
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
+
+// How often remote agents changed since the last sync are read
+const DEFAULT_POLL_INTERVAL = 5 * 1000;
+
+// How often every remote agent is read, to catch deleted rows and changes
+// the high-water mark missed
+const DEFAULT_FULL_INTERVAL = 60 * 1000;
+
+/**
+ * RemoteAgentReconciler - Keeps one AudioSocket server per active remote agent
+ * The desired state is the active remote agents with an audio port, by
+ * remote agent ID; the actual state is the servers this reconciler opened,
+ * by port. Each sync reads only the rows whose modified_at is at or after
+ * the newest one seen (the high-water mark), updates the desired state and
+ * opens or closes just the servers that differ. A port whose agent changed
+ * keeps its server, which gives its next calls to the new agent. A full read every
+ * fullInterval rebuilds the desired state from scratch. trigger() runs a
+ * sync right away, for changes made through the dashboard API. Without the
+ * modified_at column every sync is a full read.
+ */
+class RemoteAgentReconciler {
+  /**
+   * @param {Object} options
+   * @param {DatabaseManager} options.dbManager Reads the remote agents
+   * @param {PortManager} options.portManager Owns the servers
+   * @param {Function} options.openServer (agent) => opens the server of an
+   *   agent on agent.audio_port; returns false if the port is taken
+   * @param {Function} options.onActive (agentId) => called for every active
+   *   agent on full syncs, e.g. to keep its sessions warm
+   * @param {number} options.pollInterval Milliseconds between change reads
+   * @param {number} options.fullInterval Milliseconds between full reads
+   */
+  constructor({
+    dbManager,
+    portManager,
+    openServer,
+    onActive = () => {},
+    pollInterval = parseInt(process.env.REMOTE_AGENTS_POLL_INTERVAL || DEFAULT_POLL_INTERVAL, 10),
+    fullInterval = parseInt(process.env.CHECK_REMOTE_AGENTS_INTERVAL || DEFAULT_FULL_INTERVAL, 10),
+    wheel = sharedTimerWheel,
+  }) {
+    this.dbManager = dbManager;
+    this.portManager = portManager;
+    this.openServer = openServer;
+    this.onActive = onActive;
+    this.pollInterval = pollInterval;
+    this.fullInterval = fullInterval;
+    this.wheel = wheel;
+    this.desired = new Map(); // Remote agent ID -> { port, agentId }
+    this.actual = new Map(); // Port -> agent ID the server was opened for
+    this.highWater = null; // Newest modified_at seen, in unix seconds
+    this.incremental = true; // Cleared when the modified_at column is missing
+    this.lastFull = 0;
+    this.running = null;
+    this.rerun = false;
+    this.timer = null;
+    this.stats = { syncs: 0, fullSyncs: 0, rows: 0, opened: 0, closed: 0, switched: 0 };
+  }
+
+  /**
+   * Runs the first full sync and starts polling
+   * @returns {Promise<void>} Resolves after the first sync
+   */
+  async start() {
+    await this.sync();
+    this.timer = this.wheel.every(this.pollInterval, () => this.sync());
+  }
+
+  /**
+   * Syncs now, e.g. after an agent was enabled or disabled
+   * @returns {Promise<void>} Resolves once the change is applied
+   */
+  trigger() {
+    return this.sync();
+  }
+
+  /**
+   * Reads the changes and applies them; a call while a sync runs queues one
+   * more sync after it, so no change made before the call is missed
+   */
+  sync() {
+    if (this.running) {
+      this.rerun = true;
+      return this.running;
+    }
+    this.running = (async () => {
+      do {
+        this.rerun = false;
+        try {
+          await this.syncOnce();
+        } catch (error) {
+          console.error('[RemoteAgents] Error syncing remote agents:', error);
+        }
+      } while (this.rerun);
+      this.running = null;
+    })();
+    return this.running;
+  }
+
+  async syncOnce() {
+    const full = !this.incremental || this.highWater === null || Date.now() - this.lastFull >= this.fullInterval;
+    let rows;
+    try {
+      rows = await this.dbManager.getRemoteAgentChanges(full ? null : this.highWater, this.incremental);
+    } catch (error) {
+      if (error.code !== 'ER_BAD_FIELD_ERROR' || !this.incremental) throw error;
+      console.warn('[RemoteAgents] osdial_remote_agents has no modified_at column, reading all remote agents on every sync');
+      this.incremental = false;
+      rows = await this.dbManager.getRemoteAgentChanges(null, false);
+    }
+
+    this.stats.syncs++;
+    this.stats.rows += rows.length;
+    if (full) {
+      this.stats.fullSyncs++;
+      this.lastFull = Date.now();
+      this.desired.clear();
+    }
+    for (const row of rows) {
+      if (row.modified_unix != null && (this.highWater === null || row.modified_unix > this.highWater)) {
+        this.highWater = row.modified_unix;
+      }
+      const port = parseInt(row.audio_port, 10);
+      if (row.status === 'ACTIVE' && port > 0) {
+        this.desired.set(String(row.remote_agent_id), {
+          port,
+          agentId: row.agent_id || process.env.ELEVENLABS_AGENT_ID,
+        });
+      } else {
+        this.desired.delete(String(row.remote_agent_id));
+      }
+    }
+    this.apply(full);
+  }
+
+  /**
+   * Opens and closes the servers that differ from the desired state
+   * @param {boolean} full Whether this follows a full read
+   */
+  apply(full) {
+    const wanted = new Map(); // Port -> agent ID
+    for (const [remoteAgentId, { port, agentId }] of this.desired) {
+      if (wanted.has(port)) {
+        console.warn(`[RemoteAgents] Port ${port} of remote agent ${remoteAgentId} is used by another remote agent`);
+        continue;
+      }
+      wanted.set(port, agentId);
+      if (full) this.onActive(agentId);
+    }
+
+    for (const [port, agentId] of this.actual) {
+      const wantedAgentId = wanted.get(port);
+      if (wantedAgentId === agentId) continue;
+      if (wantedAgentId !== undefined) {
+        // Closing would hold the port until its running calls end, so the
+        // server stays and its next calls go to the new agent
+        console.log(`[RemoteAgents] Switching call server on port ${port} to agent ${wantedAgentId}`);
+        this.portManager.updateCallServer(String(port), { agent_id: wantedAgentId });
+        this.actual.set(port, wantedAgentId);
+        this.stats.switched++;
+        if (!full) this.onActive(wantedAgentId);
+        continue;
+      }
+      console.log(`[RemoteAgents] Closing call server on port ${port}`);
+      this.portManager.closeCallServer(String(port), false);
+      this.actual.delete(port);
+      this.stats.closed++;
+    }
+
+    for (const [port, agentId] of wanted) {
+      if (this.actual.has(port)) continue;
+      try {
+        if (this.openServer({ audio_port: port, agent_id: agentId }) === false) {
+          console.warn(`[RemoteAgents] Port ${port} is already in use`);
+          continue;
+        }
+        this.actual.set(port, agentId);
+        this.stats.opened++;
+        if (!full) this.onActive(agentId);
+      } catch (error) {
+        console.error(`[RemoteAgents] Error creating call server on port ${port}:`, error);
+      }
+    }
+  }
+
+  getStats() {
+    return { ...this.stats, desired: this.desired.size, servers: this.actual.size, highWater: this.highWater, incremental: this.incremental };
+  }
+
+  close() {
+    if (this.timer) this.timer.cancel();
+    this.timer = null;
+  }
+}
+
+module.exports = RemoteAgentReconciler;
@@ -0,0 +1,161 @@
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
+
+// How long a logged-in session is trusted without asking the database again
+const DEFAULT_TTL = 60 * 1000;
+
+// How long an unknown or anonymous session ID is remembered as such
+const DEFAULT_NEGATIVE_TTL = 5 * 1000;
+
+// Most sessions held; the least recently used one is dropped beyond it
+const DEFAULT_MAX_ENTRIES = 10000;
+
+// How often the hit rate is logged while there are lookups
+const STATS_INTERVAL = 60 * 1000;
+
+/**
+ * SessionCache - LRU cache in front of the PHP session lookup
+ * Dashboards send their session ID with every message until the connection
+ * is bound to a user, so a reconnect storm after a deploy would otherwise run
+ * the same sessions query and PHP unserialize many times over. Sessions with
+ * a user are kept for ttl, unknown sessions and sessions without a user for
+ * negativeTtl. Concurrent lookups of one session ID share a single query.
+ * Failed lookups are not cached. A logout takes up to ttl to be noticed.
+ */
+class SessionCache {
+  /**
+   * @param {Function} load Looks up a session ID; resolves to the parsed session or null
+   * @param {Object} options
+   * @param {number} options.ttl Milliseconds a session with a user is kept
+   * @param {number} options.negativeTtl Milliseconds any other result is kept
+   * @param {number} options.maxEntries Most sessions held
+   * @param {TimerWheel} options.wheel Wheel for the periodic stats line
+   */
+  constructor(load, {
+    ttl = parseInt(process.env.SESSION_CACHE_TTL || DEFAULT_TTL, 10),
+    negativeTtl = parseInt(process.env.SESSION_CACHE_NEGATIVE_TTL || DEFAULT_NEGATIVE_TTL, 10),
+    maxEntries = parseInt(process.env.SESSION_CACHE_SIZE || DEFAULT_MAX_ENTRIES, 10),
+    wheel = sharedTimerWheel,
+  } = {}) {
+    this.load = load;
+    this.ttl = ttl;
+    this.negativeTtl = negativeTtl;
+    this.maxEntries = maxEntries;
+    this.entries = new Map(); // Session ID -> { value, expires }, least recently used first
+    this.inflight = new Map(); // Session ID -> pending lookup
+    this.stats = { hits: 0, negativeHits: 0, misses: 0, coalesced: 0, evictions: 0, errors: 0 };
+    this.reported = { ...this.stats };
+    this.statsTimer = wheel.every(STATS_INTERVAL, () => this.reportStats());
+  }
+
+  /**
+   * Gets a session, from the cache when possible
+   * @param {string} sessionId The PHP session ID
+   * @returns {Promise<Object|null>} The parsed session, or null if unknown
+   */
+  async get(sessionId) {
+    const entry = this.entries.get(sessionId);
+    if (entry) {
+      if (entry.expires > Date.now()) {
+        // Move to the most recently used end
+        this.entries.delete(sessionId);
+        this.entries.set(sessionId, entry);
+        if (entry.positive) {
+          this.stats.hits++;
+        } else {
+          this.stats.negativeHits++;
+        }
+        return entry.value;
+      }
+      this.entries.delete(sessionId);
+    }
+
+    const pending = this.inflight.get(sessionId);
+    if (pending) {
+      this.stats.coalesced++;
+      return pending;
+    }
+
+    this.stats.misses++;
+    const lookup = this.lookup(sessionId);
+    this.inflight.set(sessionId, lookup);
+    return lookup;
+  }
+
+  async lookup(sessionId) {
+    try {
+      const value = await this.load(sessionId);
+      const positive = Boolean(value?.data?.PHP_AUTH_USER);
+      this.set(sessionId, value, positive);
+      return value;
+    } catch (error) {
+      this.stats.errors++;
+      throw error;
+    } finally {
+      this.inflight.delete(sessionId);
+    }
+  }
+
+  set(sessionId, value, positive) {
+    this.entries.delete(sessionId);
+    this.entries.set(sessionId, {
+      value,
+      positive,
+      expires: Date.now() + (positive ? this.ttl : this.negativeTtl),
+    });
+    while (this.entries.size > this.maxEntries) {
+      this.entries.delete(this.entries.keys().next().value);
+      this.stats.evictions++;
+    }
+  }
+
+  reportStats() {
+    const lookups = (stats) => stats.hits + stats.negativeHits + stats.misses + stats.coalesced;
+    const count = lookups(this.stats) - lookups(this.reported);
+    if (count === 0) return;
+    const stats = this.getStats();
+    console.log(`[SessionCache] ${count} lookups, hit rate ${stats.hitRate}, ${stats.size} sessions, ${stats.evictions} evictions`);
+    this.reported = { ...this.stats };
+  }
+
+  /**
+   * Get the cache statistics
+   * @returns {Object} Counters since start, the share of lookups answered
+   *   without a query of their own and the number of cached sessions
+   */
+  getStats() {
+    const { hits, negativeHits, misses, coalesced } = this.stats;
+    const lookups = hits + negativeHits + misses + coalesced;
+    const hitRate = lookups > 0 ? Math.round((lookups - misses) / lookups * 1000) / 1000 : 0;
+    return { ...this.stats, lookups, hitRate, size: this.entries.size, inflight: this.inflight.size };
+  }
+
+  /**
+   * Formats the statistics as Prometheus counters and gauges
+   * @returns {string} The metrics in the Prometheus text format
+   */
+  toPrometheus() {
+    const name = 'elevenlabs_bridge_session_cache';
+    const stats = this.getStats();
+    return [
+      `# HELP ${name}_lookups_total Session lookups by result: hit, negative_hit, miss (query) or coalesced (joined a running query).`,
+      `# TYPE ${name}_lookups_total counter`,
+      `${name}_lookups_total{result="hit"} ${stats.hits}`,
+      `${name}_lookups_total{result="negative_hit"} ${stats.negativeHits}`,
+      `${name}_lookups_total{result="miss"} ${stats.misses}`,
+      `${name}_lookups_total{result="coalesced"} ${stats.coalesced}`,
+      `# TYPE ${name}_evictions_total counter`,
+      `${name}_evictions_total ${stats.evictions}`,
+      `# TYPE ${name}_errors_total counter`,
+      `${name}_errors_total ${stats.errors}`,
+      `# TYPE ${name}_entries gauge`,
+      `${name}_entries ${stats.size}`,
+      '',
+    ].join('\n');
+  }
+
+  close() {
+    this.statsTimer.cancel();
+  }
+}
+
+module.exports = SessionCache;
@@ -1,46 +1,352 @@
 const { Buffer } = require('buffer');
+const { performance } = require('perf_hooks');
 const EventEmitter = require('events');
+const { TraceRecorder, TRACE_DIRECTIONS } = require('./TraceRecorder.cjs');
+const { sharedPacer } = require('./AudioPacer.cjs');
+const NativeAudio = require('./NativeAudio.cjs');
+const { sharedMemoryGovernor } = require('./MemoryGovernor.cjs');
+const { createLogger } = require('./Logger.cjs');
+
+const log = createLogger('Audiosocket');
 
 // Define packet types for Asterisk audiosocket
 const PACKET_TYPES = {
   TERMINATE: 0x00,
   UUID: 0x01,
   AUDIO: 0x10,
+  TIMESTAMP: 0x20,
   ERROR: 0xff,
 };
 
+// Events of the optional timestamp packets of res_audiosocket; the payload
+// is the event followed by big-endian microseconds since the epoch
+const TIMESTAMP_EVENTS = {
+  SENT: 0x01, // Asterisk sent the audio packet that follows
+  REQUEST: 0x02, // Asks Asterisk to stamp the audio packet that follows
+  RECEIVED: 0x03, // Asterisk read a request; the request's time follows
+};
+
+// 20ms of 8kHz signed linear audio
+const FRAME_BYTES = 320;
+
+// Upper bound on queued playout, in frames (60 seconds)
+const MAX_QUEUED_FRAMES = 3000;
+
+// Default playout budget per call in bytes, the same 60 seconds of packets
+const DEFAULT_PLAYOUT_BUDGET_BYTES = MAX_QUEUED_FRAMES * (FRAME_BYTES + 3);
+
+// What to do with new audio once the budget is used up: 'reject' drops the
+// new audio, 'oldest' drops queued audio to make room for it
+const DROP_POLICIES = ['reject', 'oldest'];
+
+/**
+ * FrameRing - Fixed-capacity FIFO of ready-to-send AudioSocket packets
+ * Each slot holds a packet and, for the last packet of a TTS chunk, the size
+ * of that chunk so 'audioSent' can be reported once the chunk has played.
+ */
+class FrameRing {
+  constructor(capacity) {
+    this.capacity = capacity;
+    this.frames = new Array(capacity);
+    this.chunkBytes = new Uint32Array(capacity);
+    this.head = 0;
+    this.length = 0;
+    this.bytes = 0;
+    this.lastChunkBytes = 0;
+  }
+
+  /**
+   * Append a packet
+   * @returns {boolean} False if the ring is full and the packet was not added
+   */
+  push(frame, chunkBytes = 0) {
+    if (this.length === this.capacity) return false;
+    const index = (this.head + this.length) % this.capacity;
+    this.frames[index] = frame;
+    this.chunkBytes[index] = chunkBytes;
+    this.length++;
+    this.bytes += frame.length;
+    return true;
+  }
+
+  /**
+   * Remove the oldest packet; its chunk size is left in lastChunkBytes
+   * @returns {Buffer|undefined} The packet, or undefined if the ring is empty
+   */
+  shift() {
+    if (this.length === 0) return undefined;
+    const frame = this.frames[this.head];
+    this.lastChunkBytes = this.chunkBytes[this.head];
+    this.frames[this.head] = undefined;
+    this.head = (this.head + 1) % this.capacity;
+    this.length--;
+    this.bytes -= frame.length;
+    return frame;
+  }
+
+  clear() {
+    this.frames.fill(undefined);
+    this.head = 0;
+    this.length = 0;
+    this.bytes = 0;
+  }
+}
+
+/**
+ * Builds a packet asking Asterisk to stamp the audio packet that follows it
+ * @returns {Buffer} The packet, carrying the current time
+ */
+function timestampRequest() {
+  const packet = Buffer.allocUnsafe(12);
+  packet[0] = PACKET_TYPES.TIMESTAMP;
+  packet.writeUInt16BE(9, 1);
+  packet[3] = TIMESTAMP_EVENTS.REQUEST;
+  packet.writeBigUInt64BE(BigInt(Math.round((performance.timeOrigin + performance.now()) * 1000)), 4);
+  return packet;
+}
+
+/**
+ * Reads the playout budget and drop policy from the environment
+ * @returns {Object} budgetBytes and dropPolicy
+ */
+function playoutLimitsFromEnv() {
+  const budgetBytes = parseInt(process.env.PLAYOUT_BUDGET_BYTES, 10);
+  const dropPolicy = (process.env.PLAYOUT_DROP_POLICY || '').toLowerCase();
+  return {
+    budgetBytes: budgetBytes > 0 ? budgetBytes : DEFAULT_PLAYOUT_BUDGET_BYTES,
+    dropPolicy: DROP_POLICIES.includes(dropPolicy) ? dropPolicy : 'reject',
+  };
+}
+
 // StreamService implementation (optimized version)
 class StreamService extends EventEmitter {
-  constructor(socket) {
+  /**
+   * @param {net.Socket} socket The AudioSocket connection
+   * @param {AudioPacer} pacer Clock that writes the queued frames
+   * @param {Object} options
+   * @param {number} options.budgetBytes Most playout bytes queued at once
+   * @param {string} options.dropPolicy 'reject' or 'oldest', see DROP_POLICIES
+   * @param {MemoryGovernor} options.memory Process-wide byte accounting
+   */
+  constructor(socket, pacer = sharedPacer, {
+    budgetBytes,
+    dropPolicy,
+    memory = sharedMemoryGovernor,
+  } = {}) {
     super();
+    const limits = playoutLimitsFromEnv();
     this.socket = socket;
     this.uuid = null;
-    this.audioQueue = []; // Initialize audio queue
-    this.isSending = false; // Flag to prevent concurrent sending
+    this.pacer = pacer; // Process-wide clock that writes our frames
+    this.frames = new FrameRing(MAX_QUEUED_FRAMES); // Framed audio awaiting playout
+    this.budgetBytes = budgetBytes || limits.budgetBytes;
+    this.dropPolicy = DROP_POLICIES.includes(dropPolicy) ? dropPolicy : limits.dropPolicy;
+    this.memory = memory;
+    this.droppedFrames = 0; // Frames dropped to stay within the budget
+    this.isSending = false; // True while registered with the pacer
+    this.writeBlocked = false; // True from a full socket write until 'drain'
+    this.writeStalls = 0; // Times the socket refused more data
+    this.stalledTicks = 0; // Pacer ticks skipped while blocked
+    this.stallMs = 0; // Total time spent blocked
+    this.stalledAt = 0;
+    this.peakQueuedBytes = 0;
+    this.playoutStarting = false; // True until the first frame of an utterance is written
+    this.timestampsEnabled = false; // True once Asterisk has sent a timestamp
+    this.asteriskSentAt = null; // Time Asterisk sent the last audio packet, in epoch ms
     this.packetHandlers = {
       [PACKET_TYPES.TERMINATE]: this.handleTerminatePacket.bind(this),
       [PACKET_TYPES.UUID]: this.handleUUIDPacket.bind(this),
       [PACKET_TYPES.AUDIO]: this.handleAudioPacket.bind(this),
+      [PACKET_TYPES.TIMESTAMP]: this.handleTimestampPacket.bind(this),
       [PACKET_TYPES.ERROR]: this.handleErrorPacket.bind(this),
     };
     
     // Listen for voice interruption events
     this.on('voiceInterrupted', this.clearAudioBuffer.bind(this));
+
+    // Opt-in recording of the raw AudioSocket traffic
+    this.trace = null;
+    if (socket) {
+      socket.once('close', () => this.stopPlayout());
+      const trace = TraceRecorder.fromEnv(`${socket.localPort}-${socket.remotePort}`);
+      if (trace) this.startTrace(trace);
+    }
+  }
+
+  /**
+   * Starts recording all AudioSocket packets of this stream to a trace
+   * The trace is closed automatically when the socket closes
+   * @param {TraceRecorder|string} trace A recorder, or the path of a trace file to create
+   * @returns {StreamService} This instance, for method chaining
+   */
+  startTrace(trace) {
+    this.stopTrace();
+    this.trace = typeof trace === 'string' ? new TraceRecorder(trace) : trace;
+    log.info('Recording trace to %s', this.trace.filePath);
+    this.socket.once('close', () => this.stopTrace());
+    return this;
   }
 
-  async sendAudio(audio) {
-    this.audioQueue.push(audio); // Add audio to the queue
-    if (!this.isSending) {
-      this.processAudioQueue(); // Start processing the queue if not already in progress
+  /**
+   * Stops recording the trace, if one is active
+   */
+  stopTrace() {
+    if (this.trace) {
+      this.trace.close();
+      this.trace = null;
     }
   }
 
+  /**
+   * Queues TTS audio for playout
+   * The audio is split into AudioSocket packets once, into a single buffer, and
+   * the shared pacer writes one packet per 20ms tick. Audio beyond the playout
+   * budget is dropped according to the drop policy.
+   * @param {Buffer} audio Signed linear audio
+   */
+  sendAudio(audio) {
+    if (!audio || audio.length === 0) return;
+    // Nothing would ever play it, or release its bytes
+    if (this.socket && this.socket.destroyed) return;
+
+    const framed = NativeAudio.encodeFrames(audio, FRAME_BYTES);
+    const queuedBefore = this.frames.bytes;
+    let rejected = 0;
+    let evicted = 0;
+    let offset = 0;
+    for (let i = 0; i < audio.length; i += FRAME_BYTES) {
+      const length = Math.min(FRAME_BYTES, audio.length - i);
+      const packet = framed.subarray(offset, offset + 3 + length);
+      const isLast = i + length >= audio.length;
+      offset += 3 + length;
+
+      if (this.dropPolicy === 'oldest') {
+        while (this.frames.length > 0 &&
+               (this.frames.bytes + packet.length > this.budgetBytes || this.frames.length === this.frames.capacity)) {
+          this.frames.shift();
+          evicted++;
+        }
+      }
+      if (this.frames.bytes + packet.length > this.budgetBytes || !this.frames.push(packet, isLast ? audio.length : 0)) {
+        rejected = Math.ceil((audio.length - i) / FRAME_BYTES);
+        break;
+      }
+    }
+
+    this.memory.reserve(this.frames.bytes - queuedBefore);
+    this.peakQueuedBytes = Math.max(this.peakQueuedBytes, this.frames.bytes);
+    if (rejected > 0 || evicted > 0) {
+      this.droppedFrames += rejected + evicted;
+      log.warn('Playout budget of %s bytes reached, dropped %s frames (%s)', this.budgetBytes, rejected + evicted, this.dropPolicy);
+    }
+
+    if (!this.isSending && this.frames.length > 0) {
+      this.isSending = true;
+      this.playoutStarting = true;
+      this.pacer.add(this);
+    }
+  }
+
+  /**
+   * Writes the next queued packet; called by the pacer once per tick
+   * While the socket is blocked the tick is skipped, so the frames wait in
+   * the budgeted ring rather than piling up in the socket's write buffer.
+   * @returns {boolean} False once there is nothing left to play
+   */
+  writeNextFrame() {
+    if (this.socket.destroyed) {
+      this.dropQueuedFrames();
+      this.isSending = false;
+      return false;
+    }
+    if (this.frames.length === 0) {
+      this.isSending = false;
+      return false;
+    }
+    if (this.writeBlocked) {
+      this.stalledTicks++;
+      return true;
+    }
+
+    const packet = this.frames.shift();
+    this.memory.release(packet.length);
+    if (this.playoutStarting) {
+      // Ask Asterisk when the first frame of the utterance reaches it
+      if (this.timestampsEnabled) {
+        const request = timestampRequest();
+        this.socket.write(request);
+        if (this.trace) this.trace.record(TRACE_DIRECTIONS.TO_ASTERISK, request);
+      }
+      this.playoutStarting = false;
+      this.emit('playoutStarted');
+    }
+    if (!this.socket.write(packet)) {
+      this.waitForDrain();
+    }
+    if (this.trace) this.trace.record(TRACE_DIRECTIONS.TO_ASTERISK, packet);
+    if (this.frames.lastChunkBytes > 0) {
+      this.emit('audioSent', this.frames.lastChunkBytes);
+    }
+    return true;
+  }
+
+  /**
+   * Holds playout until the socket has flushed its write buffer
+   */
+  waitForDrain() {
+    this.writeBlocked = true;
+    this.writeStalls++;
+    this.stalledAt = Date.now();
+    this.socket.once('drain', () => {
+      this.writeBlocked = false;
+      this.stallMs += Date.now() - this.stalledAt;
+    });
+  }
+
+  /**
+   * Stops playout and releases this stream from the pacer
+   */
+  stopPlayout() {
+    this.dropQueuedFrames();
+    this.isSending = false;
+    this.pacer.remove(this);
+  }
+
+  /**
+   * Empties the playout ring and returns its bytes to the memory accounting
+   */
+  dropQueuedFrames() {
+    this.memory.release(this.frames.bytes);
+    this.frames.clear();
+  }
+
+  /**
+   * Get the playout statistics of the stream
+   * @returns {Object} Queue depth in frames and bytes, its peak and budget,
+   *   dropped frames, write stalls, ticks skipped and time spent stalled, and
+   *   the bytes waiting in the socket's own buffer
+   */
+  getStats() {
+    return {
+      queuedFrames: this.frames.length,
+      queuedBytes: this.frames.bytes,
+      peakQueuedBytes: this.peakQueuedBytes,
+      budgetBytes: this.budgetBytes,
+      dropPolicy: this.dropPolicy,
+      droppedFrames: this.droppedFrames,
+      writeStalls: this.writeStalls,
+      stalledTicks: this.stalledTicks,
+      stallMs: this.stallMs + (this.writeBlocked ? Date.now() - this.stalledAt : 0),
+      socketBufferedBytes: this.socket ? this.socket.writableLength : 0,
+    };
+  }
+
   /**
    * Signals that voice streaming has been interrupted
    * This will trigger the clearAudioBuffer method to empty the cache/buffer
    */
   signalVoiceInterruption() {
-    console.log('[Audiosocket] Voice interruption detected');
+    log.info('Voice interruption detected');
     this.emit('voiceInterrupted');
     return this; // For method chaining
   }
@@ -50,7 +356,7 @@ class StreamService extends EventEmitter {
    * @returns {boolean} True if audio is currently being sent, false otherwise
    */
   isStreaming() {
-    return this.isSending || this.audioQueue.length > 0;
+    return this.isSending || this.frames.length > 0;
   }
 
   /**
@@ -60,137 +366,78 @@ class StreamService extends EventEmitter {
    */
   handleInterruptionIfStreaming() {
     if (this.isStreaming()) {
-      console.log('[Audiosocket] Interrupting active voice stream');
+      log.info('Interrupting active voice stream');
       this.signalVoiceInterruption();
       return true;
     }
     return false;
   }
 
-  async processAudioQueue() {
-    if (this.isSending) return; // Prevent concurrent processing
-
-    this.isSending = true;
-    try {
-      // Create a local variable to track interruption state
-      let interruptionDetected = false;
-      
-      // Set up a one-time listener for voice interruption events
-      const interruptionHandler = () => {
-        interruptionDetected = true;
-        console.log('[Audiosocket] Interruption detected during audio processing');
-      };
-      
-      this.once('voiceInterrupted', interruptionHandler);
-
-      while (this.audioQueue.length > 0 && !interruptionDetected) {
-        const audio = this.audioQueue.shift(); // Get the next audio chunk from the queue
-        
-        // Skip processing if it's empty or null
-        if (!audio || audio.length === 0) continue;
-
-        const chunkSize = 320;
-        for (let i = 0; i < audio.length; i += chunkSize) {
-          // Check for interruption flag before sending each chunk
-          if (interruptionDetected) break;
-
-          const chunk = audio.slice(i, i + chunkSize);
-          const header = Buffer.alloc(3);
-          header.writeUInt8(PACKET_TYPES.AUDIO, 0);
-          header.writeUInt16BE(chunk.length, 1);
-          const packet = Buffer.concat([header, chunk]);
-          this.socket.write(packet);
-          // Wait for 19ms to fit within the 20ms frame size
-          await new Promise(resolve => setTimeout(resolve, 19));
-        }
-
-        if (!interruptionDetected) {
-          this.emit('audioSent', audio.length);
-        }
-      }
-
-      // Remove the interruption listener if we're done
-      this.removeListener('voiceInterrupted', interruptionHandler);
-
-      if (interruptionDetected) {
-        console.log('[Audiosocket] Processing interrupted, remaining audio discarded');
-        // Clear any remaining audio in the queue
-        this.audioQueue = [];
-        this.emit('bufferCleared');
-      }
-    } catch (error) {
-      console.error('[Audiosocket] Error sending audio:', error);
-      this.emit('error', error);
-    } finally {
-      this.isSending = false;
-    }
-  }
-
-  handleAndProcessPacket(packetData, transformStream) {
-    if (!packetData || !Buffer.isBuffer(packetData)) {
-      console.warn('[Audiosocket] Invalid packet data received');
-      return;
-    }
-
-    let buffer = packetData;
-    while (buffer.length >= 3) {
-      const packetType = buffer.readUInt8(0);
-      const packetLength = buffer.readUInt16BE(1);
-      const fullPacketLength = 3 + packetLength;
-
-      if (buffer.length < fullPacketLength) {
-        break; // Wait for more data
-      }
-
-      const packet = buffer.subarray(0, fullPacketLength);
-      buffer = buffer.subarray(fullPacketLength);
-
-      this.processPacket(packetType, packetLength, packet, transformStream);
-    }
+  /**
+   * Handles one complete packet from Asterisk, as emitted by AudioSocketDecoder
+   * @param {Buffer} packet The packet including its 3-byte header
+   */
+  handlePacket(packet) {
+    if (this.trace) this.trace.record(TRACE_DIRECTIONS.FROM_ASTERISK, packet);
+    this.processPacket(packet[0], packet.readUInt16BE(1), packet);
   }
 
-  processPacket(type, length, packet, transformStream) {
+  processPacket(type, length, packet) {
     const handler = this.packetHandlers[type];
     if (handler) {
-      handler(length, packet, transformStream);
+      handler(length, packet);
     } else {
-      console.warn(`[Audiosocket] Unknown packet type received: ${type}`);
+      log.warn('Unknown packet type received: %s', type);
     }
   }
 
   handleTerminatePacket() {
-    console.log('[Audiosocket] Terminate packet received. Closing connection.');
+    log.info('Terminate packet received. Closing connection.');
     // Clear the audio buffer when terminating
     this.clearAudioBuffer();
     this.emit('terminate');
     try {
       this.socket.end();
     } catch (error) {
-      console.error('[Audiosocket] Error while closing the socket:', error);
+      log.error('Error while closing the socket:', error);
     }
   }
 
   handleUUIDPacket(length, packet) {
-    //console.log('[Audiosocket] UUID packet received. Length:', length);
+    log.debug('UUID packet received. Length: %d', length);
     // Get only 9 digits Lead ID
     this.uuid = packet.subarray(3, 12).toString();
     this.emit('uuid', this.uuid);
   }
 
-  handleAudioPacket(length, packet, transformStream) {
-    if (!transformStream) {
-      console.warn('[Audiosocket] Transform stream is not available or invalid.');
-      return;
-    }
-    
+  handleAudioPacket(length, packet) {
     const audioData = packet.subarray(3, 3 + length);
-    transformStream.write(audioData);
     this.emit('audioReceived', audioData);
   }
 
+  /**
+   * Handles a timestamp packet; sent by Asterisk only when timestamps are
+   * enabled in audiosocket.conf
+   */
+  handleTimestampPacket(length, packet) {
+    if (length < 9) return;
+    this.timestampsEnabled = true;
+    const at = Number(packet.readBigUInt64BE(4)) / 1000;
+    switch (packet[3]) {
+      case TIMESTAMP_EVENTS.SENT:
+        this.asteriskSentAt = at;
+        break;
+      case TIMESTAMP_EVENTS.RECEIVED:
+        if (length >= 17) {
+          this.emit('asteriskReceived', at, Number(packet.readBigUInt64BE(12)) / 1000);
+        }
+        break;
+    }
+  }
+
   handleErrorPacket(length, packet) {
     const errorCode = length > 0 ? packet.readUInt8(3) : null;
-    console.log(`Error packet received with code: ${errorCode}`);
+    log.info('Error packet received with code: %s', errorCode);
     // Clear the audio buffer when an error occurs
     this.clearAudioBuffer();
     this.emit('protocolError', errorCode);
@@ -201,9 +448,13 @@ class StreamService extends EventEmitter {
    * This prevents stale audio data from being sent after an interruption
    */
   clearAudioBuffer() {
-    console.log('[Audiosocket] Clearing audio buffer due to voice interruption');
-    // Empty the audio queue
-    this.audioQueue = [];
+    log.info('Clearing audio buffer due to voice interruption');
+    // Drop all queued frames and leave the pacer, so that the next utterance
+    // starts its playout afresh and reports 'playoutStarted' again
+    this.dropQueuedFrames();
+    this.isSending = false;
+    this.playoutStarting = false;
+    this.pacer.remove(this);
     // Emit an event to notify that the buffer has been cleared
     this.emit('bufferCleared');
   }
@@ -213,9 +464,9 @@ class StreamService extends EventEmitter {
    * This should be called before starting a new stream after an interruption
    */
   resetStreamState() {
-    console.log('[Audiosocket] Resetting stream state');
+    log.info('Resetting stream state');
     this.clearAudioBuffer();
-    this.isSending = false;
+    this.stopPlayout();
     this.emit('streamReset');
     return this;
   }
@@ -225,5 +476,7 @@ class StreamService extends EventEmitter {
 // Export the StreamService class and PACKET_TYPES
 module.exports = {
   StreamService,
-  PACKET_TYPES
+  PACKET_TYPES,
+  TIMESTAMP_EVENTS,
+  DROP_POLICIES
 };
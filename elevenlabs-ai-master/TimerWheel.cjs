@@ -0,0 +1,185 @@
+const { performance } = require('perf_hooks');
+
+// Resolution of the wheel; timers fire on the first tick at or after their
+// deadline, so up to this much late
+const TICK_MS = 50;
+
+// Slots per revolution (12.8s at the default tick); longer timers wait out
+// whole revolutions in their slot
+const SLOT_COUNT = 256;
+
+/**
+ * A timer registered with a TimerWheel
+ */
+class WheelTimer {
+  constructor(wheel, callback, intervalMs) {
+    this.wheel = wheel;
+    this.callback = callback;
+    this.intervalMs = intervalMs; // Repeat interval, or 0 for a one-shot timer
+    this.slot = null; // Set holding the timer while it is pending
+    this.rounds = 0; // Revolutions left before it fires
+    this.cancelled = false;
+  }
+
+  /**
+   * Stops the timer; safe to call more than once or after it fired
+   */
+  cancel() {
+    this.cancelled = true;
+    this.wheel.remove(this);
+  }
+}
+
+/**
+ * TimerWheel - Hashed timer wheel shared by the timers of all connections
+ * and calls
+ * Deadlines are hashed into a ring of slots advanced by a single timer, so
+ * adding or cancelling a timer is a Set operation and the event loop holds
+ * one timer however many are pending. The ring only turns while timers are
+ * pending, and does not keep the process alive.
+ *
+ * The precision is the tick, which suits timeouts, sweeps and keep-alives;
+ * audio playout keeps its own clock in AudioPacer.
+ */
+class TimerWheel {
+  /**
+   * @param {number} tickMs Resolution of the wheel
+   * @param {number} slotCount Slots per revolution
+   */
+  constructor(tickMs = TICK_MS, slotCount = SLOT_COUNT) {
+    this.tickMs = tickMs;
+    this.slots = Array.from({ length: slotCount }, () => new Set());
+    this.epoch = performance.now();
+    this.tickCount = 0; // Ticks since the epoch; selects the slot
+    this.pending = 0;
+    this.timer = null;
+    this.ticking = false;
+    this.stats = { scheduled: 0, cancelled: 0, fired: 0, ticks: 0 };
+    this.tick = this.tick.bind(this);
+  }
+
+  /**
+   * Calls callback once after delayMs
+   * @param {number} delayMs Time until the deadline
+   * @param {Function} callback Called when the deadline passes
+   * @returns {WheelTimer} The timer, to cancel it
+   */
+  schedule(delayMs, callback) {
+    const timer = new WheelTimer(this, callback, 0);
+    this.insert(timer, delayMs);
+    return timer;
+  }
+
+  /**
+   * Calls callback every intervalMs until cancelled
+   * @param {number} intervalMs Time between calls
+   * @param {Function} callback Called on every interval
+   * @returns {WheelTimer} The timer, to cancel it
+   */
+  every(intervalMs, callback) {
+    const timer = new WheelTimer(this, callback, Math.max(intervalMs, this.tickMs));
+    this.insert(timer, intervalMs);
+    return timer;
+  }
+
+  insert(timer, delayMs) {
+    const now = performance.now();
+    if (this.pending === 0 && !this.ticking) {
+      // Idle wheels do not tick; pick the clock up where it is now
+      this.tickCount = Math.floor((now - this.epoch) / this.tickMs);
+      this.arm();
+    }
+    // Count from the wheel's clock, not the last tick, so a timer added late
+    // in a tick does not fire early
+    const dueTick = Math.ceil((now + Math.max(0, delayMs) - this.epoch) / this.tickMs);
+    const ticks = Math.max(1, dueTick - this.tickCount);
+    const slotCount = this.slots.length;
+    timer.rounds = Math.floor((ticks - 1) / slotCount);
+    timer.slot = this.slots[(this.tickCount + ticks) % slotCount];
+    timer.slot.add(timer);
+    this.pending++;
+    this.stats.scheduled++;
+  }
+
+  remove(timer) {
+    if (!timer.slot) return;
+    timer.slot.delete(timer);
+    timer.slot = null;
+    this.pending--;
+    this.stats.cancelled++;
+    if (this.pending === 0 && !this.ticking) this.stop();
+  }
+
+  arm() {
+    const due = this.epoch + (this.tickCount + 1) * this.tickMs;
+    this.timer = setTimeout(this.tick, Math.max(0, due - performance.now()));
+    this.timer.unref();
+  }
+
+  stop() {
+    if (this.timer) {
+      clearTimeout(this.timer);
+      this.timer = null;
+    }
+  }
+
+  tick() {
+    this.timer = null;
+    this.ticking = true;
+    // Catch up on every tick missed while the event loop was busy
+    const dueTick = Math.floor((performance.now() - this.epoch) / this.tickMs);
+    while (this.tickCount < dueTick && this.pending > 0) {
+      this.tickCount++;
+      this.stats.ticks++;
+      this.expire(this.slots[this.tickCount % this.slots.length]);
+    }
+    this.ticking = false;
+    if (this.pending > 0) {
+      this.tickCount = Math.max(this.tickCount, dueTick);
+      this.arm();
+    }
+  }
+
+  expire(slot) {
+    const due = [];
+    for (const timer of slot) {
+      if (timer.rounds > 0) {
+        timer.rounds--;
+      } else {
+        slot.delete(timer);
+        timer.slot = null;
+        this.pending--;
+        due.push(timer);
+      }
+    }
+    // Fire after the sweep, so timers rescheduled into this slot wait a
+    // full revolution
+    for (const timer of due) {
+      if (timer.cancelled) continue;
+      this.stats.fired++;
+      if (timer.intervalMs > 0) this.insert(timer, timer.intervalMs);
+      try {
+        timer.callback();
+      } catch (error) {
+        console.error('[TimerWheel] Error in timer callback:', error);
+      }
+    }
+  }
+
+  /**
+   * Get the wheel statistics
+   * @returns {Object} Pending timers and counts of scheduled, cancelled and fired ones
+   */
+  getStats() {
+    return { pending: this.pending, ...this.stats };
+  }
+}
+
+// The wheel shared by every component of the process
+const sharedTimerWheel = new TimerWheel();
+
+module.exports = {
+  TimerWheel,
+  sharedTimerWheel,
+  TICK_MS
+};
@@ -0,0 +1,112 @@
+const fs = require('fs');
+const path = require('path');
+const { Buffer } = require('buffer');
+
+// Trace format shared with the Go AudioSocket library (trace.go), so that
+// traces recorded here can be inspected and replayed with its tooling:
+//   header: "ASTRACE" 0x01, start time as big-endian int64 Unix nanoseconds
+//   record: direction byte, uvarint microseconds since the previous record,
+//           then the complete AudioSocket packet (header and payload)
+const TRACE_MAGIC = Buffer.from('ASTRACE\x01', 'latin1');
+
+const TRACE_DIRECTIONS = {
+  FROM_ASTERISK: 0x00,
+  TO_ASTERISK: 0x01,
+};
+
+/**
+ * TraceRecorder - Records raw AudioSocket packets in both directions with
+ * microsecond timestamps to a compact binary trace file
+ */
+class TraceRecorder {
+  /**
+   * @param {string} filePath Path of the trace file to create
+   */
+  constructor(filePath) {
+    this.filePath = filePath;
+    this.closed = false;
+    this.records = 0;
+
+    this.stream = fs.createWriteStream(filePath);
+    this.stream.on('error', (error) => {
+      console.error(`[TraceRecorder] Error writing trace ${filePath}:`, error.message);
+      this.closed = true;
+    });
+
+    // Timestamps come from the monotonic clock; the wall clock is only
+    // recorded once in the header
+    this.lastNs = process.hrtime.bigint();
+
+    const header = Buffer.alloc(16);
+    TRACE_MAGIC.copy(header, 0);
+    header.writeBigInt64BE(BigInt(Date.now()) * 1000000n, 8);
+    this.stream.write(header);
+
+    // Scratch space for the direction byte and timestamp of each record
+    this.recordHeader = Buffer.alloc(11);
+  }
+
+  /**
+   * Create a recorder if tracing is enabled through AUDIOSOCKET_TRACE_DIR
+   * @param {string} label Label included in the trace file name
+   * @returns {TraceRecorder|null} The recorder, or null if tracing is disabled
+   */
+  static fromEnv(label) {
+    const dir = process.env.AUDIOSOCKET_TRACE_DIR;
+    if (!dir) return null;
+
+    const fileName = `${Date.now()}-${String(label).replace(/[^\w.-]/g, '_')}.astrace`;
+    try {
+      return new TraceRecorder(path.join(dir, fileName));
+    } catch (error) {
+      console.error('[TraceRecorder] Failed to start trace:', error.message);
+      return null;
+    }
+  }
+
+  /**
+   * Record a complete AudioSocket packet
+   * @param {number} direction One of TRACE_DIRECTIONS
+   * @param {Buffer} packet The packet including its 3-byte header; it must
+   *   not be modified afterwards
+   */
+  record(direction, packet) {
+    if (this.closed) return;
+
+    const now = process.hrtime.bigint();
+    const deltaUs = (now - this.lastNs) / 1000n;
+    // Advance by whole microseconds so rounding does not accumulate
+    this.lastNs += deltaUs * 1000n;
+
+    const header = this.recordHeader;
+    header[0] = direction;
+    let n = 1;
+    let value = Number(deltaUs);
+    while (value >= 0x80) {
+      header[n++] = (value % 0x80) | 0x80;
+      value = Math.floor(value / 0x80);
+    }
+    header[n++] = value;
+
+    // The header scratch buffer is reused, so it must be copied
+    this.stream.write(Buffer.from(header.subarray(0, n)));
+    this.stream.write(packet);
+    this.records++;
+  }
+
+  /**
+   * Finish the trace and close the file
+   */
+  close() {
+    if (this.closed) return;
+    this.closed = true;
+    this.stream.end(() => {
+      console.log(`[TraceRecorder] Trace ${this.filePath} closed with ${this.records} records`);
+    });
+  }
+}
+
+module.exports = {
+  TraceRecorder,
+  TRACE_DIRECTIONS
+};
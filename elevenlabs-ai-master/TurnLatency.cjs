@@ -0,0 +1,257 @@
+const { performance } = require('perf_hooks');
+const LatencyHistogram = require('./LatencyHistogram.cjs');
+const { frameLevel, SPEECH_LEVEL } = require('./UpstreamAggregator.cjs');
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
+
+// Hops of a turn, in the order the audio passes them, and the total from the
+// end of the caller's speech to the start of the agent's audio. The asterisk
+// hops need timestamps enabled in res_audiosocket (see its README) and the
+// clocks of both hosts in sync.
+const TURN_HOPS = [
+  'asterisk_in', // Asterisk sent the last speech frame -> bridge read it
+  'bridge_upstream', // bridge read it -> sent it to ElevenLabs
+  'remote_transcript', // sent -> user_transcript received
+  'remote_response', // user_transcript -> agent_response received
+  'remote_first_audio', // sent -> first agent audio received
+  'bridge_queue', // first agent audio received -> converted and queued
+  'bridge_pacer', // queued -> first frame written to Asterisk
+  'asterisk_out', // written -> read by Asterisk
+  'total',
+];
+
+// Time allowed for Asterisk to answer the timestamp request of a turn's
+// first frame before the turn is recorded without it
+const ASTERISK_STAMP_WAIT_MS = 1000;
+
+/**
+ * Current time as epoch milliseconds with sub-millisecond precision,
+ * comparable to the timestamps sent by Asterisk
+ */
+function now() {
+  return performance.timeOrigin + performance.now();
+}
+
+function elapsed(to, from) {
+  if (to === null || to === undefined || from === null || from === undefined) return null;
+  return Math.round((to - from) * 10) / 10;
+}
+
+/**
+ * TurnLatencyTracker - Times each turn of a call as it passes the bridge
+ * A turn starts when the caller stops speaking and ends when the agent's
+ * reply reaches Asterisk. PortManager reports the caller frames, the audio
+ * sent to ElevenLabs, the transcript, response and audio events of
+ * ElevenLabs and the playout of the agent audio; once a turn's first frame
+ * has been written (and stamped by Asterisk, when it sends timestamps) the
+ * turn's hops are passed to onTurn.
+ */
+class TurnLatencyTracker {
+  /**
+   * @param {Object} options
+   * @param {Function} options.onTurn Called with agentTurn, the index of the
+   *   agent's reply among its turns, and the hops in ms
+   * @param {number} options.asteriskWaitMs See ASTERISK_STAMP_WAIT_MS
+   */
+  constructor({ onTurn, asteriskWaitMs = ASTERISK_STAMP_WAIT_MS }) {
+    this.onTurn = onTurn;
+    this.asteriskWaitMs = asteriskWaitMs;
+    this.stamped = false; // True once Asterisk has sent a timestamp
+
+    this.speechEnd = null;
+    this.speechEndAsterisk = null;
+    this.speechSent = null;
+    this.speechUnsent = false;
+
+    this.agentResponses = 0;
+    this.turn = null;
+    this.waitTimer = null;
+  }
+
+  /**
+   * A frame of caller audio was read from Asterisk
+   * @param {Buffer} frame The audio
+   * @param {number|null} asteriskSentAt When Asterisk sent it, if stamped
+   */
+  callerAudio(frame, asteriskSentAt = null) {
+    if (asteriskSentAt !== null) this.stamped = true;
+    if (frameLevel(frame) < SPEECH_LEVEL) return;
+    this.speechEnd = now();
+    this.speechEndAsterisk = asteriskSentAt;
+    this.speechUnsent = true;
+  }
+
+  /**
+   * Caller audio was sent to ElevenLabs
+   */
+  callerAudioSent() {
+    if (!this.speechUnsent) return;
+    this.speechSent = now();
+    this.speechUnsent = false;
+  }
+
+  userTranscript() {
+    this.cancelWait();
+    this.turn = {
+      agentTurn: null,
+      speechEnd: this.speechEnd,
+      speechEndAsterisk: this.speechEndAsterisk,
+      speechSent: this.speechSent,
+      transcript: now(),
+      response: null,
+      audio: null,
+      queued: null,
+      playout: null,
+      asterisk: null,
+    };
+  }
+
+  agentResponse() {
+    const turn = this.turn;
+    if (turn && turn.response === null) {
+      turn.response = now();
+      if (turn.agentTurn === null) turn.agentTurn = this.agentResponses;
+    }
+    this.agentResponses++;
+  }
+
+  /**
+   * Agent audio was received from ElevenLabs and queued for playout
+   * @param {number} receivedAt When it was received
+   */
+  agentAudio(receivedAt) {
+    const turn = this.turn;
+    if (!turn || turn.audio !== null) return;
+    turn.audio = receivedAt;
+    turn.queued = now();
+    // The response event may still be on its way
+    if (turn.agentTurn === null) turn.agentTurn = this.agentResponses;
+  }
+
+  /**
+   * The first frame of queued agent audio was written to Asterisk
+   */
+  playoutStarted() {
+    const turn = this.turn;
+    if (!turn || turn.audio === null || turn.playout !== null) return;
+    turn.playout = now();
+    if (this.stamped) {
+      this.waitTimer = sharedTimerWheel.schedule(this.asteriskWaitMs, () => this.finish());
+    } else {
+      this.finish();
+    }
+  }
+
+  /**
+   * Asterisk answered a timestamp request
+   * @param {number} receivedAt When Asterisk read the stamped frame
+   */
+  asteriskReceived(receivedAt) {
+    const turn = this.turn;
+    if (!turn || turn.playout === null || turn.asterisk !== null) return;
+    turn.asterisk = receivedAt;
+    this.finish();
+  }
+
+  finish() {
+    this.cancelWait();
+    const turn = this.turn;
+    this.turn = null;
+    if (!turn) return;
+
+    const start = turn.speechEndAsterisk ?? turn.speechEnd;
+    const end = turn.asterisk ?? turn.playout;
+    this.onTurn({
+      agentTurn: turn.agentTurn,
+      hops: {
+        asterisk_in: elapsed(turn.speechEnd, turn.speechEndAsterisk),
+        bridge_upstream: elapsed(turn.speechSent, turn.speechEnd),
+        remote_transcript: elapsed(turn.transcript, turn.speechSent),
+        remote_response: elapsed(turn.response, turn.transcript),
+        remote_first_audio: elapsed(turn.audio, turn.speechSent),
+        bridge_queue: elapsed(turn.queued, turn.audio),
+        bridge_pacer: elapsed(turn.playout, turn.queued),
+        asterisk_out: elapsed(turn.asterisk, turn.playout),
+        total: elapsed(end, start),
+      },
+    });
+  }
+
+  cancelWait() {
+    if (this.waitTimer) {
+      this.waitTimer.cancel();
+      this.waitTimer = null;
+    }
+  }
+
+  /**
+   * Records a turn still waiting for its Asterisk timestamp and drops an
+   * unanswered one, at the end of the call
+   */
+  close() {
+    if (this.turn && this.turn.playout !== null) {
+      this.finish();
+    }
+    this.cancelWait();
+    this.turn = null;
+  }
+}
+
+/**
+ * TurnMetrics - Latency histograms of the turns of all calls
+ * Fed from the 'turnLatency' events of PortManager, including those of call
+ * workers, and served by the metrics endpoint
+ */
+class TurnMetrics {
+  constructor() {
+    this.histograms = {};
+    for (const hop of TURN_HOPS) this.histograms[hop] = new LatencyHistogram();
+  }
+
+  /**
+   * Adds the hops of a turn
+   * @param {Object} hops Latency in ms by hop; missing hops are null
+   */
+  record(hops) {
+    for (const hop of TURN_HOPS) {
+      if (typeof hops[hop] === 'number') this.histograms[hop].record(hops[hop]);
+    }
+  }
+
+  /**
+   * Get the latency summary of every hop
+   * @returns {Object} turns, and count, mean and percentiles in ms by hop
+   */
+  getStats() {
+    const hops = {};
+    for (const hop of TURN_HOPS) hops[hop] = this.histograms[hop].getStats();
+    return { turns: this.histograms.total.count, hops };
+  }
+
+  /**
+   * Formats the histograms as Prometheus summaries
+   * @returns {string} The metrics in the Prometheus text format
+   */
+  toPrometheus() {
+    const name = 'elevenlabs_bridge_turn_latency_seconds';
+    const lines = [
+      `# HELP ${name} Latency of each hop of a conversation turn, from the end of the caller's speech to the agent's audio.`,
+      `# TYPE ${name} summary`,
+    ];
+    for (const hop of TURN_HOPS) {
+      const histogram = this.histograms[hop];
+      for (const quantile of [0.5, 0.9, 0.99, 0.999]) {
+        lines.push(`${name}{hop="${hop}",quantile="${quantile}"} ${(histogram.percentile(quantile * 100) / 1000).toFixed(6)}`);
+      }
+      lines.push(`${name}_sum{hop="${hop}"} ${(histogram.sumUs / 1e6).toFixed(6)}`);
+      lines.push(`${name}_count{hop="${hop}"} ${histogram.count}`);
+    }
+    return `${lines.join('\n')}\n`;
+  }
+}
+
+module.exports = {
+  TurnLatencyTracker,
+  TurnMetrics,
+  TURN_HOPS,
+  now,
+};
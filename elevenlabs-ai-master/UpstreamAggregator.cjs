@@ -0,0 +1,161 @@
+const { performance } = require('perf_hooks');
+
+// Duration of one AudioSocket audio packet
+const FRAME_MS = 20;
+
+// Chunk sizes an agent can be configured with; 20 sends every packet as is
+const CHUNK_SIZES_MS = [20, 40, 60, 100];
+
+// Mean absolute sample value above which a frame counts as speech. Line
+// noise on a quiet call stays well below it, speech well above.
+const SPEECH_LEVEL = 400;
+
+// Frames below the speech level needed before speech counts as a new onset
+const ONSET_SILENCE_FRAMES = 10;
+
+/**
+ * Validates a configured chunk size
+ * @param {*} value Chunk size in ms from the agent settings or environment
+ * @param {number} fallback Used when value is not one of CHUNK_SIZES_MS
+ * @returns {number} The chunk size in ms
+ */
+function normalizeChunkMs(value, fallback = FRAME_MS) {
+  const chunkMs = parseInt(value, 10);
+  return CHUNK_SIZES_MS.includes(chunkMs) ? chunkMs : fallback;
+}
+
+/**
+ * Mean absolute value of the 16-bit little-endian samples of a frame
+ */
+function frameLevel(frame) {
+  const samples = frame.length >> 1;
+  if (samples === 0) return 0;
+  let sum = 0;
+  for (let i = 0; i < samples * 2; i += 2) {
+    const sample = frame[i] | (frame[i + 1] << 8);
+    sum += sample & 0x8000 ? 0x10000 - sample : sample;
+  }
+  return sum / samples;
+}
+
+/**
+ * UpstreamAggregator - Batches caller audio into larger ElevenLabs messages
+ * Collects AudioSocket frames until chunkMs of audio is buffered and hands
+ * them to send as one chunk, cutting the messages per call from 50 per second
+ * to 1000 / chunkMs. The chunk is sent early when speech starts after a
+ * silence, so the start of an utterance reaches the recognizer without the
+ * added delay, and when the call ends.
+ */
+class UpstreamAggregator {
+  /**
+   * @param {Object} options
+   * @param {number} options.chunkMs Audio per message, one of CHUNK_SIZES_MS
+   * @param {Function} options.send Called with each chunk as a Buffer
+   */
+  constructor({ chunkMs = FRAME_MS, send }) {
+    this.chunkMs = normalizeChunkMs(chunkMs);
+    this.framesPerChunk = this.chunkMs / FRAME_MS;
+    this.send = send;
+
+    this.frames = [];
+    this.bytes = 0;
+    this.silentFrames = ONSET_SILENCE_FRAMES;
+    this.arrivalSum = 0; // Sum of arrival times of the buffered frames, in ms
+    this.firstArrival = 0;
+
+    this.startedAt = performance.now();
+    this.stats = { frames: 0, messages: 0, onsetFlushes: 0, waitMsSum: 0, waitMsMax: 0 };
+  }
+
+  /**
+   * Adds a frame of caller audio
+   * @param {Buffer} frame Signed linear audio of one AudioSocket packet
+   */
+  push(frame) {
+    const now = performance.now();
+    this.stats.frames++;
+
+    if (this.framesPerChunk === 1) {
+      this.stats.messages++;
+      this.send(frame);
+      return;
+    }
+
+    if (this.frames.length === 0) this.firstArrival = now;
+    this.frames.push(frame);
+    this.bytes += frame.length;
+    this.arrivalSum += now;
+
+    let onset = false;
+    if (frameLevel(frame) >= SPEECH_LEVEL) {
+      onset = this.silentFrames >= ONSET_SILENCE_FRAMES;
+      this.silentFrames = 0;
+    } else {
+      this.silentFrames++;
+    }
+
+    if (onset) {
+      this.stats.onsetFlushes++;
+      this.flush(now);
+    } else if (this.frames.length >= this.framesPerChunk) {
+      this.flush(now);
+    }
+  }
+
+  /**
+   * Sends whatever is buffered
+   */
+  flush(now = performance.now()) {
+    if (this.frames.length === 0) return;
+
+    const chunk = this.frames.length === 1 ? this.frames[0] : Buffer.concat(this.frames, this.bytes);
+    // Each frame waited from its arrival until now; the first one the longest
+    const waitMs = this.frames.length * now - this.arrivalSum;
+    this.stats.waitMsSum += waitMs;
+    this.stats.waitMsMax = Math.max(this.stats.waitMsMax, now - this.firstArrival);
+    this.stats.messages++;
+
+    this.frames = [];
+    this.bytes = 0;
+    this.arrivalSum = 0;
+    this.send(chunk);
+  }
+
+  /**
+   * Sends the remaining audio at the end of the call and drops any frames
+   * pushed afterwards
+   */
+  close() {
+    this.flush();
+    this.send = () => {};
+  }
+
+  /**
+   * Get the aggregation statistics of the call
+   * @returns {Object} chunkMs, frame and message counts, seconds since the
+   *   start, messages per second and the mean and maximum delay added per
+   *   frame in ms
+   */
+  getStats() {
+    const { frames, messages, onsetFlushes, waitMsSum, waitMsMax } = this.stats;
+    const seconds = (performance.now() - this.startedAt) / 1000;
+    return {
+      chunkMs: this.chunkMs,
+      frames,
+      messages,
+      onsetFlushes,
+      seconds: Math.round(seconds * 10) / 10,
+      messagesPerSecond: seconds > 0 ? Math.round(messages / seconds * 10) / 10 : 0,
+      addedLatencyMs: frames > 0 ? Math.round(waitMsSum / frames * 10) / 10 : 0,
+      addedLatencyMaxMs: Math.round(waitMsMax * 10) / 10,
+    };
+  }
+}
+
+module.exports = {
+  UpstreamAggregator,
+  normalizeChunkMs,
+  frameLevel,
+  CHUNK_SIZES_MS,
+  SPEECH_LEVEL,
+};
@@ -10,13 +10,30 @@ const { ElevenLabsClient } = require('elevenlabs');
 const AsteriskService = require('./AsteriskManager.cjs');
 const { StreamService, PACKET_TYPES } = require('./StreamService.cjs');
 const ConnectionManager = require('./ConnectionManager.cjs');
+const { sharedTimerWheel } = require('./TimerWheel.cjs');
 const ConsoleLogger = require('./ConsoleLogger.cjs');
 const PortManager = require('./PortManager.cjs');
 const { pool, testConnection, getSessionData } = require('./MySQL.cjs');
 const DatabaseManager = require('./DatabaseManager.cjs');
+const { createElevenLabsSetup } = require('./ElevenLabsSession.cjs');
+const CallWorkerPool = require('./CallWorkerPool.cjs');
+const ElevenLabsSessionPool = require('./ElevenLabsSessionPool.cjs');
+const { normalizeChunkMs } = require('./UpstreamAggregator.cjs');
+const { TurnMetrics } = require('./TurnLatency.cjs');
+const { startMetricsServer } = require('./MetricsServer.cjs');
+const SessionCache = require('./SessionCache.cjs');
+const RemoteAgentReconciler = require('./RemoteAgentReconciler.cjs');
+const { OriginateScheduler } = require('./OriginateScheduler.cjs');
  
 // Environment variables
-const { ELEVENLABS_AGENT_ID, ELEVENLABS_API_KEY, CHECK_REMOTE_AGENTS_INTERVAL } = process.env;
+const { ELEVENLABS_AGENT_ID, ELEVENLABS_API_KEY, AUDIOSOCKET_PORT } = process.env;
+
+// All calls share one multiplexed AudioSocket listener on AUDIOSOCKET_PORT;
+// AUDIOSOCKET_PORT_PER_AGENT=true falls back to a port per remote agent for
+// dialplans that still connect to the agents' audio ports
+const DEFAULT_AUDIOSOCKET_PORT = 15000;
+const multiplexed = process.env.AUDIOSOCKET_PORT_PER_AGENT !== 'true';
+const audiosocketPort = parseInt(AUDIOSOCKET_PORT || DEFAULT_AUDIOSOCKET_PORT, 10);
 
 if (!ELEVENLABS_API_KEY) {
   throw new Error('Missing environment variables');
@@ -26,60 +43,11 @@ if (!ELEVENLABS_API_KEY) {
 const dbManager = new DatabaseManager();
 const asteriskService = new AsteriskService();
 
-// Check for active remote agents and create call servers
-async function checkAndCreateRemoteAgentServers() {
-  try {
-    const activeAgents = await dbManager.getActiveRemoteAgents();
-    const activeAgentIds = new Set(activeAgents.map(agent => String(agent.remote_agent_id)));
-    //console.log(`[RemoteAgents] Found ${activeAgents.length} active remote agents`);
-
-    for (const agent of activeAgents) {
-      const connectionId = `${agent.audio_port}`;
-      try {
-        // Create call server for each active agent
-        const port = portManager.createCallServer(
-          connectionId,
-          { agent_id: agent.agent_id || process.env.ELEVENLABS_AGENT_ID },  // Use custom agent_id or fallback to default
-          setupElevenLabs,
-          (socket) => new StreamService(socket),
-          agent.audio_port
-        );
-        //console.log(`[RemoteAgents] Created call server for agent ${agent.remote_agent_id} on port ${port}`);
-      } catch (error) {
-        console.error(`[RemoteAgents] Error creating call server for agent ${agent.remote_agent_id}:`, error);
-      }
-    }
-
-    // Cleanup inactive call servers
-    for (const [connectionId, serverInfo] of portManager.activeServers.entries()) {
-      if (connectionId.startsWith('remote_')) {
-        const remoteAgentId = connectionId.split('_')[1];
-        //console.log(`[RemoteAgents] Checking agent ${remoteAgentId} - Active in DB: ${activeAgentIds.has(remoteAgentId)}`);
-        if (!activeAgentIds.has(remoteAgentId)) {
-          console.log(`[RemoteAgents] Closing inactive call server for agent ${remoteAgentId}`);
-          portManager.closeCallServer(connectionId, false);
-        }
-      }
-    }
-  } catch (error) {
-    console.error('[RemoteAgents] Error checking remote agents:', error);
-  }
-}
-
-// Start periodic check for remote agents
-const checkInterval = parseInt(CHECK_REMOTE_AGENTS_INTERVAL || '60000', 10);
-const checkRemoteAgentsInterval = setInterval(checkAndCreateRemoteAgentServers, checkInterval);
-
-
-const activeAgents = dbManager.getActiveRemoteAgents().then(agents => {
-  console.error(`[RemoteAgents] Found ${activeAgents} active remote agents`);
-}).catch(error => { 
-  console.error('[RemoteAgents] Error fetching active remote agents:', error);
-}
-);
-//console.log(activeAgents);
-//console.log(`[RemoteAgents] Found ${activeAgents.length} active remote agents`);
-//return;
+// Optional pool of ElevenLabs sessions prepared ahead of calls
+const sessionPoolMax = parseInt(process.env.ELEVENLABS_POOL_MAX || '0', 10);
+const sessionPool = sessionPoolMax > 0
+  ? new ElevenLabsSessionPool({ max: sessionPoolMax, openSessions: process.env.ELEVENLABS_POOL_SESSIONS === 'true' })
+  : null;
 
 // Initialize the port manager
 const portManager = new PortManager(
@@ -88,8 +56,39 @@ const portManager = new PortManager(
   dbManager
 );
 
-// Initial check
-checkAndCreateRemoteAgentServers();
+// One persistent call server per active remote agent; the multiplexed
+// listener routes remote agent calls by lead ID instead
+const remoteAgents = multiplexed ? null : new RemoteAgentReconciler({
+  dbManager,
+  portManager,
+  openServer: (agent) => portManager.createCallServer(
+    `${agent.audio_port}`,
+    { agent_id: agent.agent_id },
+    setupElevenLabs, // Defined below; servers open after the first query
+    (socket) => new StreamService(socket),
+    agent.audio_port
+  ),
+  onActive: (agentId) => {
+    if (sessionPool) sessionPool.warm(agentId);
+  },
+});
+
+// With AUDIOSOCKET_WORKERS set, multiplexed calls run in worker processes
+const callWorkers = parseInt(process.env.AUDIOSOCKET_WORKERS || '0', 10);
+const workerPool = multiplexed && callWorkers > 0 ? new CallWorkerPool(callWorkers, portManager).start() : null;
+
+if (multiplexed) {
+  portManager.listen(
+    audiosocketPort,
+    (connectionId, customParameters, options) => setupElevenLabs(connectionId, customParameters, options), // Defined below
+    (socket) => new StreamService(socket),
+    { reusePort: process.env.AUDIOSOCKET_REUSEPORT === 'true', workerPool }
+  );
+} else {
+  remoteAgents.start().then(() => {
+    console.log(`[RemoteAgents] Serving ${remoteAgents.getStats().servers} active remote agents`);
+  });
+}
 // Set up PortManager event listeners
 portManager.on('user_transcript', ({ connectionId, user_transcript }) => {
   console.log(`[ElevenLabs:${connectionId}] User: ${user_transcript}`);
@@ -107,6 +106,41 @@ portManager.on('interruption', ({ connectionId, interruption }) => {
   console.log(`[ElevenLabs:${connectionId}] Interruption ${interruption}`);
 });
 
+// Turn latency of all calls, including those of call workers: summarised in
+// histograms for the metrics endpoint and kept with the conversation's turns
+const turnMetrics = new TurnMetrics();
+portManager.on('turnLatency', ({ conversationId, agentTurn, hops }) => {
+  turnMetrics.record(hops);
+  if (!conversationId || agentTurn === null) return;
+  const metrics = {};
+  for (const [hop, ms] of Object.entries(hops)) {
+    if (ms !== null) metrics[`latency_${hop}`] = ms / 1000;
+  }
+  dbManager.saveTurnLatency(conversationId, agentTurn, metrics).catch((error) => {
+    console.error(`[ElevenLabs:${conversationId}] Error storing turn latency:`, error.message);
+  });
+});
+
+// Dashboard sessions, looked up once per TTL instead of on every message
+const sessionCache = new SessionCache(getSessionData);
+
+// Outbound calls, paced per trunk and campaign and held back while the
+// ports, call workers or ElevenLabs concurrency are used up
+const originateMaxCalls = parseInt(process.env.ORIGINATE_MAX_CALLS || '100', 10);
+const originateMaxLagMs = parseInt(process.env.ORIGINATE_MAX_LAG_MS || '100', 10);
+const elevenLabsMaxCalls = parseInt(process.env.ELEVENLABS_MAX_CALLS || '0', 10) || Infinity;
+const originateScheduler = new OriginateScheduler({
+  originate: ({ channel, connectionId, port }) => asteriskService.originateCall(channel, connectionId, port),
+  capacity: () => Math.min(
+    portManager.getCapacity({ maxCalls: originateMaxCalls, maxLagMs: originateMaxLagMs }),
+    elevenLabsMaxCalls - portManager.countCalls()
+  ),
+});
+
+const metricsServer = process.env.METRICS_PORT
+  ? startMetricsServer({ port: parseInt(process.env.METRICS_PORT, 10), host: process.env.METRICS_HOST || undefined, turnMetrics, sessionCache, originateScheduler })
+  : null;
+
 
 
 // Initialize connection manager and logger
@@ -178,182 +212,13 @@ async function saveAgentDb(apiResponse, createNew = false) {
     throw error;
   }
 }
-// Helper function to get signed URL for ElevenLabs
-async function getSignedUrl(agentId = null) {
-  try {
-    // Use provided agent_id or fall back to environment variable
-    const agent_id = agentId || ELEVENLABS_AGENT_ID;
-    
-    if (!ELEVENLABS_API_KEY) {
-      throw new Error("Missing ELEVENLABS_API_KEY in environment variables");
-    };
-    if (!agent_id) {
-      throw new Error("Missing ELEVENLABS_AGENT_ID in environment variables or custom parameters");
-    };
-    console.log(`[ElevenLabs] Getting signed URL for agent_id: ${agent_id}`);
-    // Add timeout to prevent hanging requests
-    const controller = new AbortController();
-    const timeoutId = setTimeout(() => controller.abort(), 10000); // 10 second timeout
-    try {
-      const response = await fetch(
-        `https://api.elevenlabs.io/v1/convai/conversation/get_signed_url?agent_id=${agent_id}`,
-        {
-          method: "GET",
-          headers: {
-            "xi-api-key": ELEVENLABS_API_KEY,
-          },
-          signal: controller.signal
-        }
-      );
-      clearTimeout(timeoutId);
-      if (!response.ok) {
-        throw new Error(`Failed to get signed URL: ${response.statusText}`);
-      }
-      const data = await response.json();
-      //console.log(`[ElevenLabs] Successfully obtained signed URL`);
-      return data.signed_url;
-    } catch (fetchError) {
-      clearTimeout(timeoutId);
-      if (fetchError.name === 'AbortError') {
-        throw new Error('Timeout while getting signed URL from ElevenLabs API');
-      }
-      throw fetchError;
-    }
-  } catch (error) {
-    console.error("[ElevenLabs] Error getting signed URL:", error);
-    throw error;
-  }
-}
-
 // Function to set up ElevenLabs connection with custom parameters
-const setupElevenLabs = async (connectionId = null, customParameters = null) => {
-  let connectionTimeout;
-  
-  return new Promise((resolve, reject) => {
-    try {
-      // Better logging for debugging
-      console.log(`[ElevenLabs] Setting up connection for ${connectionId} with parameters: `, 
-        customParameters ? JSON.stringify(customParameters).substring(0, 100) + "..." : "none");
-      
-      const agentId = customParameters?.agent_id || null;
-      
-      // Get signed URL with better error handling
-      getSignedUrl(agentId).then(signedUrl => {
-        //console.log(`[ElevenLabs:${connectionId}] Got signed URL: ${signedUrl}`);
-        
-        // Create WebSocket with connection timeout
-        //console.log(`[ElevenLabs:${connectionId}] Creating WebSocket connection to ${signedUrl}`);
-        const wsConnection = new WebSocket(signedUrl);
-        
-        // Set a 15-second timeout for connection
-        connectionTimeout = setTimeout(() => {
-          console.error(`[ElevenLabs:${connectionId}] Connection timeout`);
-          try {
-            if (wsConnection) wsConnection.close();
-          } catch (e) {}
-          reject(new Error('Connection timeout: Cannot connect to service within 15 seconds'));
-        }, 15000);
-        
-        // Handle successful connection
-        wsConnection.on("open", () => {
-          clearTimeout(connectionTimeout);
-          console.log(`[ElevenLabs:${connectionId}] Connected successfully to Conversational AI`);
-          
-          // Send initial configuration with prompt and first message
-          const initialConfig = {
-            type: "conversation_initiation_client_data",
-            conversation_config_override: {
-              agent: {},
-            },
-            dynamic_variables: {
-              agent_id: customParameters?.agent_id,
-              called_number: customParameters.autoCalls?.phone_code + customParameters.autoCalls?.phone_number,
-              lead_id: customParameters.autoCalls?.lead_id,
-              campaign_id: customParameters.liveAgent?.campaign_id,
-              uniqueid: customParameters.liveAgent?.uniqueid,              
-              first_name: customParameters.leadData?.first_name,
-              last_name: customParameters.leadData?.last_name,
-              title: customParameters.leadData?.title,
-              address1: customParameters.leadData?.address1,
-              address2: customParameters.leadData?.address2,
-              city: customParameters.leadData?.city,
-              postal_code: customParameters.leadData?.postal_code,
-              custom1: customParameters.leadData?.custom1,
-              custom2: customParameters.leadData?.custom2,
-              email: customParameters.leadData?.email,
-              phone_number: customParameters.leadData?.phone_number,
-              comments: customParameters.leadData?.comments,
-              called_count: customParameters.leadData?.called_count,
-            },
-          };
-          
-          // Apply custom parameters if available
-          if (customParameters?.params?.prompt) {
-            initialConfig.conversation_config_override.agent.prompt = { "prompt": customParameters?.params.prompt};
-            console.log(`[ElevenLabs:${connectionId}] Using prompt: ${customParameters?.params.prompt}`);
-          }
-          if (customParameters?.params?.first_message) {
-            initialConfig.conversation_config_override.agent.first_message = customParameters?.params.first_message;
-            console.log(`[ElevenLabs:${connectionId}] Using first message: ${customParameters?.params.first_message}`);
-          }
-          if (customParameters?.params?.language) {
-            initialConfig.conversation_config_override.agent.language = customParameters?.params.language;
-            console.log(`[ElevenLabs:${connectionId}] Using language: ${customParameters?.params.language}`);
-          }
-          
-          // Event listeners are now handled at application startup
+const setupElevenLabs = createElevenLabsSetup(connectionManager, sessionPool);
 
-          // Send with error handling
-          try {
-            console.log(`[ElevenLabs:${connectionId}] Sending initial config`);
-            wsConnection.send(JSON.stringify(initialConfig));
-            
-            // Register the WebSocket with the connection manager
-            if (connectionId) {
-              connectionManager.setElevenLabsWs(connectionId, wsConnection);
-            }
-                        
-            resolve(wsConnection);
-
-            // Handle connection close *after* resolving
-            wsConnection.on("close", (code, reason) => {
-              clearTimeout(connectionTimeout);
-              if (wsConnection.readyState !== WebSocket.OPEN) {
-                console.error(`[ElevenLabs:${connectionId}] Hangup? WebSocket closed before open: ${code} - ${reason}`);
-                //StreamService.sendAudio(Buffer.from([0x00, 0x00, 0x00, 0x00]));
-                //handleTerminatePacket
-                // TODO: hangup call
-                //portManager.closeCallServer(connectionId);
-                reject(new Error(`WebSocket closed before open: ${code} - ${reason}`));
-              }
-            });
-
-          } catch (sendError) {
-            console.error(`[ElevenLabs:${connectionId}] Error sending initial config:`, sendError);
-            reject(sendError);
-          }
-        });
-        
-        // Handle connection errors
-        wsConnection.on("error", (wsError) => {
-          clearTimeout(connectionTimeout);
-          console.error(`[ElevenLabs:${connectionId}] WebSocket error during setup:`, wsError);
-          reject(wsError);
-        });
-      }).catch(urlError => {
-        console.error(`[ElevenLabs:${connectionId}] Failed to get signed URL:`, urlError.message);
-        if (connectionId) {
-          connectionManager.sendStatus(connectionId, 'error', `Failed to get signed URL: ${urlError.message}`, data.requestId);
-        }
-        reject(urlError);
-      });
-    } catch (error) {
-      clearTimeout(connectionTimeout);
-      console.error(`[ElevenLabs:${connectionId}] Setup error:`, error.message);
-      reject(error);
-    }
-  });
-};
+// Push channel changes to the dashboards that asked for showChannels
+asteriskService.channels.on('diff', (diff) => {
+  connectionManager.publish('channels', 'channelsDiff', diff);
+});
 
 wss.on('connection', (ws, req) => {
     const ip = req.headers['x-forwarded-for'] ? 
@@ -379,7 +244,7 @@ wss.on('connection', (ws, req) => {
         const data = JSON.parse(rawMessage.toString());
         // Verify Session ID
         if (data?.sessionId && connectionManager.getUserId(connectionId) === null) {
-          const sessionData = await getSessionData(data.sessionId);
+          const sessionData = await sessionCache.get(data.sessionId);
           if (sessionData?.data?.PHP_AUTH_USER) {
             //console.log(`[WebSocket] Session ID verified for ${data.sessionId}`);
             // Update connection manager with session data
@@ -408,6 +273,7 @@ wss.on('connection', (ws, req) => {
                 await saveAgentDb(response);
                 //console.log(`[WebSocket] Successfully synced agent ${response.agent_id} with database`);
                 response.remoteagent = await dbManager.getRemoteAgentById(data.params);
+                response.upstream_chunk_ms = (await dbManager.getAgentStreamSettings(data.params))?.upstream_chunk_ms ?? null;
               } catch (saveError) {
                 console.error(`[WebSocket] Error syncing agent ${data.params} with database:`, saveError);
               }
@@ -494,6 +360,12 @@ wss.on('connection', (ws, req) => {
               } else if (data.params.conversation_config.agent.language !== "en" && data.params.conversation_config.tts.model_id == "eleven_turbo_v2") {
                 params.conversation_config.tts.model_id = "eleven_turbo_v2_5";
               }
+              // Bridge settings are kept locally and not sent to ElevenLabs
+              if ('upstream_chunk_ms' in data.params) {
+                await dbManager.updateAgentStreamSettings(data.params.agent_id, normalizeChunkMs(data.params.upstream_chunk_ms, null));
+                portManager.contextLoader.invalidate();
+                delete data.params.upstream_chunk_ms;
+              }
               response = await client.conversationalAi.updateAgent(data.params.agent_id, data.params);
               //console.log(response);
               try {
@@ -508,7 +380,7 @@ wss.on('connection', (ws, req) => {
               console.log(`[WebSocket] ${data.action} request from ${userId} ${connectionId}`);
               try {
                 let compId = connectionManager.getCompId(connectionId);
-                const responseConv = await dbManager.listConversations(null, { compId: compId, limit: 100 });
+                const responseConv = await dbManager.listConversations(null, { compId: compId, limit: data.limit, cursor: data.cursor });
                 //const responseConv = await client.conversationalAi.getConversations();
                 connectionManager.sendStatus(connectionId, data.action, responseConv, data.requestId);
               } catch (error) {
@@ -547,16 +419,19 @@ wss.on('connection', (ws, req) => {
             case 'enableAgent':
                 console.log(`[WebSocket] ${data.action} request from ${userId} ${connectionId}`);
                 response = await dbManager.enableAgentById(data.params)
+                if (remoteAgents) await remoteAgents.trigger();
                 connectionManager.sendStatus(connectionId, data.action, "Agent enabled", data.requestId);
                 break;
             case 'disableAgent':
               console.log(`[WebSocket] ${data.action} request from ${userId} ${connectionId}`);
               response = await dbManager.disableAgentById(data.params)
+              if (remoteAgents) await remoteAgents.trigger();
               connectionManager.sendStatus(connectionId, data.action, "Agent disabled", data.requestId);
               break;
             case 'deleteAgent':
               console.log(`[WebSocket] ${data.action} request from ${userId} ${connectionId}`);
               response = await dbManager.disableAgentById(data.params)
+              if (remoteAgents) await remoteAgents.trigger();
               connectionManager.sendStatus(connectionId, data.action, "Agent disabled", data.requestId);
               break;              
             case 'listRemoteAgents':
@@ -582,12 +457,12 @@ VALUES ( NULL , 'va196001', '1', '168.119.38.103', '87196001', 'ACTIVE', '196AIT
 
   */
 
-/*
             case 'showChannels':
-              //console.log(`[WebSocket] ${data.action} request from ${connectionId}`);
-              response = await asteriskService.getChannels();
-              connectionManager.sendStatus(connectionId, data.action, response, data.requestId);
+              // Sends the current table once; changes follow as channelsDiff
+              connectionManager.subscribe(connectionId, 'channels');
+              connectionManager.sendStatus(connectionId, data.action, asteriskService.getChannels(), data.requestId);
               break;
+/*
             case 'hangup':
               console.log(`[WebSocket] ${data.action} request from ${connectionId}`);
               response = asteriskService.hangupCall(data.channel);
@@ -606,21 +481,38 @@ VALUES ( NULL , 'va196001', '1', '168.119.38.103', '87196001', 'ACTIVE', '196AIT
                 data.callerid = '4921612963110';
                 const channel = `SIP/${channelNumber}@45656`;
                 //const channel = `SIP/994${channelNumber}@voip3_994`;
-                const port = portManager.createCallServer(
-                  connectionId, 
-                  data, 
-                  setupElevenLabs,  // Pass the existing setup function
-                  (socket) => new StreamService(socket) // Factory to create StreamService instances
-                );
-                asteriskService.originateCall(channel, connectionId, port)
+                // The port is claimed when the call leaves the queue, so
+                // queued calls hold no ports or call slots
+                originateScheduler.submit({
+                  connectionId,
+                  channel,
+                  trunk: channel.split('@')[1],
+                  campaign: data.campaign_id || data.agent_id,
+                  prepare: () => {
+                    if (multiplexed) {
+                      // Asterisk sends the connectionId as the AudioSocket ID
+                      portManager.registerCall(connectionId, connectionId, data);
+                      return audiosocketPort;
+                    }
+                    return portManager.createCallServer(
+                      connectionId, 
+                      data, 
+                      setupElevenLabs,  // Pass the existing setup function
+                      (socket) => new StreamService(socket) // Factory to create StreamService instances
+                    );
+                  },
+                  release: () => {
+                    portManager.closeCallServer(connectionId);
+                    portManager.unregisterCall(connectionId);
+                  },
+                })
                   .then((response) => {
                     if (response.message == "Originate successfully queued") {
                       connectionManager.sendStatus(connectionId, 'start_call', "Call started successfully", data.requestId);
                     }
                   })
                   .catch((error) => {
-                    // Clean up the server if call fails
-                    portManager.closeCallServer(connectionId);
+                    // The scheduler already released the port of the call
                     connectionManager.sendStatus(connectionId, 'error', `Error: ${error.message}`, data.requestId);
                   });
               } catch (error) {
@@ -655,13 +547,13 @@ VALUES ( NULL , 'va196001', '1', '168.119.38.103', '87196001', 'ACTIVE', '196AIT
     });
     
     // Set up ping interval to keep connection alive
-    const pingInterval = setInterval(() => {
+    const pingInterval = sharedTimerWheel.every(30000, () => {
         try {
             // Get fresh reference to the websocket to ensure accurate state
             const connection = connectionManager.connections.get(connectionId);
             if (!connection || !connection.ws) {
                 console.log(`[WebSocket] Connection ${connectionId} no longer exists, clearing keep-alive interval`);
-                clearInterval(pingInterval);
+                pingInterval.cancel();
                 return;
             }
             
@@ -674,7 +566,7 @@ VALUES ( NULL , 'va196001', '1', '168.119.38.103', '87196001', 'ACTIVE', '196AIT
                 }
             } else {
                 console.log(`[WebSocket] Connection ${connectionId} no longer open (state: ${connection.ws.readyState}), clearing keep-alive interval`);
-                clearInterval(pingInterval);
+                pingInterval.cancel();
                 
                 // If connection not properly closed, ensure it's cleaned up
                 if (!connection.state?.isClosing) {
@@ -683,7 +575,7 @@ VALUES ( NULL , 'va196001', '1', '168.119.38.103', '87196001', 'ACTIVE', '196AIT
             }
         } catch (error) {
             console.error(`[WebSocket] Error sending keep-alive to ${connectionId}:`, error);
-            clearInterval(pingInterval);
+            pingInterval.cancel();
             
             // Attempt to clean up the connection in case of error
             try {
@@ -692,11 +584,11 @@ VALUES ( NULL , 'va196001', '1', '168.119.38.103', '87196001', 'ACTIVE', '196AIT
                 console.error(`[WebSocket] Error cleaning up connection after ping error:`, closeError);
             }
         }
-    }, 30000);
+    });
     
     // Clear interval when connection closes
     ws.on('close', () => {
-        clearInterval(pingInterval);
+        pingInterval.cancel();
     });
 });
 
@@ -704,18 +596,31 @@ VALUES ( NULL , 'va196001', '1', '168.119.38.103', '87196001', 'ACTIVE', '196AIT
 process.on('SIGINT', () => {
   console.log('Shutting down servers...');
   
-  // Clear remote agents check interval
-  if (checkRemoteAgentsInterval) {
-    clearInterval(checkRemoteAgentsInterval);
+  // Stop syncing remote agents
+  if (remoteAgents) {
+    remoteAgents.close();
   }
   
   // Close all dynamic call servers
   portManager.closeAllServers();
+  if (workerPool) {
+    workerPool.stop();
+  }
+  if (sessionPool) {
+    sessionPool.close();
+  }
+  originateScheduler.close();
+  if (metricsServer) {
+    metricsServer.close();
+  }
   
   // Close all active connections
   connectionManager.getActiveConnectionIds().forEach(connectionId => {
     connectionManager.closeConnection(connectionId);
   });
+  connectionManager.close();
+  asteriskService.channels.close();
+  sessionCache.close();
   
   // Restore original console methods
   consoleLogger.restore();
@@ -0,0 +1,353 @@
+// Benchmarks the whole bridge: starts app.cjs with the multiplexed AudioSocket
+// listener against mockElevenLabs.cjs, with the database and AMI replaced by
+// bench/bridgePreload.cjs, and plays Asterisk for rising numbers of
+// concurrent calls. Each call is routed by lead ID, streams caller audio in
+// 20ms frames and receives the mock agent's greeting and replies.
+//
+//   npm run bench:bridge > report.json
+//
+// Each step measures the bridge's CPU use in cores, event loop lag, CPU time
+// per audio frame (caller and agent frames), memory per call and the time from
+// the AudioSocket ID packet to the first agent audio. A step passes when every
+// call got agent audio and stayed up, the lag p99 is under BENCH_MAX_LAG_MS and
+// the bridge used less than BENCH_MAX_CPU cores. The largest passing step is
+// the sustainable load; divided by the cores it used it gives calls per core.
+// The steps stop at the first that fails. The JSON report goes to stdout or
+// BENCH_REPORT, progress to stderr.
+//
+//   BENCH_STEPS           concurrent calls per step (default 10,25,50,100,200,300)
+//   BENCH_STEP_MS         measured time per step once its calls are up (default 20000)
+//   BENCH_RAMP_MS         time over which the calls of a step connect (default 2000)
+//   BENCH_MAX_LAG_MS      event loop lag p99 a step may reach (default 50)
+//   BENCH_MAX_CPU         cores a step may use (default 0.85)
+//   BENCH_PORT_BASE       first of the three local ports used (default 19090)
+//   BENCH_REPORT          file for the report instead of stdout
+//   BENCH_DB_LATENCY_MS   delay of every fake query (default 0)
+//
+// MOCK_* settings go to the mock, ELEVENLABS_UPSTREAM_CHUNK_MS, NATIVE_AUDIO
+// and the playout settings to the bridge. The bridge runs without call
+// workers, so its CPU is that of one process.
+const { fork, execFileSync } = require('child_process');
+const fs = require('fs');
+const net = require('net');
+const os = require('os');
+const path = require('path');
+const { performance, monitorEventLoopDelay } = require('perf_hooks');
+const { PACKET_TYPES } = require('../StreamService.cjs');
+
+const ROOT = path.join(__dirname, '..');
+const STEPS = (process.env.BENCH_STEPS || '10,25,50,100,200,300').split(',').map((n) => parseInt(n, 10)).filter((n) => n > 0);
+const STEP_MS = parseInt(process.env.BENCH_STEP_MS || '20000', 10);
+const RAMP_MS = parseInt(process.env.BENCH_RAMP_MS || '2000', 10);
+const MAX_LAG_MS = parseFloat(process.env.BENCH_MAX_LAG_MS || '50');
+const MAX_CPU = parseFloat(process.env.BENCH_MAX_CPU || '0.85');
+const PORT_BASE = parseInt(process.env.BENCH_PORT_BASE || '19090', 10);
+
+const PORTS = {
+  mock: PORT_BASE,
+  audiosocket: PORT_BASE + 1,
+  api: PORT_BASE + 2,
+};
+
+// Caller audio: 20ms of 8kHz slin per frame, as Asterisk sends it
+const FRAME_MS = 20;
+const FRAME_BYTES = 320;
+
+// Sampling interval of the driver's own lag, which it counts in the delay
+const LAG_RESOLUTION = 10;
+
+// Calls without agent audio by then have failed
+const FIRST_AUDIO_TIMEOUT = 10000;
+
+// Time for the bridge to close the calls of a step before the next
+const SETTLE_MS = 3000;
+
+// Lead-routed call IDs, as the OSDial dialplan builds them
+const LEAD_ID_PREFIX = '00000000-0000-0000-0000-';
+const FIRST_LEAD_ID = 100000;
+
+function packet(type, payload = Buffer.alloc(0)) {
+  const header = Buffer.from([type, payload.length >> 8, payload.length & 0xff]);
+  return Buffer.concat([header, payload]);
+}
+
+const CALLER_FRAME = (() => {
+  const frame = Buffer.alloc(FRAME_BYTES);
+  for (let i = 0; i < FRAME_BYTES / 2; i++) {
+    frame.writeInt16LE(Math.round(2000 * Math.sin(2 * Math.PI * 300 * i / 8000)), i * 2);
+  }
+  return packet(PACKET_TYPES.AUDIO, frame);
+})();
+const HANGUP_PACKET = packet(PACKET_TYPES.TERMINATE);
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+function percentile(values, p) {
+  if (values.length === 0) return null;
+  const sorted = [...values].sort((a, b) => a - b);
+  return round(sorted[Math.min(sorted.length - 1, Math.ceil(p / 100 * sorted.length) - 1)]);
+}
+
+function round(value, digits = 1) {
+  const factor = 10 ** digits;
+  return Math.round(value * factor) / factor;
+}
+
+function log(message) {
+  process.stderr.write(`[Bench] ${message}\n`);
+}
+
+/**
+ * SimulatedCall - One Asterisk AudioSocket connection to the bridge
+ */
+class SimulatedCall {
+  constructor(leadId) {
+    this.leadId = leadId;
+    this.socket = null;
+    this.pending = Buffer.alloc(0);
+    this.idSentAt = 0;
+    this.firstAudioMs = null;
+    this.framesOut = 0;
+    this.framesIn = 0;
+    this.closed = false;
+    this.hungUp = false;
+  }
+
+  connect() {
+    const callId = `${LEAD_ID_PREFIX}${String(this.leadId).padStart(12, '0')}`;
+    this.socket = net.connect(PORTS.audiosocket, '127.0.0.1', () => {
+      this.socket.setNoDelay(true);
+      this.socket.write(packet(PACKET_TYPES.UUID, Buffer.from(callId.replace(/-/g, ''), 'hex')));
+      this.idSentAt = performance.now();
+    });
+    this.socket.on('data', (chunk) => this.onData(chunk));
+    this.socket.on('error', () => {});
+    this.socket.on('close', () => {
+      this.closed = true;
+    });
+    return this;
+  }
+
+  onData(chunk) {
+    const data = this.pending.length > 0 ? Buffer.concat([this.pending, chunk]) : chunk;
+    let offset = 0;
+    while (data.length - offset >= 3) {
+      const length = data.readUInt16BE(offset + 1);
+      if (data.length - offset < 3 + length) break;
+      if (data[offset] === PACKET_TYPES.AUDIO) {
+        this.framesIn++;
+        if (this.firstAudioMs === null) this.firstAudioMs = performance.now() - this.idSentAt;
+      }
+      offset += 3 + length;
+    }
+    this.pending = data.subarray(offset);
+  }
+
+  sendFrame() {
+    if (this.closed || this.idSentAt === 0) return;
+    this.socket.write(CALLER_FRAME);
+    this.framesOut++;
+  }
+
+  get failed() {
+    return this.firstAudioMs === null || (this.closed && !this.hungUp);
+  }
+
+  hangup() {
+    this.hungUp = true;
+    if (!this.closed) this.socket.end(HANGUP_PACKET);
+  }
+}
+
+function waitForPort(port, timeoutMs = 15000) {
+  const deadline = Date.now() + timeoutMs;
+  return new Promise((resolve, reject) => {
+    const attempt = () => {
+      const socket = net.connect(port, '127.0.0.1', () => {
+        socket.destroy();
+        resolve();
+      });
+      socket.on('error', () => {
+        if (Date.now() > deadline) {
+          reject(new Error(`Nothing listening on port ${port}`));
+        } else {
+          setTimeout(attempt, 100);
+        }
+      });
+    };
+    attempt();
+  });
+}
+
+/**
+ * Asks the bridge for its CPU time, memory and event loop lag
+ * @param {ChildProcess} bridge The bridge started with the preload
+ * @param {Object} options reset restarts the lag histogram, gc collects first
+ */
+function sample(bridge, options = {}) {
+  return new Promise((resolve) => {
+    const onMessage = (message) => {
+      if (message?.type !== 'benchSample') return;
+      bridge.off('message', onMessage);
+      resolve(message);
+    };
+    bridge.on('message', onMessage);
+    bridge.send({ type: 'benchSample', ...options });
+  });
+}
+
+function countFrames(calls) {
+  let frames = 0;
+  for (const call of calls) frames += call.framesIn + call.framesOut;
+  return frames;
+}
+
+async function runStep(bridge, count, firstLeadId) {
+  const idle = await sample(bridge, { gc: true });
+  const calls = [];
+  const frameTimer = setInterval(() => {
+    for (const call of calls) call.sendFrame();
+  }, FRAME_MS);
+
+  for (let i = 0; i < count; i++) {
+    calls.push(new SimulatedCall(firstLeadId + i).connect());
+    await sleep(RAMP_MS / count);
+  }
+  const deadline = Date.now() + FIRST_AUDIO_TIMEOUT;
+  while (calls.some((call) => call.firstAudioMs === null && !call.closed) && Date.now() < deadline) {
+    await sleep(100);
+  }
+
+  const driverLag = monitorEventLoopDelay({ resolution: LAG_RESOLUTION });
+  driverLag.enable();
+  const start = await sample(bridge, { reset: true });
+  const startFrames = countFrames(calls);
+  const startedAt = performance.now();
+  await sleep(STEP_MS);
+  const end = await sample(bridge);
+  const elapsedMs = performance.now() - startedAt;
+  const frames = countFrames(calls) - startFrames;
+  driverLag.disable();
+  const loaded = await sample(bridge, { gc: true });
+
+  clearInterval(frameTimer);
+  for (const call of calls) call.hangup();
+  await sleep(SETTLE_MS);
+
+  const cpuCores = (end.cpuUs - start.cpuUs) / 1000 / elapsedMs;
+  const failedCalls = calls.filter((call) => call.failed).length;
+  const firstAudio = calls.filter((call) => call.firstAudioMs !== null).map((call) => call.firstAudioMs);
+  const result = {
+    calls: count,
+    failedCalls,
+    cpuCores: round(cpuCores, 3),
+    cpuUsPerFrame: frames > 0 ? round((end.cpuUs - start.cpuUs) / frames, 2) : null,
+    framesPerSecond: round(frames / elapsedMs * 1000),
+    lagMs: { p50: round(end.lagMs.p50, 2), p99: round(end.lagMs.p99, 2), max: round(end.lagMs.max, 2) },
+    driverLagMs: { p99: round(Math.max(0, driverLag.percentile(99) / 1e6 - LAG_RESOLUTION), 2) },
+    rssMb: round(loaded.rssBytes / 1048576),
+    heapUsedMb: round(loaded.heapUsedBytes / 1048576),
+    rssPerCallKb: round((loaded.rssBytes - idle.rssBytes) / 1024 / count),
+    heapPerCallKb: round((loaded.heapUsedBytes - idle.heapUsedBytes) / 1024 / count),
+    firstAudioMs: { p50: percentile(firstAudio, 50), p95: percentile(firstAudio, 95), max: percentile(firstAudio, 100) },
+  };
+  result.passed = failedCalls === 0 && result.lagMs.p99 <= MAX_LAG_MS && cpuCores <= MAX_CPU;
+  return result;
+}
+
+function gitCommit() {
+  try {
+    return execFileSync('git', ['rev-parse', '--short', 'HEAD'], { cwd: ROOT, stdio: ['ignore', 'pipe', 'ignore'] }).toString().trim();
+  } catch (error) {
+    return null;
+  }
+}
+
+async function main() {
+  const mock = fork(path.join(ROOT, 'mockElevenLabs.cjs'), [], {
+    env: { ...process.env, MOCK_ELEVENLABS_PORT: String(PORTS.mock) },
+    stdio: ['ignore', 'ignore', 'inherit', 'ipc'],
+  });
+  const bridge = fork(path.join(ROOT, 'app.cjs'), [], {
+    cwd: ROOT,
+    execArgv: ['--expose-gc', '--require', path.join(__dirname, 'bridgePreload.cjs')],
+    env: {
+      ...process.env,
+      BENCH_BRIDGE_REPORT: '1',
+      ELEVENLABS_API_KEY: process.env.ELEVENLABS_API_KEY || 'bench',
+      ELEVENLABS_API_URL: `http://127.0.0.1:${PORTS.mock}`,
+      AUDIOSOCKET_PORT: String(PORTS.audiosocket),
+      AUDIOSOCKET_WORKERS: '0',
+      API_PORT: String(PORTS.api),
+      METRICS_PORT: '',
+    },
+    stdio: ['ignore', 'ignore', 'inherit', 'ipc'],
+  });
+  const stop = () => {
+    bridge.kill();
+    mock.kill();
+  };
+  bridge.on('exit', (code) => {
+    if (code !== null && code !== 0) log(`Bridge exited with code ${code}`);
+  });
+
+  const report = {
+    benchmark: 'bridge',
+    startedAt: new Date().toISOString(),
+    commit: gitCommit(),
+    node: process.version,
+    cpu: os.cpus()[0]?.model || null,
+    cpuCount: os.cpus().length,
+    settings: {
+      stepMs: STEP_MS,
+      rampMs: RAMP_MS,
+      maxLagMs: MAX_LAG_MS,
+      maxCpu: MAX_CPU,
+      nativeAudio: process.env.NATIVE_AUDIO !== '0',
+      upstreamChunkMs: parseInt(process.env.ELEVENLABS_UPSTREAM_CHUNK_MS || '20', 10),
+      mockResponseMs: parseInt(process.env.MOCK_RESPONSE_MS || '1000', 10),
+      mockTurnMs: parseInt(process.env.MOCK_TURN_MS || '3000', 10),
+      dbLatencyMs: parseInt(process.env.BENCH_DB_LATENCY_MS || '0', 10),
+    },
+    steps: [],
+  };
+
+  try {
+    await Promise.all([waitForPort(PORTS.mock), waitForPort(PORTS.api)]);
+    let leadId = FIRST_LEAD_ID;
+    for (const count of STEPS) {
+      log(`${count} calls...`);
+      const step = await runStep(bridge, count, leadId);
+      leadId += count;
+      report.steps.push(step);
+      log(`${count} calls: ${step.passed ? 'pass' : 'FAIL'}, ${step.cpuCores} cores, lag p99 ${step.lagMs.p99}ms, ${step.cpuUsPerFrame}us/frame, ${step.rssPerCallKb}KB/call, first audio p95 ${step.firstAudioMs.p95}ms, ${step.failedCalls} failed`);
+      if (!step.passed) break;
+    }
+  } finally {
+    stop();
+  }
+
+  const sustained = report.steps.filter((step) => step.passed).pop() || null;
+  report.summary = {
+    maxSustainableCalls: sustained ? sustained.calls : 0,
+    callsPerCore: sustained && sustained.cpuCores > 0 ? round(sustained.calls / sustained.cpuCores) : null,
+    cpuUsPerFrame: sustained ? sustained.cpuUsPerFrame : null,
+    rssPerCallKb: sustained ? sustained.rssPerCallKb : null,
+    lagP99Ms: sustained ? sustained.lagMs.p99 : null,
+    firstAudioP95Ms: sustained ? sustained.firstAudioMs.p95 : null,
+    limitedBy: report.steps.length > 0 && !report.steps[report.steps.length - 1].passed ? 'step failed' : 'steps exhausted',
+  };
+
+  const json = `${JSON.stringify(report, null, 2)}\n`;
+  if (process.env.BENCH_REPORT) {
+    fs.writeFileSync(process.env.BENCH_REPORT, json);
+    log(`Report written to ${process.env.BENCH_REPORT}`);
+  } else {
+    process.stdout.write(json);
+  }
+}
+
+main().catch((error) => {
+  log(`Failed: ${error.message}`);
+  process.exit(1);
+});
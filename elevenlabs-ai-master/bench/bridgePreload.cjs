@@ -0,0 +1,129 @@
+// Loaded into the bridge by bench/bridge.cjs with --require. Replaces the
+// MySQL pool and the AMI client with in-memory fakes, so the bridge runs
+// without a database or Asterisk, and answers the benchmark's requests for
+// the event loop lag, CPU time and memory of the process.
+//
+//   BENCH_DB_LATENCY_MS   delay of every fake query (default 0)
+const Module = require('module');
+const EventEmitter = require('events');
+const { monitorEventLoopDelay } = require('perf_hooks');
+
+const DB_LATENCY_MS = parseInt(process.env.BENCH_DB_LATENCY_MS || '0', 10);
+
+// The rows a lead-routed call looks up, as bench/bridge.cjs dials lead IDs
+const CONF_EXTEN = '8600051';
+const SERVER_IP = '127.0.0.1';
+
+function rowsFor(sql, params) {
+  if (/^\s*(INSERT|UPDATE|DELETE|REPLACE)\b/i.test(sql)) {
+    return { affectedRows: 1, insertId: 0 };
+  }
+  if (/FROM osdial_live_agents WHERE lead_id/.test(sql)) {
+    return [{
+      lead_id: params[0],
+      user: 'bench',
+      conf_exten: CONF_EXTEN,
+      server_ip: SERVER_IP,
+      campaign_id: 'BENCH',
+      channel: `SIP/bench-${params[0]}`,
+      call_server_ip: SERVER_IP,
+    }];
+  }
+  if (/FROM osdial_remote_agents WHERE conf_exten/.test(sql)) {
+    return [{
+      remote_agent_id: 1,
+      user_start: 'bench',
+      conf_exten: CONF_EXTEN,
+      server_ip: SERVER_IP,
+      status: 'ACTIVE',
+      agent_id: 'bench_agent',
+    }];
+  }
+  if (/FROM\s+osdial_list ol/.test(sql)) {
+    return [{ lead_id: params[0], list_id: 1, first_name: 'Bench', last_name: 'Caller', phone_number: '4930000000' }];
+  }
+  return [];
+}
+
+async function query(sql, params = []) {
+  if (DB_LATENCY_MS > 0) await new Promise((resolve) => setTimeout(resolve, DB_LATENCY_MS));
+  return [rowsFor(sql, params), []];
+}
+
+const fakeConnection = {
+  query,
+  execute: query,
+  beginTransaction: async () => {},
+  commit: async () => {},
+  rollback: async () => {},
+  release() {},
+};
+
+const fakeMysql = {
+  createPool: () => ({
+    query,
+    execute: query,
+    getConnection: async () => fakeConnection,
+    end: async () => {},
+  }),
+};
+
+// Never connects, so the channel cache only sees its periodic dumps
+class FakeAmi extends EventEmitter {
+  constructor() {
+    super();
+    this.sequence = 0;
+  }
+
+  keepConnected() {}
+
+  action(action, callback) {
+    const actionId = action.actionid || `bench-${++this.sequence}`;
+    setImmediate(() => {
+      if (callback) callback(null, { response: 'Success', actionid: actionId });
+      if (action.action === 'CoreShowChannels') {
+        this.emit('managerevent', { event: 'CoreShowChannelsComplete', actionid: actionId });
+      }
+    });
+    return actionId;
+  }
+
+  disconnect() {}
+}
+
+const load = Module._load;
+Module._load = function benchLoad(request, parent, isMain) {
+  if (request === 'mysql2/promise') return fakeMysql;
+  if (request === 'asterisk-manager') return FakeAmi;
+  return load.call(this, request, parent, isMain);
+};
+
+// Only the process started by the benchmark reports, not its call workers
+if (process.send && process.env.BENCH_BRIDGE_REPORT) {
+  delete process.env.BENCH_BRIDGE_REPORT;
+  // The histogram counts the sampling interval in the delay, as in callWorker.cjs
+  const LAG_RESOLUTION = 10;
+  const lag = monitorEventLoopDelay({ resolution: LAG_RESOLUTION });
+  const lagMs = (ns) => Math.max(0, ns / 1e6 - LAG_RESOLUTION) || 0;
+  lag.enable();
+
+  process.on('message', (message) => {
+    if (message?.type !== 'benchSample') return;
+    if (message.gc && global.gc) global.gc();
+    const cpu = process.cpuUsage();
+    const memory = process.memoryUsage();
+    process.send({
+      type: 'benchSample',
+      cpuUs: cpu.user + cpu.system,
+      rssBytes: memory.rss,
+      heapUsedBytes: memory.heapUsed,
+      externalBytes: memory.external,
+      lagMs: {
+        p50: lagMs(lag.percentile(50)),
+        p99: lagMs(lag.percentile(99)),
+        max: lagMs(lag.max),
+      },
+    });
+    if (message.reset) lag.reset();
+  });
+}
@@ -0,0 +1,102 @@
+// Entry point of a call worker process started by CallWorkerPool. Runs the
+// calls of the AudioSocket connections handed over by the main process.
+const { monitorEventLoopDelay } = require('perf_hooks');
+const PortManager = require('./PortManager.cjs');
+const { StreamService } = require('./StreamService.cjs');
+const { createElevenLabsSetup } = require('./ElevenLabsSession.cjs');
+const ElevenLabsSessionPool = require('./ElevenLabsSessionPool.cjs');
+const { sharedPacer } = require('./AudioPacer.cjs');
+const { sharedMemoryGovernor } = require('./MemoryGovernor.cjs');
+const ConsoleLogger = require('./ConsoleLogger.cjs');
+
+// Console output of the remaining modules goes through the log ring too
+new ConsoleLogger();
+
+const workerIndex = process.env.CALL_WORKER_INDEX;
+const reportInterval = parseInt(process.env.CALL_WORKER_REPORT_INTERVAL || '1000', 10);
+
+// Events of PortManager forwarded to the main process
+const FORWARDED_EVENTS = ['user_transcript', 'agent_response', 'agent_response_correction', 'interruption', 'callTimings', 'upstreamStats', 'playoutStats', 'callShed', 'turnLatency'];
+
+const portManager = new PortManager(0, 0, null);
+// Each worker keeps its own session pool for the calls it takes
+const sessionPoolMax = parseInt(process.env.ELEVENLABS_POOL_MAX || '0', 10);
+const sessionPool = sessionPoolMax > 0
+  ? new ElevenLabsSessionPool({ max: sessionPoolMax, openSessions: process.env.ELEVENLABS_POOL_SESSIONS === 'true' })
+  : null;
+portManager.setupElevenLabsCallback = createElevenLabsSetup(null, sessionPool);
+portManager.streamServiceFactory = (socket) => new StreamService(socket);
+
+// Call routing and its database lookups stay in the main process
+const pendingResolves = new Map();
+let nextRequestId = 0;
+portManager.resolveCall = (callId) => new Promise((resolve) => {
+  const requestId = nextRequestId++;
+  pendingResolves.set(requestId, resolve);
+  process.send({ type: 'resolveCall', requestId, callId });
+});
+
+for (const name of FORWARDED_EVENTS) {
+  portManager.on(name, (payload) => process.send({ type: 'event', name, payload }));
+}
+
+let connections = 0;
+
+process.on('message', (message, socket) => {
+  switch (message.type) {
+    case 'call':
+      if (!socket) return;
+      connections++;
+      socket.once('close', () => {
+        connections--;
+        reportLoad();
+      });
+      portManager.handleMultiplexedConnection(socket);
+      reportLoad();
+      break;
+
+    case 'resolvedCall': {
+      const resolve = pendingResolves.get(message.requestId);
+      if (resolve) {
+        pendingResolves.delete(message.requestId);
+        resolve(message.call);
+      }
+      break;
+    }
+  }
+});
+
+// Event loop lag, as the mean and maximum delay since the last report. The
+// histogram records the interval between samples, so the sampling
+// resolution itself is subtracted.
+const LAG_RESOLUTION = 10;
+const loopDelay = monitorEventLoopDelay({ resolution: LAG_RESOLUTION });
+loopDelay.enable();
+const lagMs = (ns) => Math.max(0, ns / 1e6 - LAG_RESOLUTION) || 0;
+
+function reportLoad() {
+  if (!process.connected) return;
+  const pacer = sharedPacer.getStats();
+  const memory = sharedMemoryGovernor.getStats();
+  process.send({
+    type: 'load',
+    calls: connections,
+    lagMs: lagMs(loopDelay.mean),
+    lagMaxMs: lagMs(loopDelay.max),
+    pacerLateTicks: pacer.lateTicks,
+    pacerResyncs: pacer.resyncs,
+    rssBytes: process.memoryUsage.rss(),
+    queuedBytes: memory.queuedBytes,
+    shedCalls: memory.shedCalls,
+  });
+}
+
+setInterval(() => {
+  reportLoad();
+  loopDelay.reset();
+}, reportInterval);
+
+// The worker cannot outlive the main process
+process.on('disconnect', () => process.exit(0));
+
+console.log(`[CallWorker:${workerIndex}] Started with pid ${process.pid}`);
@@ -0,0 +1,143 @@
+// Local stand-in for the ElevenLabs Conversational AI API, for load and
+// latency testing without using real agents. Serves the signed URL endpoint
+// and the conversation WebSocket: it answers the initiation data with
+// metadata and a greeting, and after every few seconds of user audio replies
+// with a transcript, an agent response and synthetic agent audio.
+//
+// Point the bridge at it with ELEVENLABS_API_URL=http://localhost:8090.
+//
+//   MOCK_ELEVENLABS_PORT   port to listen on (default 8090)
+//   MOCK_LATENCY_MS        delay added to every HTTP request and handshake (default 0)
+//   MOCK_RESPONSE_MS       length of each agent reply in ms of audio (default 1000)
+//   MOCK_TURN_MS           user audio per turn before the agent replies (default 3000)
+//   MOCK_AUDIO_FORMAT      pcm_<rate> format reported and used both ways (default pcm_8000)
+const http = require('http');
+const { URL } = require('url');
+const { WebSocketServer } = require('ws');
+
+// Agent audio is sent in chunks of this many milliseconds
+const CHUNK_MS = 250;
+
+/**
+ * Generates a tone as base64 slin chunks, so the reply is audible when
+ * testing with a real phone
+ */
+function toneChunks(durationMs, sampleRate, frequency = 440) {
+  const chunks = [];
+  const samplesPerChunk = sampleRate * CHUNK_MS / 1000;
+  let n = 0;
+  for (let t = 0; t < durationMs; t += CHUNK_MS) {
+    const buffer = Buffer.alloc(samplesPerChunk * 2);
+    for (let i = 0; i < samplesPerChunk; i++, n++) {
+      buffer.writeInt16LE(Math.round(8000 * Math.sin(2 * Math.PI * frequency * n / sampleRate)), i * 2);
+    }
+    chunks.push(buffer.toString('base64'));
+  }
+  return chunks;
+}
+
+/**
+ * Starts the mock server
+ * @param {Object} options port, latencyMs, responseMs, turnMs and audioFormat
+ * @returns {http.Server} The listening server
+ */
+function createMockServer({ port = 8090, latencyMs = 0, responseMs = 1000, turnMs = 3000, audioFormat = 'pcm_8000' } = {}) {
+  const sampleRate = parseInt(audioFormat.split('_')[1], 10);
+  const reply = toneChunks(responseMs, sampleRate);
+  const turnBytes = sampleRate * 2 * turnMs / 1000;
+  let conversations = 0;
+
+  const server = http.createServer((req, res) => {
+    const url = new URL(req.url, `http://${req.headers.host}`);
+    setTimeout(() => {
+      if (url.pathname !== '/v1/convai/conversation/get_signed_url') {
+        res.writeHead(404).end();
+        return;
+      }
+      const agentId = url.searchParams.get('agent_id');
+      res.writeHead(200, { 'Content-Type': 'application/json' });
+      res.end(JSON.stringify({
+        signed_url: `ws://${req.headers.host}/v1/convai/conversation?agent_id=${agentId}&conversation_signature=mock`,
+      }));
+    }, latencyMs);
+  });
+
+  const wss = new WebSocketServer({ noServer: true });
+  server.on('upgrade', (req, socket, head) => {
+    setTimeout(() => {
+      wss.handleUpgrade(req, socket, head, (ws) => wss.emit('connection', ws, req));
+    }, latencyMs);
+  });
+
+  wss.on('connection', (ws) => {
+    const conversationId = `mock_${++conversations}`;
+    let eventId = 0;
+    let receivedBytes = 0;
+    let replying = false;
+
+    const send = (message) => {
+      if (ws.readyState === 1) ws.send(JSON.stringify(message));
+    };
+
+    const speak = (text) => {
+      replying = true;
+      send({ type: 'agent_response', agent_response_event: { agent_response: text } });
+      reply.forEach((chunk, i) => {
+        setTimeout(() => {
+          send({ type: 'audio', audio_event: { audio_base_64: chunk, event_id: ++eventId } });
+          if (i === reply.length - 1) replying = false;
+        }, i * CHUNK_MS);
+      });
+    };
+
+    const pingTimer = setInterval(() => send({ type: 'ping', ping_event: { event_id: ++eventId } }), 10000);
+    ws.on('close', () => clearInterval(pingTimer));
+
+    ws.on('message', (data) => {
+      let message;
+      try {
+        message = JSON.parse(data);
+      } catch (error) {
+        console.error(`[MockElevenLabs:${conversationId}] Invalid message`);
+        return;
+      }
+
+      if (message.type === 'conversation_initiation_client_data') {
+        send({
+          type: 'conversation_initiation_metadata',
+          conversation_initiation_metadata_event: {
+            conversation_id: conversationId,
+            agent_output_audio_format: audioFormat,
+            user_input_audio_format: audioFormat,
+          },
+        });
+        const name = message.dynamic_variables?.first_name;
+        speak(name ? `Hello ${name}` : 'Hello');
+      } else if (message.user_audio_chunk) {
+        receivedBytes += Buffer.byteLength(message.user_audio_chunk, 'base64');
+        if (receivedBytes >= turnBytes && !replying) {
+          receivedBytes = 0;
+          send({ type: 'user_transcript', user_transcription_event: { user_transcript: 'mock user turn' } });
+          speak('Mock agent reply');
+        }
+      }
+    });
+  });
+
+  server.listen(port, () => {
+    console.log(`[MockElevenLabs] Listening on port ${port}`);
+  });
+  return server;
+}
+
+if (require.main === module) {
+  createMockServer({
+    port: parseInt(process.env.MOCK_ELEVENLABS_PORT || '8090', 10),
+    latencyMs: parseInt(process.env.MOCK_LATENCY_MS || '0', 10),
+    responseMs: parseInt(process.env.MOCK_RESPONSE_MS || '1000', 10),
+    turnMs: parseInt(process.env.MOCK_TURN_MS || '3000', 10),
+    audioFormat: process.env.MOCK_AUDIO_FORMAT || 'pcm_8000',
+  });
+}
+
+module.exports = { createMockServer };
@@ -0,0 +1,433 @@
+// Native fast paths for the per-frame work of the bridge: base64 encoding
+// and decoding into preallocated buffers, AudioSocket framing, and pulling
+// the agent audio out of ElevenLabs messages without a JSON parse. The
+// Resampler class is defined in resampler.cc.
+//
+// The JavaScript side (NativeAudio.cjs) provides the same functions in plain
+// JavaScript when this addon is not built.
+
+#include <node_api.h>
+
+#include "resampler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define HAVE_SSSE3_PATH 1
+#endif
+
+namespace {
+
+const char kEncodeTable[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Maps a base64 character to its value, 0xff for anything else
+uint8_t decode_table[256];
+
+void init_decode_table() {
+  memset(decode_table, 0xff, sizeof(decode_table));
+  for (int i = 0; i < 64; i++) {
+    decode_table[static_cast<uint8_t>(kEncodeTable[i])] = static_cast<uint8_t>(i);
+  }
+}
+
+size_t encoded_length(size_t n) { return (n + 2) / 3 * 4; }
+
+// Scalar encoder; used for the tail and on CPUs without SSSE3
+size_t encode_scalar(const uint8_t* src, size_t n, uint8_t* dst) {
+  uint8_t* out = dst;
+  size_t i = 0;
+  for (; i + 3 <= n; i += 3) {
+    uint32_t v = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+    *out++ = kEncodeTable[(v >> 18) & 0x3f];
+    *out++ = kEncodeTable[(v >> 12) & 0x3f];
+    *out++ = kEncodeTable[(v >> 6) & 0x3f];
+    *out++ = kEncodeTable[v & 0x3f];
+  }
+  if (i < n) {
+    uint32_t v = src[i] << 16;
+    if (i + 1 < n) v |= src[i + 1] << 8;
+    *out++ = kEncodeTable[(v >> 18) & 0x3f];
+    *out++ = kEncodeTable[(v >> 12) & 0x3f];
+    *out++ = i + 1 < n ? kEncodeTable[(v >> 6) & 0x3f] : '=';
+    *out++ = '=';
+  }
+  return out - dst;
+}
+
+// Scalar decoder; returns the number of bytes written, or -1 if the input
+// is not valid base64
+ptrdiff_t decode_scalar(const uint8_t* src, size_t n, uint8_t* dst) {
+  if (n % 4 != 0) return -1;
+  uint8_t* out = dst;
+  for (size_t i = 0; i < n; i += 4) {
+    uint8_t a = decode_table[src[i]];
+    uint8_t b = decode_table[src[i + 1]];
+    if ((a | b) == 0xff) return -1;
+    *out++ = static_cast<uint8_t>((a << 2) | (b >> 4));
+
+    if (src[i + 2] == '=') {
+      if (i + 4 != n || src[i + 3] != '=') return -1;
+      break;
+    }
+    uint8_t c = decode_table[src[i + 2]];
+    if (c == 0xff) return -1;
+    *out++ = static_cast<uint8_t>((b << 4) | (c >> 2));
+
+    if (src[i + 3] == '=') {
+      if (i + 4 != n) return -1;
+      break;
+    }
+    uint8_t d = decode_table[src[i + 3]];
+    if (d == 0xff) return -1;
+    *out++ = static_cast<uint8_t>((c << 6) | d);
+  }
+  return out - dst;
+}
+
+#ifdef HAVE_SSSE3_PATH
+
+// SSSE3 codecs after Muła and Lemire, "Faster Base64 Encoding and Decoding
+// using AVX2 Instructions" (2018), in their 128-bit form: 12 input bytes to
+// 16 characters per step when encoding, and the reverse when decoding.
+
+__attribute__((target("ssse3")))
+size_t encode_ssse3(const uint8_t* src, size_t n, uint8_t* dst) {
+  const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  const __m128i shift_lut = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+  size_t i = 0;
+  uint8_t* out = dst;
+  // Each step loads 16 bytes but consumes 12
+  for (; i + 16 <= n; i += 12, out += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    in = _mm_shuffle_epi8(in, shuffle);
+
+    // Split each 3-byte group into four 6-bit indices
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(t1, t3);
+
+    // Translate indices to characters by adding a per-range offset
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    range = _mm_or_si128(range, _mm_and_si128(less, _mm_set1_epi8(13)));
+    const __m128i chars = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, range), indices);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chars);
+  }
+  return (out - dst) + encode_scalar(src + i, n - i, out);
+}
+
+__attribute__((target("ssse3")))
+ptrdiff_t decode_ssse3(const uint8_t* src, size_t n, uint8_t* dst) {
+  if (n % 4 != 0) return -1;
+
+  const __m128i shift_lut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_lut = _mm_setr_epi8(
+      static_cast<char>(0xa8), static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8),
+      static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8),
+      static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf0), 0x54, 0x50, 0x50, 0x50, 0x54);
+  const __m128i bitpos_lut = _mm_setr_epi8(
+      0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, static_cast<char>(0x80), 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+  size_t i = 0;
+  uint8_t* out = dst;
+  // Padding can only occur in the last four characters, which are always
+  // left to the scalar decoder
+  for (; i + 20 <= n; i += 16, out += 12) {
+    const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    const __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    const __m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+
+    // Validate: each low nibble allows a set of high nibbles
+    const __m128i allowed = _mm_shuffle_epi8(mask_lut, lo);
+    const __m128i bit = _mm_shuffle_epi8(bitpos_lut, hi);
+    const __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(allowed, bit), _mm_setzero_si128());
+    if (_mm_movemask_epi8(invalid)) return -1;
+
+    // Translate characters to 6-bit values; '/' shares its high nibble
+    // with '+' but needs a different offset
+    const __m128i is_slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    const __m128i shift = _mm_or_si128(
+        _mm_andnot_si128(is_slash, _mm_shuffle_epi8(shift_lut, hi)),
+        _mm_and_si128(is_slash, _mm_set1_epi8(16)));
+    const __m128i values = _mm_add_epi8(in, shift);
+
+    // Pack four 6-bit values into three bytes
+    const __m128i ab_bc = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i abcd = _mm_madd_epi16(ab_bc, _mm_set1_epi32(0x00011000));
+    // The store writes 16 bytes of which 12 are kept; the caller sizes the
+    // destination with that slack
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(abcd, pack));
+  }
+
+  const ptrdiff_t tail = decode_scalar(src + i, n - i, out);
+  return tail < 0 ? -1 : (out - dst) + tail;
+}
+
+const bool have_ssse3 = __builtin_cpu_supports("ssse3");
+
+#endif  // HAVE_SSSE3_PATH
+
+size_t encode(const uint8_t* src, size_t n, uint8_t* dst) {
+#ifdef HAVE_SSSE3_PATH
+  if (have_ssse3) return encode_ssse3(src, n, dst);
+#endif
+  return encode_scalar(src, n, dst);
+}
+
+// Decodes into dst, which must have room for 3 * n / 4 bytes; the SIMD path
+// writes up to 4 bytes past the decoded data, so when that slack is not
+// available the scalar decoder is used
+ptrdiff_t decode(const uint8_t* src, size_t n, uint8_t* dst, size_t dst_len) {
+#ifdef HAVE_SSSE3_PATH
+  if (have_ssse3 && dst_len >= n / 4 * 3 + 4) return decode_ssse3(src, n, dst);
+#endif
+  return decode_scalar(src, n, dst);
+}
+
+// --- N-API helpers ---
+
+#define CHECK(env, call)                                         \
+  do {                                                           \
+    if ((call) != napi_ok) {                                     \
+      napi_throw_error((env), nullptr, "N-API call failed");     \
+      return nullptr;                                            \
+    }                                                            \
+  } while (0)
+
+bool get_buffer(napi_env env, napi_value value, uint8_t** data, size_t* length) {
+  bool is_buffer = false;
+  if (napi_is_buffer(env, value, &is_buffer) != napi_ok || !is_buffer) {
+    napi_throw_type_error(env, nullptr, "Expected a Buffer");
+    return false;
+  }
+  void* ptr = nullptr;
+  if (napi_get_buffer_info(env, value, &ptr, length) != napi_ok) {
+    napi_throw_error(env, nullptr, "Failed to read Buffer");
+    return false;
+  }
+  *data = static_cast<uint8_t*>(ptr);
+  return true;
+}
+
+napi_value make_number(napi_env env, double value) {
+  napi_value result;
+  napi_create_double(env, value, &result);
+  return result;
+}
+
+// base64Encode(src, dst) -> characters written
+napi_value Base64Encode(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  CHECK(env, napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr));
+
+  uint8_t *src, *dst;
+  size_t src_len, dst_len;
+  if (!get_buffer(env, argv[0], &src, &src_len) || !get_buffer(env, argv[1], &dst, &dst_len)) return nullptr;
+  if (dst_len < encoded_length(src_len)) {
+    napi_throw_range_error(env, nullptr, "Destination too small");
+    return nullptr;
+  }
+  return make_number(env, static_cast<double>(encode(src, src_len, dst)));
+}
+
+// base64Decode(src, dst) -> bytes written, or -1 if src is not valid base64
+napi_value Base64Decode(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  CHECK(env, napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr));
+
+  uint8_t *src, *dst;
+  size_t src_len, dst_len;
+  if (!get_buffer(env, argv[0], &src, &src_len) || !get_buffer(env, argv[1], &dst, &dst_len)) return nullptr;
+  if (dst_len < src_len / 4 * 3) {
+    napi_throw_range_error(env, nullptr, "Destination too small");
+    return nullptr;
+  }
+  return make_number(env, static_cast<double>(decode(src, src_len, dst, dst_len)));
+}
+
+// extractAudio(message, dst) -> decoded bytes of the audio_event.audio_base_64
+// string in a raw ElevenLabs message, -1 if the message has no such field,
+// or -2 if it does but needs a full JSON parse (escapes, invalid data, or
+// dst too small)
+napi_value ExtractAudio(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  CHECK(env, napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr));
+
+  uint8_t *msg, *dst;
+  size_t msg_len, dst_len;
+  if (!get_buffer(env, argv[0], &msg, &msg_len) || !get_buffer(env, argv[1], &dst, &dst_len)) return nullptr;
+
+  static const char kKey[] = "\"audio_base_64\"";
+  const size_t key_len = sizeof(kKey) - 1;
+  const uint8_t* end = msg + msg_len;
+  const uint8_t* p = msg;
+  const uint8_t* found = nullptr;
+  while (p + key_len <= end) {
+    const uint8_t* q = static_cast<const uint8_t*>(memchr(p, '"', end - p));
+    if (!q || q + key_len > end) break;
+    if (memcmp(q, kKey, key_len) == 0) {
+      found = q + key_len;
+      break;
+    }
+    p = q + 1;
+  }
+  if (!found) return make_number(env, -1);
+
+  // Skip to the opening quote of the value
+  p = found;
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+  if (p >= end || *p != ':') return make_number(env, -2);
+  p++;
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+  if (p >= end || *p != '"') return make_number(env, -2);
+  const uint8_t* value = ++p;
+
+  const uint8_t* close = static_cast<const uint8_t*>(memchr(value, '"', end - value));
+  if (!close) return make_number(env, -2);
+  const size_t value_len = close - value;
+  // An escaped character (such as \/) means the value is not raw base64
+  if (memchr(value, '\\', value_len)) return make_number(env, -2);
+  if (dst_len < value_len / 4 * 3) return make_number(env, -2);
+
+  const ptrdiff_t written = decode(value, value_len, dst, dst_len);
+  return make_number(env, written < 0 ? -2 : static_cast<double>(written));
+}
+
+// encodeFrames(audio, dst, frameBytes) -> bytes written; splits audio into
+// AudioSocket audio packets of at most frameBytes of payload each
+napi_value EncodeFrames(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  CHECK(env, napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr));
+
+  uint8_t *audio, *dst;
+  size_t audio_len, dst_len;
+  if (!get_buffer(env, argv[0], &audio, &audio_len) || !get_buffer(env, argv[1], &dst, &dst_len)) return nullptr;
+  uint32_t frame_bytes = 320;
+  if (argc > 2) CHECK(env, napi_get_value_uint32(env, argv[2], &frame_bytes));
+  if (frame_bytes == 0 || frame_bytes > 0xffff) {
+    napi_throw_range_error(env, nullptr, "Invalid frame size");
+    return nullptr;
+  }
+
+  const size_t frames = (audio_len + frame_bytes - 1) / frame_bytes;
+  if (dst_len < audio_len + 3 * frames) {
+    napi_throw_range_error(env, nullptr, "Destination too small");
+    return nullptr;
+  }
+
+  uint8_t* out = dst;
+  for (size_t i = 0; i < audio_len; i += frame_bytes) {
+    const size_t len = audio_len - i < frame_bytes ? audio_len - i : frame_bytes;
+    out[0] = 0x10;
+    out[1] = static_cast<uint8_t>(len >> 8);
+    out[2] = static_cast<uint8_t>(len);
+    memcpy(out + 3, audio + i, len);
+    out += 3 + len;
+  }
+  return make_number(env, static_cast<double>(out - dst));
+}
+
+// decodeFrames(buffer, out) -> number of complete packets found; for each,
+// out receives its offset, payload length and type. Stops early when out is
+// full. The caller continues from the end of the last packet.
+napi_value DecodeFrames(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  CHECK(env, napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr));
+
+  uint8_t* buf;
+  size_t buf_len;
+  if (!get_buffer(env, argv[0], &buf, &buf_len)) return nullptr;
+
+  napi_typedarray_type type;
+  size_t out_len;
+  void* out_data;
+  if (napi_get_typedarray_info(env, argv[1], &type, &out_len, &out_data, nullptr, nullptr) != napi_ok ||
+      type != napi_int32_array) {
+    napi_throw_type_error(env, nullptr, "Expected an Int32Array");
+    return nullptr;
+  }
+  int32_t* out = static_cast<int32_t*>(out_data);
+
+  size_t count = 0;
+  size_t offset = 0;
+  while (buf_len - offset >= 3 && (count + 1) * 3 <= out_len) {
+    const size_t len = (buf[offset + 1] << 8) | buf[offset + 2];
+    if (buf_len - offset - 3 < len) break;
+    out[count * 3] = static_cast<int32_t>(offset);
+    out[count * 3 + 1] = static_cast<int32_t>(len);
+    out[count * 3 + 2] = buf[offset];
+    count++;
+    offset += 3 + len;
+  }
+  return make_number(env, static_cast<double>(count));
+}
+
+// encodeUserAudioMessage(audio, dst) -> bytes written; writes the JSON text
+// {"user_audio_chunk":"<base64>"} sent to ElevenLabs for caller audio
+napi_value EncodeUserAudioMessage(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  CHECK(env, napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr));
+
+  uint8_t *audio, *dst;
+  size_t audio_len, dst_len;
+  if (!get_buffer(env, argv[0], &audio, &audio_len) || !get_buffer(env, argv[1], &dst, &dst_len)) return nullptr;
+
+  static const char kPrefix[] = "{\"user_audio_chunk\":\"";
+  static const char kSuffix[] = "\"}";
+  const size_t prefix_len = sizeof(kPrefix) - 1;
+  const size_t suffix_len = sizeof(kSuffix) - 1;
+  if (dst_len < prefix_len + encoded_length(audio_len) + suffix_len) {
+    napi_throw_range_error(env, nullptr, "Destination too small");
+    return nullptr;
+  }
+
+  memcpy(dst, kPrefix, prefix_len);
+  size_t n = prefix_len + encode(audio, audio_len, dst + prefix_len);
+  memcpy(dst + n, kSuffix, suffix_len);
+  return make_number(env, static_cast<double>(n + suffix_len));
+}
+
+napi_value Init(napi_env env, napi_value exports) {
+  init_decode_table();
+
+  const napi_property_descriptor properties[] = {
+      {"base64Encode", nullptr, Base64Encode, nullptr, nullptr, nullptr, napi_default, nullptr},
+      {"base64Decode", nullptr, Base64Decode, nullptr, nullptr, nullptr, napi_default, nullptr},
+      {"extractAudio", nullptr, ExtractAudio, nullptr, nullptr, nullptr, napi_default, nullptr},
+      {"encodeFrames", nullptr, EncodeFrames, nullptr, nullptr, nullptr, napi_default, nullptr},
+      {"decodeFrames", nullptr, DecodeFrames, nullptr, nullptr, nullptr, napi_default, nullptr},
+      {"encodeUserAudioMessage", nullptr, EncodeUserAudioMessage, nullptr, nullptr, nullptr, napi_default, nullptr},
+  };
+  CHECK(env, napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties));
+
+  napi_value simd;
+#ifdef HAVE_SSSE3_PATH
+  CHECK(env, napi_get_boolean(env, have_ssse3, &simd));
+#else
+  CHECK(env, napi_get_boolean(env, false, &simd));
+#endif
+  CHECK(env, napi_set_named_property(env, exports, "simd", simd));
+  CHECK(env, InitResampler(env, exports));
+  return exports;
+}
+
+}  // namespace
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, Init)
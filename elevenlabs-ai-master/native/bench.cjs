@@ -0,0 +1,138 @@
+// Benchmarks the per-frame media work of the bridge: the original JavaScript
+// (JSON and Buffer base64) against NativeAudio with and without the addon.
+//
+//   npm run bench:native
+//
+// Set BENCH_MS to change how long each case runs (default 1000).
+const crypto = require('crypto');
+const NativeAudio = require('../NativeAudio.cjs');
+const { JsResampler, createResampler } = require('../AudioConverter.cjs');
+
+const BENCH_MS = parseInt(process.env.BENCH_MS || '1000', 10);
+
+// Agent audio arrives in chunks of about 250ms; caller audio in 20ms frames
+const AGENT_CHUNK = crypto.randomBytes(4000);
+const CALLER_FRAME = crypto.randomBytes(320);
+const AGENT_MESSAGE = Buffer.from(JSON.stringify({
+  type: 'audio',
+  audio_event: { audio_base_64: AGENT_CHUNK.toString('base64'), event_id: 42 },
+}));
+const PACKETS = NativeAudio.encodeFrames(AGENT_CHUNK);
+
+function run(name, fn) {
+  // Warm up so both paths are optimized before timing
+  for (let i = 0; i < 10000; i++) fn();
+
+  let iterations = 0;
+  const start = process.hrtime.bigint();
+  const deadline = start + BigInt(BENCH_MS) * 1000000n;
+  let now = start;
+  while (now < deadline) {
+    for (let i = 0; i < 1000; i++) fn();
+    iterations += 1000;
+    now = process.hrtime.bigint();
+  }
+  const nsPerOp = Number(now - start) / iterations;
+  return { name, nsPerOp };
+}
+
+function withImpl(impl) {
+  return {
+    extractAudio() {
+      const dst = Buffer.allocUnsafe(Math.floor(AGENT_MESSAGE.length / 4) * 3 + 4);
+      return impl.extractAudio(AGENT_MESSAGE, dst);
+    },
+    encodeUserAudioMessage() {
+      const dst = Buffer.allocUnsafe(23 + Math.ceil(CALLER_FRAME.length / 3) * 4);
+      return impl.encodeUserAudioMessage(CALLER_FRAME, dst);
+    },
+    encodeFrames() {
+      const dst = Buffer.allocUnsafe(AGENT_CHUNK.length + 3 * Math.ceil(AGENT_CHUNK.length / 320));
+      return impl.encodeFrames(AGENT_CHUNK, dst, 320);
+    },
+    decodeFrames: (() => {
+      // The decoder still needs a view per packet
+      const out = new Int32Array(3 * 64);
+      return () => {
+        const count = impl.decodeFrames(PACKETS, out);
+        for (let i = 0; i < count; i++) {
+          PACKETS.subarray(out[i * 3], out[i * 3] + 3 + out[i * 3 + 1]);
+        }
+        return count;
+      };
+    })(),
+  };
+}
+
+// The code these functions replace
+const original = {
+  extractAudio() {
+    const message = JSON.parse(AGENT_MESSAGE);
+    return Buffer.from(message.audio_event.audio_base_64, 'base64');
+  },
+  encodeUserAudioMessage() {
+    return JSON.stringify({ user_audio_chunk: Buffer.from(CALLER_FRAME).toString('base64') });
+  },
+  encodeFrames() {
+    const framed = Buffer.allocUnsafe(AGENT_CHUNK.length + 3 * Math.ceil(AGENT_CHUNK.length / 320));
+    let offset = 0;
+    for (let i = 0; i < AGENT_CHUNK.length; i += 320) {
+      const length = Math.min(320, AGENT_CHUNK.length - i);
+      framed[offset] = 0x10;
+      framed.writeUInt16BE(length, offset + 1);
+      AGENT_CHUNK.copy(framed, offset + 3, i, i + length);
+      offset += 3 + length;
+    }
+    return framed;
+  },
+  decodeFrames() {
+    let count = 0;
+    for (let offset = 0; PACKETS.length - offset >= 3;) {
+      const end = offset + 3 + PACKETS.readUInt16BE(offset + 1);
+      if (end > PACKETS.length) break;
+      PACKETS.subarray(offset, end);
+      count++;
+      offset = end;
+    }
+    return count;
+  },
+};
+
+const variants = { original, js: withImpl(NativeAudio.js) };
+if (NativeAudio.addon) {
+  variants.native = withImpl(NativeAudio.addon);
+} else {
+  console.warn('Native addon not built, run npm run build:native');
+}
+
+const report = {
+  node: process.version,
+  simd: NativeAudio.simd,
+  benchMs: BENCH_MS,
+  results: {},
+};
+for (const name of Object.keys(original)) {
+  report.results[name] = {};
+  for (const [variant, fns] of Object.entries(variants)) {
+    const { nsPerOp } = run(`${name}/${variant}`, fns[name]);
+    report.results[name][variant] = Math.round(nsPerOp);
+  }
+  const row = report.results[name];
+  const best = row.native ?? row.js;
+  console.log(`${name.padEnd(24)} ${Object.entries(row).map(([v, ns]) => `${v} ${ns} ns`).join('  ')}  (${(row.original / best).toFixed(2)}x)`);
+}
+
+// 20ms of 16kHz agent audio down to 8kHz, as for a pcm_16000 agent
+const AGENT_FRAME_16K = crypto.randomBytes(640);
+const resamplers = { js: new JsResampler(16000, 8000) };
+if (NativeAudio.addon) resamplers.native = createResampler(16000, 8000);
+report.results.resample = {};
+for (const [variant, resampler] of Object.entries(resamplers)) {
+  report.results.resample[variant] = Math.round(run(`resample/${variant}`, () => resampler.process(AGENT_FRAME_16K)).nsPerOp);
+}
+const resample = report.results.resample;
+console.log(`${'resample 16k>8k 20ms'.padEnd(24)} ${Object.entries(resample).map(([v, ns]) => `${v} ${ns} ns`).join('  ')}${resample.native ? `  (${(resample.js / resample.native).toFixed(2)}x)` : ''}`);
+
+if (process.env.BENCH_JSON) {
+  console.log(JSON.stringify(report, null, 2));
+}
@@ -0,0 +1,12 @@
+{
+  "targets": [
+    {
+      "target_name": "audiosocket_native",
+      "sources": ["audiosocket_native.cc", "resampler.cc"],
+      "cflags_cc": ["-O3", "-std=c++17"],
+      "xcode_settings": {
+        "OTHER_CPLUSPLUSFLAGS": ["-O3", "-std=c++17"]
+      }
+    }
+  ]
+}
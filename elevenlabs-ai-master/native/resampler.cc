@@ -0,0 +1,272 @@
+// Stateful polyphase resampler for 16-bit signed linear audio.
+//
+// Converts between any two integer rates by the reduced ratio L/M: the
+// signal is conceptually upsampled by L, low-pass filtered and decimated by
+// M, computing only the outputs that are kept. The filter is a Kaiser
+// windowed sinc split into L phases; each phase is stored reversed so every
+// output is one contiguous dot product with the input history, which runs
+// four samples at a time with SSE. The history and phase carry over between
+// calls, so a stream can be converted frame by frame without clicks at the
+// frame boundaries.
+
+#include "resampler.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+#if defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define HAVE_SSE_PATH 1
+#endif
+
+namespace {
+
+// Filter taps per phase when not decimating; scaled up by the decimation
+// factor so the transition band stays as narrow in output terms
+const int kBaseTaps = 16;
+
+// Kaiser window shape; about 70 dB stopband attenuation
+const double kKaiserBeta = 7.0;
+
+// Passband edge as a fraction of the lower Nyquist frequency
+const double kRolloff = 0.9;
+
+double bessel_i0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 50; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < 1e-12 * sum) break;
+  }
+  return sum;
+}
+
+int gcd(int a, int b) {
+  while (b) {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+class Resampler {
+ public:
+  Resampler(int in_rate, int out_rate) : in_rate_(in_rate), out_rate_(out_rate) {
+    const int g = gcd(in_rate, out_rate);
+    up_ = out_rate / g;
+    down_ = in_rate / g;
+
+    // Round up to a multiple of 4 for the SIMD dot product
+    taps_ = kBaseTaps * ((down_ + up_ - 1) / up_);
+    taps_ = (taps_ + 3) & ~3;
+
+    // Prototype filter at the upsampled rate, cut off below the lower of the
+    // two Nyquist frequencies and scaled by L to keep unity gain
+    const int length = up_ * taps_;
+    const double cutoff = kRolloff * 0.5 / std::max(up_, down_);
+    const double center = (length - 1) / 2.0;
+    const double norm = bessel_i0(kKaiserBeta);
+    std::vector<double> prototype(length);
+    for (int n = 0; n < length; n++) {
+      const double t = n - center;
+      const double sinc = t == 0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+      const double r = 2.0 * n / (length - 1) - 1.0;
+      const double window = bessel_i0(kKaiserBeta * sqrt(std::max(0.0, 1.0 - r * r))) / norm;
+      prototype[n] = sinc * window * up_;
+    }
+
+    // Phase p holds prototype[p + k * L] for k = taps - 1 down to 0
+    bank_.resize(static_cast<size_t>(up_) * taps_);
+    for (int p = 0; p < up_; p++) {
+      for (int j = 0; j < taps_; j++) {
+        bank_[static_cast<size_t>(p) * taps_ + j] = static_cast<float>(prototype[p + (taps_ - 1 - j) * up_]);
+      }
+    }
+
+    Reset();
+  }
+
+  void Reset() {
+    history_.assign(taps_ - 1, 0.0f);
+    pos_ = taps_ - 1;
+    phase_ = 0;
+  }
+
+  // Converts n little-endian input samples, appending the output to out
+  void Process(const uint8_t* in, size_t n, std::vector<int16_t>* out) {
+    const size_t start = history_.size();
+    history_.resize(start + n);
+    for (size_t i = 0; i < n; i++) {
+      history_[start + i] = static_cast<int16_t>(in[2 * i] | (in[2 * i + 1] << 8));
+    }
+
+    const float* x = history_.data();
+    while (pos_ < history_.size()) {
+      const float* window = x + pos_ + 1 - taps_;
+      const float y = Dot(bank_.data() + static_cast<size_t>(phase_) * taps_, window);
+      const float rounded = y < 0 ? y - 0.5f : y + 0.5f;
+      out->push_back(static_cast<int16_t>(std::min(32767.0f, std::max(-32768.0f, rounded))));
+
+      phase_ += down_;
+      pos_ += phase_ / up_;
+      phase_ %= up_;
+    }
+
+    // Keep the samples the next outputs still need
+    const size_t keep_from = pos_ + 1 - taps_;
+    if (keep_from > 0) {
+      history_.erase(history_.begin(), history_.begin() + keep_from);
+      pos_ -= keep_from;
+    }
+  }
+
+  // Upper bound of the outputs produced by n more input samples
+  size_t MaxOutput(size_t n) const {
+    return n * up_ / down_ + 2;
+  }
+
+  int in_rate() const { return in_rate_; }
+  int out_rate() const { return out_rate_; }
+  int taps() const { return taps_; }
+
+ private:
+  float Dot(const float* h, const float* x) const {
+#ifdef HAVE_SSE_PATH
+    __m128 acc = _mm_setzero_ps();
+    for (int j = 0; j < taps_; j += 4) {
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(h + j), _mm_loadu_ps(x + j)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    float acc = 0.0f;
+    for (int j = 0; j < taps_; j++) acc += h[j] * x[j];
+    return acc;
+#endif
+  }
+
+  int in_rate_, out_rate_;
+  int up_, down_, taps_;
+  std::vector<float> bank_;
+  std::vector<float> history_;  // taps - 1 samples of history, then unread input
+  size_t pos_;                  // Index in history_ of the newest sample of the next output
+  int phase_;
+};
+
+napi_value Unwrap(napi_env env, napi_callback_info info, size_t* argc, napi_value* argv, Resampler** resampler) {
+  napi_value self;
+  if (napi_get_cb_info(env, info, argc, argv, &self, nullptr) != napi_ok ||
+      napi_unwrap(env, self, reinterpret_cast<void**>(resampler)) != napi_ok) {
+    napi_throw_error(env, nullptr, "Invalid Resampler");
+    return nullptr;
+  }
+  return self;
+}
+
+void Finalize(napi_env env, void* data, void* hint) {
+  delete static_cast<Resampler*>(data);
+}
+
+// new Resampler(inRate, outRate)
+napi_value New(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_value self;
+  if (napi_get_cb_info(env, info, &argc, argv, &self, nullptr) != napi_ok) return nullptr;
+
+  int32_t in_rate = 0, out_rate = 0;
+  if (argc < 2 || napi_get_value_int32(env, argv[0], &in_rate) != napi_ok ||
+      napi_get_value_int32(env, argv[1], &out_rate) != napi_ok || in_rate <= 0 || out_rate <= 0 ||
+      in_rate > 192000 || out_rate > 192000) {
+    napi_throw_range_error(env, nullptr, "Expected two sample rates between 1 and 192000");
+    return nullptr;
+  }
+
+  Resampler* resampler = new (std::nothrow) Resampler(in_rate, out_rate);
+  if (!resampler) {
+    napi_throw_error(env, nullptr, "Out of memory");
+    return nullptr;
+  }
+  if (napi_wrap(env, self, resampler, Finalize, nullptr, nullptr) != napi_ok) {
+    delete resampler;
+    napi_throw_error(env, nullptr, "Failed to create Resampler");
+    return nullptr;
+  }
+  return self;
+}
+
+// resampler.process(buffer) -> Buffer with the converted samples available so far
+napi_value Process(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  Resampler* resampler;
+  if (!Unwrap(env, info, &argc, argv, &resampler)) return nullptr;
+
+  bool is_buffer = false;
+  void* data;
+  size_t length;
+  if (argc < 1 || napi_is_buffer(env, argv[0], &is_buffer) != napi_ok || !is_buffer ||
+      napi_get_buffer_info(env, argv[0], &data, &length) != napi_ok) {
+    napi_throw_type_error(env, nullptr, "Expected a Buffer");
+    return nullptr;
+  }
+
+  // An odd trailing byte is ignored
+  const size_t samples = length / 2;
+  std::vector<int16_t> out;
+  out.reserve(resampler->MaxOutput(samples));
+  resampler->Process(static_cast<const uint8_t*>(data), samples, &out);
+
+  napi_value result;
+  void* result_data;
+  if (napi_create_buffer_copy(env, out.size() * 2, out.data(), &result_data, &result) != napi_ok) {
+    napi_throw_error(env, nullptr, "Failed to allocate output");
+    return nullptr;
+  }
+  return result;
+}
+
+// resampler.reset() clears the history, e.g. after an interruption
+napi_value ResetMethod(napi_env env, napi_callback_info info) {
+  size_t argc = 0;
+  Resampler* resampler;
+  if (!Unwrap(env, info, &argc, nullptr, &resampler)) return nullptr;
+  resampler->Reset();
+  return nullptr;
+}
+
+napi_value Getter(napi_env env, napi_callback_info info, int (Resampler::*field)() const) {
+  size_t argc = 0;
+  Resampler* resampler;
+  if (!Unwrap(env, info, &argc, nullptr, &resampler)) return nullptr;
+  napi_value result;
+  napi_create_int32(env, (resampler->*field)(), &result);
+  return result;
+}
+
+napi_value GetInRate(napi_env env, napi_callback_info info) { return Getter(env, info, &Resampler::in_rate); }
+napi_value GetOutRate(napi_env env, napi_callback_info info) { return Getter(env, info, &Resampler::out_rate); }
+napi_value GetTaps(napi_env env, napi_callback_info info) { return Getter(env, info, &Resampler::taps); }
+
+}  // namespace
+
+napi_status InitResampler(napi_env env, napi_value exports) {
+  const napi_property_descriptor properties[] = {
+      {"process", nullptr, Process, nullptr, nullptr, nullptr, napi_default, nullptr},
+      {"reset", nullptr, ResetMethod, nullptr, nullptr, nullptr, napi_default, nullptr},
+      {"inRate", nullptr, nullptr, GetInRate, nullptr, nullptr, napi_default, nullptr},
+      {"outRate", nullptr, nullptr, GetOutRate, nullptr, nullptr, napi_default, nullptr},
+      {"taps", nullptr, nullptr, GetTaps, nullptr, nullptr, napi_default, nullptr},
+  };
+  napi_value constructor;
+  napi_status status = napi_define_class(env, "Resampler", NAPI_AUTO_LENGTH, New, nullptr,
+                                         sizeof(properties) / sizeof(properties[0]), properties, &constructor);
+  if (status != napi_ok) return status;
+  return napi_set_named_property(env, exports, "Resampler", constructor);
+}
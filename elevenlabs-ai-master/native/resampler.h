@@ -0,0 +1,9 @@
+#ifndef AUDIOSOCKET_NATIVE_RESAMPLER_H_
+#define AUDIOSOCKET_NATIVE_RESAMPLER_H_
+
+#include <node_api.h>
+
+// Adds the Resampler class to the addon exports
+napi_status InitResampler(napi_env env, napi_value exports);
+
+#endif  // AUDIOSOCKET_NATIVE_RESAMPLER_H_
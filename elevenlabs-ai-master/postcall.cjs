@@ -6,7 +6,7 @@ const app = express();
 const port = 3000;
 const DatabaseManager = require('./DatabaseManager.cjs');
 const db = new DatabaseManager();
-const { pool } = require('./MySQL.cjs');
+const PostCallQueue = require('./PostCallQueue.cjs');
  
 // Environment variables
 const { ELEVENLABS_API_KEY, ELEVENLABS_POST_SECRET } = process.env;
@@ -90,87 +90,151 @@ app.use((err, req, res, next) => {
   next(err);
 });
 
-async function storeConversationData(data) {
-  try {
-    // Start transaction
-    const connection = await pool.getConnection();
-    await connection.beginTransaction();
-    const conversationId = data.data.conversation_id;
+// Status set on the dialer lead and logs per call_successful value
+const DIALER_STATUS = { success: 'SALE' };
+const DEFAULT_DIALER_STATUS = 'NI';
+
+/**
+ * Builds an INSERT or REPLACE of several rows for connection.query
+ * @returns {Array} The statement and its parameters, or null without rows
+ */
+function multiRowInsert(verb, table, rows) {
+  if (rows.length === 0) return null;
+  const columns = Object.keys(rows[0]);
+  return [
+    `${verb} INTO ${table} (${columns.join(', ')}) VALUES ?`,
+    [rows.map((row) => columns.map((column) => row[column]))]
+  ];
+}
 
-    try {
-      // 1. Store main conversation data
-      const conversationData = {
-        conversation_id: conversationId,
-        agent_id: data.data.agent_id,
-        lead_id: sanitizeValue(data.data.conversation_initiation_client_data.dynamic_variables.lead_id),
-        uniqueid: sanitizeValue(data.data.conversation_initiation_client_data.dynamic_variables.uniqueid),
-        campaign_id: sanitizeValue(data.data.conversation_initiation_client_data.dynamic_variables.campaign_id),
-        start_time_unix_secs: data.data.metadata.start_time_unix_secs,
-        call_duration_secs: data.data.metadata.call_duration_secs,
-        status: data.data.status,
-        termination_reason: sanitizeValue(data.data.metadata.termination_reason),
-        cost: data.data.metadata.cost,
-        call_successful: sanitizeValue(data.data.analysis.call_successful),
-        transcript_summary: sanitizeValue(data.data.analysis.transcript_summary),
-        metadata: sanitizeValue(data.data.metadata),
-        analysis: JSON.stringify(data.data.analysis),
-        client_data: sanitizeValue(data.data.conversation_initiation_client_data.dynamic_variables)
-      };
-
-      console.log('Storing conversation data:', data.data.conversation_id);
-      await db.executeQuery(
-        `REPLACE INTO elevenlabs_conversations SET ?`,
-        [conversationData]
-      );
+/**
+ * Stores a batch of post-call payloads in one transaction
+ * Each table is written with one multi-row statement for the whole batch.
+ * The turns, collected data and evaluations of the conversations are
+ * replaced, so a payload delivered or retried twice is stored once.
+ * @param {Array<Object>} payloads Validated post_call_transcription bodies
+ */
+async function storeConversations(payloads) {
+  const conversations = new Map();
+  for (const payload of payloads) {
+    // A later delivery of the same conversation wins
+    conversations.set(payload.data.conversation_id, payload.data);
+  }
+  const conversationIds = [...conversations.keys()];
+
+  const turnCount = await db.transaction(async (connection) => {
+    const run = async (statement) => {
+      if (statement) await connection.query(...statement);
+    };
+
+    // The latency the bridge measured for each agent turn during the calls
+    const [latencyRows] = await connection.query(
+      'SELECT conversation_id, agent_turn, metric_name, elapsed_time FROM elevenlabs_turn_latency WHERE conversation_id IN (?)',
+      [conversationIds]
+    );
+    const bridgeLatency = new Map();
+    for (const { conversation_id, agent_turn, metric_name, elapsed_time } of latencyRows) {
+      const key = `${conversation_id}:${agent_turn}`;
+      if (!bridgeLatency.has(key)) bridgeLatency.set(key, {});
+      bridgeLatency.get(key)[metric_name] = elapsed_time;
+    }
+
+    // The bridge latency an earlier delivery already moved into the turn
+    // metrics, as its elevenlabs_turn_latency rows are gone
+    const [copiedRows] = await connection.query(
+      `SELECT t.conversation_id, t.turn_index, m.metric_name, m.elapsed_time
+       FROM elevenlabs_turn_metrics m
+       JOIN elevenlabs_conversation_turns t ON t.turn_id = m.turn_id
+       WHERE t.conversation_id IN (?) AND m.metric_name LIKE 'latency\\_%'`,
+      [conversationIds]
+    );
+    const copiedLatency = new Map(); // "conversation:turn_index" -> metrics
+    for (const { conversation_id, turn_index, metric_name, elapsed_time } of copiedRows) {
+      const key = `${conversation_id}:${turn_index}`;
+      if (!copiedLatency.has(key)) copiedLatency.set(key, {});
+      copiedLatency.get(key)[metric_name] = elapsed_time;
+    }
+
+    // Rows written before by an earlier delivery
+    await connection.query(
+      `DELETE m FROM elevenlabs_turn_metrics m
+       JOIN elevenlabs_conversation_turns t ON t.turn_id = m.turn_id
+       WHERE t.conversation_id IN (?)`,
+      [conversationIds]
+    );
+    for (const table of ['elevenlabs_conversation_turns', 'elevenlabs_collected_data', 'elevenlabs_evaluations']) {
+      await connection.query(`DELETE FROM ${table} WHERE conversation_id IN (?)`, [conversationIds]);
+    }
 
-      // 2. Store conversation turns
-      console.log('Storing conversation turns...');
-      for (let i = 0; i < data.data.transcript.length; i++) {
-        const turn = data.data.transcript[i];
-        const turnData = {
+    const conversationRows = [];
+    const turnRows = [];
+    const turnMetrics = new Map(); // "conversation:turn_index" -> metrics
+    const collectedRows = [];
+    const evaluationRows = [];
+    const retentionRows = [];
+    for (const [conversationId, data] of conversations) {
+      const dynamicVariables = data.conversation_initiation_client_data?.dynamic_variables || {};
+
+      // 1. Main conversation data
+      conversationRows.push({
+        conversation_id: conversationId,
+        agent_id: data.agent_id,
+        lead_id: sanitizeValue(dynamicVariables.lead_id),
+        uniqueid: sanitizeValue(dynamicVariables.uniqueid),
+        campaign_id: sanitizeValue(dynamicVariables.campaign_id),
+        start_time_unix_secs: data.metadata.start_time_unix_secs,
+        call_duration_secs: data.metadata.call_duration_secs,
+        status: data.status,
+        termination_reason: sanitizeValue(data.metadata.termination_reason),
+        cost: data.metadata.cost,
+        call_successful: sanitizeValue(data.analysis.call_successful),
+        transcript_summary: sanitizeValue(data.analysis.transcript_summary),
+        metadata: sanitizeValue(data.metadata),
+        analysis: JSON.stringify(data.analysis),
+        client_data: sanitizeValue(dynamicVariables)
+      });
+
+      // 2. Conversation turns, with ElevenLabs' metrics and the bridge's
+      // latency for each agent turn
+      let agentTurn = 0;
+      data.transcript.forEach((turn, index) => {
+        turnRows.push({
           conversation_id: conversationId,
-          turn_index: i,
+          turn_index: index,
           role: turn.role,
           message: sanitizeValue(turn.message),
-          time_in_call_secs: turn.time_in_call_secs,
+          time_in_call_secs: turn.time_in_call_secs ?? null,
           feedback: sanitizeValue(turn.feedback),
           llm_override: sanitizeValue(turn.llm_override)
-        };
-
-        const result = await db.addConversationTurn(turnData);
-        console.log(`Stored turn ${i + 1}/${data.data.transcript.length}`);
-
-        // Store turn metrics if present
-        if (turn.conversation_turn_metrics?.metrics) {
-          console.log('Processing metrics:', turn.conversation_turn_metrics.metrics);
-          const flatMetrics = {};
-          // Extract elapsed_time values from the nested structure
-          for (const [key, value] of Object.entries(turn.conversation_turn_metrics.metrics)) {
-            if (!value || typeof value.elapsed_time !== 'number') {
-              continue;
-            }
+        });
+
+        const flatMetrics = turn.role === 'agent'
+          ? { ...copiedLatency.get(`${conversationId}:${index}`), ...bridgeLatency.get(`${conversationId}:${agentTurn++}`) }
+          : {};
+        for (const [key, value] of Object.entries(turn.conversation_turn_metrics?.metrics || {})) {
+          if (value && typeof value.elapsed_time === 'number') {
             flatMetrics[key] = value.elapsed_time;
           }
-          await db.updateTurnMetrics(result, flatMetrics);
-          console.log(`Stored metrics for turn ${i + 1}`);
         }
-      }
+        if (Object.keys(flatMetrics).length > 0) {
+          turnMetrics.set(`${conversationId}:${index}`, flatMetrics);
+        }
+      });
 
-      // 3. Store collected data
-      console.log('Storing collected data...');
-      for (const [id, collectedData] of Object.entries(data.data.analysis.data_collection_results || {})) {
-        await db.executeQuery(
-          `INSERT INTO elevenlabs_collected_data
-          (conversation_id, data_collection_id, value, json_schema, rationale)
-          VALUES (?, ?, ?, ?, ?)`,
-          [conversationId, id, sanitizeValue(collectedData.value), sanitizeValue(collectedData.json_schema), sanitizeValue(collectedData.rationale)]
-        );
+      // 3. Collected data
+      for (const [id, collectedData] of Object.entries(data.analysis.data_collection_results || {})) {
+        collectedRows.push({
+          conversation_id: conversationId,
+          data_collection_id: id,
+          value: sanitizeValue(collectedData.value),
+          json_schema: sanitizeValue(collectedData.json_schema),
+          rationale: sanitizeValue(collectedData.rationale)
+        });
       }
 
-      // 4. Store evaluation results
-      console.log('Storing evaluation results...');
-      for (const [id, evalData] of Object.entries(data.data.analysis.evaluation_criteria_results || {})) {
-        await db.addEvaluation({ 
+      // 4. Evaluation results
+      for (const [id, evalData] of Object.entries(data.analysis.evaluation_criteria_results || {})) {
+        evaluationRows.push({
           conversation_id: conversationId,
           criteria_id: sanitizeValue(id),
           result: sanitizeValue(evalData.result),
@@ -178,85 +242,69 @@ async function storeConversationData(data) {
         });
       }
 
-      // 5. Store retention settings
-      console.log('Storing retention settings...');
-      if (data.data.metadata.deletion_settings) {
-        const deletionSettings = data.data.metadata.deletion_settings;
-        await db.executeQuery(
-          `REPLACE INTO elevenlabs_retention_settings SET
-           conversation_id = ?,
-           deletion_time_unix_secs = ?,
-           deleted_logs_at_time_unix_secs = ?,
-           deleted_audio_at_time_unix_secs = ?,
-           deleted_transcript_at_time_unix_secs = ?,
-           delete_transcript_and_pii = ?,
-           delete_audio = ?`,
-          [conversationId, deletionSettings.deletion_time_unix_secs, deletionSettings.deleted_logs_at_time_unix_secs, deletionSettings.deleted_audio_at_time_unix_secs, deletionSettings.deleted_transcript_at_time_unix_secs, deletionSettings.delete_transcript_and_pii ? 1 : 0, deletionSettings.delete_audio ? 1 : 0]
-        );
+      // 5. Retention settings
+      const deletionSettings = data.metadata.deletion_settings;
+      if (deletionSettings) {
+        retentionRows.push({
+          conversation_id: conversationId,
+          deletion_time_unix_secs: deletionSettings.deletion_time_unix_secs,
+          deleted_logs_at_time_unix_secs: deletionSettings.deleted_logs_at_time_unix_secs,
+          deleted_audio_at_time_unix_secs: deletionSettings.deleted_audio_at_time_unix_secs,
+          deleted_transcript_at_time_unix_secs: deletionSettings.deleted_transcript_at_time_unix_secs,
+          delete_transcript_and_pii: deletionSettings.delete_transcript_and_pii ? 1 : 0,
+          delete_audio: deletionSettings.delete_audio ? 1 : 0
+        });
       }
+    }
 
-      // 6. Store Dialer data
-      console.log('Storing dialing result...');
-      switch (sanitizeValue(data.data.analysis.call_successful)) {
-        case "success" : {
-          await db.executeQuery(
-            `UPDATE osdial_list 
-              SET status='SALE' 
-              WHERE lead_id = ? LIMIT 1`,
-            [sanitizeValue(data.data.conversation_initiation_client_data.dynamic_variables.lead_id)]
-          );
-          await db.executeQuery(
-            `UPDATE osdial_agent_log
-              SET status='SALE' 
-              WHERE uniqueid = ? LIMIT 1`,
-            [sanitizeValue(data.data.conversation_initiation_client_data.dynamic_variables.uniqueid)]
-          );
-          await db.executeQuery(
-            `UPDATE osdial_log
-              SET status='SALE' 
-              WHERE uniqueid = ? LIMIT 1`,
-            [sanitizeValue(data.data.conversation_initiation_client_data.dynamic_variables.uniqueid)]
-          );
-        }
-        default : {
-          await db.executeQuery(
-            `UPDATE osdial_list 
-              SET status='NI' 
-              WHERE lead_id = ? LIMIT 1`,
-            [sanitizeValue(data.data.conversation_initiation_client_data.dynamic_variables.lead_id)]
-          );
-          await db.executeQuery(
-            `UPDATE osdial_agent_log
-              SET status='NI' 
-              WHERE uniqueid = ? LIMIT 1`,
-            [sanitizeValue(data.data.conversation_initiation_client_data.dynamic_variables.uniqueid)]
-          );
-          await db.executeQuery(
-            `UPDATE osdial_log
-              SET status='NI' 
-              WHERE uniqueid = ? LIMIT 1`,
-            [sanitizeValue(data.data.conversation_initiation_client_data.dynamic_variables.uniqueid)]
-          );
+    await run(multiRowInsert('REPLACE', 'elevenlabs_conversations', conversationRows));
+    await run(multiRowInsert('INSERT', 'elevenlabs_conversation_turns', turnRows));
+    await run(multiRowInsert('INSERT', 'elevenlabs_collected_data', collectedRows));
+    await run(multiRowInsert('INSERT', 'elevenlabs_evaluations', evaluationRows));
+    await run(multiRowInsert('REPLACE', 'elevenlabs_retention_settings', retentionRows));
+
+    // Turn IDs are not consecutive with auto_increment_increment > 1, so
+    // they are read back to attach the metrics
+    if (turnMetrics.size > 0) {
+      const [turnIds] = await connection.query(
+        'SELECT turn_id, conversation_id, turn_index FROM elevenlabs_conversation_turns WHERE conversation_id IN (?)',
+        [conversationIds]
+      );
+      const metricRows = [];
+      for (const { turn_id, conversation_id, turn_index } of turnIds) {
+        const metrics = turnMetrics.get(`${conversation_id}:${turn_index}`);
+        for (const [metric_name, elapsed_time] of Object.entries(metrics || {})) {
+          if (elapsed_time !== undefined && elapsed_time !== null) {
+            metricRows.push({ turn_id, metric_name, elapsed_time });
+          }
         }
       }
+      await run(multiRowInsert('REPLACE', 'elevenlabs_turn_metrics', metricRows));
+    }
 
-
-      // Commit transaction
-      await connection.commit();
-      console.log('All data stored successfully');
-    } catch (error) {
-      // Rollback transaction on error
-      await connection.rollback();
-      throw error;
-    } finally {
-      connection.release();
+    // The bridge latency now lives in the turn metrics
+    await connection.query('DELETE FROM elevenlabs_turn_latency WHERE conversation_id IN (?)', [conversationIds]);
+
+    // 6. Dialer result of each call
+    for (const data of conversations.values()) {
+      const dynamicVariables = data.conversation_initiation_client_data?.dynamic_variables || {};
+      const status = DIALER_STATUS[sanitizeValue(data.analysis.call_successful)] || DEFAULT_DIALER_STATUS;
+      const leadId = sanitizeValue(dynamicVariables.lead_id);
+      const uniqueid = sanitizeValue(dynamicVariables.uniqueid);
+      await connection.query('UPDATE osdial_list SET status = ? WHERE lead_id = ? LIMIT 1', [status, leadId]);
+      await connection.query('UPDATE osdial_agent_log SET status = ? WHERE uniqueid = ? LIMIT 1', [status, uniqueid]);
+      await connection.query('UPDATE osdial_log SET status = ? WHERE uniqueid = ? LIMIT 1', [status, uniqueid]);
     }
-  } catch (error) {
-    console.error('Error storing conversation data:', error);
-    throw error;
-  }
+    return turnRows.length;
+  });
+
+  console.log(`Stored ${conversations.size} conversations (${turnCount} turns)`);
 }
 
+// Payloads are acknowledged once queued on disk and written to the
+// database in batches behind the webhook
+const queue = new PostCallQueue({ store: storeConversations });
+
 // Webhook handler
 app.post('/webhook/postcall', async (req, res) => {
   console.log('Received webhook request');
@@ -344,8 +392,15 @@ app.post('/webhook/postcall', async (req, res) => {
       return;
     }
 
-    await storeConversationData(data);
-    console.log('Successfully stored conversation data for ID:', data.data.conversation_id);
+    try {
+      await queue.enqueue(data);
+    } catch (error) {
+      // Not acknowledged, so ElevenLabs delivers it again
+      console.error('Error queueing conversation data:', error);
+      res.status(503).send('Unable to queue request');
+      return;
+    }
+    console.log('Queued conversation data for ID:', data.data.conversation_id);
 
     // Respond with success
     res.status(200).send();
@@ -357,7 +412,23 @@ app.post('/webhook/postcall', async (req, res) => {
   }
 });
 
+// Queue depth and write throughput; only answered on the loopback
+// interface, as the route has no authentication
+const LOOPBACK_ADDRESSES = new Set(['127.0.0.1', '::1', '::ffff:127.0.0.1']);
+app.get('/webhook/postcall/stats', (req, res) => {
+  if (!LOOPBACK_ADDRESSES.has(req.socket.remoteAddress)) {
+    res.status(404).send();
+    return;
+  }
+  res.json(queue.getStats());
+});
+
 const PORT = process.env.PORT || 3000;
-app.listen(PORT, () => {
-  console.log(`Server running on port ${PORT}: http://localhost:${PORT}`);
+queue.start().then(() => {
+  app.listen(PORT, () => {
+    console.log(`Server running on port ${PORT}: http://localhost:${PORT}`);
+  });
+}).catch((error) => {
+  console.error('Error opening the post-call queue:', error);
+  process.exit(1);
 });